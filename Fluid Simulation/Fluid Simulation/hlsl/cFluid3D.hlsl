@@ -13,6 +13,39 @@ Date: 09/11/2013
 #define NUM_THREADS_Y 8
 #define NUM_THREADS_Z 8
 
+// Entries of the conjugate gradient scalars buffer
+#define PCG_RESIDUAL_DOT_PRECONDITIONED 0
+#define PCG_ALPHA 1
+#define PCG_BETA 2
+#define PCG_MEAN 3
+
+// The fused shaders keep a tile of their group's cells plus a one cell border in shared memory
+#define FUSED_TILE_X (NUM_THREADS_X+2)
+#define FUSED_TILE_Y (NUM_THREADS_Y+2)
+#define FUSED_TILE_Z (NUM_THREADS_Z+2)
+#define FUSED_TILE_SIZE (FUSED_TILE_X*FUSED_TILE_Y*FUSED_TILE_Z)
+
+// Bricks are the cells of one thread group. Based on the values from Fluid3DBricks.h
+#define BRICK_MAX_HALO 3
+#define BRICK_COORDINATE_BITS 10
+#define BRICK_COORDINATE_MASK 0x3FF
+
+// Fields an impulse source adds to. Based on ImpulseTarget_t from FluidSettings.h
+#define IMPULSE_TARGET_VELOCITY 0
+#define IMPULSE_TARGET_TEMPERATURE 1
+#define IMPULSE_TARGET_DENSITY 2
+#define IMPULSE_TARGET_REACTION 3
+
+// Flags of a cell of the obstacle textures. Based on ObstacleFlag_t from Fluid3DCPUFields.h. Every cell flags
+// which of its neighbours are solid, neighbours outside of the volume count as solid
+#define OBSTACLE_SOLID 1
+#define OBSTACLE_T 2
+#define OBSTACLE_B 4
+#define OBSTACLE_R 8
+#define OBSTACLE_L 16
+#define OBSTACLE_U 32
+#define OBSTACLE_D 64
+
 // Constant buffers
 cbuffer InputBufferGeneral : register (b0) {
 	float fTimeStep;			// Used for AdvectComputeShader, BuoyancyComputeShader	
@@ -29,32 +62,107 @@ cbuffer InputBufferAdvection : register (b1) {
 	float padding1;				// pad to 16 bytes
 }
 
-cbuffer InputBufferImpulse : register (b2) {
-	float3 vPoint;				// Used for ImpulseComputeShader
-	float  fRadius;				// Used for ImpulseComputeShader
-	float3 vAmount;				// Used for ImpulseComputeShader
-	float  fExtinguishment;		// Used for ExtinguishmentImpulseComputeShader
+cbuffer InputBufferRedBlack : register (b3) {
+	float fOverRelaxation;		// Used for RedBlackSORComputeShader
+	uint  uParity;				// Used for RedBlackSORComputeShader, cells with (x + y + z) % 2 == uParity get updated
+	float2 padding3;			// pad to 16 bytes
+}
+
+cbuffer InputBufferInjection : register (b4) {
+	uint   uImpulseSourceCount;	// Used for ImpulseSourcesComputeShader, BuoyancyImpulse shaders, BrickActivityComputeShader, entries of impulseSources
+	float  fSmokeAmount;		// Used for ExtinguishmentImpulse shaders, BuoyancyImpulseFire shaders, density formed as the fire is extinguished
+	float  fInputExtinguishment;
+	float  padding4;
+	uint3  vInjectionRegionMin;	// Used for ImpulseSourcesComputeShader, cells any source adds to, inclusive
+	float  padding2;
+	uint3  vInjectionRegionMax;
+	float  padding9;
+	// 48 bytes //
+}
+
+cbuffer InputBufferScalarAdvection : register (b5) {
+	float3 vScalarDissipation;	// Used for AdvectScalars shaders, dissipation of the temperature, density and reaction
+	float  fReactionDecay;
+	float3 vScalarMacCormack;	// Used for AdvectScalarsMacCormackComputeShader, 1 for the fields advected with MacCormack and 0 for the rest
+	float  padding5;
 	// 32 bytes //
 }
 
+cbuffer InputBufferBricks : register (b6) {
+	uint3 vBrickCount;			// Used for BrickActivityComputeShader, BrickListComputeShader, bricks along each axis
+	float fBrickThreshold;		// Used for BrickActivityComputeShader
+	uint  uAllBricksActive;		// Used for BrickListComputeShader, puts every brick in every list
+	float3 padding6;
+	// 32 bytes //
+}
+
+cbuffer InputBufferObstacles : register (b7) {
+	uint3 vObstacleRegionMin;	// Used for ObstaclesComputeShader, cells voxelized in this step, inclusive
+	uint  uObstacleBoxCount;	// Used for ObstaclesComputeShader, entries of obstacleBoxes
+	uint3 vObstacleRegionMax;
+	float padding7;
+	// 32 bytes //
+}
+
+cbuffer InputBufferResample : register (b8) {
+	uint  uResampleRatio;		// Used for the Restrict and Prolong shaders, cells of the finer grid along each axis of a cell of the coarser one
+	float fResampleScale;		// the resampled values are multiplied by this
+	float fResampleMinimum;		// and kept from going below this
+	float padding8;
+	// 16 bytes //
+}
+
+
+// One impulse of a step, the same as ImpulseSourceData from Fluid3DBuffers.h
+struct ImpulseSource {
+	float3 vPoint;
+	float  fRadius;
+	float3 vAmount;				// scalar fields only receive x
+	uint   uTarget;				// one of the IMPULSE_TARGET_ fields
+	uint3  vRegionMin;			// cells the source adds to, inclusive
+	uint3  vRegionMax;
+};
+
+// An obstacle box in cells, the same as ObstacleBoxData from Fluid3DBuffers.h
+struct ObstacleBox {
+	float3 vCentre;
+	float3 vInverseX;			// rows of the inverse of the matrix whose columns are the half axes
+	float3 vInverseY;
+	float3 vInverseZ;
+	float3 vPreviousCentre;		// pose of the box a step ago
+	float3 vPreviousAxisX;
+	float3 vPreviousAxisY;
+	float3 vPreviousAxisZ;
+	uint3  vRegionMin;			// cells the box covers, inclusive
+	uint3  vRegionMax;
+};
 
 // Samplers
 SamplerState linearSampler : register (s0);
 
 // Texture Inputs
-Texture3D<float3>	velocity : register (t0);	// Used for AdvectComputeShader, DivergenceComputeShader, BuoyancyComputeShader, SubtractGradientComputeShader, VorticityComputeShader, ConfinementComputeShader
+Texture3D<float3>	velocity : register (t0);	// Used for AdvectComputeShader, DivergenceComputeShader, BuoyancyComputeShader, ImpulseSourcesComputeShader, SubtractGradientComputeShader, VorticityComputeShader, ConfinementComputeShader
 Texture3D<float3>	advectionTargetA : register (t1); // Used for AdvectComputeShader, AdvectBackwardComputeShader
 Texture3D<float3>	advectionTargetB : register (t2); // User for AdvectMacCormackComputeShader
 Texture3D<float3>	advectionTargetC : register (t3); // User for AdvectMacCormackComputeShader
-RWTexture3D<float3> advectionResult : register (u0); // Used for AdvectComputeShader, AdvectBackwardComputeShader, AdvectMacCormackComputeShader
+RWTexture3D<float3> advectionResult : register (u0); // Used for AdvectComputeShader, AdvectBackwardComputeShader, AdvectMacCormackComputeShader, AdvectScalarsForwardComputeShader
+
+Texture3D<float>	temperature : register (t1); // Used for BuoyancyComputeShader, BuoyancyImpulse shaders, ImpulseSourcesComputeShader, AdvectScalars shaders
+Texture3D<float>	density : register (t2); // Used for BuoyancyComputeShader, BuoyancyImpulse shaders, ImpulseSourcesComputeShader, AdvectScalars shaders
+RWTexture3D<float3> buoyancyResult : register (u0); // Used for BuoyancyComputeShader, BuoyancyImpulse shaders
+
+Texture3D<float>   injectionReaction : register (t3); // Used for BuoyancyImpulseFireComputeShader, ImpulseSourcesComputeShader, AdvectScalars shaders
+RWTexture3D<float> temperatureResult : register (u1); // Used for BuoyancyImpulse shaders, ImpulseSourcesComputeShader, AdvectScalars shaders
+RWTexture3D<float> densityResult : register (u2); // Used for BuoyancyImpulse shaders, ImpulseSourcesComputeShader, AdvectScalars shaders
+RWTexture3D<float> reactionResult : register (u3); // Used for BuoyancyImpulseFireComputeShader, ImpulseSourcesComputeShader, AdvectScalars shaders
 
-Texture3D<float>	temperature : register (t1); // Used for BuoyancyComputeShader
-Texture3D<float>	density : register (t2); // Used for BuoyancyComputeShader
-RWTexture3D<float3> buoyancyResult : register (u0); // Used for BuoyancyComputeShader
+// Temperature, density and reaction interleaved in the x, y and z channels of one volume
+Texture3D<float3>   packedForward : register (t5); // Used for AdvectScalarsMacCormackComputeShader
+Texture3D<float3>   packedBackward : register (t6); // Used for AdvectScalarsMacCormackComputeShader
 
-Texture3D<float3>   impulseInitial : register (t0); // Used for ImpulseComputeShader, ExtinguishmentImpulseComputeShader
+Texture3D<float3>   impulseInitial : register (t0); // Used for ExtinguishmentImpulseComputeShader
 Texture3D<float>   reaction : register(t1); // Used for ExtinguishmentImpulseComputeShader
-RWTexture3D<float3> impulseResult : register (u0); // Used for ImpulseComputeShader, ExtinguishmentImpulseComputeShader
+RWTexture3D<float3> impulseResult : register (u0); // Used for ExtinguishmentImpulseComputeShader
 
 Texture3D<float4>   vorticity : register (t1); // Used for ConfinementComputeShader
 RWTexture3D<float4> vorticityResult : register (u0); // Used for VorticityComputeShader
@@ -65,13 +173,71 @@ RWTexture3D<float>   divergenceResult : register (u0);  // Used for DivergenceCo
 Texture3D<float>   pressure : register (t1);  // Used for JacobiComputeShader, SubtractGradientComputeShader
 RWTexture3D<float> pressureResult : register (u0); // Used for JacobiComputeShader
 
-RWTexture3D<float3> velocityResult : register (u0); // Used for SubtractGradientComputeShader, ConfinementComputeShader
-
-Texture3D<int>  obstacles : register (t4); // DivergenceComputeShader, AdvectComputeShader, AdvectBackwardComputeShader, ConfinementComputeShader, JacobiComputeShader, SubtractGradientComputeShader, AdvectMacCormackComputeShader
-RWTexture3D<int>  obstaclesResult : register (u0); // Used for ObstacleComputeShader
-
-
-uint3 GetDimensionsIntRW(RWTexture3D<int> tex) {
+RWTexture3D<float3> velocityResult : register (u0); // Used for SubtractGradientComputeShader, ImpulseSourcesComputeShader, ConfinementComputeShader, ConfinementDivergenceComputeShader, JacobiSubtractGradientComputeShader
+
+RWTexture3D<float> fusedDivergenceResult : register (u1); // Used for ConfinementDivergenceComputeShader
+Texture3D<float>   fusedDivergence : register (t2); // Used for JacobiSubtractGradientComputeShader
+RWTexture3D<float> fusedPressureResult : register (u1); // Used for JacobiSubtractGradientComputeShader
+
+Texture3D<uint>  obstacles : register (t4); // DivergenceComputeShader, AdvectComputeShader, AdvectBackwardComputeShader, ConfinementComputeShader, JacobiComputeShader, SubtractGradientComputeShader, AdvectMacCormackComputeShader
+RWTexture3D<uint>  obstaclesResult : register (u0); // Used for ObstacleComputeShader, MultigridRestrictObstaclesComputeShader
+Texture3D<float3>  obstacleVelocity : register (t11); // Used for every shader calling GetObstacleVelocity, bound together with obstacles
+RWTexture3D<float3> obstacleVelocityResult : register (u1); // Used for ObstacleComputeShader
+
+Texture3D<float>   fineResidual : register (t0); // Used for MultigridRestrictComputeShader
+Texture3D<float>   coarseCorrection : register (t0); // Used for MultigridProlongComputeShader
+Texture3D<uint>    fineObstacles : register (t0); // Used for MultigridRestrictObstaclesComputeShader
+Texture3D<uint>    levelObstacles : register (t2); // Obstacles of the current grid level. Used for all multigrid shaders
+RWTexture3D<float> multigridResult : register (u0); // Used for MultigridResidualComputeShader, MultigridRestrictComputeShader
+RWTexture3D<float> pressureInPlace : register (u0); // Used for RedBlackSORComputeShader, MultigridProlongComputeShader. Must be R32_FLOAT to allow typed UAV loads
+
+Texture3D<float>   residualField : register (t0); // Used for ResidualReductionComputeShader
+RWStructuredBuffer<float> residualSumsResult : register (u0); // Used for ResidualReductionComputeShader, one entry per thread group
+RWStructuredBuffer<float4> activityResult : register (u0); // Used for ActivityReductionComputeShader, one entry per thread group
+
+Texture3D<float>   dotFirst : register (t0); // Used for PCGDotProductComputeShader
+Texture3D<float>   dotSecond : register (t1); // Used for PCGDotProductComputeShader
+Texture3D<float>   pcgDirection : register (t0); // Used for PCGUpdateSolutionComputeShader
+Texture3D<float>   pcgLaplacian : register (t1); // Used for PCGUpdateSolutionComputeShader
+Texture3D<float>   pcgPreconditioned : register (t1); // Used for PCGUpdateDirectionComputeShader
+StructuredBuffer<float2> pcgSums : register (t0); // Used for PCGComputeAlphaComputeShader, PCGComputeBetaComputeShader, PCGComputeMeanComputeShader
+StructuredBuffer<float> pcgScalars : register (t3); // Used for PCGUpdateSolutionComputeShader, PCGUpdateDirectionComputeShader, PCGRemoveMeanComputeShader
+RWStructuredBuffer<float2> pcgSumsResult : register (u0); // Used for PCGDotProductComputeShader, PCGResidualSumComputeShader, one entry per thread group
+RWStructuredBuffer<float> pcgScalarsResult : register (u0); // Used for PCGComputeAlphaComputeShader, PCGComputeBetaComputeShader, PCGComputeMeanComputeShader
+RWTexture3D<float> pcgTargetInPlace : register (u0); // Used for PCGUpdateDirectionComputeShader, PCGRemoveMeanComputeShader
+RWTexture3D<float> pcgResidualInPlace : register (u1); // Used for PCGUpdateSolutionComputeShader
+
+// The second buffer of every field, a brick is only left out while both buffers are below the threshold
+Texture3D<float3>  previousVelocity : register (t5); // Used for BrickActivityComputeShader
+Texture3D<float>   previousTemperature : register (t6); // Used for BrickActivityComputeShader
+Texture3D<float>   previousDensity : register (t8); // Used for BrickActivityComputeShader
+Texture3D<float>   previousReaction : register (t9); // Used for BrickActivityComputeShader
+RWStructuredBuffer<uint> brickActivityResult : register (u0); // Used for BrickActivityComputeShader, one entry per brick
+StructuredBuffer<uint>   brickActivity : register (t0); // Used for BrickListComputeShader
+// Bricks within 0, 1, 2 and 3 bricks of an active one, stored as packed brick coordinates
+AppendStructuredBuffer<uint> brickListResult0 : register (u0); // Used for BrickListComputeShader
+AppendStructuredBuffer<uint> brickListResult1 : register (u1); // Used for BrickListComputeShader
+AppendStructuredBuffer<uint> brickListResult2 : register (u2); // Used for BrickListComputeShader
+AppendStructuredBuffer<uint> brickListResult3 : register (u3); // Used for BrickListComputeShader
+StructuredBuffer<uint>   activeBricks : register (t7); // Used for all the Sparse shaders, one thread group per brick
+
+StructuredBuffer<ImpulseSource> impulseSources : register (t10); // Used for ImpulseSourcesComputeShader, BuoyancyImpulse shaders, BrickActivityComputeShader
+StructuredBuffer<ObstacleBox> obstacleBoxes : register (t0); // Used for ObstacleComputeShader
+
+Texture3D<float3>   resampleVectorSource : register (t0); // Used for RestrictVectorComputeShader, ProlongVectorComputeShader
+Texture3D<float>    resampleScalarSource : register (t0); // Used for RestrictScalarComputeShader, ProlongScalarComputeShader
+RWTexture3D<float3> resampleVectorResult : register (u0); // Used for RestrictVectorComputeShader, ProlongVectorComputeShader
+RWTexture3D<float>  resampleScalarResult : register (u0); // Used for RestrictScalarComputeShader, ProlongScalarComputeShader
+
+groupshared float sharedResidual[NUM_THREADS_X*NUM_THREADS_Y*NUM_THREADS_Z];
+groupshared float2 sharedSums[NUM_THREADS_X*NUM_THREADS_Y*NUM_THREADS_Z];
+groupshared float3 sharedTileVelocity[FUSED_TILE_SIZE];
+groupshared float sharedTilePressure[FUSED_TILE_SIZE];
+groupshared uint sharedBrickActivity;
+groupshared float4 sharedActivity[NUM_THREADS_X*NUM_THREADS_Y*NUM_THREADS_Z];
+
+
+uint3 GetDimensionsUintRW(RWTexture3D<uint> tex) {
 	uint3 dimensions;
 	tex.GetDimensions(dimensions.x, dimensions.y, dimensions.z);
 	return dimensions;
@@ -89,23 +255,103 @@ uint3 GetDimensionsFloat3(Texture3D<float3> tex) {
 	return dimensions;
 }
 
+uint3 GetDimensionsFloatRW(RWTexture3D<float> tex) {
+	uint3 dimensions;
+	tex.GetDimensions(dimensions.x, dimensions.y, dimensions.z);
+	return dimensions;
+}
+
 uint3 GetDimensionsFloat(Texture3D<float> tex) {
 	uint3 dimensions;
 	tex.GetDimensions(dimensions.x, dimensions.y, dimensions.z);
 	return dimensions;
 }
 
+uint3 GetDimensionsUint(Texture3D<uint> tex) {
+	uint3 dimensions;
+	tex.GetDimensions(dimensions.x, dimensions.y, dimensions.z);
+	return dimensions;
+}
+
 bool IsObstacleCell (uint3 pos) {
-	return obstacles[pos] > 0;
+	return (obstacles[pos] & OBSTACLE_SOLID) != 0;
+}
+
+bool IsLevelObstacleCell (uint3 pos) {
+	return (levelObstacles[pos] & OBSTACLE_SOLID) != 0;
 }
 
 float3 GetObstacleVelocity (uint3 pos) {
-	return float3(0,0,0);
+	return obstacleVelocity[pos];
+}
+
+// Falloff of an impulse at a cell
+float ImpulseFalloff (uint3 i, float3 position, float radius) {
+	float3 pos = i - position;
+	float mag = pos.x*pos.x + pos.y*pos.y + pos.z*pos.z;
+	mag *= mag;
+	return exp(-mag/(radius*radius)) * fTimeStep;
+}
+
+// Adds up what every impulse source of the step adds to a cell. The temperature, density and reaction amounts are
+// returned in x, y and z of scalarAmounts
+void SumImpulseSources (uint3 i, out float3 velocityAmount, out float3 scalarAmounts) {
+	velocityAmount = float3(0,0,0);
+	scalarAmounts = float3(0,0,0);
+	for (uint s = 0; s < uImpulseSourceCount; ++s) {
+		ImpulseSource source = impulseSources[s];
+		if (any(i < source.vRegionMin) || any(i > source.vRegionMax)) {
+			continue;
+		}
+
+		float falloff = ImpulseFalloff(i, source.vPoint, source.fRadius);
+		if (source.uTarget == IMPULSE_TARGET_VELOCITY) {
+			velocityAmount += falloff * source.vAmount;
+		}
+		else {
+			float3 scalarMask = float3(source.uTarget == IMPULSE_TARGET_TEMPERATURE, source.uTarget == IMPULSE_TARGET_DENSITY, source.uTarget == IMPULSE_TARGET_REACTION);
+			scalarAmounts += falloff * source.vAmount.x * scalarMask;
+		}
+	}
+}
+
+// Index of a cell of the fused shaders' tile. The tile cell (1,1,1) is the first cell of the group
+uint TileIndex (uint3 tileCell) {
+	return tileCell.x + FUSED_TILE_X * (tileCell.y + FUSED_TILE_Y * tileCell.z);
+}
+
+// Volume coordinates of a tile cell. Cells past the edge of the volume are clamped to it, the same as coordT/B/R/L/U/D
+uint3 TileCellCoordinates (uint tileIndex, uint3 groupId, uint3 dimensions) {
+	int3 tileCell = int3(tileIndex % FUSED_TILE_X, (tileIndex / FUSED_TILE_X) % FUSED_TILE_Y, tileIndex / (FUSED_TILE_X*FUSED_TILE_Y));
+	int3 cell = int3(groupId * uint3(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)) + tileCell - 1;
+	return (uint3) clamp(cell, int3(0,0,0), int3(dimensions) - 1);
+}
+
+uint PackBrick (uint3 brick) {
+	return brick.x | (brick.y << BRICK_COORDINATE_BITS) | (brick.z << (2*BRICK_COORDINATE_BITS));
+}
+
+// Volume coordinates of a thread of a Sparse shader, every thread group processes one brick of the activeBricks list
+uint3 BrickCell (uint3 groupId, uint3 groupThreadId) {
+	uint packedBrick = activeBricks[groupId.x];
+	uint3 brick = uint3(packedBrick, packedBrick >> BRICK_COORDINATE_BITS, packedBrick >> (2*BRICK_COORDINATE_BITS)) & BRICK_COORDINATE_MASK;
+	return brick * uint3(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z) + groupThreadId;
+}
+
+// Creates two entry points for the per cell function nameCell - nameComputeShader covers the whole volume and
+// nameSparseComputeShader only the bricks of the activeBricks list. The Sparse version is run with DispatchIndirect
+#define DENSE_AND_SPARSE_ENTRY_POINTS(name) \
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)] \
+void name##ComputeShader( uint3 i : SV_DispatchThreadID ) { \
+	name##Cell(i); \
+} \
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)] \
+void name##SparseComputeShader( uint3 groupId : SV_GroupID, uint3 groupThreadId : SV_GroupThreadID ) { \
+	name##Cell(BrickCell(groupId, groupThreadId)); \
 }
 
-[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
 // Advect the speed by sampling at pos - deltaTime*velocity
-void AdvectComputeShader( uint3 i : SV_DispatchThreadID ) {
+void AdvectCell(uint3 i) {
 	// check obstacles
 	if (IsObstacleCell(i)) {
 		advectionResult[i] = float3(0,0,0);
@@ -127,10 +373,10 @@ void AdvectComputeShader( uint3 i : SV_DispatchThreadID ) {
 
 	advectionResult[i] = finalResult;
 }
+DENSE_AND_SPARSE_ENTRY_POINTS(Advect)
 
-[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
 // Advect the speed by using the two intermediate semi-Lagrangian steps to achieve higher-order accuracy
-void AdvectMacCormackComputeShader( uint3 i : SV_DispatchThreadID ) {
+void AdvectMacCormackCell(uint3 i) {
 	// check obstacles
 	if (IsObstacleCell(i)) {
 		advectionResult[i] = float3(0,0,0);
@@ -177,10 +423,113 @@ void AdvectMacCormackComputeShader( uint3 i : SV_DispatchThreadID ) {
 
 	advectionResult[i] = finalResult;
 }
+DENSE_AND_SPARSE_ENTRY_POINTS(AdvectMacCormack)
+
+// Samples the temperature, density and reaction fields at the same position. The reaction texture is not bound for smoke and reads as 0
+float3 SampleScalars (float3 uvw) {
+	return float3(temperature.SampleLevel(linearSampler, uvw, 0), density.SampleLevel(linearSampler, uvw, 0), injectionReaction.SampleLevel(linearSampler, uvw, 0));
+}
+
+// Applies the dissipation and decay of AdvectComputeShader to each field and writes them out. Writes to the unbound reaction result are discarded
+void WriteScalars (uint3 i, float3 scalars) {
+	scalars *= vScalarDissipation;
+	if (fReactionDecay > 0.0f) {
+		scalars.z = max(0, scalars.z - fReactionDecay);
+	}
+
+	temperatureResult[i] = scalars.x;
+	densityResult[i] = scalars.y;
+	reactionResult[i] = scalars.z;
+}
+
+// AdvectComputeShader for the temperature, density and reaction at once, so the trace back is only done once
+void AdvectScalarsCell(uint3 i) {
+	// check obstacles
+	if (IsObstacleCell(i)) {
+		temperatureResult[i] = 0;
+		densityResult[i] = 0;
+		reactionResult[i] = 0;
+		return;
+	}
+
+	uint3 dimensions = GetDimensionsFloat3(velocity);
+
+	// advect by trace back
+	float3 prevPos = i - fTimeStep * velocity[i];
+	prevPos = (prevPos+0.5f)/dimensions;
+
+	WriteScalars(i, SampleScalars(prevPos));
+}
+DENSE_AND_SPARSE_ENTRY_POINTS(AdvectScalars)
+
+// First step of the MacCormack scalar advection - the forward advected fields are packed into one volume. The backward
+// step runs AdvectComputeShader on that volume
+void AdvectScalarsForwardCell(uint3 i) {
+	// check obstacles
+	if (IsObstacleCell(i)) {
+		advectionResult[i] = float3(0,0,0);
+		return;
+	}
+
+	uint3 dimensions = GetDimensionsFloat3(velocity);
+
+	// advect by trace back
+	float3 prevPos = i - fTimeStep * velocity[i];
+	prevPos = (prevPos+0.5f)/dimensions;
+
+	advectionResult[i] = SampleScalars(prevPos);
+}
+DENSE_AND_SPARSE_ENTRY_POINTS(AdvectScalarsForward)
+
+// AdvectMacCormackComputeShader for the packed fields. Fields that are not advected with MacCormack get the
+// result of AdvectComputeShader instead
+void AdvectScalarsMacCormackCell(uint3 i) {
+	// check obstacles
+	if (IsObstacleCell(i)) {
+		temperatureResult[i] = 0;
+		densityResult[i] = 0;
+		reactionResult[i] = 0;
+		return;
+	}
+
+	uint3 dimensions = GetDimensionsFloat3(velocity);
+
+	// advect by trace back
+	float3 prevPos = i - fTimeStep * velocity[i];
+	uint3 j = (uint3) prevPos;
+
+	prevPos = (prevPos+0.5f)/dimensions;
+
+	// Get the values of nodes that contribute to the interpolated value.  
+	float3 r0 = packedForward[j + uint3(0,0,0)];
+	float3 r1 = packedForward[j + uint3(1,0,0)];
+	float3 r2 = packedForward[j + uint3(0,1,0)];
+	float3 r3 = packedForward[j + uint3(1,1,0)];
+	float3 r4 = packedForward[j + uint3(0,0,1)];
+	float3 r5 = packedForward[j + uint3(1,0,1)];
+	float3 r6 = packedForward[j + uint3(0,1,1)];
+	float3 r7 = packedForward[j + uint3(1,1,1)];
+
+	// Determine a valid range for the result.
+	float3 lmin = min(r0,min(r1,min(r2, min(r3, min(r4, min(r5, min(r6, r7)))))));
+	float3 lmax = max(r0,max(r1,max(r2, max(r3, max(r4, max(r5, max(r6, r7)))))));
+
+	// Perform final advection, combining values from intermediate advection steps.
+	float3 phi_n_1_hat = packedForward.SampleLevel(linearSampler,prevPos, 0);
+	float3 phi_n_hat = packedBackward.SampleLevel(linearSampler,prevPos, 0);
+	float3 phi_n = SampleScalars(prevPos);
+
+	float3 s = phi_n_1_hat + 0.5f*(phi_n - phi_n_hat);
+
+	// clamp results to desired range
+	s = clamp(s,lmin,lmax);
+
+	WriteScalars(i, lerp(phi_n, s, vScalarMacCormack));
+}
+DENSE_AND_SPARSE_ENTRY_POINTS(AdvectScalarsMacCormack)
 
-[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
 // Create upward force by using the temperature difference
-void BuoyancyComputeShader( uint3 i : SV_DispatchThreadID ) {
+void BuoyancyCell(uint3 i) {
 	float temperatureVal = temperature[i];
 	float densityVal = density[i];
 
@@ -191,30 +540,39 @@ void BuoyancyComputeShader( uint3 i : SV_DispatchThreadID ) {
 	//}
 	buoyancyResult[i] = result;
 }
+DENSE_AND_SPARSE_ENTRY_POINTS(Buoyancy)
 
 [numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
-// Adds impulse depending on point of interaction
-void ImpulseComputeShader( uint3 i : SV_DispatchThreadID ) {
-	float3 pos = i - vPoint;
-	float mag = pos.x*pos.x + pos.y*pos.y + pos.z*pos.z;
-	mag *= mag;
-	float rad2 = fRadius*fRadius;
+// Adds every impulse source of the step to the velocity, temperature, density and reaction in one pass. Only dispatched
+// over the region the sources reach, beyond which they add next to nothing. Writes to the unbound reaction result are
+// discarded
+void ImpulseSourcesComputeShader( uint3 regionCell : SV_DispatchThreadID ) {
+	uint3 i = vInjectionRegionMin + regionCell;
+	if (any(i > vInjectionRegionMax)) {
+		return;
+	}
 
-	float3 amount = exp(-mag/rad2) * vAmount * fTimeStep;
-	impulseResult[i] = impulseInitial[i] + amount;
+	float3 velocityAmount;
+	float3 scalarAmounts;
+	SumImpulseSources(i, velocityAmount, scalarAmounts);
+
+	velocityResult[i] = velocity[i] + velocityAmount;
+	temperatureResult[i] = temperature[i] + scalarAmounts.x;
+	densityResult[i] = density[i] + scalarAmounts.y;
+	reactionResult[i] = injectionReaction[i] + scalarAmounts.z;
 }
 
-[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
-void ExtinguishmentImpulseComputeShader(uint3 i : SV_DispatchThreadID) {	
+void ExtinguishmentImpulseCell(uint3 i) {	
 	float amount = 0.0f;
 	float reactionAmount = reaction[i];
 	
 	// can this be optimized?
-	if (reactionAmount > 0.0f && reactionAmount < fExtinguishment) {
-		amount = vAmount.r * reactionAmount;
+	if (reactionAmount > 0.0f && reactionAmount < fInputExtinguishment) {
+		amount = fSmokeAmount * reactionAmount;
 	}
 	impulseResult[i] = impulseInitial[i] + amount;
 }
+DENSE_AND_SPARSE_ENTRY_POINTS(ExtinguishmentImpulse)
 
 [numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
 // reintroduce some vorticity back into the system
@@ -244,16 +602,8 @@ void VorticityComputeShader( uint3 i : SV_DispatchThreadID ) {
 	vorticityResult[i] = float4(result, lresult);
 }
 
-[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
-// reintroduce some vorticity back into the system
-void ConfinementComputeShader( uint3 i : SV_DispatchThreadID ) {
-	// if obstacle - do nothing
-	if (IsObstacleCell(i)) {
-		return;
-	}
-
-	uint3 dimensions = GetDimensionsFloat4(vorticity);
-
+// Vorticity confinement force of a fluid cell
+float3 ConfinementForce( uint3 i, uint3 dimensions ) {
 	uint3 coordT = uint3(i.x, min(i.y+1,dimensions.y-1), i.z);
 	uint3 coordB = uint3(i.x, max(i.y-1,0), i.z);
 	uint3 coordR = uint3(min(i.x+1,dimensions.x-1), i.y, i.z);
@@ -273,16 +623,24 @@ void ConfinementComputeShader( uint3 i : SV_DispatchThreadID ) {
 	float3 eta = 0.5f * float3( omegaR - omegaL, omegaT - omegaB, omegaU - omegaD );
 	eta = normalize( eta + float3(0.001f,0.001f,0.001f) );
 
-	float3 force = fTimeStep * fVorticityStrength * float3( (eta.y * omega.z - eta.z * omega.y), (eta.z * omega.x - eta.x * omega.z), (eta.x * omega.y - eta.y * omega.x) );
-
-	velocityResult[i] = velocity[i] + force;
+	return fTimeStep * fVorticityStrength * float3( (eta.y * omega.z - eta.z * omega.y), (eta.z * omega.x - eta.x * omega.z), (eta.x * omega.y - eta.y * omega.x) );
 }
 
 [numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
-// calculate the velocity divergence
-void DivergenceComputeShader( uint3 i : SV_DispatchThreadID ) {
-	uint3 dimensions = GetDimensionsFloat3(velocity);
+// reintroduce some vorticity back into the system
+void ConfinementComputeShader( uint3 i : SV_DispatchThreadID ) {
+	// if obstacle - do nothing
+	if (IsObstacleCell(i)) {
+		return;
+	}
+
+	uint3 dimensions = GetDimensionsFloat4(vorticity);
+
+	velocityResult[i] = velocity[i] + ConfinementForce(i, dimensions);
+}
 
+// Divergence of a cell given the velocities of its neighbours
+float VelocityDivergence( uint3 i, uint3 dimensions, float3 vT, float3 vB, float3 vR, float3 vL, float3 vU, float3 vD ) {
 	uint3 coordT = uint3(i.x, min(i.y+1,dimensions.y-1), i.z);
 	uint3 coordB = uint3(i.x, max(i.y-1,0), i.z);
 	uint3 coordR = uint3(min(i.x+1,dimensions.x-1), i.y, i.z);
@@ -290,34 +648,39 @@ void DivergenceComputeShader( uint3 i : SV_DispatchThreadID ) {
 	uint3 coordU = uint3(i.x, i.y, min(i.z+1,dimensions.z-1));
 	uint3 coordD = uint3(i.x, i.y, max(i.z-1,0));
 
-	// Find neighbouring velocities
-	float3 vT = velocity[coordT];
-	float3 vB = velocity[coordB];
-	float3 vR = velocity[coordR];
-	float3 vL = velocity[coordL];
-	float3 vU = velocity[coordU];
-	float3 vD = velocity[coordD];
+	uint obstacleFlags = obstacles[i];
 
 	// Enforce boundaries
-	if(IsObstacleCell(coordT)) vT = GetObstacleVelocity(coordT);
-	if(IsObstacleCell(coordB)) vB = GetObstacleVelocity(coordB);
+	if(obstacleFlags & OBSTACLE_T) vT = GetObstacleVelocity(coordT);
+	if(obstacleFlags & OBSTACLE_B) vB = GetObstacleVelocity(coordB);
 	
-	if(IsObstacleCell(coordR)) vR = GetObstacleVelocity(coordR);
-	if(IsObstacleCell(coordL)) vL = GetObstacleVelocity(coordL);
+	if(obstacleFlags & OBSTACLE_R) vR = GetObstacleVelocity(coordR);
+	if(obstacleFlags & OBSTACLE_L) vL = GetObstacleVelocity(coordL);
 	
-	if(IsObstacleCell(coordU)) vU = GetObstacleVelocity(coordU);
-	if(IsObstacleCell(coordD)) vD = GetObstacleVelocity(coordD);
-
-	float result = 0.5f * (vR.x - vL.x + vT.y - vB.y + vU.z - vD.z);
+	if(obstacleFlags & OBSTACLE_U) vU = GetObstacleVelocity(coordU);
+	if(obstacleFlags & OBSTACLE_D) vD = GetObstacleVelocity(coordD);
 
-	divergenceResult[i] = result;
+	return 0.5f * (vR.x - vL.x + vT.y - vB.y + vU.z - vD.z);
 }
 
 [numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
-// jacobi shader to compute the gradient pressure field
-void JacobiComputeShader( uint3 i : SV_DispatchThreadID ) {
-	uint3 dimensions = GetDimensionsFloat(pressure);
+// calculate the velocity divergence
+void DivergenceComputeShader( uint3 i : SV_DispatchThreadID ) {
+	uint3 dimensions = GetDimensionsFloat3(velocity);
+
+	uint3 coordT = uint3(i.x, min(i.y+1,dimensions.y-1), i.z);
+	uint3 coordB = uint3(i.x, max(i.y-1,0), i.z);
+	uint3 coordR = uint3(min(i.x+1,dimensions.x-1), i.y, i.z);
+	uint3 coordL = uint3(max(i.x-1,0), i.y, i.z);
+	uint3 coordU = uint3(i.x, i.y, min(i.z+1,dimensions.z-1));
+	uint3 coordD = uint3(i.x, i.y, max(i.z-1,0));
 
+	// Find neighbouring velocities
+	divergenceResult[i] = VelocityDivergence(i, dimensions, velocity[coordT], velocity[coordB], velocity[coordR], velocity[coordL], velocity[coordU], velocity[coordD]);
+}
+
+// One Jacobi iteration of the pressure at a cell
+float JacobiPressure( uint3 i, uint3 dimensions, float bC ) {
 	uint3 coordT = uint3(i.x, min(i.y+1,dimensions.y-1), i.z);
 	uint3 coordB = uint3(i.x, max(i.y-1,0), i.z);
 	uint3 coordR = uint3(min(i.x+1,dimensions.x-1), i.y, i.z);
@@ -334,33 +697,31 @@ void JacobiComputeShader( uint3 i : SV_DispatchThreadID ) {
 	float xU = pressure[coordU];
 	float xD = pressure[coordD];
 
-	if(IsObstacleCell(coordT)) xT = xC;
-	if(IsObstacleCell(coordB)) xB = xC;
+	uint obstacleFlags = obstacles[i];
+
+	if(obstacleFlags & OBSTACLE_T) xT = xC;
+	if(obstacleFlags & OBSTACLE_B) xB = xC;
 							   
-	if(IsObstacleCell(coordR)) xR = xC;
-	if(IsObstacleCell(coordL)) xL = xC;
+	if(obstacleFlags & OBSTACLE_R) xR = xC;
+	if(obstacleFlags & OBSTACLE_L) xL = xC;
 							   
-	if(IsObstacleCell(coordU)) xU = xC;
-	if(IsObstacleCell(coordD)) xD = xC;
+	if(obstacleFlags & OBSTACLE_U) xU = xC;
+	if(obstacleFlags & OBSTACLE_D) xD = xC;
 
-	// Sample divergence
-	float bC = divergence[i];
-
-	float final = (xL + xR + xB + xT + xU + xD - bC ) / 6;
-
-	pressureResult[i] = final;
+	return (xL + xR + xB + xT + xU + xD - bC ) / 6;
 }
 
 [numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
-// enforce incompressibility condition by making the velocity divergence 0 by subtracting the pressure gradient
-void SubtractGradientComputeShader( uint3 i : SV_DispatchThreadID ) {
-	if(IsObstacleCell(i)) {
-		velocityResult[i] = GetObstacleVelocity(i);
-		return;
-	}
-
+// jacobi shader to compute the gradient pressure field
+void JacobiComputeShader( uint3 i : SV_DispatchThreadID ) {
 	uint3 dimensions = GetDimensionsFloat(pressure);
 
+	// Sample divergence
+	pressureResult[i] = JacobiPressure(i, dimensions, divergence[i]);
+}
+
+// Divergence free velocity of a fluid cell given the pressure of it and its neighbours
+float3 ProjectVelocity( uint3 i, uint3 dimensions, float pC, float pT, float pB, float pR, float pL, float pU, float pD ) {
 	uint3 coordT = uint3(i.x, min(i.y+1,dimensions.y-1), i.z);
 	uint3 coordB = uint3(i.x, max(i.y-1,0), i.z);
 	uint3 coordR = uint3(min(i.x+1,dimensions.x-1), i.y, i.z);
@@ -368,25 +729,17 @@ void SubtractGradientComputeShader( uint3 i : SV_DispatchThreadID ) {
 	uint3 coordU = uint3(i.x, i.y, min(i.z+1,dimensions.z-1));
 	uint3 coordD = uint3(i.x, i.y, max(i.z-1,0));
 
-	// Find neighbouring pressure
-	float pT = pressure[coordT];
-	float pB = pressure[coordB];
-	float pR = pressure[coordR];
-	float pL = pressure[coordL];
-	float pU = pressure[coordU];
-	float pD = pressure[coordD];
-	float pC = pressure[i];
-
 	float3 vMask = float3(1,1,1);
 	float3 obstV = float3(0,0,0);
+	uint obstacleFlags = obstacles[i];
 
 	// If an adjacent cell is solid or boundary, ignore its pressure and use its velocity.
-	if(IsObstacleCell(coordT)) { pT = pC; obstV.y = GetObstacleVelocity(coordT).y; vMask.y = 0;}
-	if(IsObstacleCell(coordB)) { pB = pC; obstV.y = GetObstacleVelocity(coordB).y; vMask.y = 0;}							  
-	if(IsObstacleCell(coordR)) { pR = pC; obstV.x = GetObstacleVelocity(coordR).x; vMask.x = 0;}
-	if(IsObstacleCell(coordL)) { pL = pC; obstV.x = GetObstacleVelocity(coordL).x; vMask.x = 0;}							  
-	if(IsObstacleCell(coordU)) { pU = pC; obstV.z = GetObstacleVelocity(coordU).z; vMask.z = 0;}
-	if(IsObstacleCell(coordD)) { pD = pC; obstV.z = GetObstacleVelocity(coordD).z; vMask.z = 0;}
+	if(obstacleFlags & OBSTACLE_T) { pT = pC; obstV.y = GetObstacleVelocity(coordT).y; vMask.y = 0;}
+	if(obstacleFlags & OBSTACLE_B) { pB = pC; obstV.y = GetObstacleVelocity(coordB).y; vMask.y = 0;}							  
+	if(obstacleFlags & OBSTACLE_R) { pR = pC; obstV.x = GetObstacleVelocity(coordR).x; vMask.x = 0;}
+	if(obstacleFlags & OBSTACLE_L) { pL = pC; obstV.x = GetObstacleVelocity(coordL).x; vMask.x = 0;}							  
+	if(obstacleFlags & OBSTACLE_U) { pU = pC; obstV.z = GetObstacleVelocity(coordU).z; vMask.z = 0;}
+	if(obstacleFlags & OBSTACLE_D) { pD = pC; obstV.z = GetObstacleVelocity(coordD).z; vMask.z = 0;}
 
 	// Compute the gradient of pressure at the current cell by taking central differences of neighboring pressure values. 
 	float3 grad = float3(pR - pL, pT - pB, pU - pD) * 0.5f;
@@ -396,12 +749,18 @@ void SubtractGradientComputeShader( uint3 i : SV_DispatchThreadID ) {
 	// Explicitly enforce the free-slip boundary condition by  
 	// replacing the appropriate components of the new velocity with  
 	// obstacle velocities. 
-	velocityResult[i] = newV * vMask + obstV;
+	return newV * vMask + obstV;
 }
 
 [numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
-void ObstaclesComputeShader( uint3 i : SV_DispatchThreadID ) {
-	uint3 dimensions = GetDimensionsIntRW(obstaclesResult);
+// enforce incompressibility condition by making the velocity divergence 0 by subtracting the pressure gradient
+void SubtractGradientComputeShader( uint3 i : SV_DispatchThreadID ) {
+	if(IsObstacleCell(i)) {
+		velocityResult[i] = GetObstacleVelocity(i);
+		return;
+	}
+
+	uint3 dimensions = GetDimensionsFloat(pressure);
 
 	uint3 coordT = uint3(i.x, min(i.y+1,dimensions.y-1), i.z);
 	uint3 coordB = uint3(i.x, max(i.y-1,0), i.z);
@@ -410,22 +769,651 @@ void ObstaclesComputeShader( uint3 i : SV_DispatchThreadID ) {
 	uint3 coordU = uint3(i.x, i.y, min(i.z+1,dimensions.z-1));
 	uint3 coordD = uint3(i.x, i.y, max(i.z-1,0));
 
-	int obstacle = 0;
+	// Find neighbouring pressure
+	velocityResult[i] = ProjectVelocity(i, dimensions, pressure[i], pressure[coordT], pressure[coordB], pressure[coordR], pressure[coordL], pressure[coordU], pressure[coordD]);
+}
+
+// Buoyancy followed by the velocity impulses of the fused shaders
+float3 BuoyancyImpulseVelocity( uint3 i, float temperatureVal, float densityVal, float3 velocityAmount ) {
+	float3 result = velocity[i];
+	result += (fTimeStep * (temperatureVal) * fDensityBuoyancy - (densityVal * fDensityWeight) ) * float3(0,1,0);
+	return result + velocityAmount;
+}
 
-	if(i.x-1 < 0) obstacle = 1;
-	if(i.x+1 > (int)dimensions.x-1) obstacle = 1;
-	
-	if(i.y-1 < 0) obstacle = 1;
-	if(i.y+1 > (int)dimensions.y-1) obstacle = 1;
-	
-	if(i.z-1 < 0) obstacle = 1;
-	if(i.z+1 > (int)dimensions.z-1) obstacle = 1;
+// BuoyancyComputeShader and ImpulseSourcesComputeShader in one pass. Both only touch their own cell, so the result is
+// the same as running them one after another
+void BuoyancyImpulseSmokeCell(uint3 i) {
+	float temperatureVal = temperature[i];
+	float densityVal = density[i];
+
+	float3 velocityAmount;
+	float3 scalarAmounts;
+	SumImpulseSources(i, velocityAmount, scalarAmounts);
+
+	buoyancyResult[i] = BuoyancyImpulseVelocity(i, temperatureVal, densityVal, velocityAmount);
+	temperatureResult[i] = temperatureVal + scalarAmounts.x;
+	densityResult[i] = densityVal + scalarAmounts.y;
+}
+DENSE_AND_SPARSE_ENTRY_POINTS(BuoyancyImpulseSmoke)
+
+// The fire version injects reaction instead of density and forms smoke from the reaction as it is extinguished,
+// the same as ExtinguishmentImpulseComputeShader
+void BuoyancyImpulseFireCell(uint3 i) {
+	float temperatureVal = temperature[i];
+	float densityVal = density[i];
+
+	float3 velocityAmount;
+	float3 scalarAmounts;
+	SumImpulseSources(i, velocityAmount, scalarAmounts);
+
+	buoyancyResult[i] = BuoyancyImpulseVelocity(i, temperatureVal, densityVal, velocityAmount);
+
+	float reactionVal = injectionReaction[i] + scalarAmounts.z;
+	float smokeAmount = 0.0f;
+	if (reactionVal > 0.0f && reactionVal < fInputExtinguishment) {
+		smokeAmount = fSmokeAmount * reactionVal;
+	}
+
+	reactionResult[i] = reactionVal;
+	densityResult[i] = densityVal + scalarAmounts.y + smokeAmount;
+	temperatureResult[i] = temperatureVal + scalarAmounts.x;
+}
+DENSE_AND_SPARSE_ENTRY_POINTS(BuoyancyImpulseFire)
+
+// Whether any impulse source of the step adds to the cells of a brick
+bool BrickHasImpulseSource (uint3 brick) {
+	uint3 brickMin = brick * uint3(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z);
+	uint3 brickMax = brickMin + uint3(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z) - 1;
+	for (uint s = 0; s < uImpulseSourceCount; ++s) {
+		if (all(brickMin <= impulseSources[s].vRegionMax) && all(brickMax >= impulseSources[s].vRegionMin)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// Flags every brick that holds a value above the threshold in either buffer of any field, or that an impulse source
+// adds to. Runs one thread group per brick. The reaction textures are not bound for smoke and read as 0
+void BrickActivityComputeShader( uint3 i : SV_DispatchThreadID, uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex ) {
+	if (groupIndex == 0) {
+		sharedBrickActivity = 0;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	float scalars = max(max(abs(temperature[i]), abs(previousTemperature[i])), max(abs(density[i]), abs(previousDensity[i])));
+	scalars = max(scalars, max(abs(injectionReaction[i]), abs(previousReaction[i])));
+	float speed = max(length(velocity[i]), length(previousVelocity[i]));
+	// the values are never negative, so they order the same as their bits
+	InterlockedMax(sharedBrickActivity, asuint(max(scalars, speed)));
+	GroupMemoryBarrierWithGroupSync();
+
+	if (groupIndex == 0) {
+		bool active = sharedBrickActivity > asuint(fBrickThreshold);
+		active = active || BrickHasImpulseSource(groupId);
+		brickActivityResult[groupId.x + vBrickCount.x * (groupId.y + vBrickCount.y * groupId.z)] = active ? 1 : 0;
+	}
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// Runs one thread per brick and appends the brick to the lists of every halo width that reaches it from the nearest
+// active brick
+void BrickListComputeShader( uint3 i : SV_DispatchThreadID ) {
+	if (any(i >= vBrickCount)) {
+		return;
+	}
+
+	int distance = uAllBricksActive ? 0 : BRICK_MAX_HALO + 1;
+	int3 searchMin = max(int3(i) - BRICK_MAX_HALO, int3(0,0,0));
+	int3 searchMax = min(int3(i) + BRICK_MAX_HALO, int3(vBrickCount) - 1);
+	for (int z = searchMin.z; z <= searchMax.z; ++z) {
+		for (int y = searchMin.y; y <= searchMax.y; ++y) {
+			for (int x = searchMin.x; x <= searchMax.x; ++x) {
+				if (brickActivity[x + vBrickCount.x * (y + vBrickCount.y * z)]) {
+					int3 offset = abs(int3(x, y, z) - int3(i));
+					distance = min(distance, max(offset.x, max(offset.y, offset.z)));
+				}
+			}
+		}
+	}
+
+	uint packedBrick = PackBrick(i);
+	if (distance <= 0) {
+		brickListResult0.Append(packedBrick);
+	}
+	if (distance <= 1) {
+		brickListResult1.Append(packedBrick);
+	}
+	if (distance <= 2) {
+		brickListResult2.Append(packedBrick);
+	}
+	if (distance <= 3) {
+		brickListResult3.Append(packedBrick);
+	}
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// ConfinementComputeShader followed by DivergenceComputeShader. The group confines the velocity of its cells and of
+// a one cell border around them into shared memory, so the divergence reads the confined velocity from there instead
+// of waiting for the whole velocity texture to be written and reading it back
+void ConfinementDivergenceComputeShader( uint3 i : SV_DispatchThreadID, uint3 groupThreadId : SV_GroupThreadID, uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex ) {
+	uint3 dimensions = GetDimensionsFloat4(vorticity);
+
+	// the border cells are confined again by the neighbouring groups, obstacle cells keep their velocity
+	for (uint tileIndex = groupIndex; tileIndex < FUSED_TILE_SIZE; tileIndex += NUM_THREADS_X*NUM_THREADS_Y*NUM_THREADS_Z) {
+		uint3 cell = TileCellCoordinates(tileIndex, groupId, dimensions);
+		float3 result = velocity[cell];
+		if (!IsObstacleCell(cell)) {
+			result += ConfinementForce(cell, dimensions);
+		}
+		sharedTileVelocity[tileIndex] = result;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	uint centre = TileIndex(groupThreadId + 1);
 
-	//float3 center = dimensions/2;
-	//float radius = 5;
-	//
-	//if (distance(center, i) <= radius)
-	//	obstacle = 1;
+	float3 vT = sharedTileVelocity[centre + FUSED_TILE_X];
+	float3 vB = sharedTileVelocity[centre - FUSED_TILE_X];
+	float3 vR = sharedTileVelocity[centre + 1];
+	float3 vL = sharedTileVelocity[centre - 1];
+	float3 vU = sharedTileVelocity[centre + FUSED_TILE_X*FUSED_TILE_Y];
+	float3 vD = sharedTileVelocity[centre - FUSED_TILE_X*FUSED_TILE_Y];
+
+	velocityResult[i] = sharedTileVelocity[centre];
+	fusedDivergenceResult[i] = VelocityDivergence(i, dimensions, vT, vB, vR, vL, vU, vD);
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// The last JacobiComputeShader iteration followed by SubtractGradientComputeShader, sharing the new pressure of the
+// group's cells and their border through shared memory the same way as ConfinementDivergenceComputeShader
+void JacobiSubtractGradientComputeShader( uint3 i : SV_DispatchThreadID, uint3 groupThreadId : SV_GroupThreadID, uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex ) {
+	uint3 dimensions = GetDimensionsFloat(pressure);
+
+	for (uint tileIndex = groupIndex; tileIndex < FUSED_TILE_SIZE; tileIndex += NUM_THREADS_X*NUM_THREADS_Y*NUM_THREADS_Z) {
+		uint3 cell = TileCellCoordinates(tileIndex, groupId, dimensions);
+		sharedTilePressure[tileIndex] = JacobiPressure(cell, dimensions, fusedDivergence[cell]);
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	uint centre = TileIndex(groupThreadId + 1);
+	float pC = sharedTilePressure[centre];
+	fusedPressureResult[i] = pC;
+
+	if(IsObstacleCell(i)) {
+		velocityResult[i] = GetObstacleVelocity(i);
+		return;
+	}
+
+	float pT = sharedTilePressure[centre + FUSED_TILE_X];
+	float pB = sharedTilePressure[centre - FUSED_TILE_X];
+	float pR = sharedTilePressure[centre + 1];
+	float pL = sharedTilePressure[centre - 1];
+	float pU = sharedTilePressure[centre + FUSED_TILE_X*FUSED_TILE_Y];
+	float pD = sharedTilePressure[centre - FUSED_TILE_X*FUSED_TILE_Y];
+
+	velocityResult[i] = ProjectVelocity(i, dimensions, pC, pT, pB, pR, pL, pU, pD);
+}
+
+// Offsets of the neighbours, in the order of the OBSTACLE_T to OBSTACLE_D flags
+static const int3 obstacleNeighbourOffsets[6] = { int3(0,1,0), int3(0,-1,0), int3(1,0,0), int3(-1,0,0), int3(0,0,1), int3(0,0,-1) };
+
+// Whether a neighbour of a cell lies outside of the volume
+bool IsOutsideNeighbour(int3 neighbour, uint3 dimensions) {
+	return any(neighbour < 0) || any(neighbour >= int3(dimensions));
+}
+
+// The walls around the volume
+bool IsBoundaryCell(int3 pos, uint3 dimensions) {
+	return any(pos == 0) || any(pos == int3(dimensions) - 1);
+}
+
+// Whether a cell lies inside of an obstacle box, local receives its position in the frame of the box
+bool IsInsideObstacleBox(int3 pos, ObstacleBox box, out float3 local) {
+	local = float3(0,0,0);
+	if (any(pos < int3(box.vRegionMin)) || any(pos > int3(box.vRegionMax))) {
+		return false;
+	}
+	float3 offset = float3(pos) - box.vCentre;
+	local = float3(dot(box.vInverseX, offset), dot(box.vInverseY, offset), dot(box.vInverseZ, offset));
+	return all(abs(local) <= 1.0f);
+}
+
+// The walls and the cells inside of any obstacle box are solid
+bool IsVoxelizedSolid(int3 pos, uint3 dimensions) {
+	if (IsBoundaryCell(pos, dimensions)) {
+		return true;
+	}
+	float3 local;
+	for (uint b = 0; b < uObstacleBoxCount; ++b) {
+		if (IsInsideObstacleBox(pos, obstacleBoxes[b], local)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Velocity of the first box covering a cell, worked out from where the same point of the box was a step ago.
+// Zero in the fluid
+float3 ObstacleBoxVelocity(int3 pos) {
+	float3 local;
+	for (uint b = 0; b < uObstacleBoxCount; ++b) {
+		ObstacleBox box = obstacleBoxes[b];
+		if (IsInsideObstacleBox(pos, box, local)) {
+			float3 previous = box.vPreviousCentre + local.x * box.vPreviousAxisX + local.y * box.vPreviousAxisY + local.z * box.vPreviousAxisZ;
+			return (float3(pos) - previous) / fTimeStep;
+		}
+	}
+	return float3(0,0,0);
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// Voxelizes the walls and the obstacle boxes into the obstacle flags and velocities. Only dispatched over the cells
+// around the boxes that changed in the step
+void ObstaclesComputeShader( uint3 regionCell : SV_DispatchThreadID ) {
+	uint3 i = vObstacleRegionMin + regionCell;
+	if (any(i > vObstacleRegionMax)) {
+		return;
+	}
+
+	uint3 dimensions = GetDimensionsUintRW(obstaclesResult);
+
+	uint obstacleFlags = IsVoxelizedSolid(int3(i), dimensions) ? OBSTACLE_SOLID : 0;
+	[unroll]
+	for (uint n = 0; n < 6; ++n) {
+		int3 neighbour = int3(i) + obstacleNeighbourOffsets[n];
+		if (IsOutsideNeighbour(neighbour, dimensions) || IsVoxelizedSolid(neighbour, dimensions)) {
+			obstacleFlags |= OBSTACLE_T << n;
+		}
+	}
+
+	obstaclesResult[i] = obstacleFlags;
+	// the walls never move
+	obstacleVelocityResult[i] = IsBoundaryCell(int3(i), dimensions) ? float3(0,0,0) : ObstacleBoxVelocity(int3(i));
+}
+
+// Sums the pressure of the fluid neighbours of a cell on the current multigrid level.
+// Cells outside of the level count as solid
+void SumFluidNeighbours(uint3 i, out float sum, out float count) {
+	uint3 coords[6] = { uint3(i.x, i.y+1, i.z), uint3(i.x, i.y-1, i.z),
+						uint3(i.x+1, i.y, i.z), uint3(i.x-1, i.y, i.z),
+						uint3(i.x, i.y, i.z+1), uint3(i.x, i.y, i.z-1) };
+	uint obstacleFlags = levelObstacles[i];
+	sum = 0.0f;
+	count = 0.0f;
+	[unroll]
+	for (int n = 0; n < 6; ++n) {
+		if ((obstacleFlags & (OBSTACLE_T << n)) == 0) {
+			sum += pressure[coords[n]];
+			count += 1.0f;
+		}
+	}
+}
+
+// Same as SumFluidNeighbours but reads the pressure that is being updated in place
+void SumFluidNeighboursInPlace(uint3 i, out float sum, out float count) {
+	uint3 coords[6] = { uint3(i.x, i.y+1, i.z), uint3(i.x, i.y-1, i.z),
+						uint3(i.x+1, i.y, i.z), uint3(i.x-1, i.y, i.z),
+						uint3(i.x, i.y, i.z+1), uint3(i.x, i.y, i.z-1) };
+	uint obstacleFlags = levelObstacles[i];
+	sum = 0.0f;
+	count = 0.0f;
+	[unroll]
+	for (int n = 0; n < 6; ++n) {
+		if ((obstacleFlags & (OBSTACLE_T << n)) == 0) {
+			sum += pressureInPlace[coords[n]];
+			count += 1.0f;
+		}
+	}
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// in place over-relaxed Gauss-Seidel update of the cells of one colour. The neighbours of a cell are all of
+// the other colour, so no thread reads a value another thread writes. Dispatched at half width in x,
+// every thread handles one cell of the requested colour
+void RedBlackSORComputeShader( uint3 i : SV_DispatchThreadID ) {
+	uint3 cell = uint3(i.x * 2 + ((i.y + i.z + uParity) & 1), i.y, i.z);
+	uint3 dimensions = GetDimensionsFloatRW(pressureInPlace);
+	if (any(cell >= dimensions)) {
+		return;
+	}
+
+	if (IsLevelObstacleCell(cell)) {
+		pressureInPlace[cell] = 0;
+		return;
+	}
+
+	float sum, count;
+	SumFluidNeighboursInPlace(cell, sum, count);
+
+	if (count > 0.0f) {
+		float xC = pressureInPlace[cell];
+		pressureInPlace[cell] = lerp(xC, (sum - divergence[cell]) / count, fOverRelaxation);
+	}
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// residual of the pressure equation on a multigrid level
+void MultigridResidualComputeShader( uint3 i : SV_DispatchThreadID ) {
+	if (IsLevelObstacleCell(i)) {
+		multigridResult[i] = 0;
+		return;
+	}
+
+	uint3 dimensions = GetDimensionsFloat(pressure);
+
+	float sum, count;
+	SumFluidNeighbours(i, sum, count);
+
+	multigridResult[i] = divergence[i] - (sum - count * pressure[i]);
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// transfer the fine residual onto the coarse grid as its right hand side
+void MultigridRestrictComputeShader( uint3 i : SV_DispatchThreadID ) {
+	if (IsLevelObstacleCell(i)) {
+		multigridResult[i] = 0;
+		return;
+	}
+
+	uint3 fineDimensions = GetDimensionsFloat(fineResidual);
+	uint3 fineBase = i * 2;
+
+	float sum = 0.0f;
+	[unroll]
+	for (uint n = 0; n < 8; ++n) {
+		uint3 fineCoord = fineBase + uint3(n & 1, (n >> 1) & 1, (n >> 2) & 1);
+		if (all(fineCoord < fineDimensions)) {
+			sum += fineResidual[fineCoord];
+		}
+	}
+
+	// average of the children scaled by the coarse grid spacing squared (4/8)
+	multigridResult[i] = 0.5f * sum;
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// interpolate the coarse correction and add it to the fine solution in place
+void MultigridProlongComputeShader( uint3 i : SV_DispatchThreadID ) {
+	if (IsLevelObstacleCell(i)) {
+		pressureInPlace[i] = 0;
+		return;
+	}
+
+	uint3 coarseDimensions = GetDimensionsFloat(coarseCorrection);
+	// fine cell centres in coarse texture space, kept inside the outermost coarse cell centres
+	// so the interpolation never fades towards the zero border colour
+	float3 coarsePos = clamp((i + 0.5f) * 0.5f, 0.5f, coarseDimensions - 0.5f) / coarseDimensions;
+
+	pressureInPlace[i] += coarseCorrection.SampleLevel(linearSampler, coarsePos, 0);
+}
+
+// a coarse cell is solid only if all of its children are solid
+bool IsCoarseObstacleCell(int3 coarse, uint3 fineDimensions) {
+	uint3 fineBase = coarse * 2;
+	[unroll]
+	for (uint n = 0; n < 8; ++n) {
+		uint3 fineCoord = fineBase + uint3(n & 1, (n >> 1) & 1, (n >> 2) & 1);
+		if (all(fineCoord < fineDimensions) && (fineObstacles[fineCoord] & OBSTACLE_SOLID) == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// flags of a coarse level cell, restricting the children of the cell and of its neighbours
+void MultigridRestrictObstaclesComputeShader( uint3 i : SV_DispatchThreadID ) {
+	uint3 fineDimensions = GetDimensionsUint(fineObstacles);
+	uint3 dimensions = GetDimensionsUintRW(obstaclesResult);
+
+	uint obstacleFlags = IsCoarseObstacleCell(int3(i), fineDimensions) ? OBSTACLE_SOLID : 0;
+	[unroll]
+	for (uint n = 0; n < 6; ++n) {
+		int3 neighbour = int3(i) + obstacleNeighbourOffsets[n];
+		if (IsOutsideNeighbour(neighbour, dimensions) || IsCoarseObstacleCell(neighbour, fineDimensions)) {
+			obstacleFlags |= OBSTACLE_T << n;
+		}
+	}
+
+	obstaclesResult[i] = obstacleFlags;
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// sum the squared residual of every thread group, the partial sums are added up on the CPU
+void ResidualReductionComputeShader( uint3 i : SV_DispatchThreadID, uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex ) {
+	uint3 dimensions = GetDimensionsFloat(residualField);
+
+	float residualVal = all(i < dimensions) ? residualField[i] : 0.0f;
+	sharedResidual[groupIndex] = residualVal * residualVal;
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for (uint stride = (NUM_THREADS_X*NUM_THREADS_Y*NUM_THREADS_Z) / 2; stride > 0; stride >>= 1) {
+		if (groupIndex < stride) {
+			sharedResidual[groupIndex] += sharedResidual[groupIndex + stride];
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if (groupIndex == 0) {
+		uint3 numGroups = (dimensions + uint3(NUM_THREADS_X-1, NUM_THREADS_Y-1, NUM_THREADS_Z-1)) / uint3(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z);
+		residualSumsResult[groupId.x + numGroups.x * (groupId.y + numGroups.y * groupId.z)] = sharedResidual[0];
+	}
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// the largest density or reaction, temperature and squared speed of every thread group along with its kinetic energy,
+// the groups are combined on the CPU. The reaction is left unbound for smoke, which reads it as 0
+void ActivityReductionComputeShader( uint3 i : SV_DispatchThreadID, uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex ) {
+	uint3 dimensions = GetDimensionsFloat3(velocity);
+
+	float4 activity = float4(0,0,0,0);
+	if (all(i < dimensions)) {
+		float3 velocityVal = velocity[i];
+		float speedSquared = dot(velocityVal, velocityVal);
+		activity = float4(max(abs(density[i]), abs(injectionReaction[i])), abs(temperature[i]), speedSquared, 0.5f * speedSquared);
+	}
+	sharedActivity[groupIndex] = activity;
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for (uint stride = (NUM_THREADS_X*NUM_THREADS_Y*NUM_THREADS_Z) / 2; stride > 0; stride >>= 1) {
+		if (groupIndex < stride) {
+			float4 other = sharedActivity[groupIndex + stride];
+			sharedActivity[groupIndex] = float4(max(sharedActivity[groupIndex].xyz, other.xyz), sharedActivity[groupIndex].w + other.w);
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if (groupIndex == 0) {
+		uint3 numGroups = (dimensions + uint3(NUM_THREADS_X-1, NUM_THREADS_Y-1, NUM_THREADS_Z-1)) / uint3(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z);
+		activityResult[groupId.x + numGroups.x * (groupId.y + numGroups.y * groupId.z)] = sharedActivity[0];
+	}
+}
+
+// Tree reduction of sharedSums, the total ends up in sharedSums[0]
+void ReduceSharedSums(uint groupIndex) {
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for (uint stride = (NUM_THREADS_X*NUM_THREADS_Y*NUM_THREADS_Z) / 2; stride > 0; stride >>= 1) {
+		if (groupIndex < stride) {
+			sharedSums[groupIndex] += sharedSums[groupIndex + stride];
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+}
+
+void WriteGroupSum(uint3 dimensions, uint3 groupId, uint groupIndex) {
+	if (groupIndex == 0) {
+		uint3 numGroups = (dimensions + uint3(NUM_THREADS_X-1, NUM_THREADS_Y-1, NUM_THREADS_Z-1)) / uint3(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z);
+		pcgSumsResult[groupId.x + numGroups.x * (groupId.y + numGroups.y * groupId.z)] = sharedSums[0];
+	}
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// apply the pressure operator to the search direction. Works on the fine level only
+void PCGLaplacianComputeShader( uint3 i : SV_DispatchThreadID ) {
+	if (IsLevelObstacleCell(i)) {
+		multigridResult[i] = 0;
+		return;
+	}
+
+	uint3 dimensions = GetDimensionsFloat(pressure);
+
+	float sum, count;
+	SumFluidNeighbours(i, sum, count);
+
+	multigridResult[i] = sum - count * pressure[i];
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// sum the products of two fields over every thread group, the partial sums are added up by PCGComputeAlpha/BetaComputeShader
+void PCGDotProductComputeShader( uint3 i : SV_DispatchThreadID, uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex ) {
+	uint3 dimensions = GetDimensionsFloat(dotFirst);
+
+	float product = all(i < dimensions) ? dotFirst[i] * dotSecond[i] : 0.0f;
+	sharedSums[groupIndex] = float2(product, 0.0f);
+	ReduceSharedSums(groupIndex);
+
+	WriteGroupSum(dimensions, groupId, groupIndex);
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// sum the residual and count the fluid cells of every thread group, the partial sums are added up by PCGComputeMeanComputeShader
+void PCGResidualSumComputeShader( uint3 i : SV_DispatchThreadID, uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex ) {
+	uint3 dimensions = GetDimensionsFloat(dotFirst);
+
+	bool fluidCell = all(i < dimensions) && !IsObstacleCell(i);
+	sharedSums[groupIndex] = fluidCell ? float2(dotFirst[i], 1.0f) : float2(0.0f, 0.0f);
+	ReduceSharedSums(groupIndex);
+
+	WriteGroupSum(dimensions, groupId, groupIndex);
+}
+
+// Adds up every partial sum of pcgSums with a single thread group, the total ends up in sharedSums[0]
+void SumPartialSums(uint groupIndex) {
+	uint numSums, stride;
+	pcgSums.GetDimensions(numSums, stride);
+
+	float2 sum = float2(0.0f, 0.0f);
+	for (uint n = groupIndex; n < numSums; n += NUM_THREADS_X*NUM_THREADS_Y*NUM_THREADS_Z) {
+		sum += pcgSums[n];
+	}
+	sharedSums[groupIndex] = sum;
+	ReduceSharedSums(groupIndex);
+}
+
+[numthreads(NUM_THREADS_X*NUM_THREADS_Y*NUM_THREADS_Z, 1, 1)]
+// step length along the search direction from the direction dot its laplacian. Dispatched as a single group
+void PCGComputeAlphaComputeShader( uint groupIndex : SV_GroupIndex ) {
+	SumPartialSums(groupIndex);
+
+	if (groupIndex == 0) {
+		float directionDotLaplacian = sharedSums[0].x;
+		pcgScalarsResult[PCG_ALPHA] = directionDotLaplacian != 0.0f ? pcgScalarsResult[PCG_RESIDUAL_DOT_PRECONDITIONED] / directionDotLaplacian : 0.0f;
+	}
+}
+
+[numthreads(NUM_THREADS_X*NUM_THREADS_Y*NUM_THREADS_Z, 1, 1)]
+// weight of the previous search direction from the new residual dot its preconditioned version. Dispatched as a single group
+void PCGComputeBetaComputeShader( uint groupIndex : SV_GroupIndex ) {
+	SumPartialSums(groupIndex);
+
+	if (groupIndex == 0) {
+		float residualDotPreconditioned = sharedSums[0].x;
+		float previous = pcgScalarsResult[PCG_RESIDUAL_DOT_PRECONDITIONED];
+		pcgScalarsResult[PCG_BETA] = previous != 0.0f ? residualDotPreconditioned / previous : 0.0f;
+		pcgScalarsResult[PCG_RESIDUAL_DOT_PRECONDITIONED] = residualDotPreconditioned;
+	}
+}
+
+[numthreads(NUM_THREADS_X*NUM_THREADS_Y*NUM_THREADS_Z, 1, 1)]
+// mean of the residual over the fluid cells. Starts a new solve, so the previous residual dot product is cleared as well.
+// Dispatched as a single group
+void PCGComputeMeanComputeShader( uint groupIndex : SV_GroupIndex ) {
+	SumPartialSums(groupIndex);
+
+	if (groupIndex == 0) {
+		float2 total = sharedSums[0];
+		pcgScalarsResult[PCG_MEAN] = total.y > 0.0f ? total.x / total.y : 0.0f;
+		pcgScalarsResult[PCG_RESIDUAL_DOT_PRECONDITIONED] = 0.0f;
+	}
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// subtract the mean from the fluid cells of the residual in place
+void PCGRemoveMeanComputeShader( uint3 i : SV_DispatchThreadID ) {
+	if (IsObstacleCell(i)) {
+		return;
+	}
+	pcgTargetInPlace[i] -= pcgScalars[PCG_MEAN];
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// step the pressure along the search direction and update the residual to match
+void PCGUpdateSolutionComputeShader( uint3 i : SV_DispatchThreadID ) {
+	float alpha = pcgScalars[PCG_ALPHA];
+	pressureInPlace[i] += alpha * pcgDirection[i];
+	pcgResidualInPlace[i] -= alpha * pcgLaplacian[i];
+}
+
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)]
+// new search direction from the preconditioned residual and the previous direction, updated in place
+void PCGUpdateDirectionComputeShader( uint3 i : SV_DispatchThreadID ) {
+	pcgTargetInPlace[i] = pcgPreconditioned[i] + pcgScalars[PCG_BETA] * pcgTargetInPlace[i];
+}
+
+// Moving a field onto a grid of another resolution, a cell of the coarser grid covers uResampleRatio cells of the finer one
+// along each axis
+
+// a coarse cell takes the average of the fine cells it covers, which keeps the total of the field
+#define RESTRICT_ENTRY_POINT(name, type, source, result) \
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)] \
+void name##ComputeShader( uint3 i : SV_DispatchThreadID ) { \
+	uint3 fineBase = i * uResampleRatio; \
+	type sum = 0; \
+	for (uint z = 0; z < uResampleRatio; ++z) { \
+		for (uint y = 0; y < uResampleRatio; ++y) { \
+			for (uint x = 0; x < uResampleRatio; ++x) { \
+				sum += source[fineBase + uint3(x, y, z)]; \
+			} \
+		} \
+	} \
+	result[i] = max(sum * fResampleScale / (uResampleRatio * uResampleRatio * uResampleRatio), fResampleMinimum); \
+}
+
+// weight of a coarse cell in the average of the interpolated values of the fine cells of its neighbour, whatever the ratio
+float ProlongWeight(int offset) {
+	return offset == 0 ? 0.75f : 0.125f;
+}
+
+// a fine cell interpolates the coarse field, then the fine cells of every coarse cell are moved by the same amount so
+// their average is the coarse value again. The sample points are kept inside the outermost coarse cell centres like
+// MultigridProlongComputeShader, so the neighbours past the border count as the cell itself
+#define PROLONG_ENTRY_POINT(name, type, source, result, getDimensions) \
+[numthreads(NUM_THREADS_X, NUM_THREADS_Y, NUM_THREADS_Z)] \
+void name##ComputeShader( uint3 i : SV_DispatchThreadID ) { \
+	int3 coarseDimensions = int3(getDimensions(source)); \
+	int3 coarse = int3(i / uResampleRatio); \
+	float3 coarsePos = clamp((i + 0.5f) / uResampleRatio, 0.5f, coarseDimensions - 0.5f) / coarseDimensions; \
+	type interpolated = source.SampleLevel(linearSampler, coarsePos, 0); \
+	type averageInterpolated = 0; \
+	[unroll] \
+	for (int z = -1; z <= 1; ++z) { \
+		[unroll] \
+		for (int y = -1; y <= 1; ++y) { \
+			[unroll] \
+			for (int x = -1; x <= 1; ++x) { \
+				int3 neighbour = clamp(coarse + int3(x, y, z), 0, coarseDimensions - 1); \
+				averageInterpolated += ProlongWeight(x) * ProlongWeight(y) * ProlongWeight(z) * source[uint3(neighbour)]; \
+			} \
+		} \
+	} \
+	result[i] = max((interpolated + source[uint3(coarse)] - averageInterpolated) * fResampleScale, fResampleMinimum); \
+}
 
-	obstaclesResult[i] = obstacle;
-}
\ No newline at end of file
+RESTRICT_ENTRY_POINT(RestrictVector, float3, resampleVectorSource, resampleVectorResult)
+RESTRICT_ENTRY_POINT(RestrictScalar, float, resampleScalarSource, resampleScalarResult)
+PROLONG_ENTRY_POINT(ProlongVector, float3, resampleVectorSource, resampleVectorResult, GetDimensionsFloat3)
+PROLONG_ENTRY_POINT(ProlongScalar, float, resampleScalarSource, resampleScalarResult, GetDimensionsFloat)
\ No newline at end of file
@@ -11,6 +11,17 @@ Date: 19/02/2014
 #include "../D3DGraphicsObject.h"
 #include "../../objects/Transform.h"
 
+void InstanceSettings::GetTextureAxes(Vector2 &axisX, Vector2 &axisZ) const {
+	// turned a quarter at a time after the mirroring
+	axisX = Vector2(mirrored ? -1.0f : 1.0f, 0.0f);
+	axisZ = Vector2(0.0f, 1.0f);
+	int turns = ((quarterTurns % 4) + 4) % 4;
+	for (int i = 0; i < turns; ++i) {
+		axisX = Vector2(-axisX.y, axisX.x);
+		axisZ = Vector2(-axisZ.y, axisZ.x);
+	}
+}
+
 SmokeRenderShader::SmokeRenderShader(const D3DGraphicsObject * const d3dGraphicsObject) : 
 	pD3dGraphicsObject(d3dGraphicsObject), pVolumeValuesTexture(nullptr) {
 }
@@ -117,11 +128,33 @@ void SmokeRenderShader::SetSmokeProperties(const RenderSettings &renderSettings)
 	// Set the buffer inside the pixel shader
 }
 
+void SmokeRenderShader::SetInstanceProperties(const InstanceSettings &instanceSettings) const {
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	PixelInstanceBuffer* dataPtr;
+
+	ID3D11DeviceContext *context = pD3dGraphicsObject->GetDeviceContext();
+
+	HRESULT result = context->Map(mPixelInstanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	if(FAILED(result)) {
+		throw std::runtime_error(std::string("VolumeRenderShader: failed to map buffer in SetInstanceProperties function"));
+	}
+
+	Vector2 axisX, axisZ;
+	instanceSettings.GetTextureAxes(axisX, axisZ);
+
+	dataPtr = (PixelInstanceBuffer*)mappedResource.pData;
+	dataPtr->vInstanceAxes = Vector4(axisX.x, axisX.y, axisZ.x, axisZ.y);
+	dataPtr->fNoiseSeed = instanceSettings.noiseSeed;
+	dataPtr->fNoiseStrength = instanceSettings.noiseStrength;
+
+	context->Unmap(mPixelInstanceBuffer,0);
+}
+
 void SmokeRenderShader::BindShaderResources(_In_ ID3D11DeviceContext* deviceContext) {
 	deviceContext->PSSetShaderResources(0, 1, &pVolumeValuesTexture);
 
-	ID3D11Buffer *const pPixelBuffers[3] = {mPixelBufferPerFrame, mPixelBufferPerObject, mPixelRenderSettingsBuffer};
-	deviceContext->PSSetConstantBuffers(0,3,pPixelBuffers);
+	ID3D11Buffer *const pPixelBuffers[4] = {mPixelBufferPerFrame, mPixelBufferPerObject, mPixelRenderSettingsBuffer, mPixelInstanceBuffer};
+	deviceContext->PSSetConstantBuffers(0,4,pPixelBuffers);
 
 	deviceContext->VSSetConstantBuffers(0, 1, &(mVertexInputBuffer.p));
 }
@@ -151,6 +184,12 @@ bool SmokeRenderShader::SpecificInitialization(ID3D11Device* device) {
 		return false;
 	}
 
+	// Create the pixel instance buffer
+	result = BuildDynamicBuffer<PixelInstanceBuffer>(device, &mPixelInstanceBuffer);
+	if (!result) {
+		return false;
+	}
+
 	return true;
 }
 
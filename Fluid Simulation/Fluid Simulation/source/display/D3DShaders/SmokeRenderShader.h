@@ -24,6 +24,20 @@ struct RenderSettings {
 		vSmokeColor(color), fSmokeAbsorption(smokeAbsorption), fFireAbsorption(fireAbsorption), iNumSamples(numSamples) {}
 };
 
+// What sets a renderer apart from the others showing the same fluid
+struct InstanceSettings {
+	int timeOffset;			// frames back in the history of the fluid the renderer shows it
+	int quarterTurns;		// of the volume around its vertical axis, best kept even unless the volume is as deep as it is wide
+	bool mirrored;			// along the x axis, before the turns
+	float noiseSeed;
+	float noiseStrength;	// how far the noise displaces the samples, as a part of the volume. 0 turns it off
+
+	InstanceSettings() : timeOffset(0), quarterTurns(0), mirrored(false), noiseSeed(0.0f), noiseStrength(0.0f) {}
+
+	// Where the x and z axes of the volume land in texture space once mirrored and turned
+	void GetTextureAxes(Vector2 &axisX, Vector2 &axisZ) const;
+};
+
 class SmokeRenderShader : public BaseD3DShader {
 public:
 	SmokeRenderShader(const D3DGraphicsObject * const d3dGraphicsObject);
@@ -33,6 +47,7 @@ public:
 	void SetTransform(const Transform &transform) const;
 	void SetCameraPosition(const Vector3 &camPos) const;
 	void SetSmokeProperties(const RenderSettings &renderSettings) const;
+	void SetInstanceProperties(const InstanceSettings &instanceSettings) const;
 
 	void SetVolumeValuesTexture(ID3D11ShaderResourceView *volumeValues);
 
@@ -68,10 +83,19 @@ private:
 		float padding;
 	};
 
+	struct PixelInstanceBuffer {
+		Vector4 vInstanceAxes;
+
+		float fNoiseSeed;
+		float fNoiseStrength;
+		Vector2 padding4;
+	};
+
 	CComPtr<ID3D11Buffer>		mVertexInputBuffer;
 	CComPtr<ID3D11Buffer>		mPixelBufferPerFrame;
 	CComPtr<ID3D11Buffer>		mPixelBufferPerObject;
 	CComPtr<ID3D11Buffer>		mPixelRenderSettingsBuffer;
+	CComPtr<ID3D11Buffer>		mPixelInstanceBuffer;
 
 	ID3D11ShaderResourceView *  pVolumeValuesTexture;
 };
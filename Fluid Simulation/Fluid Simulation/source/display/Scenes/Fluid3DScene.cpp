@@ -18,6 +18,7 @@ Date: 24/10/2013
 #include "../../system/ServiceProvider.h"
 #include "../../objects/VolumeRenderer.h"
 #include "../simulations/FluidSimulation.h"
+#include "../simulations/FluidScheduler.h"
 #include "../../objects/SkyObject.h"
 #include "../../objects/TerrainObject.h"
 #include "../../objects/ModelGameObject.h"
@@ -86,14 +87,31 @@ bool Fluid3DScene::Initialize(_In_ IGraphicsObject* graphicsObject, HWND hwnd) {
 	return result;
 }
 
-bool Fluid3DScene::InitSimulations(HWND hwnd) {
-
+FluidSettings Fluid3DScene::CreateSmokeSettings() {
 	FluidSettings fluidSettingsSmoke(SMOKE);
 	fluidSettingsSmoke.dimensions = Vector3(64,128,64);
 	fluidSettingsSmoke.densityDissipation = 0.99f;
 	fluidSettingsSmoke.densityWeight = 0.15f;
 	fluidSettingsSmoke.densityBuoyancy = 0.9f;
 	fluidSettingsSmoke.constantInputPosition = Vector3(0.5f, 0.02f, 0.5f);
+	return fluidSettingsSmoke;
+}
+
+FluidSettings Fluid3DScene::CreateFireSettings() {
+	FluidSettings fluidSettingsFire(FIRE);
+	fluidSettingsFire.densityDissipation = 0.992f;
+	fluidSettingsFire.constantReactionAmount = 0.95f;
+	fluidSettingsFire.reactionDecay = 0.009f;
+	fluidSettingsFire.reactionExtinguishment = 0.03f;
+	fluidSettingsFire.vorticityStrength = 0.95f;
+	fluidSettingsFire.dimensions = Vector3(40,80,40);
+	fluidSettingsFire.constantInputPosition = Vector3(0.5f,0.07f,0.5f);
+	return fluidSettingsFire;
+}
+
+bool Fluid3DScene::InitSimulations(HWND hwnd) {
+
+	FluidSettings fluidSettingsSmoke = CreateSmokeSettings();
 
 	auto volumeRendererSmoke = make_shared<VolumeRenderer>();
 	volumeRendererSmoke->transform->scale = Vector3(4,8,4);
@@ -102,20 +120,15 @@ bool Fluid3DScene::InitSimulations(HWND hwnd) {
 
 	auto smokeFluidSim = make_shared<FluidSimulation>(fluidSettingsSmoke);
 	smokeFluidSim->AddVolumeRenderer(volumeRendererSmoke);
+	smokeFluidSim->SetStateFile(L"data/SmokeState.fluidstate");
 	mSimulations.push_back(smokeFluidSim);
 
-	FluidSettings fluidSettingsFire(FIRE);
-	fluidSettingsFire.densityDissipation = 0.992f;
-	fluidSettingsFire.constantReactionAmount = 0.95f;
-	fluidSettingsFire.reactionDecay = 0.009f;
-	fluidSettingsFire.reactionExtinguishment = 0.03f;
-	fluidSettingsFire.vorticityStrength = 0.95f;
-	fluidSettingsFire.dimensions = Vector3(40,80,40);
-	fluidSettingsFire.constantInputPosition = Vector3(0.5f,0.07f,0.5f);
+	FluidSettings fluidSettingsFire = CreateFireSettings();
 	auto fireFluidSim = make_shared<FluidSimulation>(fluidSettingsFire);
+	fireFluidSim->SetStateFile(L"data/FireState.fluidstate");
 	mSimulations.push_back(fireFluidSim);
 
-	// two fire simulations using one calculator
+	// two fire simulations using one calculator, the second one a few frames behind and turned around so they differ
 	for (int i = 0; i < 2; ++i) {
 		auto volumeRendererFire = make_shared<VolumeRenderer>();
 		volumeRendererFire->transform->scale = Vector3(1,2,1);
@@ -124,6 +137,13 @@ bool Fluid3DScene::InitSimulations(HWND hwnd) {
 
 		auto smokeProperties = volumeRendererFire->GetRenderSettings();
 		smokeProperties->vSmokeColor = RGBA2Color(40,40,40,255);
+
+		auto instanceProperties = volumeRendererFire->GetInstanceSettings();
+		instanceProperties->timeOffset = i * 4;
+		instanceProperties->quarterTurns = i * 2;
+		instanceProperties->mirrored = i == 1;
+		instanceProperties->noiseSeed = (float)i;
+		instanceProperties->noiseStrength = 0.01f;
 		
 		fireFluidSim->AddVolumeRenderer(volumeRendererFire);
 		mVolumeRenderers.push_back(volumeRendererFire);
@@ -136,13 +156,20 @@ bool Fluid3DScene::InitSimulations(HWND hwnd) {
 	fluidSettingsSmoke.dimensions = Vector3(30,60,30);
 	fluidSettingsSmoke.constantInputPosition = Vector3(0.5f, 0.05f, 0.5f);
 	auto smallFireFluidSim = make_shared<FluidSimulation>(fluidSettingsSmoke);
+	smallFireFluidSim->SetStateFile(L"data/SmallFireState.fluidstate");
 	mSimulations.push_back(smallFireFluidSim);
-	// three fire simulations using one calculator
+	// three fire simulations using one calculator, each at another point of its history and turned another way
 	for (int i = 0; i < 3; ++i) {
 		auto volumeRendererFire = make_shared<VolumeRenderer>();
 		volumeRendererFire->transform->scale = Vector3(1,2,1);
 		Vector3 pos;
 		auto smokeProperties = volumeRendererFire->GetRenderSettings();
+		auto instanceProperties = volumeRendererFire->GetInstanceSettings();
+		instanceProperties->timeOffset = i * 3;
+		instanceProperties->quarterTurns = i;
+		instanceProperties->mirrored = i == 2;
+		instanceProperties->noiseSeed = (float)i;
+		instanceProperties->noiseStrength = 0.01f;
 		if (i == 0) {
 			pos = Vector3(-5.0f, 6.28f, 19.5f);
 			smokeProperties->fSmokeAbsorption = 40.0f;
@@ -164,11 +191,21 @@ bool Fluid3DScene::InitSimulations(HWND hwnd) {
 		mVolumeRenderers.push_back(volumeRendererFire);
 	}
 
+	// the house and the fountains are obstacles of every simulation, each one leaves out the boxes that miss its first
+	// volume or cover its input
+	for (auto & simulation : mSimulations) {
+		for (auto & modelObject : mModelObjects) {
+			simulation->AddObstacle(modelObject);
+		}
+	}
+
+	mFluidScheduler = unique_ptr<FluidScheduler>(new FluidScheduler());
 	for (auto & simulation : mSimulations) {
 		bool result = simulation->Initialize(pD3dGraphicsObj, hwnd);
 		if (!result) {
 			return false;
 		}
+		mFluidScheduler->AddSimulation(simulation);
 	}
 
 	return true;
@@ -269,11 +306,7 @@ void Fluid3DScene::Update(float delta) {
 void Fluid3DScene::FixedUpdate(float fixedDelta) {
 	const ICamera &camera = *mCamera;
 	if (!mPaused) {
-		for (auto & fluidSim : mSimulations) {
-			if (fluidSim->Update(fixedDelta, camera)) {
-				++mNumFluidsUpdating;
-			}
-		}
+		mNumFluidsUpdating += mFluidScheduler->Update(camera);
 	}
 }
 
@@ -416,6 +449,7 @@ void Fluid3DScene::HandleMousePicking(bool interaction) {
 			if (pickedRenderer != nullptr) {
 				pPickedRenderer = pickedRenderer;
 				pickedSim->DisplayInfoOnBar(mTwBar);
+				mFluidScheduler->DisplayInfoOnBar(mTwBar);
 				pickedRenderer->DisplayRenderInfoOnBar(mTwBar);
 				string command = " '" + barName + "' visible=true ";
 				TwDefine(command.c_str());
@@ -19,12 +19,14 @@ class AutoCameraController;
 class D3DGraphicsObject;
 class InputSystem;
 class FluidSimulation;
+class FluidScheduler;
 class SkyObject;
 class ModelGameObject;
 class TerrainObject;
 class VolumeRenderer;
 class Transform;
 struct CTwBar;
+struct FluidSettings;
 
 using namespace std;
 
@@ -43,6 +45,10 @@ public:
 	bool Render();
 	void RenderOverlay(std::shared_ptr<DirectX::SpriteBatch> spriteBatch, std::shared_ptr<DirectX::SpriteFont> spriteFont);
 
+	// Settings of the large smoke column and the campfires used by this scene
+	static FluidSettings CreateSmokeSettings();
+	static FluidSettings CreateFireSettings();
+
 private:
 	bool InitSimulations(HWND hwnd);
 	void InitGameObjects();
@@ -62,6 +68,7 @@ private:
 
 	shared_ptr<VolumeRenderer> pPickedRenderer;
 	vector<shared_ptr<FluidSimulation>> mSimulations;
+	unique_ptr<FluidScheduler> mFluidScheduler;
 
 	D3DGraphicsObject* pD3dGraphicsObj;
 
@@ -0,0 +1,67 @@
+/********************************************************************
+FluidScheduler.cpp: Implementation of FluidScheduler
+
+Author:	Valentin Hinov
+Date: 11/5/2014
+*********************************************************************/
+
+#include "FluidScheduler.h"
+#include <algorithm>
+#include <AntTweakBar.h>
+#include "FluidSimulation.h"
+
+using namespace std;
+
+#define FLUID_BUDGET_MILLISECONDS 8.0f
+// Added to the priority of every simulation, so one out of view still ages while it is skipped and gets stepped on spare budget
+#define MIN_FLUID_PRIORITY 0.05f
+
+FluidScheduler::FluidScheduler() : budgetMilliseconds(FLUID_BUDGET_MILLISECONDS), mScheduledMilliseconds(0.0f), mSimulationsStepped(0) {
+
+}
+
+void FluidScheduler::AddSimulation(std::shared_ptr<FluidSimulation> simulation) {
+	mSimulations.push_back(simulation);
+}
+
+int FluidScheduler::Update(const ICamera &camera) {
+	mCandidates.clear();
+	for (auto &simulation : mSimulations) {
+		simulation->UpdateLOD(camera);
+
+		// every frame a simulation waits makes it more urgent
+		Candidate candidate;
+		candidate.simulation = simulation.get();
+		candidate.urgency = (simulation->GetPriority() + MIN_FLUID_PRIORITY) * (simulation->GetFramesSkipped() + 1);
+		candidate.cost = simulation->EstimateStepCost();
+		candidate.mustStep = simulation->MustCatchUp();
+		mCandidates.push_back(candidate);
+	}
+
+	sort(mCandidates.begin(), mCandidates.end(), [](const Candidate &first, const Candidate &second) {
+		return first.urgency > second.urgency;
+	});
+
+	mScheduledMilliseconds = 0.0f;
+	mSimulationsStepped = 0;
+	for (size_t i = 0; i < mCandidates.size(); ++i) {
+		const Candidate &candidate = mCandidates[i];
+		if (i > 0 && !candidate.mustStep && mScheduledMilliseconds + candidate.cost > budgetMilliseconds) {
+			candidate.simulation->SkipFrame();
+			continue;
+		}
+
+		mScheduledMilliseconds += candidate.cost;
+		if (candidate.simulation->Step()) {
+			++mSimulationsStepped;
+		}
+	}
+
+	return mSimulationsStepped;
+}
+
+void FluidScheduler::DisplayInfoOnBar(CTwBar * const pBar) {
+	TwAddVarRW(pBar, "Fluid Budget ms", TW_TYPE_FLOAT, &budgetMilliseconds, "min=0.0 step=0.5 group=Scheduler");
+	TwAddVarRO(pBar, "Scheduled ms", TW_TYPE_FLOAT, &mScheduledMilliseconds, "precision=2 group=Scheduler");
+	TwAddVarRO(pBar, "Simulations Stepped", TW_TYPE_INT32, &mSimulationsStepped, "group=Scheduler");
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+/********************************************************************
+FluidScheduler.h: Shares a per frame time budget between the fluid
+simulations of a scene.
+
+Every frame the simulations are ranked by their LOD priority, which
+grows with every frame a simulation is skipped so none of them
+starve. The simulations are stepped in that order as long as their
+estimated step cost fits in the budget, the rest skip the frame and
+make its time up when they are next stepped. The most urgent
+simulation is always stepped, even if it alone goes over the budget,
+and so is any simulation that has skipped as many frames as its next
+step can make up. Simulations out of view rank lowest, they are
+stepped on spare budget or once they cannot skip any longer.
+
+Author:	Valentin Hinov
+Date: 11/5/2014
+*********************************************************************/
+
+#ifndef _FLUIDSCHEDULER_H
+#define _FLUIDSCHEDULER_H
+
+#include <memory>
+#include <vector>
+
+class FluidSimulation;
+class ICamera;
+struct CTwBar;
+
+class FluidScheduler {
+public:
+	FluidScheduler();
+
+	void AddSimulation(std::shared_ptr<FluidSimulation> simulation);
+
+	// Steps the simulations that fit in the budget this frame and skips the others. Returns the number stepped
+	int Update(const ICamera &camera);
+
+	void DisplayInfoOnBar(CTwBar * const pBar);
+
+public:
+	float budgetMilliseconds;	// of fluid steps per frame
+
+private:
+	struct Candidate {
+		FluidSimulation *simulation;
+		float urgency;
+		float cost;		// estimated milliseconds
+		bool mustStep;	// stepped even over the budget, another skipped frame would be lost
+	};
+
+	std::vector<std::shared_ptr<FluidSimulation>> mSimulations;
+	std::vector<Candidate> mCandidates;
+
+	// Last frame
+	float mScheduledMilliseconds;
+	int mSimulationsStepped;
+};
+
+#endif
\ No newline at end of file
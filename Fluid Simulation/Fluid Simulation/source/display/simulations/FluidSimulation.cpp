@@ -9,6 +9,8 @@ Date: 3/3/2014
 #include "FluidSimulation.h"
 #include <AntTweakBar.h>
 #include "../../objects/VolumeRenderer.h"
+#include "../../objects/BoxCollider.h"
+#include "../../objects/ModelGameObject.h"
 #include "../../utilities/FluidCalculation/Fluid3DCalculator.h"
 #include "../../utilities/ICamera.h"
 #include "../../utilities/D3DTexture.h"
@@ -18,15 +20,39 @@ using namespace DirectX;
 using namespace Fluid3D;
 
 #define UPDATES_BEFORE_LOD 150
+// weight of the latest step in the smoothed step time
+#define STEP_TIME_SMOOTHING 0.1f
+#define ADAPTIVE_RESOLUTION true
+// how far the LOD has to climb back above the threshold of a tier before the finer tier is used again
+#define RESOLUTION_TIER_HYSTERESIS 0.05f
+#define SCALED_SOLVER_EFFORT true
+
+// LOD below which each tier drops to the next coarser one
+static const float resolutionTierThresholds[NUM_RESOLUTION_TIERS - 1] = {0.3f, 0.1f};
 
 static D3DTexture fireTexture;
+static TwType stageTimingsTwType = TW_TYPE_UNDEF;
 
 void InitFireTexture(D3DGraphicsObject * d3dGraphicsObj) {
 	fireTexture.Initialize(d3dGraphicsObj->GetDevice(), d3dGraphicsObj->GetDeviceContext(), L"data/FireTransferFunction2.dds");
 }
 
+TwType GetStageTimingsTwType() {
+	if (stageTimingsTwType == TW_TYPE_UNDEF) {
+		TwStructMember stageTimingsMembers[] = {
+			{ "Min ms", TW_TYPE_FLOAT, offsetof(StageTimings, minMilliseconds), "precision=3" },
+			{ "Avg ms", TW_TYPE_FLOAT, offsetof(StageTimings, averageMilliseconds), "precision=3" },
+			{ "P99 ms", TW_TYPE_FLOAT, offsetof(StageTimings, p99Milliseconds), "precision=3" },
+			{ "Samples", TW_TYPE_INT32, offsetof(StageTimings, samples), "" }
+		};
+		stageTimingsTwType = TwDefineStruct("StageTimingsType", stageTimingsMembers, 4, sizeof(StageTimings), nullptr, nullptr);
+	}
+	return stageTimingsTwType;
+}
+
 FluidSimulation::FluidSimulation(const FluidSettings &fluidSettings) : mUpdateEnabled(true), mIsVisible(true), mRenderEnabled(true),
-	mFramesSinceLastProcess(0), mFluidUpdatesSinceStart(0), mFramesToSkip(2)
+	mFramesSinceLastProcess(0), mFluidUpdatesSinceStart(0), mPriority(1.0f), mStepMilliseconds(0.0f),
+	mAdaptiveResolution(ADAPTIVE_RESOLUTION), mResolutionTier(0), mScaledSolverEffort(SCALED_SOLVER_EFFORT)
 {
 	mFluidCalculator = make_shared<Fluid3DCalculator>(fluidSettings);
 }
@@ -42,11 +68,17 @@ void FluidSimulation::AddVolumeRenderer(std::shared_ptr<VolumeRenderer> volumeRe
 bool FluidSimulation::Initialize(_In_ D3DGraphicsObject * d3dGraphicsObj, HWND hwnd) {
 	bool result;
 
+	UpdateHistoryLength();
 	result = mFluidCalculator->Initialize(d3dGraphicsObj, hwnd);
 	if (!result) {
 		return false;
 	}
 
+	// a simulation loaded from a state has already developed
+	if (!mStateFile.empty() && mFluidCalculator->LoadState(mStateFile)) {
+		mFluidUpdatesSinceStart = UPDATES_BEFORE_LOD;
+	}
+
 	const FluidSettings &settings = mFluidCalculator->GetFluidSettings();
 	for (auto volumeRenderer : mVolumeRenderers) {
 		result = volumeRenderer->Initialize(d3dGraphicsObj, hwnd, settings.GetFluidType());
@@ -66,33 +98,121 @@ bool FluidSimulation::Initialize(_In_ D3DGraphicsObject * d3dGraphicsObj, HWND h
 		volumeRenderer->Update();
 	}
 
+	mLODControllers.resize(mVolumeRenderers.size());
+	for (size_t i = 0; i < mVolumeRenderers.size(); ++i) {
+		mLODControllers[i].SetObjectBoundingBox(mVolumeRenderers[i]->bounds->GetBoundingBox());
+	}
+
 	return true;
 }
 
+void FluidSimulation::SetStateFile(const std::wstring &path) {
+	mStateFile = path;
+}
 
-bool FluidSimulation::Update(float dt, const ICamera &camera) {
-	bool skipFrames = !IsSimulationVisible(camera);
-	bool canUpdate = true;
+void FluidSimulation::SaveState() {
+	if (mFluidCalculator->SetResolutionTier(0)) {
+		mResolutionTier = 0;
+		UpdateRendererTextures();
+	}
+	mFluidCalculator->SaveState(mStateFile);
+}
 
-	// do not do frame skipping until simulation has developed a bit
-	if (skipFrames) {
-		if (mFluidUpdatesSinceStart < UPDATES_BEFORE_LOD) {
-			mFluidUpdatesSinceStart++;
-		}
-		else {
-			canUpdate = mFramesToSkip <= 0 || mFramesSinceLastProcess > mFramesToSkip;
-		}
+void FluidSimulation::AddObstacle(std::shared_ptr<BoxCollider> collider) {
+	mObstacleColliders.push_back(collider);
+}
+
+void FluidSimulation::AddObstacle(std::shared_ptr<ModelGameObject> model) {
+	mObstacleModels.push_back(model);
+}
+
+void FluidSimulation::UpdateLOD(const ICamera &camera) {
+	mPriority = 0.0f;
+	if (!IsSimulationVisible(camera)) {
+		return;
+	}
+	for (LODController &lodController : mLODControllers) {
+		lodController.CalculateOverallLOD(camera);
+		mPriority = Max(mPriority, lodController.overallLOD);
 	}
+}
 
-	if (canUpdate && mUpdateEnabled) {
-		mFluidCalculator->Process();
-		mFramesSinceLastProcess = 0;
-	} 
-	else {
-		++mFramesSinceLastProcess;
+float FluidSimulation::GetPriority() const {
+	return IsDeveloping() ? 1.0f : mPriority;
+}
+
+bool FluidSimulation::MustCatchUp() const {
+	if (!mUpdateEnabled || mFluidCalculator->GetFluidActivityStats().sleeping) {
+		return false;
 	}
 
-	return canUpdate;
+	// a Step makes up at most maxSubsteps steps of maxTimeStep, or of timeStep if that is longer
+	const FluidSettings &settings = mFluidCalculator->GetFluidSettings();
+	if (settings.timeStep <= 0.0f) {
+		return false;
+	}
+	float catchUpTime = Max(settings.maxSubsteps, 1) * Max(settings.maxTimeStep, settings.timeStep);
+	int catchUpFrames = Max((int)(catchUpTime / settings.timeStep), 1);
+	return mFramesSinceLastProcess + 2 > catchUpFrames;
+}
+
+float FluidSimulation::EstimateStepCost() const {
+	if (!mUpdateEnabled || mFluidCalculator->GetFluidActivityStats().sleeping) {
+		return 0.0f;
+	}
+
+	// the GPU runs behind the calls that queue its work, so its own timings are used when there are any
+	const StageTimings &stepTimings = mFluidCalculator->GetStageProfiler().GetStageTimings(STAGE_STEP);
+	float stepMilliseconds = stepTimings.samples > 0 ? stepTimings.averageMilliseconds : mStepMilliseconds;
+
+	// skipped frames are made up in steps of up to maxTimeStep
+	const FluidSettings &settings = mFluidCalculator->GetFluidSettings();
+	float pendingTime = settings.timeStep * (mFramesSinceLastProcess + 1);
+	int steps = settings.maxTimeStep > 0.0f ? (int)ceil(pendingTime / settings.maxTimeStep) : 1;
+	steps = Clamp(steps, 1, Max(settings.maxSubsteps, 1));
+
+	return stepMilliseconds * steps;
+}
+
+int FluidSimulation::GetFramesSkipped() const {
+	return mFramesSinceLastProcess;
+}
+
+bool FluidSimulation::Step() {
+	if (!mUpdateEnabled) {
+		return false;
+	}
+
+	UpdateResolutionTier();
+	UpdateHistoryLength();
+	mFluidCalculator->SetSolverProfile(ChooseSolverProfile());
+	UpdateObstacles();
+
+	LARGE_INTEGER frequency, start, end;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&start);
+	// a sleeping fluid or a frame carried over to the next one takes no steps
+	int steps = mFluidCalculator->Process(mFramesSinceLastProcess + 1);
+	QueryPerformanceCounter(&end);
+	UpdateRendererTextures();
+
+	mFluidCalculator->GetStageProfiler().Collect();
+	mFramesSinceLastProcess = 0;
+	if (steps == 0) {
+		return false;
+	}
+
+	float stepMilliseconds = (float)((end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart) / steps;
+	mStepMilliseconds = mStepMilliseconds > 0.0f ? Lerp(mStepMilliseconds, stepMilliseconds, STEP_TIME_SMOOTHING) : stepMilliseconds;
+	mFluidUpdatesSinceStart = Min(mFluidUpdatesSinceStart + steps, UPDATES_BEFORE_LOD);
+	return true;
+}
+
+void FluidSimulation::SkipFrame() {
+	// the time a disabled simulation does not update for is not made up
+	if (mUpdateEnabled) {
+		++mFramesSinceLastProcess;
+	}
 }
 
 void FluidSimulation::FluidInteraction(const Ray &ray) {
@@ -109,6 +229,80 @@ void FluidSimulation::FluidInteraction(const Ray &ray) {
 	}*/
 }
 
+void FluidSimulation::UpdateObstacles() {
+	if ((mObstacleColliders.empty() && mObstacleModels.empty()) || mVolumeRenderers.empty()) {
+		return;
+	}
+
+	// gather the boxes in world space first
+	vector<ObstacleBox> worldBoxes;
+	for (auto collider : mObstacleColliders) {
+		Vector3 localAxes[3];
+		collider->GetLocalRotationVectors(localAxes);
+		const Vector3 &extents = collider->GetExtents();
+
+		ObstacleBox box;
+		box.centre = collider->GetCenter();
+		box.halfAxes[0] = localAxes[0] * extents.x;
+		box.halfAxes[1] = localAxes[1] * extents.y;
+		box.halfAxes[2] = localAxes[2] * extents.z;
+		worldBoxes.push_back(box);
+	}
+	for (auto model : mObstacleModels) {
+		Matrix worldMatrix;
+		model->transform->GetTransformMatrixQuaternion(worldMatrix);
+		for (auto mesh : model->GetModel()->meshes) {
+			const BoundingBox &meshBox = mesh->boundingBox;
+
+			ObstacleBox box;
+			box.centre = Vector3::Transform(Vector3(meshBox.Center), worldMatrix);
+			box.halfAxes[0] = Vector3::TransformNormal(Vector3(meshBox.Extents.x, 0.0f, 0.0f), worldMatrix);
+			box.halfAxes[1] = Vector3::TransformNormal(Vector3(0.0f, meshBox.Extents.y, 0.0f), worldMatrix);
+			box.halfAxes[2] = Vector3::TransformNormal(Vector3(0.0f, 0.0f, meshBox.Extents.z), worldMatrix);
+			worldBoxes.push_back(box);
+		}
+	}
+
+	// The renderers of a simulation all show the one grid, so the boxes are voxelized around the first volume only, in
+	// its (0,0,0) to (1,1,1) range and turned into texture space the way it samples the grid. An obstacle near any of
+	// the others would carve the grid under all of them. The ids follow the order of the boxes, so they stay the same
+	// between steps even when a box is left out
+	shared_ptr<VolumeRenderer> referenceRenderer = mVolumeRenderers.front();
+	Matrix toVolume;
+	referenceRenderer->transform->GetTransformMatrixQuaternion(toVolume);
+	toVolume = toVolume.Invert();
+	Vector2 textureAxisX, textureAxisZ;
+	referenceRenderer->GetInstanceSettings()->GetTextureAxes(textureAxisX, textureAxisZ);
+	auto toTexture = [&](const Vector3 &v) {
+		return Vector3(v.x * textureAxisX.x + v.z * textureAxisZ.x, v.y, v.x * textureAxisX.y + v.z * textureAxisZ.y);
+	};
+
+	const FluidSettings &fluidSettings = mFluidCalculator->GetFluidSettings();
+	mObstacleBoxes.clear();
+	unsigned int id = 0;
+	for (const ObstacleBox &worldBox : worldBoxes) {
+		ObstacleBox box;
+		box.id = id++;
+		box.centre = toTexture(Vector3::Transform(worldBox.centre, toVolume)) + Vector3(0.5f);
+		Vector3 reach(0.0f);
+		for (int axis = 0; axis < 3; ++axis) {
+			box.halfAxes[axis] = toTexture(Vector3::TransformNormal(worldBox.halfAxes[axis], toVolume));
+			reach += Vector3(fabs(box.halfAxes[axis].x), fabs(box.halfAxes[axis].y), fabs(box.halfAxes[axis].z));
+		}
+
+		// the bounding box of a whole mesh is coarse, one around the base of the fire or the chimney under the smoke
+		// would cover the input and put it out
+		Vector3 low = box.centre - reach;
+		Vector3 high = box.centre + reach;
+		bool inVolume = high.x >= 0.0f && high.y >= 0.0f && high.z >= 0.0f && low.x <= 1.0f && low.y <= 1.0f && low.z <= 1.0f;
+		if (inVolume && !CoversConstantInput(box, fluidSettings, mFluidCalculator->GetDimensions())) {
+			mObstacleBoxes.push_back(box);
+		}
+	}
+
+	mFluidCalculator->SetObstacles(mObstacleBoxes);
+}
+
 Vector3 FluidSimulation::GetLocalIntersectPosition(const Ray &ray, float distance) const {
 	/*Vector3 worldIntersectPos = ray.position + ray.direction * distance;
 	Matrix matrix;
@@ -134,6 +328,75 @@ std::shared_ptr<VolumeRenderer> FluidSimulation::IntersectsRay(const Ray &ray, f
 	return picked;
 }
 
+bool FluidSimulation::IsDeveloping() const {
+	return mFluidUpdatesSinceStart < UPDATES_BEFORE_LOD;
+}
+
+int FluidSimulation::ChooseResolutionTier() const {
+	if (!mAdaptiveResolution || IsDeveloping()) {
+		return 0;
+	}
+
+	int tier = mResolutionTier;
+	while (tier < NUM_RESOLUTION_TIERS - 1 && mPriority < resolutionTierThresholds[tier]) {
+		++tier;
+	}
+	while (tier > 0 && mPriority > resolutionTierThresholds[tier - 1] + RESOLUTION_TIER_HYSTERESIS) {
+		--tier;
+	}
+	while (tier > 0 && !mFluidCalculator->IsResolutionTierAvailable(tier)) {
+		--tier;
+	}
+	return tier;
+}
+
+void FluidSimulation::UpdateResolutionTier() {
+	int tier = ChooseResolutionTier();
+	if (tier == mResolutionTier || !mFluidCalculator->SetResolutionTier(tier)) {
+		return;
+	}
+	mResolutionTier = tier;
+	UpdateRendererTextures();
+
+	// the step costs of the old grid no longer apply
+	mFluidCalculator->GetStageProfiler().ClearTimings();
+	mStepMilliseconds = 0.0f;
+}
+
+void FluidSimulation::UpdateHistoryLength() {
+	int historyLength = 0;
+	for (auto volumeRenderer : mVolumeRenderers) {
+		historyLength = Max(historyLength, volumeRenderer->GetInstanceSettings()->timeOffset);
+	}
+	mFluidCalculator->SetHistoryLength(historyLength);
+}
+
+void FluidSimulation::UpdateRendererTextures() {
+	bool isFire = mFluidCalculator->GetFluidSettings().GetFluidType() == FIRE;
+	for (auto volumeRenderer : mVolumeRenderers) {
+		// the history moves on with every step, so the textures of a renderer behind the others change every step
+		int timeOffset = volumeRenderer->GetInstanceSettings()->timeOffset;
+		volumeRenderer->SetSourceTexture(mFluidCalculator->GetVolumeTexture(timeOffset));
+		if (isFire) {
+			volumeRenderer->SetReactionTexture(mFluidCalculator->GetReactionTexture(timeOffset));
+		}
+	}
+}
+
+SolverProfile FluidSimulation::ChooseSolverProfile() const {
+	if (!mScaledSolverEffort || IsDeveloping()) {
+		return SolverProfile();
+	}
+
+	const LODController *closest = nullptr;
+	for (const LODController &lodController : mLODControllers) {
+		if (closest == nullptr || lodController.overallLOD > closest->overallLOD) {
+			closest = &lodController;
+		}
+	}
+	return closest != nullptr ? closest->solverProfile : SolverProfile();
+}
+
 bool FluidSimulation::IsSimulationVisible(const ICamera &camera) const {
 	const BoundingFrustum &frustum = camera.GetBoundingFrustum();
 	for (auto renderer : mVolumeRenderers) {
@@ -158,7 +421,44 @@ void FluidSimulation::DisplayInfoOnBar(TwBar * const pBar) {
 	TwAddVarCB(pBar,"Simulation", settings->GetFluidSettingsTwType(), SetFluidSettings, GetFluidSettings, mFluidCalculator.get(), "");
 	TwAddVarRW(pBar,"Input Position", TW_TYPE_DIR3F, &settings->constantInputPosition, "group=Simulation");
 
-	TwAddVarRO(pBar, "Frames Skipped", TW_TYPE_INT32, &mFramesToSkip, nullptr);
+	if (!mStateFile.empty()) {
+		TwAddButton(pBar, "Save State", SaveStateCallback, this, nullptr);
+	}
+
+	TwAddVarRW(pBar, "Adaptive Resolution", TW_TYPE_BOOLCPP, &mAdaptiveResolution, nullptr);
+	TwAddVarRO(pBar, "Resolution Tier", TW_TYPE_INT32, &mResolutionTier, nullptr);
+	TwAddVarRW(pBar, "Scaled Solver Effort", TW_TYPE_BOOLCPP, &mScaledSolverEffort, nullptr);
+
+	const SolverProfile &solverProfile = mFluidCalculator->GetSolverProfile();
+	TwAddVarRO(pBar, "Pressure Effort", TW_TYPE_FLOAT, &solverProfile.pressureEffort, "precision=2");
+	TwAddVarRO(pBar, "MacCormack Advection", TW_TYPE_BOOLCPP, &solverProfile.macCormackAdvection, nullptr);
+	TwAddVarRO(pBar, "Vorticity Confinement", TW_TYPE_BOOLCPP, &solverProfile.vorticityConfinement, nullptr);
+
+	const PressureSolverStats &solverStats = mFluidCalculator->GetPressureSolverStats();
+	TwAddVarRO(pBar, "Pressure Iterations", TW_TYPE_INT32, &solverStats.iterationsUsed, nullptr);
+	TwAddVarRO(pBar, "Pressure Residual", TW_TYPE_FLOAT, &solverStats.residual, "precision=6");
+
+	const TimeStepPlan &timeStepPlan = mFluidCalculator->GetTimeStepPlan();
+	TwAddVarRO(pBar, "Time Steps", TW_TYPE_INT32, &timeStepPlan.steps, nullptr);
+	TwAddVarRO(pBar, "Step Length", TW_TYPE_FLOAT, &timeStepPlan.timeStep, "precision=4");
+
+	const FluidActivityStats &activityStats = mFluidCalculator->GetFluidActivityStats();
+	TwAddVarRO(pBar, "Sleeping", TW_TYPE_BOOLCPP, &activityStats.sleeping, nullptr);
+	TwAddVarRO(pBar, "Max Density", TW_TYPE_FLOAT, &activityStats.maxDensity, "precision=4");
+	TwAddVarRO(pBar, "Max Speed", TW_TYPE_FLOAT, &activityStats.maxSpeed, "precision=4");
+	TwAddVarRO(pBar, "Kinetic Energy", TW_TYPE_FLOAT, &activityStats.kineticEnergy, "precision=4");
+
+	const BrickOccupancyStats &brickStats = mFluidCalculator->GetBrickOccupancyStats();
+	TwAddVarRO(pBar, "Active Bricks", TW_TYPE_INT32, &brickStats.activeBricks, nullptr);
+	TwAddVarRO(pBar, "Processed Bricks", TW_TYPE_INT32, &brickStats.processedBricks, nullptr);
+	TwAddVarRO(pBar, "Processed %", TW_TYPE_FLOAT, &brickStats.processedPercentage, "precision=1");
+
+	// filled in while Profile Stages is on
+	const StageProfiler &stageProfiler = mFluidCalculator->GetStageProfiler();
+	for (int stage = 0; stage < NUM_PROFILER_STAGES; ++stage) {
+		const StageTimings &stageTimings = stageProfiler.GetStageTimings((ProfilerStage_t)stage);
+		TwAddVarRO(pBar, StageProfiler::GetStageName((ProfilerStage_t)stage), GetStageTimingsTwType(), &stageTimings, "group='Stage Timings'");
+	}
 }
 
 void TW_CALL FluidSimulation::GetFluidSettings(void *value, void *clientData) {
@@ -169,4 +469,8 @@ void TW_CALL FluidSimulation::SetFluidSettings(const void *value, void *clientDa
 	Fluid3DCalculator* fluidCalculator = static_cast<Fluid3DCalculator *>(clientData);
 	FluidSettings fluidSettings = *static_cast<const FluidSettings *>(value);
 	fluidCalculator->SetFluidSettings(fluidSettings);
+}
+
+void TW_CALL FluidSimulation::SaveStateCallback(void *clientData) {
+	static_cast<FluidSimulation *>(clientData)->SaveState();
 }
\ No newline at end of file
@@ -11,11 +11,15 @@ Date: 3/3/2014
 
 #include <memory>
 #include <vector>
+#include <string>
 #include "../../utilities/AtlInclude.h"
 #include "../D3DGraphicsObject.h"
 #include "../../utilities/FluidCalculation/FluidSettings.h"
+#include "LODController.h"
 
 class VolumeRenderer;
+class BoxCollider;
+class ModelGameObject;
 class ICamera;
 struct CTwBar;
 
@@ -29,12 +33,38 @@ public:
 	FluidSimulation(const FluidSettings &fluidSettings);
 	~FluidSimulation();
 
-	// Add a volume renderer who will use the fluid calculator for this simulation for rendering
+	// Add a volume renderer who will use the fluid calculator for this simulation for rendering. Its instance settings
+	// set it apart from the other renderers of the simulation
 	void AddVolumeRenderer(std::shared_ptr<VolumeRenderer> volumeRenderer);
 	bool Initialize(_In_ D3DGraphicsObject * d3dGraphicsObj, HWND hwnd);
 
-	// Returns true if this simulation is updated and false if it wasn't
-	bool Update(float dt, const ICamera &camera);
+	// The simulation starts out from the state in this file if it holds one the fluid can take, skipping the steps it
+	// would take to develop, and the tweak bar saves the state of the simulation to it. Set before Initialize
+	void SetStateFile(const std::wstring &path);
+
+	// Makes the fluid flow around a box collider, or around the bounding box of every mesh of a model. The obstacles
+	// follow the objects as they move, the fluid takes on their velocity where it meets them. They are placed around the
+	// first volume renderer, and boxes that would cover the constant input are left out
+	void AddObstacle(std::shared_ptr<BoxCollider> collider);
+	void AddObstacle(std::shared_ptr<ModelGameObject> model);
+
+	// Works out the detail the simulation deserves from the part of the screen its volumes cover and how close they are.
+	// A simulation none of whose volumes are in view gets none
+	void UpdateLOD(const ICamera &camera);
+	// 0 for a simulation out of view up to 1 for one close up, always 1 while the simulation is still developing
+	float GetPriority() const;
+	// True once the next Step could not make up the time of another skipped frame, the simulation has to be stepped then
+	// or it falls behind
+	bool MustCatchUp() const;
+	// Estimated milliseconds of the next Step, including any substeps the skipped frames will be made up in. Taken from
+	// the GPU stage timings while they are profiled and from the time Process takes otherwise
+	float EstimateStepCost() const;
+	int GetFramesSkipped() const;
+	// Processes the frame along with the frames skipped before it, on the resolution tier and with the solver profile
+	// its LOD calls for while adaptive resolution and scaled solver effort are on. Returns true if the fluid took any steps
+	bool Step();
+	// Skips the frame, its time is made up on the next Step
+	void SkipFrame();
 
 	void DisplayInfoOnBar(CTwBar * const pBar);
 	// Checks if this ray intersects any of the volume renderers associated with this 
@@ -44,12 +74,31 @@ public:
 private:
 	static void __stdcall GetFluidSettings(void *value, void *clientData);
 	static void __stdcall SetFluidSettings(const void *value, void *clientData);
+	static void __stdcall SaveStateCallback(void *clientData);
+	// Saves the state at full resolution, switching to it first
+	void SaveState();
 
 	Vector3 GetLocalIntersectPosition(const Ray &ray, float distance) const;
+	// Hands the obstacles, in the space of every volume renderer, to the fluid calculator
+	void UpdateObstacles();
 	bool IsSimulationVisible(const ICamera &camera) const;
+	bool IsDeveloping() const;
+	int ChooseResolutionTier() const;
+	// Switches the calculator to the tier the LOD calls for and points the renderers at its fields
+	void UpdateResolutionTier();
+	// Keeps as much history as the renderer furthest behind needs
+	void UpdateHistoryLength();
+	// Points every renderer at the fields as of its time offset
+	void UpdateRendererTextures();
+	// The profile of the volume seen in the most detail
+	Fluid3D::SolverProfile ChooseSolverProfile() const;
 private:
 	std::shared_ptr<Fluid3D::Fluid3DCalculator>	mFluidCalculator;
 	std::vector<std::shared_ptr<VolumeRenderer>> mVolumeRenderers;
+	std::vector<std::shared_ptr<BoxCollider>> mObstacleColliders;
+	std::vector<std::shared_ptr<ModelGameObject>> mObstacleModels;
+	std::vector<Fluid3D::ObstacleBox> mObstacleBoxes;
+	std::wstring mStateFile;
 
 	bool mUpdateEnabled;
 	bool mRenderEnabled;
@@ -57,9 +106,14 @@ private:
 
 // LOD Values
 private:
-	int mFramesToSkip;
 	int mFluidUpdatesSinceStart;
-	int mFramesSinceLastProcess;
+	int mFramesSinceLastProcess;	// skipped, to be made up on the next processed frame
+	std::vector<LODController> mLODControllers;	// one per volume renderer
+	float mPriority;
+	float mStepMilliseconds;	// smoothed time Process takes per step
+	bool mAdaptiveResolution;
+	int mResolutionTier;
+	bool mScaledSolverEffort;
 };
 
 #endif
\ No newline at end of file
@@ -15,15 +15,19 @@ using namespace DirectX;
 
 #define MIN_DISTANCE 6.0f
 #define MAX_DISTANCE 20.0f
-#define MAX_FRAMES_TO_SKIP 2
+#define MAX_FRAMES_TO_SKIP 8
 #define NUM_SAMPLES 64
 #define MAX_SAMPLES 128
+#define MIN_PRESSURE_EFFORT 0.25f
+#define MACCORMACK_LOD 0.2f
+#define VORTICITY_LOD 0.1f
 
 TwType lodTwType;
 
 LODController::LODController() : 
 	overallLOD(1.0f), distanceLOD(1.0f), framesToSkip(0), minDistance(MIN_DISTANCE), maxDistance(MAX_DISTANCE),
-	maxFramesToSkip(MAX_FRAMES_TO_SKIP), partOfScreen(0.0f), pObjectBox(nullptr), numSamples(NUM_SAMPLES), maxSamples(MAX_SAMPLES)
+	maxFramesToSkip(MAX_FRAMES_TO_SKIP), partOfScreen(0.0f), pObjectBox(nullptr), numSamples(NUM_SAMPLES), maxSamples(MAX_SAMPLES),
+	minPressureEffort(MIN_PRESSURE_EFFORT), macCormackLOD(MACCORMACK_LOD), vorticityLOD(VORTICITY_LOD)
 {
 
 }
@@ -55,6 +59,16 @@ void LODController::CalculateOverallLOD(const ICamera &camera) {
 
 	numSamples = Clamp(numSamples, 0, maxSamples);
 	framesToSkip = Clamp(framesToSkip, 0, maxFramesToSkip);
+
+	CalculateSolverProfile();
+}
+
+void LODController::CalculateSolverProfile() {
+	// the pressure solve is the bulk of a step, so its effort falls off with the LOD while the cheaper passes are
+	// only dropped once the fluid is barely seen
+	solverProfile.pressureEffort = Lerp(Clamp(minPressureEffort, 0.0f, 1.0f), 1.0f, overallLOD);
+	solverProfile.macCormackAdvection = overallLOD >= macCormackLOD;
+	solverProfile.vorticityConfinement = overallLOD >= vorticityLOD;
 }
 
 void LODController::CalculatedDistanceLOD(const ICamera &camera) {
@@ -125,6 +139,10 @@ void InitType() {
 		{ "Max Distance", TW_TYPE_FLOAT, offsetof(LODController, maxDistance), "min=0.0 step=0.5" },
 		{ "Max Skip Frames", TW_TYPE_INT32, offsetof(LODController, maxFramesToSkip), "min=0 step=1" },
 		{ "Max Samples", TW_TYPE_INT32, offsetof(LODController, maxSamples), "min=16 step=1" },
+		{ "Pressure Effort", TW_TYPE_FLOAT, offsetof(LODController, solverProfile.pressureEffort), "readonly=true" },
+		{ "Min Pressure Effort", TW_TYPE_FLOAT, offsetof(LODController, minPressureEffort), "min=0.0 max=1.0 step=0.05" },
+		{ "MacCormack LOD", TW_TYPE_FLOAT, offsetof(LODController, macCormackLOD), "min=0.0 max=1.0 step=0.05" },
+		{ "Vorticity LOD", TW_TYPE_FLOAT, offsetof(LODController, vorticityLOD), "min=0.0 max=1.0 step=0.05" },
 
 	};
 
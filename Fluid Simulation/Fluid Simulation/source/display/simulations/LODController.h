@@ -9,6 +9,7 @@ Date: 31/3/2014
 #define	_LODCONTROLLER_H
 
 #include <memory>
+#include "../../utilities/FluidCalculation/FluidSettings.h"
 
 namespace DirectX 
 {
@@ -33,6 +34,12 @@ struct LODController {
 	int maxSamples;
 	int numSamples;
 
+	// The solver profile follows the overall LOD
+	Fluid3D::SolverProfile solverProfile;
+	float minPressureEffort;	// at an overall LOD of 0, full effort at 1
+	float macCormackLOD;		// overall LOD below which the advection falls back to normal
+	float vorticityLOD;			// overall LOD below which vorticity confinement is left out
+
 	void SetObjectBoundingBox(const DirectX::BoundingBox* objectBox);
 	void CalculateOverallLOD(const ICamera &camera);
 	LODController();
@@ -44,6 +51,7 @@ private:
 	// Calculates what percentage of the total screen is occupied by the simulation
 	void CalculateScreenPercentage(const ICamera &camera);
 	void CalculatedDistanceLOD(const ICamera &camera);
+	void CalculateSolverProfile();
 
 private:
 	const DirectX::BoundingBox* pObjectBox;
@@ -17,15 +17,108 @@ Version: 1.0
 	#endif
 #endif
 
+#include <string.h>
+#include <stdlib.h>
 #include "system\MainSystem.h"
+#include "system\HeadlessSystem.h"
+#include "system\SolverCrossCheck.h"
 #include "utilities\Console.h"
 
+#define HEADLESS_ARGUMENT "-headless"
+#define HEADLESS_DEFAULT_STEPS 100
+#define SOLVER_ARGUMENT "-solver"
+#define CROSS_CHECK_ARGUMENT "-crosscheck"
+#define UNFUSED_ARGUMENT "-unfused"
+#define UNPACKED_ARGUMENT "-unpacked"
+#define TRAFFIC_ARGUMENT "-traffic"
+#define STENCILS_ARGUMENT "-stencils"
+#define ADAPTIVE_ARGUMENT "-adaptive"
+#define PROFILE_ARGUMENT "-profile"
+
+// Runs the simulations on the CPU only. Usage: -headless [numSteps] [-solver jacobi|multigrid|sor|pcg] [-unfused] [-unpacked] [-traffic] [-stencils] [-adaptive] [-profile]
+static int RunHeadless(const char *arguments) {
+	ShowWin32Console();
+
+	int numSteps = atoi(arguments + strlen(HEADLESS_ARGUMENT));
+	if (numSteps <= 0) {
+		numSteps = HEADLESS_DEFAULT_STEPS;
+	}
+
+	HeadlessSystem headlessSystem;
+
+	const char *solverArgument = strstr(arguments, SOLVER_ARGUMENT);
+	if (solverArgument) {
+		const char *solverName = solverArgument + strlen(SOLVER_ARGUMENT) + 1;
+		if (strncmp(solverName, "jacobi", 6) == 0) {
+			headlessSystem.OverridePressureSolver(JACOBI);
+		}
+		else if (strncmp(solverName, "multigrid", 9) == 0) {
+			headlessSystem.OverridePressureSolver(MULTIGRID);
+		}
+		else if (strncmp(solverName, "sor", 3) == 0) {
+			headlessSystem.OverridePressureSolver(RED_BLACK_SOR);
+		}
+		else if (strncmp(solverName, "pcg", 3) == 0) {
+			headlessSystem.OverridePressureSolver(PRECONDITIONED_CG);
+		}
+	}
+	if (strstr(arguments, UNFUSED_ARGUMENT)) {
+		headlessSystem.DisableFusedKernels();
+	}
+	if (strstr(arguments, UNPACKED_ARGUMENT)) {
+		headlessSystem.DisablePackedScalarAdvection();
+	}
+	if (strstr(arguments, ADAPTIVE_ARGUMENT)) {
+		headlessSystem.EnableAdaptiveTimeStep();
+	}
+	if (strstr(arguments, PROFILE_ARGUMENT)) {
+		headlessSystem.EnableStageProfiling();
+	}
+
+	bool result = headlessSystem.Initialize();
+	if (result) {
+		if (strstr(arguments, TRAFFIC_ARGUMENT)) {
+			headlessSystem.PrintMemoryTraffic();
+		}
+		if (strstr(arguments, STENCILS_ARGUMENT)) {
+			headlessSystem.PrintStencilBenchmark();
+		}
+		headlessSystem.Run(numSteps);
+	}
+
+	return 0;
+}
+
+// Compares the simulation compute shaders against their CPU versions on a WARP device. Usage: -crosscheck
+static int RunSolverCrossCheck() {
+	ShowWin32Console();
+
+	SolverCrossCheck solverCrossCheck;
+	bool result = solverCrossCheck.Initialize();
+	if (!result) {
+		return 1;
+	}
+
+	result = solverCrossCheck.Run();
+
+	return result ? 0 : 1;
+}
+
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR pScmdline, int iCmdshow) {
 
 	#if defined(_DEBUG)
 	_CrtSetDbgFlag ( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 	#endif
 
+	if (strstr(pScmdline, CROSS_CHECK_ARGUMENT)) {
+		return RunSolverCrossCheck();
+	}
+
+	const char *headlessArgument = strstr(pScmdline, HEADLESS_ARGUMENT);
+	if (headlessArgument) {
+		return RunHeadless(headlessArgument);
+	}
+
 	MainSystem mainSystem;
 	
 	//ShowWin32Console();
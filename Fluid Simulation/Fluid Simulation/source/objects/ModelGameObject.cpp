@@ -42,3 +42,7 @@ void ModelGameObject::Render(const ICamera &camera, ID3D11DeviceContext * const
 	transform->GetTransformMatrixQuaternion(worldMatrix);
 	mModel->Draw(deviceContext, *pCommonStates, worldMatrix, camera.GetViewMatrix(), camera.GetProjectionMatrix());
 }
+
+const std::shared_ptr<Model> &ModelGameObject::GetModel() const {
+	return mModel;
+}
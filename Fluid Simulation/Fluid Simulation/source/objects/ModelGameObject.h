@@ -28,6 +28,8 @@ public:
 	void Update();
 	void Render(const ICamera &camera, ID3D11DeviceContext * const deviceContext);
 
+	const std::shared_ptr<DirectX::Model> &GetModel() const;
+
 private:
 	std::shared_ptr<DirectX::Model> mModel;
 	std::shared_ptr<DirectX::CommonStates> pCommonStates;
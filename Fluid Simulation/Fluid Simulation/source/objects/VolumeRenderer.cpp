@@ -25,6 +25,7 @@ static int   defaultNumSamples = 64;
 
 TwType renderSettingsTwType;
 TwType firePropertiesTwType;
+TwType instanceSettingsTwType;
 
 void DefinePropertiesTwType() {
 	TwStructMember smokePropertiesStructMembers[] = {
@@ -36,12 +37,23 @@ void DefinePropertiesTwType() {
 
 	renderSettingsTwType = TwDefineStruct("Smoke Render Properties", smokePropertiesStructMembers, 3, sizeof(RenderSettings), nullptr, nullptr);
 	firePropertiesTwType = TwDefineStruct("Fire Render Properties", smokePropertiesStructMembers, 4, sizeof(RenderSettings), nullptr, nullptr);
+
+	TwStructMember instanceStructMembers[] = {
+		{ "Time Offset", TW_TYPE_INT32, offsetof(InstanceSettings, timeOffset), "min=0 max=8 step=1" },
+		{ "Quarter Turns", TW_TYPE_INT32, offsetof(InstanceSettings, quarterTurns), "min=0 max=3 step=1" },
+		{ "Mirrored", TW_TYPE_BOOLCPP, offsetof(InstanceSettings, mirrored), "" },
+		{ "Noise Seed", TW_TYPE_FLOAT, offsetof(InstanceSettings, noiseSeed), "step=1.0" },
+		{ "Noise Strength", TW_TYPE_FLOAT, offsetof(InstanceSettings, noiseStrength), "min=0.0 max=0.1 step=0.001" }
+	};
+
+	instanceSettingsTwType = TwDefineStruct("Instance Properties", instanceStructMembers, 5, sizeof(InstanceSettings), nullptr, nullptr);
 }
 
 VolumeRenderer::VolumeRenderer() :
 	pD3dGraphicsObj(nullptr) 
 {
 	mRenderSettings = unique_ptr<RenderSettings>(new RenderSettings(defaultSmokeColor, defaultSmokeAbsorption, defaultFireAbsorption, defaultNumSamples));
+	mInstanceSettings = make_shared<InstanceSettings>();
 }
 
 VolumeRenderer::~VolumeRenderer() {
@@ -69,6 +81,7 @@ bool VolumeRenderer::Initialize(_In_ D3DGraphicsObject* d3dGraphicsObj, HWND hwn
 	}
 	
 	mVolumeRenderShader->SetSmokeProperties(*mRenderSettings);
+	mVolumeRenderShader->SetInstanceProperties(*mInstanceSettings);
 	mVolumeRenderShader->SetTransform(*transform);
 
 	auto graphicsSystem = ServiceProvider::Instance().GetService<IGraphicsSystem>();
@@ -129,11 +142,13 @@ void VolumeRenderer::SetFireGradientTexture(ID3D11ShaderResourceView *gradientTe
 void VolumeRenderer::DisplayRenderInfoOnBar(TwBar * const pBar) {
 	TwType typeToAdd = mFluidType == SMOKE ? renderSettingsTwType : firePropertiesTwType;
 	TwAddVarRW(pBar,"Rendering", typeToAdd, mRenderSettings.get(), "");
+	TwAddVarRW(pBar,"Instance", instanceSettingsTwType, mInstanceSettings.get(), "group=Rendering");
 	TwAddButton(pBar, "Apply Changes", SetSmokePropertiesCallback, this, "label='Apply Changes' group=Rendering");
 }
 
 void VolumeRenderer::RefreshSmokeProperties() {
 	mVolumeRenderShader->SetSmokeProperties(*mRenderSettings);
+	mVolumeRenderShader->SetInstanceProperties(*mInstanceSettings);
 }
 
 void __stdcall VolumeRenderer::SetSmokePropertiesCallback(void *clientData) {
@@ -144,6 +159,10 @@ std::shared_ptr<RenderSettings> VolumeRenderer::GetRenderSettings() const {
 	return mRenderSettings;
 }
 
+std::shared_ptr<InstanceSettings> VolumeRenderer::GetInstanceSettings() const {
+	return mInstanceSettings;
+}
+
 void VolumeRenderer::SetNumRenderSamples(int numSamples) {
 	if (numSamples != mRenderSettings->iNumSamples) {
 		mRenderSettings->iNumSamples = numSamples;
@@ -42,6 +42,9 @@ public:
 	void DisplayRenderInfoOnBar(CTwBar * const pBar);
 	void SetNumRenderSamples(int numSamples);
 	std::shared_ptr<RenderSettings> GetRenderSettings() const;
+	// Changes made after Initialize are applied along with the render settings, except the time offset which the fluid
+	// simulation picks up on its next step
+	std::shared_ptr<InstanceSettings> GetInstanceSettings() const;
 private:
 	static void __stdcall SetSmokePropertiesCallback(void *clientData);
 	void RefreshSmokeProperties();
@@ -53,6 +56,7 @@ private:
 	D3DGraphicsObject* pD3dGraphicsObj;
 
 	std::shared_ptr<RenderSettings>			mRenderSettings;
+	std::shared_ptr<InstanceSettings>		mInstanceSettings;
 	std::unique_ptr<SmokeRenderShader>		mVolumeRenderShader;
 	std::shared_ptr<DirectX::CommonStates>	pCommonStates;	
 };
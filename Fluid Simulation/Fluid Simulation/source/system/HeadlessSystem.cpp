@@ -0,0 +1,130 @@
+/***************************************************************
+HeadlessSystem.cpp: Implementation of HeadlessSystem
+
+Author: Valentin Hinov
+Date: 02/05/2014
+Version: 1.0
+**************************************************************/
+#include "HeadlessSystem.h"
+#include <stdio.h>
+#include <windows.h>
+#include "../display/Scenes/Fluid3DScene.h"
+#include "../utilities/FluidCalculation/Fluid3DCPUCalculator.h"
+#include "../utilities/FluidCalculation/Fluid3DMemoryTraffic.h"
+#include "../utilities/FluidCalculation/Fluid3DStencilBenchmark.h"
+
+using namespace std;
+using namespace Fluid3D;
+
+// Runs of every stencil the benchmark times
+#define STENCIL_BENCHMARK_RUNS 50
+
+HeadlessSystem::HeadlessSystem() : mOverridePressureSolver(false), mPressureSolverType(MULTIGRID), mDisableFusedKernels(false), mDisablePackedScalarAdvection(false),
+	mAdaptiveTimeStep(false), mProfileStages(false) {
+}
+
+HeadlessSystem::~HeadlessSystem() {
+	mCalculators.clear();
+}
+
+void HeadlessSystem::OverridePressureSolver(PressureSolverType_t pressureSolverType) {
+	mOverridePressureSolver = true;
+	mPressureSolverType = pressureSolverType;
+}
+
+void HeadlessSystem::DisableFusedKernels() {
+	mDisableFusedKernels = true;
+}
+
+void HeadlessSystem::DisablePackedScalarAdvection() {
+	mDisablePackedScalarAdvection = true;
+}
+
+void HeadlessSystem::EnableAdaptiveTimeStep() {
+	mAdaptiveTimeStep = true;
+}
+
+void HeadlessSystem::EnableStageProfiling() {
+	mProfileStages = true;
+}
+
+bool HeadlessSystem::Initialize() {
+	FluidSettings settings[2] = {Fluid3DScene::CreateSmokeSettings(), Fluid3DScene::CreateFireSettings()};
+	for (int i = 0; i < 2; ++i) {
+		if (mOverridePressureSolver) {
+			settings[i].pressureSolverType = mPressureSolverType;
+		}
+		if (mDisableFusedKernels) {
+			settings[i].fusedKernels = false;
+		}
+		if (mDisablePackedScalarAdvection) {
+			settings[i].packedScalarAdvection = false;
+		}
+		if (mAdaptiveTimeStep) {
+			settings[i].adaptiveTimeStep = true;
+		}
+		if (mProfileStages) {
+			settings[i].profileStages = true;
+		}
+		mCalculators.push_back(make_shared<Fluid3DCPUCalculator>(settings[i]));
+	}
+
+	for (auto &calculator : mCalculators) {
+		bool result = calculator->Initialize();
+		if (!result) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void HeadlessSystem::PrintMemoryTraffic() const {
+	MemoryTrafficModel models[2] = {MemoryTrafficModel::CreateGPUModel(), MemoryTrafficModel::CreateCPUModel()};
+	for (auto &calculator : mCalculators) {
+		for (int i = 0; i < 2; ++i) {
+			PrintTrafficReport(calculator->GetFluidSettings(), models[i]);
+		}
+	}
+}
+
+void HeadlessSystem::PrintStencilBenchmark() const {
+	for (auto &calculator : mCalculators) {
+		const FluidSettings &fluidSettings = calculator->GetFluidSettings();
+		Fluid3D::PrintStencilBenchmark(fluidSettings.dimensions, STENCIL_BENCHMARK_RUNS);
+		Fluid3D::PrintJacobiBlockingBenchmark(fluidSettings.dimensions, fluidSettings.jacobiIterations, STENCIL_BENCHMARK_RUNS);
+		Fluid3D::PrintLayoutBenchmark(fluidSettings.dimensions, fluidSettings.timeStep, STENCIL_BENCHMARK_RUNS);
+	}
+}
+
+void HeadlessSystem::Run(int numSteps) {
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	for (int step = 0; step < numSteps; ++step) {
+		for (size_t i = 0; i < mCalculators.size(); ++i) {
+			LARGE_INTEGER start, end;
+			QueryPerformanceCounter(&start);
+			mCalculators[i]->Process();
+			QueryPerformanceCounter(&end);
+			mCalculators[i]->GetStageProfiler().Collect();
+
+			double milliseconds = (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+			const Vector3 &dimensions = mCalculators[i]->GetFluidSettings().dimensions;
+			const PressureSolverStats &solverStats = mCalculators[i]->GetPressureSolverStats();
+			const BrickOccupancyStats &brickStats = mCalculators[i]->GetBrickOccupancyStats();
+			const TimeStepPlan &timeStepPlan = mCalculators[i]->GetTimeStepPlan();
+			const FluidActivityStats &activityStats = mCalculators[i]->GetFluidActivityStats();
+			printf("Step %d: simulation %d (%dx%dx%d) took %.2f ms in %d time steps of %g%s, pressure iterations %d, residual %g, bricks active %d processed %d/%d (%.1f%%)\n", step, (int)i,
+				(int)dimensions.x, (int)dimensions.y, (int)dimensions.z, milliseconds, timeStepPlan.steps, timeStepPlan.timeStep, activityStats.sleeping ? " (sleeping)" : "", solverStats.iterationsUsed, solverStats.residual,
+				brickStats.activeBricks, brickStats.processedBricks, brickStats.totalBricks, brickStats.processedPercentage);
+		}
+	}
+
+	if (mProfileStages) {
+		for (size_t i = 0; i < mCalculators.size(); ++i) {
+			printf("Stage timings of simulation %d over the last %d samples:\n", (int)i, STAGE_TIMING_WINDOW);
+			mCalculators[i]->GetStageProfiler().PrintStageTimings();
+		}
+	}
+}
@@ -0,0 +1,58 @@
+/***************************************************************
+HeadlessSystem.h: Runs the 3D fluid simulations of Fluid3DScene
+on the CPU without creating a window or a Direct3D device. Used
+on machines that have no GPU.
+
+Author: Valentin Hinov
+Date: 02/05/2014
+Version: 1.0
+**************************************************************/
+#ifndef _HEADLESSSYSTEM_H_
+#define _HEADLESSSYSTEM_H_
+
+#include <vector>
+#include <memory>
+#include "../utilities/FluidCalculation/FluidSettings.h"
+
+namespace Fluid3D {
+	class Fluid3DCPUCalculator;
+}
+
+class HeadlessSystem {
+public:
+	HeadlessSystem();
+	~HeadlessSystem();
+
+	// Replaces the pressure solver of every simulation. Must be called before Initialize
+	void OverridePressureSolver(PressureSolverType_t pressureSolverType);
+	// Runs every simulation with the unfused kernels. Must be called before Initialize
+	void DisableFusedKernels();
+	// Advects the temperature, density and reaction of every simulation one by one. Must be called before Initialize
+	void DisablePackedScalarAdvection();
+	// Splits the steps of every simulation into adaptive time steps under the CFL number. Must be called before Initialize
+	void EnableAdaptiveTimeStep();
+	// Times every stage of the steps of every simulation. Must be called before Initialize
+	void EnableStageProfiling();
+
+	bool Initialize();
+	// Prints the estimated GPU and CPU memory traffic of a step of every simulation
+	void PrintMemoryTraffic() const;
+	// Times the CPU neighbour stencils with and without the ghost border, the Jacobi solver with and without temporal
+	// blocking and the kernels on row-major and Morton ordered fields, on the volume of every simulation
+	void PrintStencilBenchmark() const;
+	// Steps every simulation numSteps times and prints the time each step took, and the adaptive steps it was run as.
+	// With stage profiling on, prints the timings of the stages of every simulation at the end
+	void Run(int numSteps);
+
+private:
+	std::vector<std::shared_ptr<Fluid3D::Fluid3DCPUCalculator>> mCalculators;
+
+	bool mOverridePressureSolver;
+	PressureSolverType_t mPressureSolverType;
+	bool mDisableFusedKernels;
+	bool mDisablePackedScalarAdvection;
+	bool mAdaptiveTimeStep;
+	bool mProfileStages;
+};
+
+#endif
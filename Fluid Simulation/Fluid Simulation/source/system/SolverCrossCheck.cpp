@@ -0,0 +1,833 @@
+/***************************************************************
+SolverCrossCheck.cpp: Implementation of SolverCrossCheck
+
+Author: Valentin Hinov
+Date: 06/05/2014
+Version: 1.0
+**************************************************************/
+#include "SolverCrossCheck.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "../utilities/FluidCalculation/FluidSettings.h"
+#include "../utilities/FluidCalculation/Fluid3DShaders.h"
+#include "../utilities/FluidCalculation/Fluid3DBuffers.h"
+#include "../utilities/FluidCalculation/Fluid3DCPUFields.h"
+#include "../utilities/FluidCalculation/Fluid3DCPUKernels.h"
+
+// Both implementations run in single precision but sum the neighbours in a different order
+#define CROSS_CHECK_TOLERANCE 1e-4f
+// The texture units only keep 8 bits of a sample position between two cells, which can put a trilinear sample of
+// uncorrelated values a percent or two of their spread away from the exact one
+#define SAMPLED_CROSS_CHECK_TOLERANCE 3e-2f
+
+// Settings of the seeded volumes, close to the ones of a running simulation
+#define CROSS_CHECK_TIME_STEP 0.5f
+#define CROSS_CHECK_JACOBI_ITERATIONS 10
+
+using namespace std;
+using namespace Fluid3D;
+
+struct SolverCrossCheck::SeededVolume {
+	Vector3 dimensions;
+	InputBufferGeneral general;
+	ObstacleField3D obstacles;
+	VectorField3D velocity;
+	ScalarField3D temperature;
+	ScalarField3D density;
+	ScalarField3D reaction;
+	ScalarField3D pressure;
+	ScalarField3D divergence;
+
+	CComPtr<ID3D11Buffer> generalBuffer;
+	ShaderParams obstaclesSP;
+	ShaderParams obstacleVelocitySP;
+	ShaderParams velocitySP;
+	ShaderParams temperatureSP;
+	ShaderParams densitySP;
+	ShaderParams reactionSP;
+	ShaderParams pressureSP;
+	ShaderParams divergenceSP;
+};
+
+namespace {
+	// A repeatable pseudo random value in [-0.5, 0.5)
+	float NextRandom(unsigned int &seed) {
+		seed = seed * 1664525u + 1013904223u;
+		return (float)(seed >> 8) / (float)(1 << 24) - 0.5f;
+	}
+
+	// Walls on the border plus a solid block in the middle of the volume, moving at blockVelocity
+	void SeedObstacles(ObstacleField3D &obstacles, int width, int height, int depth, const Vector3 &blockVelocity) {
+		obstacles.Resize(width, height, depth);
+		CPUKernels::Obstacles(obstacles);
+		for (int z = depth/3; z < depth/2; ++z) {
+			for (int y = height/3; y < height/2; ++y) {
+				for (int x = width/3; x < width/2; ++x) {
+					obstacles.SetObstacleCell(x, y, z, true);
+					obstacles.velocity.Set(obstacles.Index(x, y, z), blockVelocity);
+				}
+			}
+		}
+	}
+
+	float LargestValue(const ScalarField3D &field) {
+		float largestValue = 0.0f;
+		for (size_t i = 0; i < field.values.size(); ++i) {
+			largestValue = max(largestValue, fabsf(field.values[i]));
+		}
+		return largestValue;
+	}
+
+	float LargestValue(const VectorField3D &field) {
+		return max(LargestValue(field.x), max(LargestValue(field.y), LargestValue(field.z)));
+	}
+
+	float MaxAbsVectorDifference(const VectorField3D &first, const VectorField3D &second) {
+		return max(MaxAbsDifference(first.x, second.x), max(MaxAbsDifference(first.y, second.y), MaxAbsDifference(first.z, second.z)));
+	}
+
+	bool InitializeShader(BaseD3DShader &shader, ID3D11Device *device, const char *name) {
+		bool result = shader.Initialize(device);
+		if (!result) {
+			printf("Could not compile %s\n", name);
+		}
+		return result;
+	}
+}
+
+SolverCrossCheck::SolverCrossCheck() {
+}
+
+SolverCrossCheck::~SolverCrossCheck() {
+}
+
+bool SolverCrossCheck::Initialize() {
+	D3D_FEATURE_LEVEL featureLevel = D3D_FEATURE_LEVEL_11_0;
+	HRESULT hr = D3D11CreateDevice(NULL, D3D_DRIVER_TYPE_WARP, NULL, 0, &featureLevel, 1, D3D11_SDK_VERSION, &mDevice, NULL, &mDeviceContext);
+	if (FAILED(hr)) {
+		printf("Could not create a WARP device for the solver cross check\n");
+		return false;
+	}
+
+	// the same sampler as Fluid3DCalculator, samples outside of the volume read zero
+	D3D11_SAMPLER_DESC samplerDesc;
+	ZeroMemory(&samplerDesc, sizeof(D3D11_SAMPLER_DESC));
+	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_BORDER;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_BORDER;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_BORDER;
+	samplerDesc.MaxAnisotropy = 16;
+	samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+
+	hr = mDevice->CreateSamplerState(&samplerDesc, &mSampleState);
+	if (FAILED(hr)) {
+		printf("Could not create the cross check sampler\n");
+		return false;
+	}
+	return true;
+}
+
+bool SolverCrossCheck::Run() {
+	// the second volume is not a multiple of the thread group size and has an odd width
+	bool result = CheckStepKernels(Vector3(64.0f, 64.0f, 64.0f));
+	result = CheckStepKernels(Vector3(37.0f, 29.0f, 21.0f)) && result;
+
+	result = CheckRedBlackSOR(Vector3(64.0f, 64.0f, 64.0f), 20, SOR_OVER_RELAXATION) && result;
+	result = CheckRedBlackSOR(Vector3(37.0f, 29.0f, 21.0f), 20, 1.0f) && result;
+
+	return result;
+}
+
+bool SolverCrossCheck::CheckRedBlackSOR(const Vector3 &dimensions, int sweeps, float overRelaxation) {
+	int width = (int)dimensions.x;
+	int height = (int)dimensions.y;
+	int depth = (int)dimensions.z;
+
+	ObstacleField3D obstacles;
+	SeedObstacles(obstacles, width, height, depth, Vector3(0.0f, 0.0f, 0.0f));
+
+	// a repeatable pseudo random right hand side
+	ScalarField3D rightHandSide(width, height, depth);
+	unsigned int seed = 12345;
+	for (size_t i = 0; i < rightHandSide.values.size(); ++i) {
+		float value = NextRandom(seed);
+		rightHandSide.values[i] = (obstacles.flags[i] & OBSTACLE_SOLID) ? 0.0f : value;
+	}
+
+	ScalarField3D cpuPressure(width, height, depth);
+	cpuPressure.Fill(0.0f);
+
+	// upload the same starting point to the device
+	ShaderParams rightHandSideSP, obstaclesSP, pressureSP;
+	bool result = CreateVolume(dimensions, DXGI_FORMAT_R32_FLOAT, &rightHandSide.values[0], sizeof(float), rightHandSideSP);
+	result = result && CreateVolume(dimensions, DXGI_FORMAT_R8_UINT, &obstacles.flags[0], sizeof(unsigned char), obstaclesSP);
+	result = result && CreateVolume(dimensions, DXGI_FORMAT_R32_FLOAT, &cpuPressure.values[0], sizeof(float), pressureSP);
+	if (!result) {
+		printf("Could not create the cross check volumes\n");
+		return false;
+	}
+
+	CComPtr<ID3D11Buffer> redBlackBuffers[2];
+	for (int parity = 0; parity < 2; ++parity) {
+		InputBufferRedBlack bufferData;
+		ZeroMemory(&bufferData, sizeof(InputBufferRedBlack));
+		bufferData.fOverRelaxation = overRelaxation;
+		bufferData.uParity = parity;
+
+		result = CreateConstantBuffer(&bufferData, sizeof(InputBufferRedBlack), redBlackBuffers[parity]);
+		if (!result) {
+			printf("Could not create the red-black constant buffers\n");
+			return false;
+		}
+	}
+
+	RedBlackSORShader redBlackSORShader(dimensions);
+	result = InitializeShader(redBlackSORShader, mDevice, "RedBlackSORComputeShader");
+	if (!result) {
+		return false;
+	}
+
+	for (int i = 0; i < sweeps; ++i) {
+		for (int parity = 0; parity < 2; ++parity) {
+			mDeviceContext->CSSetConstantBuffers(3, 1, &(redBlackBuffers[parity].p));
+			redBlackSORShader.Compute(mDeviceContext, dimensions, &rightHandSideSP, &obstaclesSP, &pressureSP);
+
+			CPUKernels::RedBlackSOR(cpuPressure, rightHandSide, obstacles, overRelaxation, parity);
+		}
+	}
+
+	ScalarField3D gpuPressure(width, height, depth);
+	result = ReadVolume(pressureSP, gpuPressure);
+	if (!result) {
+		printf("Could not read back the cross check pressure\n");
+		return false;
+	}
+
+	float largestValue = LargestValue(cpuPressure);
+	float difference = MaxAbsDifference(cpuPressure, gpuPressure);
+	bool passed = difference <= CROSS_CHECK_TOLERANCE * max(1.0f, largestValue);
+
+	printf("Red-black SOR (%dx%dx%d, %d sweeps, omega %.2f): max difference %g, largest pressure %g - %s\n",
+		width, height, depth, sweeps, overRelaxation, difference, largestValue, passed ? "passed" : "FAILED");
+
+	return passed;
+}
+
+bool SolverCrossCheck::CheckStepKernels(const Vector3 &dimensions) {
+	SeededVolume volume;
+	bool result = SeedVolume(dimensions, volume);
+	if (!result) {
+		printf("Could not create the cross check volumes\n");
+		return false;
+	}
+
+	// the sampler, the general constants and the obstacles stay bound for every kernel, the same as during a step
+	mDeviceContext->CSSetSamplers(0, 1, &(mSampleState.p));
+	mDeviceContext->CSSetConstantBuffers(0, 1, &(volume.generalBuffer.p));
+	mDeviceContext->CSSetShaderResources(4, 1, &(volume.obstaclesSP.mSRV.p));
+	mDeviceContext->CSSetShaderResources(11, 1, &(volume.obstacleVelocitySP.mSRV.p));
+
+	result = CheckAdvection(volume);
+	result = CheckMacCormack(volume) && result;
+	result = CheckBuoyancy(volume) && result;
+	result = CheckImpulses(volume) && result;
+	result = CheckVorticityConfinement(volume) && result;
+	result = CheckDivergence(volume) && result;
+	result = CheckJacobi(volume, CROSS_CHECK_JACOBI_ITERATIONS) && result;
+	result = CheckSubtractGradient(volume) && result;
+
+	ID3D11ShaderResourceView *const pSRVNULL[1] = {nullptr};
+	mDeviceContext->CSSetShaderResources(4, 1, pSRVNULL);
+	mDeviceContext->CSSetShaderResources(11, 1, pSRVNULL);
+
+	return result;
+}
+
+bool SolverCrossCheck::CheckAdvection(SeededVolume &volume) {
+	InputBufferAdvection advection;
+	ZeroMemory(&advection, sizeof(InputBufferAdvection));
+	advection.fDissipation = 0.99f;
+	advection.fTimeStepModifier = 1.0f;
+	advection.fDecay = 0.01f;
+
+	CComPtr<ID3D11Buffer> advectionBuffer;
+	AdvectionShader advectionShader(AdvectionShader::ADVECTION_TYPE_NORMAL, volume.dimensions);
+	bool result = CreateConstantBuffer(&advection, sizeof(InputBufferAdvection), advectionBuffer);
+	result = result && InitializeShader(advectionShader, mDevice, "AdvectComputeShader");
+	if (!result) {
+		return false;
+	}
+
+	// the velocity advects itself, the same as in a step
+	VectorField3D cpuVelocity;
+	cpuVelocity.Resize(volume.velocity.x.width, volume.velocity.x.height, volume.velocity.x.depth);
+	CPUKernels::Advect(volume.velocity, volume.velocity, volume.obstacles, volume.general, advection, cpuVelocity);
+
+	ShaderParams velocityResultSP;
+	result = CreateVolume(volume.velocity, nullptr, velocityResultSP);
+	if (!result) {
+		printf("Could not create the advection result volume\n");
+		return false;
+	}
+
+	mDeviceContext->CSSetConstantBuffers(1, 1, &(advectionBuffer.p));
+	advectionShader.Compute(mDeviceContext, &volume.velocitySP, &volume.velocitySP, &velocityResultSP);
+
+	VectorField3D gpuVelocity;
+	gpuVelocity.Resize(cpuVelocity.x.width, cpuVelocity.x.height, cpuVelocity.x.depth);
+	result = ReadVolume(velocityResultSP, gpuVelocity, nullptr);
+	if (!result) {
+		printf("Could not read back the advected velocity\n");
+		return false;
+	}
+
+	return Report("Advect", volume.dimensions, MaxAbsVectorDifference(cpuVelocity, gpuVelocity), LargestValue(cpuVelocity), SAMPLED_CROSS_CHECK_TOLERANCE);
+}
+
+bool SolverCrossCheck::CheckMacCormack(SeededVolume &volume) {
+	const int width = volume.velocity.x.width;
+	const int height = volume.velocity.x.height;
+	const int depth = volume.velocity.x.depth;
+
+	// the forward and backward steps come from the CPU and are given to both, so only the MacCormack pass is compared
+	InputBufferAdvection intermediate;
+	ZeroMemory(&intermediate, sizeof(InputBufferAdvection));
+	intermediate.fDissipation = 1.0f;
+	intermediate.fTimeStepModifier = 1.0f;
+
+	VectorField3D forward, backward;
+	forward.Resize(width, height, depth);
+	backward.Resize(width, height, depth);
+	CPUKernels::Advect(volume.velocity, volume.velocity, volume.obstacles, volume.general, intermediate, forward);
+	intermediate.fTimeStepModifier = -1.0f;
+	CPUKernels::Advect(volume.velocity, forward, volume.obstacles, volume.general, intermediate, backward);
+
+	InputBufferAdvection advection;
+	ZeroMemory(&advection, sizeof(InputBufferAdvection));
+	advection.fDissipation = 0.99f;
+	advection.fTimeStepModifier = 1.0f;
+	advection.fDecay = 0.01f;
+
+	VectorField3D cpuVelocity;
+	cpuVelocity.Resize(width, height, depth);
+	CPUKernels::AdvectMacCormack(volume.velocity, forward, backward, volume.velocity, volume.obstacles, volume.general, advection, cpuVelocity);
+
+	CComPtr<ID3D11Buffer> advectionBuffer;
+	AdvectionShader macCormackShader(AdvectionShader::ADVECTION_TYPE_MACCORMARCK, volume.dimensions);
+	ShaderParams targetsSP[3], velocityResultSP;
+	bool result = CreateConstantBuffer(&advection, sizeof(InputBufferAdvection), advectionBuffer);
+	result = result && InitializeShader(macCormackShader, mDevice, "AdvectMacCormackComputeShader");
+	if (!result) {
+		return false;
+	}
+	result = CreateVolume(forward, nullptr, targetsSP[0]);
+	result = result && CreateVolume(backward, nullptr, targetsSP[1]);
+	result = result && CreateVolume(volume.velocity, nullptr, velocityResultSP);
+	if (!result) {
+		printf("Could not create the MacCormack volumes\n");
+		return false;
+	}
+	targetsSP[2] = volume.velocitySP;
+
+	mDeviceContext->CSSetConstantBuffers(1, 1, &(advectionBuffer.p));
+	macCormackShader.Compute(mDeviceContext, &volume.velocitySP, targetsSP, &velocityResultSP);
+
+	VectorField3D gpuVelocity;
+	gpuVelocity.Resize(width, height, depth);
+	result = ReadVolume(velocityResultSP, gpuVelocity, nullptr);
+	if (!result) {
+		printf("Could not read back the MacCormack velocity\n");
+		return false;
+	}
+
+	return Report("Advect MacCormack", volume.dimensions, MaxAbsVectorDifference(cpuVelocity, gpuVelocity), LargestValue(cpuVelocity), SAMPLED_CROSS_CHECK_TOLERANCE);
+}
+
+bool SolverCrossCheck::CheckBuoyancy(SeededVolume &volume) {
+	BuoyancyShader buoyancyShader(volume.dimensions);
+	bool result = InitializeShader(buoyancyShader, mDevice, "BuoyancyComputeShader");
+	if (!result) {
+		return false;
+	}
+
+	VectorField3D cpuVelocity;
+	cpuVelocity.Resize(volume.velocity.x.width, volume.velocity.x.height, volume.velocity.x.depth);
+	CPUKernels::Buoyancy(volume.velocity, volume.temperature, volume.density, volume.general, cpuVelocity);
+
+	ShaderParams velocityResultSP;
+	result = CreateVolume(volume.velocity, nullptr, velocityResultSP);
+	if (!result) {
+		printf("Could not create the buoyancy result volume\n");
+		return false;
+	}
+
+	buoyancyShader.Compute(mDeviceContext, &volume.velocitySP, &volume.temperatureSP,
+		&volume.densitySP, &velocityResultSP);
+
+	VectorField3D gpuVelocity;
+	gpuVelocity.Resize(cpuVelocity.x.width, cpuVelocity.x.height, cpuVelocity.x.depth);
+	result = ReadVolume(velocityResultSP, gpuVelocity, nullptr);
+	if (!result) {
+		printf("Could not read back the buoyancy velocity\n");
+		return false;
+	}
+
+	return Report("Buoyancy", volume.dimensions, MaxAbsVectorDifference(cpuVelocity, gpuVelocity), LargestValue(cpuVelocity), CROSS_CHECK_TOLERANCE);
+}
+
+bool SolverCrossCheck::CheckImpulses(SeededVolume &volume) {
+	const int dimensions[3] = {volume.velocity.x.width, volume.velocity.x.height, volume.velocity.x.depth};
+
+	// one source for each field, next to each other so their regions overlap
+	ImpulseSourceData sources[4];
+	ZeroMemory(sources, sizeof(sources));
+	InputBufferInjection injection;
+	ZeroMemory(&injection, sizeof(InputBufferInjection));
+	injection.uImpulseSourceCount = 4;
+
+	float radius = 0.05f * (volume.dimensions.x + volume.dimensions.y + volume.dimensions.z);
+	int reach = (int)ceil(radius);
+	for (int target = 0; target < 4; ++target) {
+		ImpulseSourceData &source = sources[target];
+		source.vPoint = volume.dimensions * Vector3(0.35f + 0.1f * target, 0.25f, 0.6f);
+		source.fRadius = radius;
+		source.vAmount = Vector3(1.0f, -0.5f, 0.25f) * (float)(target + 1);
+		source.uTarget = target;
+
+		const float point[3] = {source.vPoint.x, source.vPoint.y, source.vPoint.z};
+		for (int axis = 0; axis < 3; ++axis) {
+			source.vRegionMin[axis] = (unsigned int)Max((int)point[axis] - reach, 0);
+			source.vRegionMax[axis] = (unsigned int)Min((int)point[axis] + reach, dimensions[axis] - 1);
+			injection.vInjectionRegionMin[axis] = target == 0 ? source.vRegionMin[axis] : Min(injection.vInjectionRegionMin[axis], source.vRegionMin[axis]);
+			injection.vInjectionRegionMax[axis] = target == 0 ? source.vRegionMax[axis] : Max(injection.vInjectionRegionMax[axis], source.vRegionMax[axis]);
+		}
+	}
+
+	// the shader only writes the injection region, so the results start out as copies of the fields
+	CComPtr<ID3D11Buffer> injectionBuffer;
+	ShaderParams sourcesSP, velocityResultSP, temperatureResultSP, densityResultSP, reactionResultSP;
+	ImpulseSourcesShader impulseSourcesShader(volume.dimensions);
+	bool result = CreateConstantBuffer(&injection, sizeof(InputBufferInjection), injectionBuffer);
+	result = result && CreateStructuredBuffer(sources, 4, sizeof(ImpulseSourceData), sourcesSP);
+	result = result && CreateVolume(volume.velocity, nullptr, velocityResultSP);
+	result = result && CreateVolume(volume.dimensions, DXGI_FORMAT_R32_FLOAT, &volume.temperature.values[0], sizeof(float), temperatureResultSP);
+	result = result && CreateVolume(volume.dimensions, DXGI_FORMAT_R32_FLOAT, &volume.density.values[0], sizeof(float), densityResultSP);
+	result = result && CreateVolume(volume.dimensions, DXGI_FORMAT_R32_FLOAT, &volume.reaction.values[0], sizeof(float), reactionResultSP);
+	if (!result) {
+		printf("Could not create the impulse volumes\n");
+		return false;
+	}
+	result = InitializeShader(impulseSourcesShader, mDevice, "ImpulseSourcesComputeShader");
+	if (!result) {
+		return false;
+	}
+
+	VectorField3D cpuVelocity = volume.velocity;
+	ScalarField3D cpuTemperature = volume.temperature;
+	ScalarField3D cpuDensity = volume.density;
+	ScalarField3D cpuReaction = volume.reaction;
+	CPUKernels::ImpulseSources(cpuVelocity, cpuTemperature, cpuDensity, &cpuReaction, volume.general, injection, sources);
+
+	Vector3 regionSize((float)(injection.vInjectionRegionMax[0] - injection.vInjectionRegionMin[0] + 1), (float)(injection.vInjectionRegionMax[1] - injection.vInjectionRegionMin[1] + 1),
+		(float)(injection.vInjectionRegionMax[2] - injection.vInjectionRegionMin[2] + 1));
+	mDeviceContext->CSSetConstantBuffers(4, 1, &(injectionBuffer.p));
+	mDeviceContext->CSSetShaderResources(10, 1, &(sourcesSP.mSRV.p));
+	impulseSourcesShader.Compute(mDeviceContext, regionSize, &volume.velocitySP, &volume.temperatureSP,
+		&volume.densitySP, &volume.reactionSP, &velocityResultSP, &temperatureResultSP, &densityResultSP, &reactionResultSP);
+	ID3D11ShaderResourceView *const pSRVNULL[1] = {nullptr};
+	mDeviceContext->CSSetShaderResources(10, 1, pSRVNULL);
+
+	VectorField3D gpuVelocity;
+	gpuVelocity.Resize(dimensions[0], dimensions[1], dimensions[2]);
+	ScalarField3D gpuTemperature(dimensions[0], dimensions[1], dimensions[2]);
+	ScalarField3D gpuDensity(dimensions[0], dimensions[1], dimensions[2]);
+	ScalarField3D gpuReaction(dimensions[0], dimensions[1], dimensions[2]);
+	result = ReadVolume(velocityResultSP, gpuVelocity, nullptr);
+	result = result && ReadVolume(temperatureResultSP, gpuTemperature);
+	result = result && ReadVolume(densityResultSP, gpuDensity);
+	result = result && ReadVolume(reactionResultSP, gpuReaction);
+	if (!result) {
+		printf("Could not read back the impulse results\n");
+		return false;
+	}
+
+	float difference = max(MaxAbsVectorDifference(cpuVelocity, gpuVelocity), MaxAbsDifference(cpuTemperature, gpuTemperature));
+	difference = max(difference, max(MaxAbsDifference(cpuDensity, gpuDensity), MaxAbsDifference(cpuReaction, gpuReaction)));
+	float largestValue = max(LargestValue(cpuVelocity), LargestValue(cpuTemperature));
+	largestValue = max(largestValue, max(LargestValue(cpuDensity), LargestValue(cpuReaction)));
+
+	return Report("Impulse sources", volume.dimensions, difference, largestValue, CROSS_CHECK_TOLERANCE);
+}
+
+bool SolverCrossCheck::CheckVorticityConfinement(SeededVolume &volume) {
+	const int width = volume.velocity.x.width;
+	const int height = volume.velocity.x.height;
+	const int depth = volume.velocity.x.depth;
+
+	VorticityShader vorticityShader(volume.dimensions);
+	ConfinementShader confinementShader(volume.dimensions);
+	bool result = InitializeShader(vorticityShader, mDevice, "VorticityComputeShader");
+	result = result && InitializeShader(confinementShader, mDevice, "ConfinementComputeShader");
+	if (!result) {
+		return false;
+	}
+
+	VectorField3D cpuVorticity;
+	cpuVorticity.Resize(width, height, depth);
+	ScalarField3D cpuVorticityLength(width, height, depth);
+	CPUKernels::Vorticity(volume.velocity, cpuVorticity, cpuVorticityLength);
+
+	// the confinement reads the CPU vorticity on both, so it is compared on its own. The shader leaves obstacle cells
+	// untouched, so its result starts out as a copy of the velocity
+	VectorField3D cpuVelocity;
+	cpuVelocity.Resize(width, height, depth);
+	CPUKernels::Confinement(volume.velocity, cpuVorticity, cpuVorticityLength, volume.obstacles, volume.general, cpuVelocity);
+
+	ShaderParams vorticityResultSP, vorticitySP, velocityResultSP;
+	result = CreateVolume(cpuVorticity, nullptr, vorticityResultSP);
+	result = result && CreateVolume(cpuVorticity, &cpuVorticityLength, vorticitySP);
+	result = result && CreateVolume(volume.velocity, nullptr, velocityResultSP);
+	if (!result) {
+		printf("Could not create the vorticity volumes\n");
+		return false;
+	}
+
+	vorticityShader.Compute(mDeviceContext, &volume.velocitySP, &vorticityResultSP);
+	confinementShader.Compute(mDeviceContext, &volume.velocitySP, &vorticitySP, &velocityResultSP);
+
+	VectorField3D gpuVorticity, gpuVelocity;
+	gpuVorticity.Resize(width, height, depth);
+	gpuVelocity.Resize(width, height, depth);
+	ScalarField3D gpuVorticityLength(width, height, depth);
+	result = ReadVolume(vorticityResultSP, gpuVorticity, &gpuVorticityLength);
+	result = result && ReadVolume(velocityResultSP, gpuVelocity, nullptr);
+	if (!result) {
+		printf("Could not read back the vorticity results\n");
+		return false;
+	}
+
+	float difference = max(MaxAbsVectorDifference(cpuVorticity, gpuVorticity), MaxAbsDifference(cpuVorticityLength, gpuVorticityLength));
+	result = Report("Vorticity", volume.dimensions, difference, LargestValue(cpuVorticityLength), CROSS_CHECK_TOLERANCE);
+	result = Report("Confinement", volume.dimensions, MaxAbsVectorDifference(cpuVelocity, gpuVelocity), LargestValue(cpuVelocity), CROSS_CHECK_TOLERANCE) && result;
+
+	return result;
+}
+
+bool SolverCrossCheck::CheckDivergence(SeededVolume &volume) {
+	DivergenceShader divergenceShader(volume.dimensions);
+	bool result = InitializeShader(divergenceShader, mDevice, "DivergenceComputeShader");
+	if (!result) {
+		return false;
+	}
+
+	ScalarField3D cpuDivergence(volume.divergence.width, volume.divergence.height, volume.divergence.depth);
+	CPUKernels::Divergence(volume.velocity, volume.obstacles, cpuDivergence);
+
+	ShaderParams divergenceResultSP;
+	result = CreateVolume(volume.dimensions, DXGI_FORMAT_R32_FLOAT, &volume.divergence.values[0], sizeof(float), divergenceResultSP);
+	if (!result) {
+		printf("Could not create the divergence result volume\n");
+		return false;
+	}
+
+	divergenceShader.Compute(mDeviceContext, &volume.velocitySP, &divergenceResultSP);
+
+	ScalarField3D gpuDivergence(cpuDivergence.width, cpuDivergence.height, cpuDivergence.depth);
+	result = ReadVolume(divergenceResultSP, gpuDivergence);
+	if (!result) {
+		printf("Could not read back the divergence\n");
+		return false;
+	}
+
+	return Report("Divergence", volume.dimensions, MaxAbsDifference(cpuDivergence, gpuDivergence), LargestValue(cpuDivergence), CROSS_CHECK_TOLERANCE);
+}
+
+bool SolverCrossCheck::CheckJacobi(SeededVolume &volume, int iterations) {
+	JacobiShader jacobiShader(volume.dimensions);
+	bool result = InitializeShader(jacobiShader, mDevice, "JacobiComputeShader");
+	if (!result) {
+		return false;
+	}
+
+	// both ping-pong between two pressure volumes from the seeded pressure
+	ShaderParams pressureSP[2];
+	result = CreateVolume(volume.dimensions, DXGI_FORMAT_R32_FLOAT, &volume.pressure.values[0], sizeof(float), pressureSP[0]);
+	result = result && CreateVolume(volume.dimensions, DXGI_FORMAT_R32_FLOAT, &volume.pressure.values[0], sizeof(float), pressureSP[1]);
+	if (!result) {
+		printf("Could not create the Jacobi volumes\n");
+		return false;
+	}
+
+	ScalarField3D cpuPressure = volume.pressure;
+	ScalarField3D cpuPressureScratch(cpuPressure.width, cpuPressure.height, cpuPressure.depth);
+	for (int i = 0; i < iterations; ++i) {
+		jacobiShader.Compute(mDeviceContext, &pressureSP[i % 2], &volume.divergenceSP, &pressureSP[(i + 1) % 2]);
+
+		CPUKernels::Jacobi(cpuPressure, volume.divergence, volume.obstacles, cpuPressureScratch);
+		swap(cpuPressure, cpuPressureScratch);
+	}
+
+	// the CPU calculator runs its iterations through the blocked version, which has to give the same result
+	ScalarField3D cpuBlockedPressure(cpuPressure.width, cpuPressure.height, cpuPressure.depth);
+	CPUKernels::JacobiBlocked(volume.pressure, volume.divergence, volume.obstacles, iterations, cpuBlockedPressure);
+
+	ScalarField3D gpuPressure(cpuPressure.width, cpuPressure.height, cpuPressure.depth);
+	result = ReadVolume(pressureSP[iterations % 2], gpuPressure);
+	if (!result) {
+		printf("Could not read back the Jacobi pressure\n");
+		return false;
+	}
+
+	float largestValue = LargestValue(cpuPressure);
+	result = Report("Jacobi", volume.dimensions, MaxAbsDifference(cpuPressure, gpuPressure), largestValue, CROSS_CHECK_TOLERANCE);
+	result = Report("Jacobi blocked", volume.dimensions, MaxAbsDifference(cpuBlockedPressure, gpuPressure), largestValue, CROSS_CHECK_TOLERANCE) && result;
+
+	return result;
+}
+
+bool SolverCrossCheck::CheckSubtractGradient(SeededVolume &volume) {
+	SubtractGradientShader subtractGradientShader(volume.dimensions);
+	bool result = InitializeShader(subtractGradientShader, mDevice, "SubtractGradientComputeShader");
+	if (!result) {
+		return false;
+	}
+
+	VectorField3D cpuVelocity;
+	cpuVelocity.Resize(volume.velocity.x.width, volume.velocity.x.height, volume.velocity.x.depth);
+	CPUKernels::SubtractGradient(volume.velocity, volume.pressure, volume.obstacles, cpuVelocity);
+
+	ShaderParams velocityResultSP;
+	result = CreateVolume(volume.velocity, nullptr, velocityResultSP);
+	if (!result) {
+		printf("Could not create the subtract gradient result volume\n");
+		return false;
+	}
+
+	subtractGradientShader.Compute(mDeviceContext, &volume.velocitySP, &volume.pressureSP, &velocityResultSP);
+
+	VectorField3D gpuVelocity;
+	gpuVelocity.Resize(cpuVelocity.x.width, cpuVelocity.x.height, cpuVelocity.x.depth);
+	result = ReadVolume(velocityResultSP, gpuVelocity, nullptr);
+	if (!result) {
+		printf("Could not read back the projected velocity\n");
+		return false;
+	}
+
+	return Report("Subtract gradient", volume.dimensions, MaxAbsVectorDifference(cpuVelocity, gpuVelocity), LargestValue(cpuVelocity), CROSS_CHECK_TOLERANCE);
+}
+
+bool SolverCrossCheck::SeedVolume(const Vector3 &dimensions, SeededVolume &volume) {
+	int width = (int)dimensions.x;
+	int height = (int)dimensions.y;
+	int depth = (int)dimensions.z;
+
+	volume.dimensions = dimensions;
+	ZeroMemory(&volume.general, sizeof(InputBufferGeneral));
+	volume.general.fTimeStep = CROSS_CHECK_TIME_STEP;
+	volume.general.fDensityBuoyancy = 1.0f;
+	volume.general.fDensityWeight = 0.25f;
+	volume.general.fVorticityStrength = 0.8f;
+	volume.general.vBuoyancyDirection = Vector3(0.0f, 1.0f, 0.0f);
+
+	// the solid block moves, so the boundary conditions pick up an obstacle velocity
+	SeedObstacles(volume.obstacles, width, height, depth, Vector3(0.5f, -0.25f, 0.125f));
+
+	unsigned int seed = 54321;
+
+	// velocities of up to a cell per unit of time, so the traces back cross cell boundaries
+	volume.velocity.Resize(width, height, depth);
+	volume.temperature.Resize(width, height, depth);
+	volume.density.Resize(width, height, depth);
+	volume.reaction.Resize(width, height, depth);
+	volume.pressure.Resize(width, height, depth);
+	volume.divergence.Resize(width, height, depth);
+	for (int i = 0; i < width * height * depth; ++i) {
+		volume.velocity.Set(i, 2.0f * Vector3(NextRandom(seed), NextRandom(seed), NextRandom(seed)));
+		volume.temperature.values[i] = NextRandom(seed) + 0.5f;
+		volume.density.values[i] = NextRandom(seed) + 0.5f;
+		volume.reaction.values[i] = NextRandom(seed) + 0.5f;
+		volume.pressure.values[i] = NextRandom(seed);
+		volume.divergence.values[i] = NextRandom(seed);
+	}
+
+	bool result = CreateConstantBuffer(&volume.general, sizeof(InputBufferGeneral), volume.generalBuffer);
+	result = result && CreateVolume(dimensions, DXGI_FORMAT_R8_UINT, &volume.obstacles.flags[0], sizeof(unsigned char), volume.obstaclesSP);
+	result = result && CreateVolume(volume.obstacles.velocity, nullptr, volume.obstacleVelocitySP);
+	result = result && CreateVolume(volume.velocity, nullptr, volume.velocitySP);
+	result = result && CreateVolume(dimensions, DXGI_FORMAT_R32_FLOAT, &volume.temperature.values[0], sizeof(float), volume.temperatureSP);
+	result = result && CreateVolume(dimensions, DXGI_FORMAT_R32_FLOAT, &volume.density.values[0], sizeof(float), volume.densitySP);
+	result = result && CreateVolume(dimensions, DXGI_FORMAT_R32_FLOAT, &volume.reaction.values[0], sizeof(float), volume.reactionSP);
+	result = result && CreateVolume(dimensions, DXGI_FORMAT_R32_FLOAT, &volume.pressure.values[0], sizeof(float), volume.pressureSP);
+	result = result && CreateVolume(dimensions, DXGI_FORMAT_R32_FLOAT, &volume.divergence.values[0], sizeof(float), volume.divergenceSP);
+
+	return result;
+}
+
+bool SolverCrossCheck::Report(const char *kernel, const Vector3 &dimensions, float difference, float largestValue, float tolerance) {
+	bool passed = difference <= tolerance * max(1.0f, largestValue);
+
+	printf("%s (%dx%dx%d): max difference %g, largest value %g, tolerance %g - %s\n",
+		kernel, (int)dimensions.x, (int)dimensions.y, (int)dimensions.z, difference, largestValue, tolerance, passed ? "passed" : "FAILED");
+
+	return passed;
+}
+
+bool SolverCrossCheck::CreateConstantBuffer(const void *data, UINT size, CComPtr<ID3D11Buffer> &buffer) {
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	bufferDesc.ByteWidth = size;
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.CPUAccessFlags = 0;
+	bufferDesc.MiscFlags = 0;
+	bufferDesc.StructureByteStride = 0;
+
+	D3D11_SUBRESOURCE_DATA initialData;
+	initialData.pSysMem = data;
+	initialData.SysMemPitch = 0;
+	initialData.SysMemSlicePitch = 0;
+
+	HRESULT hr = mDevice->CreateBuffer(&bufferDesc, &initialData, &buffer);
+	return SUCCEEDED(hr);
+}
+
+bool SolverCrossCheck::CreateStructuredBuffer(const void *data, UINT numElements, UINT elementSize, ShaderParams &shaderParams) {
+	D3D11_BUFFER_DESC bufferDesc;
+	ZeroMemory(&bufferDesc, sizeof(D3D11_BUFFER_DESC));
+	bufferDesc.ByteWidth = numElements * elementSize;
+	bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bufferDesc.StructureByteStride = elementSize;
+
+	D3D11_SUBRESOURCE_DATA initialData;
+	initialData.pSysMem = data;
+	initialData.SysMemPitch = 0;
+	initialData.SysMemSlicePitch = 0;
+
+	CComPtr<ID3D11Buffer> buffer;
+	HRESULT hr = mDevice->CreateBuffer(&bufferDesc, &initialData, &buffer);
+	if (FAILED(hr)) {
+		return false;
+	}
+	hr = mDevice->CreateShaderResourceView(buffer, NULL, &shaderParams.mSRV);
+	return SUCCEEDED(hr);
+}
+
+bool SolverCrossCheck::CreateVolume(const Vector3 &dimensions, DXGI_FORMAT format, const void *data, UINT elementSize, ShaderParams &shaderParams) {
+	D3D11_TEXTURE3D_DESC textureDesc;
+	ZeroMemory(&textureDesc, sizeof(D3D11_TEXTURE3D_DESC));
+	textureDesc.Width = (UINT) dimensions.x;
+	textureDesc.Height = (UINT) dimensions.y;
+	textureDesc.Depth = (UINT) dimensions.z;
+	textureDesc.MipLevels = 1;
+	textureDesc.Format = format;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	textureDesc.CPUAccessFlags = 0;
+	textureDesc.MiscFlags = 0;
+
+	D3D11_SUBRESOURCE_DATA initialData;
+	initialData.pSysMem = data;
+	initialData.SysMemPitch = textureDesc.Width * elementSize;
+	initialData.SysMemSlicePitch = textureDesc.Width * textureDesc.Height * elementSize;
+
+	CComPtr<ID3D11Texture3D> texture;
+	HRESULT hr = mDevice->CreateTexture3D(&textureDesc, &initialData, &texture);
+	if (FAILED(hr)) {
+		return false;
+	}
+	hr = mDevice->CreateShaderResourceView(texture, NULL, &shaderParams.mSRV);
+	if (FAILED(hr)) {
+		return false;
+	}
+	hr = mDevice->CreateUnorderedAccessView(texture, NULL, &shaderParams.mUAV);
+	if (FAILED(hr)) {
+		return false;
+	}
+
+	return true;
+}
+
+bool SolverCrossCheck::CreateVolume(const VectorField3D &field, const ScalarField3D *fourth, ShaderParams &shaderParams) {
+	const int numCells = field.x.GetNumCells();
+	vector<float> texels(4 * numCells, 0.0f);
+	for (int i = 0; i < numCells; ++i) {
+		texels[4*i] = field.x.values[i];
+		texels[4*i + 1] = field.y.values[i];
+		texels[4*i + 2] = field.z.values[i];
+		if (fourth) {
+			texels[4*i + 3] = fourth->values[i];
+		}
+	}
+
+	Vector3 dimensions((float)field.x.width, (float)field.x.height, (float)field.x.depth);
+	return CreateVolume(dimensions, DXGI_FORMAT_R32G32B32A32_FLOAT, &texels[0], 4 * sizeof(float), shaderParams);
+}
+
+bool SolverCrossCheck::ReadVolume(ShaderParams &shaderParams, ScalarField3D &result) {
+	return ReadTexture(shaderParams, DXGI_FORMAT_R32_FLOAT, sizeof(float), result.width, result.height, result.depth, &result.values[0]);
+}
+
+bool SolverCrossCheck::ReadVolume(ShaderParams &shaderParams, VectorField3D &result, ScalarField3D *fourth) {
+	const int numCells = result.x.GetNumCells();
+	vector<float> texels(4 * numCells);
+	bool success = ReadTexture(shaderParams, DXGI_FORMAT_R32G32B32A32_FLOAT, 4 * sizeof(float), result.x.width, result.x.height, result.x.depth, &texels[0]);
+	if (!success) {
+		return false;
+	}
+
+	for (int i = 0; i < numCells; ++i) {
+		result.Set(i, Vector3(texels[4*i], texels[4*i + 1], texels[4*i + 2]));
+		if (fourth) {
+			fourth->values[i] = texels[4*i + 3];
+		}
+	}
+	return true;
+}
+
+bool SolverCrossCheck::ReadTexture(ShaderParams &shaderParams, DXGI_FORMAT format, UINT elementSize, int width, int height, int depth, void *result) {
+	D3D11_TEXTURE3D_DESC textureDesc;
+	ZeroMemory(&textureDesc, sizeof(D3D11_TEXTURE3D_DESC));
+	textureDesc.Width = (UINT) width;
+	textureDesc.Height = (UINT) height;
+	textureDesc.Depth = (UINT) depth;
+	textureDesc.MipLevels = 1;
+	textureDesc.Format = format;
+	textureDesc.Usage = D3D11_USAGE_STAGING;
+	textureDesc.BindFlags = 0;
+	textureDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	textureDesc.MiscFlags = 0;
+
+	CComPtr<ID3D11Texture3D> stagingTexture;
+	HRESULT hr = mDevice->CreateTexture3D(&textureDesc, NULL, &stagingTexture);
+	if (FAILED(hr)) {
+		return false;
+	}
+
+	CComPtr<ID3D11Resource> sourceResource;
+	shaderParams.mUAV->GetResource(&sourceResource);
+	mDeviceContext->CopyResource(stagingTexture, sourceResource);
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	hr = mDeviceContext->Map(stagingTexture, 0, D3D11_MAP_READ, 0, &mappedResource);
+	if (FAILED(hr)) {
+		return false;
+	}
+
+	// rows and slices of the mapped texture may be padded
+	const char *data = (const char*)mappedResource.pData;
+	char *destination = (char*)result;
+	const UINT rowSize = width * elementSize;
+	for (int z = 0; z < depth; ++z) {
+		for (int y = 0; y < height; ++y) {
+			const char *row = data + z * mappedResource.DepthPitch + y * mappedResource.RowPitch;
+			memcpy(destination + (z * height + y) * rowSize, row, rowSize);
+		}
+	}
+
+	mDeviceContext->Unmap(stagingTexture, 0);
+	return true;
+}
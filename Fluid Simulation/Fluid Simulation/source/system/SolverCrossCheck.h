@@ -0,0 +1,73 @@
+/***************************************************************
+SolverCrossCheck.h: Runs the simulation compute shaders on a
+WARP device and compares their output against the CPU kernels of
+Fluid3DCPUKernels. Needs no window and no GPU, so it can be run
+next to the headless simulations.
+
+Author: Valentin Hinov
+Date: 06/05/2014
+Version: 1.0
+**************************************************************/
+#ifndef _SOLVERCROSSCHECK_H_
+#define _SOLVERCROSSCHECK_H_
+
+#include "../utilities/AtlInclude.h"
+#include "../utilities/D3dIncludes.h"
+#include "../display/D3DShaders/ShaderParams.h"
+
+namespace Fluid3D {
+	struct ScalarField3D;
+	struct VectorField3D;
+}
+
+class SolverCrossCheck {
+public:
+	SolverCrossCheck();
+	~SolverCrossCheck();
+
+	bool Initialize();
+	// Runs every check and prints its result. Returns false if any of them failed
+	bool Run();
+
+private:
+	// The CPU fields of a pseudo random volume and their copies on the device
+	struct SeededVolume;
+
+	// Runs the given number of red-black sweeps on both implementations from the same
+	// starting point and compares the results
+	bool CheckRedBlackSOR(const Vector3 &dimensions, int sweeps, float overRelaxation);
+
+	// Runs every kernel of a simulation step once on both implementations from the same seeded volume
+	// and compares the results kernel by kernel
+	bool CheckStepKernels(const Vector3 &dimensions);
+
+	bool CheckAdvection(SeededVolume &volume);
+	bool CheckMacCormack(SeededVolume &volume);
+	bool CheckBuoyancy(SeededVolume &volume);
+	bool CheckImpulses(SeededVolume &volume);
+	bool CheckVorticityConfinement(SeededVolume &volume);
+	bool CheckDivergence(SeededVolume &volume);
+	bool CheckJacobi(SeededVolume &volume, int iterations);
+	bool CheckSubtractGradient(SeededVolume &volume);
+
+	bool SeedVolume(const Vector3 &dimensions, SeededVolume &volume);
+	// Passes if the difference is within tolerance of the largest value, or of 1 for small values
+	bool Report(const char *kernel, const Vector3 &dimensions, float difference, float largestValue, float tolerance);
+
+	bool CreateConstantBuffer(const void *data, UINT size, CComPtr<ID3D11Buffer> &buffer);
+	bool CreateStructuredBuffer(const void *data, UINT numElements, UINT elementSize, ShaderParams &shaderParams);
+	bool CreateVolume(const Vector3 &dimensions, DXGI_FORMAT format, const void *data, UINT elementSize, ShaderParams &shaderParams);
+	// Interleaves the field into a four channel volume, the fourth channel is zero unless given
+	bool CreateVolume(const Fluid3D::VectorField3D &field, const Fluid3D::ScalarField3D *fourth, ShaderParams &shaderParams);
+	bool ReadVolume(ShaderParams &shaderParams, Fluid3D::ScalarField3D &result);
+	// Reads back a four channel volume, the fourth channel is skipped unless fourth is given
+	bool ReadVolume(ShaderParams &shaderParams, Fluid3D::VectorField3D &result, Fluid3D::ScalarField3D *fourth);
+	bool ReadTexture(ShaderParams &shaderParams, DXGI_FORMAT format, UINT elementSize, int width, int height, int depth, void *result);
+
+private:
+	CComPtr<ID3D11Device>			mDevice;
+	CComPtr<ID3D11DeviceContext>	mDeviceContext;
+	CComPtr<ID3D11SamplerState>		mSampleState;
+};
+
+#endif
@@ -0,0 +1,77 @@
+/********************************************************************
+Fluid3DBricks.h: Constants and helpers of the sparse brick tracking
+and the bounded impulses shared by the GPU and CPU calculators.
+
+The volume is split into bricks of BRICK_SIZE^3 cells, one thread
+group each. A brick is active while any of its cells holds a
+temperature, density, reaction or velocity above the activity
+threshold in either buffer of the field. Advection, buoyancy and the
+impulses only run on the active bricks and their halo, every other
+brick keeps values below the threshold.
+
+Author:	Valentin Hinov
+Date: 8/5/2014
+*********************************************************************/
+
+#ifndef _FLUID3DBRICKS_H
+#define _FLUID3DBRICKS_H
+
+#include <vector>
+#include <cmath>
+#include "../math/MathUtils.h"
+
+// Side of a brick in cells, the same as the thread group size of the shaders
+#define BRICK_SIZE 8
+// A list of bricks is kept for every halo width up to this one. The passes run on the bricks within one brick of an
+// active one. The MacCormack correction reads the backward step one brick further out, which reads the forward step
+// one brick further still, so the intermediate steps run on the bricks within three and two bricks respectively.
+// Assumes the fluid moves less than a brick per step
+#define BRICK_MAX_HALO 3
+#define BRICK_HALO_FORWARD 3
+#define BRICK_HALO_BACKWARD 2
+#define BRICK_HALO_PASSES 1
+
+// Impulses are only applied where they add at least this fraction of their peak
+#define IMPULSE_FALLOFF_CUTOFF 1e-4f
+// Impulses that can be added to a single step, on top of the constant input's
+#define MAX_IMPULSE_SOURCES 256
+#define CONSTANT_INPUT_SOURCES 2
+
+namespace Fluid3D {
+
+// Indices of the bricks to process, numbered x first, then y, then z like the cells
+typedef std::vector<int> BrickList;
+
+inline int GetBrickCount(int cells) {
+	return (cells + BRICK_SIZE - 1) / BRICK_SIZE;
+}
+
+// Distance from the centre of an impulse beyond which it adds less than threshold in a step. The impulses fall off
+// as exp(-d^4 / r^2) and peak at peakAmount
+inline float GetImpulseReach(float radius, float peakAmount, float threshold) {
+	if (peakAmount <= threshold || radius <= 0.0f) {
+		return 0.0f;
+	}
+	return sqrt(radius * sqrt(log(peakAmount / threshold)));
+}
+
+// Cells, inclusive, an impulse adds at least IMPULSE_FALLOFF_CUTOFF of its peak to. Returns false if it misses the volume
+inline bool GetImpulseRegion(const Vector3 &centre, float radius, const Vector3 &dimensions, int regionMin[3], int regionMax[3]) {
+	const float reach = GetImpulseReach(radius, 1.0f, IMPULSE_FALLOFF_CUTOFF);
+	const float centres[3] = {centre.x, centre.y, centre.z};
+	const float sizes[3] = {dimensions.x, dimensions.y, dimensions.z};
+	for (int axis = 0; axis < 3; ++axis) {
+		int low = (int)ceil(centres[axis] - reach);
+		int high = (int)floor(centres[axis] + reach);
+		if (high < 0 || low > (int)sizes[axis] - 1 || low > high) {
+			return false;
+		}
+		regionMin[axis] = Max(low, 0);
+		regionMax[axis] = Min(high, (int)sizes[axis] - 1);
+	}
+	return true;
+}
+
+}
+
+#endif
\ No newline at end of file
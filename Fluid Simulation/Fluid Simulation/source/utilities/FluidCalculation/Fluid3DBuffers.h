@@ -29,11 +29,78 @@ namespace Fluid3D {
 		float padding1;
 	};
 
-	struct InputBufferImpulse {
-		Vector3 vPoint;				
+	struct InputBufferRedBlack {
+		float fOverRelaxation;
+		unsigned int uParity;
+		float padding3[2];
+	};
+
+	// Everything the impulse shaders add in a step. The impulses themselves are in a structured buffer of ImpulseSourceData
+	struct InputBufferInjection {
+		unsigned int uImpulseSourceCount;
+		float fSmokeAmount;
+		float fInputExtinguishment;
+		float padding4;
+		unsigned int vInjectionRegionMin[3];	// cells any source adds to, inclusive. Empty if min > max
+		float padding2;
+		unsigned int vInjectionRegionMax[3];
+		float padding9;
+	};
+
+	// An entry of the impulse source structured buffer. The point and the region are in cells
+	struct ImpulseSourceData {
+		Vector3 vPoint;
 		float fRadius;
-		Vector3 vAmount;
-		float fExtinguishment;
+		Vector3 vAmount;				// scalar fields only receive x
+		unsigned int uTarget;			// ImpulseTarget_t
+		unsigned int vRegionMin[3];		// cells the source adds to, inclusive
+		unsigned int vRegionMax[3];
+	};
+
+	struct InputBufferScalarAdvection {
+		Vector3 vScalarDissipation;	// temperature, density and reaction
+		float fReactionDecay;
+		Vector3 vScalarMacCormack;	// 1 for the fields advected with MacCormack, 0 for the rest
+		float padding5;
+	};
+
+	struct InputBufferBricks {
+		unsigned int vBrickCount[3];
+		float fBrickThreshold;
+		unsigned int uAllBricksActive;
+		float padding6[3];
+	};
+
+	// Cells the obstacle shader voxelizes again in a step. The boxes overlapping them are in a structured buffer of ObstacleBoxData
+	struct InputBufferObstacles {
+		unsigned int vObstacleRegionMin[3];	// inclusive
+		unsigned int uObstacleBoxCount;
+		unsigned int vObstacleRegionMax[3];
+		float padding7;
+	};
+
+	// An entry of the obstacle box structured buffer, in cells. A cell p is inside of the box if every component of
+	// (dot(vInverseX, p - vCentre), dot(vInverseY, p - vCentre), dot(vInverseZ, p - vCentre)) lies within [-1, 1]. The
+	// previous pose gives where that point of the box was a step ago
+	struct ObstacleBoxData {
+		Vector3 vCentre;
+		Vector3 vInverseX;				// rows of the inverse of the matrix whose columns are the half axes
+		Vector3 vInverseY;
+		Vector3 vInverseZ;
+		Vector3 vPreviousCentre;
+		Vector3 vPreviousAxisX;
+		Vector3 vPreviousAxisY;
+		Vector3 vPreviousAxisZ;
+		unsigned int vRegionMin[3];		// cells the box covers, inclusive
+		unsigned int vRegionMax[3];
+	};
+
+	// Moving a field between the grids of two resolution tiers
+	struct InputBufferResample {
+		unsigned int uResampleRatio;	// cells of the finer grid along each axis of a cell of the coarser one
+		float fResampleScale;
+		float fResampleMinimum;
+		float padding8;
 	};
 }
 
@@ -0,0 +1,793 @@
+/********************************************************************
+Fluid3DCPUCalculator.cpp: Implementation of Fluid3DCPUCalculator
+
+Author:	Valentin Hinov
+Date: 2/5/2014
+*********************************************************************/
+
+#include "Fluid3DCPUCalculator.h"
+#include "Fluid3DCPUKernels.h"
+#include "Fluid3DMultigrid.h"
+
+#define READ 0
+#define WRITE 1
+
+using namespace std;
+using namespace Fluid3D;
+
+Fluid3DCPUCalculator::Fluid3DCPUCalculator(const FluidSettings &fluidSettings) :
+	mFluidSettings(fluidSettings), mStageTimer(mStageProfiler), mPCGResidualDotPreconditioned(0.0), mFluidCellCount(0.0)
+{
+
+}
+
+Fluid3DCPUCalculator::~Fluid3DCPUCalculator() {
+
+}
+
+bool Fluid3DCPUCalculator::Initialize() {
+	int width = (int)mFluidSettings.dimensions.x;
+	int height = (int)mFluidSettings.dimensions.y;
+	int depth = (int)mFluidSettings.dimensions.z;
+	if (width <= 0 || height <= 0 || depth <= 0) {
+		return false;
+	}
+
+	for (int i = 0; i < 2; ++i) {
+		mVelocity[i].Resize(width, height, depth);
+		mDensity[i].Resize(width, height, depth);
+		mTemperature[i].Resize(width, height, depth);
+		if (mFluidSettings.GetFluidType() == FIRE) {
+			mReaction[i].Resize(width, height, depth);
+		}
+		mTemp[i].Resize(width, height, depth);
+	}
+	mVorticity.Resize(width, height, depth);
+	mPressure.Resize(width, height, depth);
+	mVorticityLength.Resize(width, height, depth);
+	mDivergence.Resize(width, height, depth);
+	mResidual.Resize(width, height, depth);
+	mObstacles.Resize(width, height, depth);
+	mPCGResidual.Resize(width, height, depth);
+	mPCGPreconditioned.Resize(width, height, depth);
+	mPCGDirection.Resize(width, height, depth);
+	mFluidMask.Resize(width, height, depth);
+	mLaplacianDiagonal.Resize(width, height, depth);
+
+	vector<Vector3> levelDimensions = GetMultigridLevelDimensions(mFluidSettings.dimensions);
+	mMultigridLevels.resize(levelDimensions.size());
+	for (size_t level = 0; level < levelDimensions.size(); ++level) {
+		int levelWidth = (int)levelDimensions[level].x;
+		int levelHeight = (int)levelDimensions[level].y;
+		int levelDepth = (int)levelDimensions[level].z;
+		MultigridLevel &current = mMultigridLevels[level];
+		current.rightHandSide.Resize(levelWidth, levelHeight, levelDepth);
+		current.correction.Resize(levelWidth, levelHeight, levelDepth);
+		current.residual.Resize(levelWidth, levelHeight, levelDepth);
+		current.obstacles.Resize(levelWidth, levelHeight, levelDepth);
+	}
+
+	UpdateGeneralBuffer();
+
+	// the first voxelization covers the whole volume
+	UpdateObstacles();
+
+	return true;
+}
+
+void Fluid3DCPUCalculator::AddForce(const ExtraForce& force) {
+	ImpulseSource impulse;
+	impulse.target = IMPULSE_TARGET_VELOCITY;
+	impulse.position = force.position;
+	impulse.radius = force.radius;
+	impulse.amount = force.amount;
+	AddImpulse(impulse);
+}
+
+bool Fluid3DCPUCalculator::AddImpulse(const ImpulseSource& impulse) {
+	if (mImpulses.size() >= MAX_IMPULSE_SOURCES) {
+		return false;
+	}
+	mImpulses.push_back(impulse);
+	Wake();
+	return true;
+}
+
+void Fluid3DCPUCalculator::SetObstacles(const vector<ObstacleBox> &boxes) {
+	if (!HaveSameObstacleBoxes(boxes, mObstacleBoxes)) {
+		Wake();
+	}
+	mObstacleBoxes = boxes;
+}
+
+int Fluid3DCPUCalculator::Process(int frames) {
+	if (mActivityStats.sleeping) {
+		mTimeStepPlan = TimeStepPlan();
+		return 0;
+	}
+
+	if (!mFluidSettings.adaptiveTimeStep) {
+		mTimeStepper.Reset();
+		if (frames <= 1) {
+			mTimeStepPlan.steps = 1;
+			mTimeStepPlan.timeStep = mFluidSettings.timeStep;
+			Step();
+			if (mFluidSettings.sleepWhenQuiet) {
+				MeasureActivity();
+			}
+			return 1;
+		}
+		mTimeStepPlan = AdaptiveTimeStepper::PlanSkippedFrames(mFluidSettings, mActivityStats.maxSpeed, frames);
+	}
+	else {
+		mTimeStepPlan = mTimeStepper.Plan(mFluidSettings, mActivityStats.maxSpeed, frames);
+	}
+	if (mTimeStepPlan.steps == 0) {
+		return 0;
+	}
+
+	// the steps run on the settings scaled to their length, the frame's own are put back once they are done
+	FluidSettings frameSettings = mFluidSettings;
+	mFluidSettings = AdaptiveTimeStepper::GetStepSettings(frameSettings, mTimeStepPlan.timeStep);
+	UpdateGeneralBuffer();
+	for (int i = 0; i < mTimeStepPlan.steps; ++i) {
+		Step();
+	}
+	mFluidSettings = frameSettings;
+	UpdateGeneralBuffer();
+	MeasureActivity();
+
+	return mTimeStepPlan.steps;
+}
+
+void Fluid3DCPUCalculator::MeasureActivity() {
+	const ScalarField3D *reaction = mFluidSettings.GetFluidType() == FIRE ? &mReaction[READ] : nullptr;
+	CPUKernels::ActivityReduction(mVelocity[READ], mTemperature[READ], mDensity[READ], reaction, mActivityStats);
+
+	bool quiet = mFluidSettings.sleepWhenQuiet && mActivityStats.IsBelow(mFluidSettings.sleepThreshold);
+	mActivityStats.quietSteps = quiet ? mActivityStats.quietSteps + 1 : 0;
+	mActivityStats.sleeping = mActivityStats.quietSteps >= SLEEP_QUIET_STEPS;
+}
+
+void Fluid3DCPUCalculator::Wake() {
+	mActivityStats.quietSteps = 0;
+	mActivityStats.sleeping = false;
+}
+
+void Fluid3DCPUCalculator::Step() {
+	mStageTimer.BeginStep(mFluidSettings.profileStages);
+	mStageTimer.Begin(STAGE_STEP);
+
+	mStageTimer.Begin(STAGE_OBSTACLES);
+	UpdateObstacles();
+	mStageTimer.End(STAGE_OBSTACLES);
+	UpdateInjectionBuffer();
+	mStageTimer.Begin(STAGE_BRICKS);
+	UpdateActiveBricks();
+	mStageTimer.End(STAGE_BRICKS);
+
+	if (mFluidSettings.packedScalarAdvection) {
+		mStageTimer.Begin(STAGE_ADVECT_SCALARS);
+		AdvectScalars();
+		mStageTimer.End(STAGE_ADVECT_SCALARS);
+	}
+	else {
+		//Advect temperature against velocity
+		mStageTimer.Begin(STAGE_ADVECT_TEMPERATURE);
+		Advect(mTemperature, NORMAL, mFluidSettings.temperatureDissipation);
+		mStageTimer.End(STAGE_ADVECT_TEMPERATURE);
+
+		// Advect density against velocity
+		mStageTimer.Begin(STAGE_ADVECT_DENSITY);
+		Advect(mDensity, mFluidSettings.advectionType, mFluidSettings.densityDissipation);
+		mStageTimer.End(STAGE_ADVECT_DENSITY);
+
+		// Advect the reaction field against velocity
+		if (mFluidSettings.GetFluidType() == FIRE) {
+			mStageTimer.Begin(STAGE_ADVECT_REACTION);
+			Advect(mReaction, mFluidSettings.advectionType, 1.0f, mFluidSettings.reactionDecay);
+			mStageTimer.End(STAGE_ADVECT_REACTION);
+		}
+	}
+
+	// Advect velocity against itself
+	mStageTimer.Begin(STAGE_ADVECT_VELOCITY);
+	AdvectVelocity(mFluidSettings.advectionType, mFluidSettings.velocityDissipation);
+	mStageTimer.End(STAGE_ADVECT_VELOCITY);
+
+	if (mFluidSettings.fusedKernels) {
+		mStageTimer.Begin(STAGE_BUOYANCY_AND_IMPULSES);
+		ApplyBuoyancyAndImpulses();
+		mStageTimer.End(STAGE_BUOYANCY_AND_IMPULSES);
+	}
+	else {
+		//Determine how the temperature of the fluid changes the velocity
+		mStageTimer.Begin(STAGE_BUOYANCY);
+		CPUKernels::Buoyancy(mVelocity[READ], mTemperature[READ], mDensity[READ], mInputBufferGeneral, mVelocity[WRITE], GetBrickList(BRICK_HALO_PASSES));
+		swap(mVelocity[READ], mVelocity[WRITE]);
+		mStageTimer.End(STAGE_BUOYANCY);
+
+		// Add a constant amount of density and temperature back into the system, along with any extra forces and impulses
+		mStageTimer.Begin(STAGE_IMPULSES);
+		ApplyImpulses();
+		mStageTimer.End(STAGE_IMPULSES);
+	}
+
+	if (mFluidSettings.fusedKernels) {
+		mStageTimer.Begin(STAGE_VORTICITY_AND_DIVERGENCE);
+		ComputeVorticityConfinementAndDivergence();
+		mStageTimer.End(STAGE_VORTICITY_AND_DIVERGENCE);
+	}
+	else {
+		// Try to preserve swirling movement of the fluid by injecting vorticity back into the system
+		mStageTimer.Begin(STAGE_VORTICITY);
+		ComputeVorticityConfinement();
+		mStageTimer.End(STAGE_VORTICITY);
+
+		// Calculate the divergence of the velocity
+		mStageTimer.Begin(STAGE_DIVERGENCE);
+		CPUKernels::Divergence(mVelocity[READ], mObstacles, mDivergence);
+		mStageTimer.End(STAGE_DIVERGENCE);
+	}
+
+	// the fused Jacobi solver runs its last iteration together with the gradient subtraction
+	bool fuseLastIteration = mFluidSettings.fusedKernels && mFluidSettings.pressureSolverType == JACOBI;
+	bool solverConverged = CalculatePressureGradient(fuseLastIteration ? 1 : 0);
+
+	mStageTimer.Begin(STAGE_SUBTRACT_GRADIENT);
+	if (fuseLastIteration && !solverConverged) {
+		CPUKernels::JacobiSubtractGradient(mVelocity[READ], mPressure, mDivergence, mObstacles, mVelocity[WRITE], mResidual);
+		swap(mPressure, mResidual);
+		++mPressureSolverStats.iterationsUsed;
+	}
+	else {
+		//Use the pressure field that was last computed. This computes divergence free velocity
+		CPUKernels::SubtractGradient(mVelocity[READ], mPressure, mObstacles, mVelocity[WRITE]);
+	}
+	swap(mVelocity[READ], mVelocity[WRITE]);
+	mStageTimer.End(STAGE_SUBTRACT_GRADIENT);
+
+	mImpulses.clear();
+
+	mStageTimer.End(STAGE_STEP);
+	mStageTimer.EndStep();
+}
+
+void Fluid3DCPUCalculator::Advect(std::array<ScalarField3D, 2> &target, SystemAdvectionType_t advectionType, float dissipation, float decay) {
+	switch (advectionType) {
+	case NORMAL:
+		UpdateAdvectionBuffer(dissipation, 1.0f, decay);
+		CPUKernels::Advect(mVelocity[READ], target[READ], mObstacles, mInputBufferGeneral, mInputBufferAdvection, target[WRITE], GetBrickList(BRICK_HALO_PASSES));
+		break;
+	case MACCORMARCK:
+		UpdateAdvectionBuffer(1.0f, 1.0f, 0.0f);
+		CPUKernels::Advect(mVelocity[READ], target[READ], mObstacles, mInputBufferGeneral, mInputBufferAdvection, mTemp[0].x, GetBrickList(BRICK_HALO_FORWARD));
+		// advect backwards a step
+		UpdateAdvectionBuffer(1.0f, -1.0f, 0.0f);
+		CPUKernels::Advect(mVelocity[READ], mTemp[0].x, mObstacles, mInputBufferGeneral, mInputBufferAdvection, mTemp[1].x, GetBrickList(BRICK_HALO_BACKWARD));
+		// proceed with MacCormack advection
+		UpdateAdvectionBuffer(dissipation, 1.0f, decay);
+		CPUKernels::AdvectMacCormack(mVelocity[READ], mTemp[0].x, mTemp[1].x, target[READ], mObstacles, mInputBufferGeneral, mInputBufferAdvection, target[WRITE], GetBrickList(BRICK_HALO_PASSES));
+		break;
+	}
+	swap(target[READ], target[WRITE]);
+}
+
+void Fluid3DCPUCalculator::AdvectVelocity(SystemAdvectionType_t advectionType, float dissipation) {
+	switch (advectionType) {
+	case NORMAL:
+		UpdateAdvectionBuffer(dissipation, 1.0f, 0.0f);
+		CPUKernels::Advect(mVelocity[READ], mVelocity[READ], mObstacles, mInputBufferGeneral, mInputBufferAdvection, mVelocity[WRITE], GetBrickList(BRICK_HALO_PASSES));
+		break;
+	case MACCORMARCK:
+		UpdateAdvectionBuffer(1.0f, 1.0f, 0.0f);
+		CPUKernels::Advect(mVelocity[READ], mVelocity[READ], mObstacles, mInputBufferGeneral, mInputBufferAdvection, mTemp[0], GetBrickList(BRICK_HALO_FORWARD));
+		// advect backwards a step
+		UpdateAdvectionBuffer(1.0f, -1.0f, 0.0f);
+		CPUKernels::Advect(mVelocity[READ], mTemp[0], mObstacles, mInputBufferGeneral, mInputBufferAdvection, mTemp[1], GetBrickList(BRICK_HALO_BACKWARD));
+		// proceed with MacCormack advection
+		UpdateAdvectionBuffer(dissipation, 1.0f, 0.0f);
+		CPUKernels::AdvectMacCormack(mVelocity[READ], mTemp[0], mTemp[1], mVelocity[READ], mObstacles, mInputBufferGeneral, mInputBufferAdvection, mVelocity[WRITE], GetBrickList(BRICK_HALO_PASSES));
+		break;
+	}
+	swap(mVelocity[READ], mVelocity[WRITE]);
+}
+
+void Fluid3DCPUCalculator::AdvectScalars() {
+	bool isFire = mFluidSettings.GetFluidType() == FIRE;
+	UpdateScalarAdvectionBuffer();
+
+	// the reaction entries stay empty for smoke
+	const ScalarField3D *targets[3] = {&mTemperature[READ], &mDensity[READ], isFire ? &mReaction[READ] : nullptr};
+	ScalarField3D *results[3] = {&mTemperature[WRITE], &mDensity[WRITE], isFire ? &mReaction[WRITE] : nullptr};
+
+	switch (mFluidSettings.advectionType) {
+	case NORMAL:
+		CPUKernels::AdvectScalars(mVelocity[READ], targets, mObstacles, mInputBufferGeneral, mInputBufferScalarAdvection, results, GetBrickList(BRICK_HALO_PASSES));
+		break;
+	case MACCORMARCK:
+		// the forward and backward steps keep the three fields packed in the temporary fields
+		CPUKernels::AdvectScalarsForward(mVelocity[READ], targets, mObstacles, mInputBufferGeneral, mInputBufferScalarAdvection, mTemp[0], GetBrickList(BRICK_HALO_FORWARD));
+		CPUKernels::AdvectScalarsBackward(mVelocity[READ], mTemp[0], isFire, mObstacles, mInputBufferGeneral, mInputBufferScalarAdvection, mTemp[1], GetBrickList(BRICK_HALO_BACKWARD));
+		CPUKernels::AdvectScalarsMacCormack(mVelocity[READ], mTemp[0], mTemp[1], targets, mObstacles, mInputBufferGeneral, mInputBufferScalarAdvection, results, GetBrickList(BRICK_HALO_PASSES));
+		break;
+	}
+
+	swap(mTemperature[READ], mTemperature[WRITE]);
+	swap(mDensity[READ], mDensity[WRITE]);
+	if (isFire) {
+		swap(mReaction[READ], mReaction[WRITE]);
+	}
+}
+
+void Fluid3DCPUCalculator::ApplyImpulses() {
+	bool isFire = mFluidSettings.GetFluidType() == FIRE;
+	const ImpulseSourceData *sources = mImpulseSources.empty() ? nullptr : &mImpulseSources[0];
+	CPUKernels::ImpulseSources(mVelocity[READ], mTemperature[READ], mDensity[READ], isFire ? &mReaction[READ] : nullptr, mInputBufferGeneral, mInputBufferInjection, sources);
+
+	if (isFire) {
+		// Smoke forms as fire is extinguished
+		CPUKernels::ExtinguishmentImpulse(mReaction[READ], mDensity[READ], mInputBufferInjection, mDensity[WRITE], GetBrickList(BRICK_HALO_PASSES));
+		swap(mDensity[READ], mDensity[WRITE]);
+	}
+}
+
+void Fluid3DCPUCalculator::ApplyBuoyancyAndImpulses() {
+	const ImpulseSourceData *sources = mImpulseSources.empty() ? nullptr : &mImpulseSources[0];
+
+	if (mFluidSettings.GetFluidType() == FIRE) {
+		CPUKernels::BuoyancyImpulse(mVelocity[READ], mTemperature[READ], mDensity[READ], &mReaction[READ], mInputBufferGeneral, mInputBufferInjection, sources,
+			mVelocity[WRITE], mTemperature[WRITE], mDensity[WRITE], &mReaction[WRITE], GetBrickList(BRICK_HALO_PASSES));
+		swap(mReaction[READ], mReaction[WRITE]);
+	}
+	else {
+		CPUKernels::BuoyancyImpulse(mVelocity[READ], mTemperature[READ], mDensity[READ], nullptr, mInputBufferGeneral, mInputBufferInjection, sources,
+			mVelocity[WRITE], mTemperature[WRITE], mDensity[WRITE], nullptr, GetBrickList(BRICK_HALO_PASSES));
+	}
+	swap(mVelocity[READ], mVelocity[WRITE]);
+	swap(mTemperature[READ], mTemperature[WRITE]);
+	swap(mDensity[READ], mDensity[WRITE]);
+}
+
+void Fluid3DCPUCalculator::GetConstantInput(Vector3 &position, float &radius) const {
+	position = mFluidSettings.dimensions * mFluidSettings.constantInputPosition;
+	float size = mFluidSettings.dimensions.x + mFluidSettings.dimensions.y + mFluidSettings.dimensions.z;
+	radius = mFluidSettings.constantInputRadius * size;
+}
+
+void Fluid3DCPUCalculator::ComputeVorticityConfinement() {
+	CPUKernels::Vorticity(mVelocity[READ], mVorticity, mVorticityLength);
+	CPUKernels::Confinement(mVelocity[READ], mVorticity, mVorticityLength, mObstacles, mInputBufferGeneral, mVelocity[WRITE]);
+	swap(mVelocity[READ], mVelocity[WRITE]);
+}
+
+void Fluid3DCPUCalculator::ComputeVorticityConfinementAndDivergence() {
+	CPUKernels::Vorticity(mVelocity[READ], mVorticity, mVorticityLength);
+	CPUKernels::ConfinementDivergence(mVelocity[READ], mVorticity, mVorticityLength, mObstacles, mInputBufferGeneral, mVelocity[WRITE], mDivergence);
+	swap(mVelocity[READ], mVelocity[WRITE]);
+}
+
+bool Fluid3DCPUCalculator::CalculatePressureGradient(int reservedIterations) {
+	// clear pressure to prepare for the solver, unless last step's pressure is used as the initial guess
+	if (!mFluidSettings.warmStartPressure) {
+		mPressure.Fill(0.0f);
+	}
+
+	int maxIterations = mFluidSettings.GetMaxPressureIterations() - reservedIterations;
+	// the residual is checked on the same iterations as Fluid3DCalculator, so both solve alike
+	int checkInterval = mFluidSettings.residualCheckInterval;
+	bool measureResidual = mFluidSettings.pressureTolerance > 0.0f;
+	bool checkResidual = measureResidual && checkInterval > 0 && maxIterations > checkInterval;
+	bool converged = false;
+	bool residualMeasured = false;	// the stats hold the residual of the current pressure
+	mPressureSolverStats.residual = -1.0f;
+
+	if (mFluidSettings.pressureSolverType == PRECONDITIONED_CG) {
+		BeginConjugateGradient();
+	}
+
+	int i = 0;
+	while (i < maxIterations) {
+		// a batch runs up to the next residual measurement
+		mStageTimer.Begin(STAGE_PRESSURE_BATCH);
+		int iterations = 1;
+		switch (mFluidSettings.pressureSolverType) {
+		case JACOBI:
+			// several iterations per pass over the volume, up to the next residual measurement
+			iterations = Min(JACOBI_BLOCK_ITERATIONS, maxIterations - i);
+			if (checkResidual) {
+				iterations = Min(iterations, checkInterval - i % checkInterval);
+			}
+			// Jacobi cannot update in place, the residual field is free to use as its second buffer
+			CPUKernels::JacobiBlocked(mPressure, mDivergence, mObstacles, iterations, mResidual);
+			swap(mPressure, mResidual);
+			break;
+		case MULTIGRID:
+			MultigridVCycle(mPressure, mDivergence);
+			break;
+		case RED_BLACK_SOR:
+			SmoothPressure(mPressure, mDivergence, mObstacles, 1, mFluidSettings.sorOverRelaxation);
+			break;
+		case PRECONDITIONED_CG:
+			ConjugateGradientIteration();
+			break;
+		}
+		i += iterations;
+		residualMeasured = false;
+
+		if (checkResidual && i % checkInterval == 0 && i < maxIterations) {
+			mStageTimer.End(STAGE_PRESSURE_BATCH);
+			mStageTimer.Begin(STAGE_PRESSURE_RESIDUAL);
+			mPressureSolverStats.residual = MeasurePressureResidual();
+			residualMeasured = true;
+			mStageTimer.End(STAGE_PRESSURE_RESIDUAL);
+			if (mPressureSolverStats.residual < mFluidSettings.pressureTolerance) {
+				converged = true;
+				break;
+			}
+		}
+	}
+	mStageTimer.End(STAGE_PRESSURE_BATCH);
+	mPressureSolverStats.iterationsUsed = i;
+
+	// measuring the final residual for the stats costs a pass over the volume but no wait
+	if (measureResidual && !residualMeasured) {
+		mPressureSolverStats.residual = MeasurePressureResidual();
+	}
+	return converged;
+}
+
+float Fluid3DCPUCalculator::MeasurePressureResidual() {
+	CPUKernels::MultigridResidual(mPressure, mDivergence, mObstacles, mResidual);
+	return CPUKernels::ResidualReduction(mResidual);
+}
+
+void Fluid3DCPUCalculator::MultigridVCycle(ScalarField3D &target, const ScalarField3D &rightHandSide) {
+	int numLevels = (int)mMultigridLevels.size();
+
+	// Post-smoothing sweeps the colours in the opposite order to pre-smoothing and the coarse solves do half of
+	// their sweeps each way, which keeps the cycle symmetric so it can precondition the conjugate gradient solver
+
+	// grid too small to coarsen - relax on the fine grid only
+	if (numLevels == 0) {
+		SmoothPressure(target, rightHandSide, mObstacles, MULTIGRID_COARSE_ITERATIONS / 2);
+		SmoothPressure(target, rightHandSide, mObstacles, MULTIGRID_COARSE_ITERATIONS / 2, 1.0f, true);
+		return;
+	}
+
+	// smooth the fine grid and pass its residual down as the right hand side of the first coarse level
+	SmoothPressure(target, rightHandSide, mObstacles, MULTIGRID_PRE_SMOOTHING_STEPS);
+	CPUKernels::MultigridResidual(target, rightHandSide, mObstacles, mResidual);
+	CPUKernels::MultigridRestrict(mResidual, mMultigridLevels[0].obstacles, mMultigridLevels[0].rightHandSide);
+
+	// go down the hierarchy, every level solves for a correction starting from zero
+	for (int level = 0; level < numLevels; ++level) {
+		MultigridLevel &current = mMultigridLevels[level];
+		current.correction.Fill(0.0f);
+
+		if (level == numLevels - 1) {
+			SmoothPressure(current.correction, current.rightHandSide, current.obstacles, MULTIGRID_COARSE_ITERATIONS / 2);
+			SmoothPressure(current.correction, current.rightHandSide, current.obstacles, MULTIGRID_COARSE_ITERATIONS / 2, 1.0f, true);
+			break;
+		}
+
+		MultigridLevel &coarser = mMultigridLevels[level+1];
+		SmoothPressure(current.correction, current.rightHandSide, current.obstacles, MULTIGRID_PRE_SMOOTHING_STEPS);
+		CPUKernels::MultigridResidual(current.correction, current.rightHandSide, current.obstacles, current.residual);
+		CPUKernels::MultigridRestrict(current.residual, coarser.obstacles, coarser.rightHandSide);
+	}
+
+	// come back up, interpolating each coarse correction onto the level above it
+	for (int level = numLevels - 2; level >= 0; --level) {
+		MultigridLevel &current = mMultigridLevels[level];
+		CPUKernels::MultigridProlong(mMultigridLevels[level+1].correction, current.obstacles, current.correction);
+
+		SmoothPressure(current.correction, current.rightHandSide, current.obstacles, MULTIGRID_POST_SMOOTHING_STEPS, 1.0f, true);
+	}
+
+	CPUKernels::MultigridProlong(mMultigridLevels[0].correction, mObstacles, target);
+
+	SmoothPressure(target, rightHandSide, mObstacles, MULTIGRID_POST_SMOOTHING_STEPS, 1.0f, true);
+}
+
+void Fluid3DCPUCalculator::SmoothPressure(ScalarField3D &target, const ScalarField3D &rightHandSide, const ObstacleField3D &obstacles, int iterations, float overRelaxation, bool reverseOrder) {
+	// every iteration is a full sweep - the red cells followed by the black cells, or the other way around
+	int firstParity = reverseOrder ? 1 : 0;
+	for (int i = 0; i < iterations; ++i) {
+		CPUKernels::RedBlackSOR(target, rightHandSide, obstacles, overRelaxation, firstParity);
+		CPUKernels::RedBlackSOR(target, rightHandSide, obstacles, overRelaxation, 1 - firstParity);
+	}
+}
+
+void Fluid3DCPUCalculator::BeginConjugateGradient() {
+	// the residual of the current pressure starts the search, the zero direction makes the first update take the
+	// preconditioned residual as it is
+	CPUKernels::MultigridResidual(mPressure, mDivergence, mObstacles, mPCGResidual);
+
+	// An enclosed fluid only defines its pressure up to a constant, so a solution exists only if the divergence sums
+	// to zero. The central differenced divergence does not quite, and conjugate gradient would amplify that part
+	// instead of ignoring it like the relaxation solvers do
+	if (mFluidCellCount > 0.0) {
+		float mean = (float)(CPUKernels::PCGDotProduct(mPCGResidual, mFluidMask) / mFluidCellCount);
+		CPUKernels::PCGRemoveMean(mFluidMask, mean, mPCGResidual);
+	}
+
+	mPCGDirection.Fill(0.0f);
+	mPCGResidualDotPreconditioned = 0.0;
+
+	PreconditionConjugateGradient();
+}
+
+void Fluid3DCPUCalculator::ConjugateGradientIteration() {
+	CPUKernels::PCGLaplacian(mPCGDirection, mFluidMask, mLaplacianDiagonal, mResidual);
+
+	double directionDotLaplacian = CPUKernels::PCGDotProduct(mPCGDirection, mResidual);
+	float alpha = directionDotLaplacian != 0.0 ? (float)(mPCGResidualDotPreconditioned / directionDotLaplacian) : 0.0f;
+	CPUKernels::PCGUpdateSolution(mPCGDirection, mResidual, alpha, mPressure, mPCGResidual);
+
+	PreconditionConjugateGradient();
+}
+
+void Fluid3DCPUCalculator::PreconditionConjugateGradient() {
+	// one V-cycle from zero approximates the inverse of the pressure operator
+	mPCGPreconditioned.Fill(0.0f);
+	MultigridVCycle(mPCGPreconditioned, mPCGResidual);
+
+	double residualDotPreconditioned = CPUKernels::PCGDotProduct(mPCGResidual, mPCGPreconditioned);
+	float beta = mPCGResidualDotPreconditioned != 0.0 ? (float)(residualDotPreconditioned / mPCGResidualDotPreconditioned) : 0.0f;
+	mPCGResidualDotPreconditioned = residualDotPreconditioned;
+
+	CPUKernels::PCGUpdateDirection(mPCGPreconditioned, beta, mPCGDirection);
+}
+
+void Fluid3DCPUCalculator::UpdateActiveBricks() {
+	const int width = mVelocity[READ].x.width;
+	const int height = mVelocity[READ].x.height;
+	const int depth = mVelocity[READ].x.depth;
+	const int bricks[3] = {GetBrickCount(width), GetBrickCount(height), GetBrickCount(depth)};
+	const int numBricks = bricks[0] * bricks[1] * bricks[2];
+	mBrickOccupancyStats.totalBricks = numBricks;
+
+	if (!mFluidSettings.sparseBricks) {
+		mBrickOccupancyStats.activeBricks = numBricks;
+		mBrickOccupancyStats.processedBricks = numBricks;
+		mBrickOccupancyStats.processedPercentage = 100.0f;
+		return;
+	}
+
+	// A skipped brick keeps whatever the last pass to run on it wrote into each buffer of a field, so a brick only
+	// stays inactive while both buffers of every field are below the threshold
+	const float threshold = mFluidSettings.brickActivityThreshold;
+	vector<const ScalarField3D*> scalarFields;
+	for (int i = 0; i < 2; ++i) {
+		scalarFields.push_back(&mTemperature[i]);
+		scalarFields.push_back(&mDensity[i]);
+		if (mFluidSettings.GetFluidType() == FIRE) {
+			scalarFields.push_back(&mReaction[i]);
+		}
+	}
+
+	mBrickActivity.assign(numBricks, 0);
+	concurrency::parallel_for(0, numBricks, [&](int brick) {
+		int xBegin = (brick % bricks[0]) * BRICK_SIZE;
+		int yBegin = (brick / bricks[0] % bricks[1]) * BRICK_SIZE;
+		int zBegin = (brick / (bricks[0] * bricks[1])) * BRICK_SIZE;
+		int xEnd = Min(xBegin + BRICK_SIZE, width);
+		int yEnd = Min(yBegin + BRICK_SIZE, height);
+		int zEnd = Min(zBegin + BRICK_SIZE, depth);
+
+		bool active = false;
+		for (int z = zBegin; z < zEnd && !active; ++z) {
+			for (int y = yBegin; y < yEnd && !active; ++y) {
+				for (int x = xBegin; x < xEnd && !active; ++x) {
+					int index = x + width * (y + height * z);
+					for (const ScalarField3D *field : scalarFields) {
+						active |= fabs(field->values[index]) > threshold;
+					}
+					for (int i = 0; i < 2; ++i) {
+						active |= mVelocity[i].Get(index).LengthSquared() > threshold * threshold;
+					}
+				}
+			}
+		}
+		mBrickActivity[brick] = active ? 1 : 0;
+	});
+
+	// the impulse sources add to their bricks whether they hold fluid or not
+	for (const ImpulseSourceData &source : mImpulseSources) {
+		for (int z = source.vRegionMin[2] / BRICK_SIZE; z <= (int)source.vRegionMax[2] / BRICK_SIZE; ++z) {
+			for (int y = source.vRegionMin[1] / BRICK_SIZE; y <= (int)source.vRegionMax[1] / BRICK_SIZE; ++y) {
+				for (int x = source.vRegionMin[0] / BRICK_SIZE; x <= (int)source.vRegionMax[0] / BRICK_SIZE; ++x) {
+					mBrickActivity[x + bricks[0] * (y + bricks[1] * z)] = 1;
+				}
+			}
+		}
+	}
+
+	// every brick goes into the lists of the halo widths that reach it from the nearest active brick
+	for (BrickList &list : mBrickLists) {
+		list.clear();
+	}
+	int numActive = 0;
+	for (int z = 0; z < bricks[2]; ++z) {
+		for (int y = 0; y < bricks[1]; ++y) {
+			for (int x = 0; x < bricks[0]; ++x) {
+				int distance = BRICK_MAX_HALO + 1;
+				for (int dz = Max(z - BRICK_MAX_HALO, 0); dz <= Min(z + BRICK_MAX_HALO, bricks[2] - 1); ++dz) {
+					for (int dy = Max(y - BRICK_MAX_HALO, 0); dy <= Min(y + BRICK_MAX_HALO, bricks[1] - 1); ++dy) {
+						for (int dx = Max(x - BRICK_MAX_HALO, 0); dx <= Min(x + BRICK_MAX_HALO, bricks[0] - 1); ++dx) {
+							if (mBrickActivity[dx + bricks[0] * (dy + bricks[1] * dz)]) {
+								distance = Min(distance, Max(abs(dx - x), Max(abs(dy - y), abs(dz - z))));
+							}
+						}
+					}
+				}
+
+				int brick = x + bricks[0] * (y + bricks[1] * z);
+				numActive += mBrickActivity[brick];
+				for (int halo = distance; halo <= BRICK_MAX_HALO; ++halo) {
+					mBrickLists[halo].push_back(brick);
+				}
+			}
+		}
+	}
+
+	mBrickOccupancyStats.activeBricks = numActive;
+	mBrickOccupancyStats.processedBricks = (int)mBrickLists[BRICK_HALO_PASSES].size();
+	mBrickOccupancyStats.processedPercentage = 100.0f * mBrickOccupancyStats.processedBricks / numBricks;
+}
+
+const BrickList *Fluid3DCPUCalculator::GetBrickList(int haloBricks) const {
+	return mFluidSettings.sparseBricks ? &mBrickLists[haloBricks] : nullptr;
+}
+
+void Fluid3DCPUCalculator::UpdateObstacles() {
+	int regionMin[3];
+	int regionMax[3];
+	if (!mObstacleTracker.Update(mFluidSettings.dimensions, mObstacleBoxes, regionMin, regionMax, mObstacleBoxData)) {
+		return;
+	}
+
+	for (int axis = 0; axis < 3; ++axis) {
+		mInputBufferObstacles.vObstacleRegionMin[axis] = regionMin[axis];
+		mInputBufferObstacles.vObstacleRegionMax[axis] = regionMax[axis];
+	}
+	mInputBufferObstacles.uObstacleBoxCount = (unsigned int)mObstacleBoxData.size();
+	const ObstacleBoxData *boxes = mObstacleBoxData.empty() ? nullptr : &mObstacleBoxData[0];
+	CPUKernels::Obstacles(mInputBufferGeneral, mInputBufferObstacles, boxes, mObstacles);
+
+	// coarsen the obstacle field for the multigrid levels and rebuild the pressure operator
+	RestrictObstacles();
+	CPUKernels::PCGLaplacianCoefficients(mObstacles, mFluidMask, mLaplacianDiagonal);
+	mFluidCellCount = CPUKernels::PCGDotProduct(mFluidMask, mFluidMask);
+}
+
+void Fluid3DCPUCalculator::RestrictObstacles() {
+	const ObstacleField3D *fineObstacles = &mObstacles;
+	for (size_t level = 0; level < mMultigridLevels.size(); ++level) {
+		CPUKernels::MultigridRestrictObstacles(*fineObstacles, mMultigridLevels[level].obstacles);
+		fineObstacles = &mMultigridLevels[level].obstacles;
+	}
+}
+
+void Fluid3DCPUCalculator::UpdateGeneralBuffer() {
+	mInputBufferGeneral.fTimeStep = mFluidSettings.timeStep;
+	mInputBufferGeneral.fDensityBuoyancy = mFluidSettings.densityBuoyancy;
+	mInputBufferGeneral.fDensityWeight = mFluidSettings.densityWeight;
+	mInputBufferGeneral.fVorticityStrength = mFluidSettings.vorticityStrength;
+}
+
+void Fluid3DCPUCalculator::UpdateAdvectionBuffer(float dissipation, float timeModifier, float decay) {
+	mInputBufferAdvection.fDissipation = dissipation;
+	mInputBufferAdvection.fTimeStepModifier = timeModifier;
+	mInputBufferAdvection.fDecay = decay;
+}
+
+void Fluid3DCPUCalculator::UpdateInjectionBuffer() {
+	bool isFire = mFluidSettings.GetFluidType() == FIRE;
+
+	// the constant input comes first, followed by the impulses added to the step
+	mImpulseSources.clear();
+	Vector3 inputPosition;
+	float inputRadius;
+	GetConstantInput(inputPosition, inputRadius);
+	float inputAmount = isFire ? mFluidSettings.constantReactionAmount : mFluidSettings.constantDensityAmount;
+	AddImpulseSource(isFire ? IMPULSE_TARGET_REACTION : IMPULSE_TARGET_DENSITY, inputPosition, inputRadius, Vector3(inputAmount, 0.0f, 0.0f));
+	AddImpulseSource(IMPULSE_TARGET_TEMPERATURE, inputPosition, inputRadius, Vector3(mFluidSettings.constantTemperature, 0.0f, 0.0f));
+	for (const ImpulseSource &impulse : mImpulses) {
+		if (impulse.target != IMPULSE_TARGET_REACTION || isFire) {
+			AddImpulseSource(impulse.target, mFluidSettings.dimensions * impulse.position, impulse.radius, impulse.amount);
+		}
+	}
+
+	mInputBufferInjection.uImpulseSourceCount = (unsigned int)mImpulseSources.size();
+	mInputBufferInjection.fSmokeAmount = mFluidSettings.constantDensityAmount;
+	mInputBufferInjection.fInputExtinguishment = mFluidSettings.reactionExtinguishment;
+	if (mImpulseSources.empty()) {
+		for (int axis = 0; axis < 3; ++axis) {
+			mInputBufferInjection.vInjectionRegionMin[axis] = 1;
+			mInputBufferInjection.vInjectionRegionMax[axis] = 0;
+		}
+	}
+}
+
+void Fluid3DCPUCalculator::AddImpulseSource(ImpulseTarget_t target, const Vector3 &point, float radius, const Vector3 &amount) {
+	int regionMin[3], regionMax[3];
+	if ((amount.x == 0.0f && amount.y == 0.0f && amount.z == 0.0f) || !GetImpulseRegion(point, radius, mFluidSettings.dimensions, regionMin, regionMax)) {
+		return;
+	}
+
+	ImpulseSourceData source;
+	source.vPoint = point;
+	source.fRadius = radius;
+	source.vAmount = amount;
+	source.uTarget = target;
+	for (int axis = 0; axis < 3; ++axis) {
+		source.vRegionMin[axis] = regionMin[axis];
+		source.vRegionMax[axis] = regionMax[axis];
+		// the injection region grows to hold every source
+		bool first = mImpulseSources.empty();
+		mInputBufferInjection.vInjectionRegionMin[axis] = first ? regionMin[axis] : Min((int)mInputBufferInjection.vInjectionRegionMin[axis], regionMin[axis]);
+		mInputBufferInjection.vInjectionRegionMax[axis] = first ? regionMax[axis] : Max((int)mInputBufferInjection.vInjectionRegionMax[axis], regionMax[axis]);
+	}
+	mImpulseSources.push_back(source);
+}
+
+void Fluid3DCPUCalculator::UpdateScalarAdvectionBuffer() {
+	// temperature is always advected normally
+	float macCormack = mFluidSettings.advectionType == MACCORMARCK ? 1.0f : 0.0f;
+
+	mInputBufferScalarAdvection.vScalarDissipation = Vector3(mFluidSettings.temperatureDissipation, mFluidSettings.densityDissipation, 1.0f);
+	mInputBufferScalarAdvection.fReactionDecay = mFluidSettings.GetFluidType() == FIRE ? mFluidSettings.reactionDecay : 0.0f;
+	mInputBufferScalarAdvection.vScalarMacCormack = Vector3(0.0f, macCormack, macCormack);
+}
+
+void Fluid3DCPUCalculator::SetFluidSettings(const FluidSettings &fluidSettings) {
+	mFluidSettings = fluidSettings;
+	UpdateGeneralBuffer();
+	Wake();
+}
+
+const FluidSettings &Fluid3DCPUCalculator::GetFluidSettings() const {
+	return mFluidSettings;
+}
+
+const ScalarField3D &Fluid3DCPUCalculator::GetDensityField() const {
+	return mDensity[READ];
+}
+
+const ScalarField3D &Fluid3DCPUCalculator::GetReactionField() const {
+	return mReaction[READ];
+}
+
+const ScalarField3D &Fluid3DCPUCalculator::GetTemperatureField() const {
+	return mTemperature[READ];
+}
+
+const VectorField3D &Fluid3DCPUCalculator::GetVelocityField() const {
+	return mVelocity[READ];
+}
+
+const ScalarField3D &Fluid3DCPUCalculator::GetPressureField() const {
+	return mPressure;
+}
+
+const PressureSolverStats &Fluid3DCPUCalculator::GetPressureSolverStats() const {
+	return mPressureSolverStats;
+}
+
+const BrickOccupancyStats &Fluid3DCPUCalculator::GetBrickOccupancyStats() const {
+	return mBrickOccupancyStats;
+}
+
+const TimeStepPlan &Fluid3DCPUCalculator::GetTimeStepPlan() const {
+	return mTimeStepPlan;
+}
+
+const FluidActivityStats &Fluid3DCPUCalculator::GetFluidActivityStats() const {
+	return mActivityStats;
+}
+
+StageProfiler &Fluid3DCPUCalculator::GetStageProfiler() {
+	return mStageProfiler;
+}
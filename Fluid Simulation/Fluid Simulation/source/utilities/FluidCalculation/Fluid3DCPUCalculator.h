@@ -0,0 +1,178 @@
+/********************************************************************
+Fluid3DCPUCalculator.h: Encapsulates a 3D fluid simulation
+being calculated on the CPU. Runs the same pipeline as
+Fluid3DCalculator without needing a Direct3D device, so it can be
+used on machines with no GPU.
+
+Author:	Valentin Hinov
+Date: 2/5/2014
+*********************************************************************/
+
+#ifndef _FLUID3DCPUCALCULATOR_H
+#define _FLUID3DCPUCALCULATOR_H
+
+#include <array>
+#include <vector>
+#include "FluidSettings.h"
+#include "Fluid3DCPUFields.h"
+#include "Fluid3DBuffers.h"
+#include "Fluid3DObstacles.h"
+#include "Fluid3DTimeStep.h"
+#include "Fluid3DProfiler.h"
+
+namespace Fluid3D {
+
+class Fluid3DCPUCalculator {
+public:
+	Fluid3DCPUCalculator(const FluidSettings &fluidSettings);
+	~Fluid3DCPUCalculator();
+
+	bool Initialize();
+	// Runs a frame of the simulation and returns the steps it took. That is always a single step unless adaptiveTimeStep
+	// is on, which can split the frame into several steps or carry it over to the next one and take none. A sleeping
+	// fluid takes no steps
+	// Frames above 1 are frames the caller skipped. Their time is made up in steps as long as the CFL number allows, up
+	// to maxSubsteps of them
+	int Process(int frames = 1);
+
+	// Adds a velocity impulse to the next step. Any number of forces can be added to a step, up to MAX_IMPULSE_SOURCES
+	// forces and impulses in total
+	void AddForce(const ExtraForce& force);
+	// Adds to a field during the next step. All the impulses of a step are applied together with the constant input in
+	// a single pass. Returns false if the step already holds MAX_IMPULSE_SOURCES impulses. Wakes the fluid
+	bool AddImpulse(const ImpulseSource& impulse);
+	// Replaces the obstacle boxes, starting with the next step. Only the cells around the boxes that changed since the
+	// last step are voxelized again. Wakes the fluid if any box changed
+	void SetObstacles(const std::vector<ObstacleBox> &boxes);
+
+	const ScalarField3D &GetDensityField() const;
+	// If simulating fire - get the reaction values
+	const ScalarField3D &GetReactionField() const;
+	const ScalarField3D &GetTemperatureField() const;
+	const VectorField3D &GetVelocityField() const;
+	const ScalarField3D &GetPressureField() const;
+
+	// Iterations and residual of the last pressure solve
+	const PressureSolverStats &GetPressureSolverStats() const;
+	// Bricks the last step found active and processed
+	const BrickOccupancyStats &GetBrickOccupancyStats() const;
+	// Steps the last frame was run as
+	const TimeStepPlan &GetTimeStepPlan() const;
+	// Maxima and kinetic energy of the fluid after its last step and whether it is sleeping
+	const FluidActivityStats &GetFluidActivityStats() const;
+	// Timings of the stages of the steps taken while profileStages is on. They are only updated by a Collect on it, which
+	// can be done from another thread than Process
+	StageProfiler &GetStageProfiler();
+
+	const FluidSettings &GetFluidSettings() const;
+	// Wakes the fluid
+	void SetFluidSettings(const FluidSettings &fluidSettings);
+
+private:
+	// A single step of the simulation, of the time step the general buffer holds
+	void Step();
+	// Measures the activity of the fluid and puts it to sleep once it has stayed below the threshold long enough
+	void MeasureActivity();
+	void Wake();
+	void Advect(std::array<ScalarField3D, 2> &target, SystemAdvectionType_t advectionType, float dissipation, float decay = 0.0f);
+	void AdvectVelocity(SystemAdvectionType_t advectionType, float dissipation);
+	// Advects the temperature, density and reaction together, the same as advecting them one by one
+	void AdvectScalars();
+	// Adds the constant input and every impulse of the step in one pass over the region they reach. Fire then forms
+	// smoke from the reaction
+	void ApplyImpulses();
+	// fused version of the buoyancy and ApplyImpulses
+	void ApplyBuoyancyAndImpulses();
+	void GetConstantInput(Vector3 &position, float &radius) const;
+	void ComputeVorticityConfinement();
+	// fused version of ComputeVorticityConfinement and the divergence
+	void ComputeVorticityConfinementAndDivergence();
+	// Leaves reservedIterations of the solver's iterations to the caller. Returns true if the solve stopped early
+	// because the residual fell below the tolerance
+	bool CalculatePressureGradient(int reservedIterations = 0);
+	void MultigridVCycle(ScalarField3D &target, const ScalarField3D &rightHandSide);
+	void SmoothPressure(ScalarField3D &target, const ScalarField3D &rightHandSide, const ObstacleField3D &obstacles, int iterations, float overRelaxation = 1.0f, bool reverseOrder = false);
+	void BeginConjugateGradient();
+	void ConjugateGradientIteration();
+	void PreconditionConjugateGradient();
+	// Voxelizes the cells around the obstacle boxes that changed, then rebuilds what depends on the obstacles
+	void UpdateObstacles();
+	void RestrictObstacles();
+	float MeasurePressureResidual();
+	// Finds the active bricks and rebuilds the brick lists
+	void UpdateActiveBricks();
+	// Bricks within haloBricks of an active brick, or nullptr for the whole volume if sparse bricks are turned off
+	const BrickList *GetBrickList(int haloBricks) const;
+
+	void UpdateGeneralBuffer();
+	void UpdateAdvectionBuffer(float dissipation, float timeModifier, float decay);
+	// Gathers the constant input and the impulses added to the step into mImpulseSources
+	void UpdateInjectionBuffer();
+	// Queues an impulse of the step unless it adds nothing or misses the volume. The point is in cells
+	void AddImpulseSource(ImpulseTarget_t target, const Vector3 &point, float radius, const Vector3 &amount);
+	void UpdateScalarAdvectionBuffer();
+
+private:
+	// Equivalent of MultigridLevelResources plus the level obstacles
+	struct MultigridLevel {
+		ScalarField3D					rightHandSide;
+		ScalarField3D					correction;
+		ScalarField3D					residual;
+		ObstacleField3D					obstacles;
+	};
+
+	FluidSettings mFluidSettings;
+	std::vector<ImpulseSource> mImpulses;	// added for the next step
+	std::vector<ObstacleBox> mObstacleBoxes;
+	ObstacleTracker mObstacleTracker;
+	PressureSolverStats mPressureSolverStats;
+	BrickOccupancyStats mBrickOccupancyStats;
+	AdaptiveTimeStepper mTimeStepper;
+	TimeStepPlan mTimeStepPlan;
+	FluidActivityStats mActivityStats;
+	StageProfiler mStageProfiler;
+	CPUStageTimer mStageTimer;
+
+	// Per object fields, double buffered the same way as FluidResourcesPerObject
+	std::array<VectorField3D, 2>	mVelocity;
+	std::array<ScalarField3D, 2>	mDensity;
+	std::array<ScalarField3D, 2>	mTemperature;
+	std::array<ScalarField3D, 2>	mReaction; // only used when fluid type is fire
+	ObstacleField3D					mObstacles;
+	VectorField3D					mVorticity;
+	ScalarField3D					mVorticityLength;
+	ScalarField3D					mPressure; // updated in place and kept between steps to warm start the pressure solve
+
+	// Scratch fields, the equivalent of CommonFluidResources
+	ScalarField3D					mDivergence;
+	std::array<VectorField3D, 2>	mTemp;
+	ScalarField3D					mResidual; // also the second buffer of the Jacobi solver and the laplacian of the conjugate gradient direction
+	std::vector<MultigridLevel>		mMultigridLevels;
+
+	// Conjugate gradient state - residual, preconditioned residual and search direction
+	ScalarField3D					mPCGResidual;
+	ScalarField3D					mPCGPreconditioned;
+	ScalarField3D					mPCGDirection;
+	double							mPCGResidualDotPreconditioned;
+	// Pressure operator coefficients, rebuilt whenever the obstacles change
+	ScalarField3D					mFluidMask;
+	ScalarField3D					mLaplacianDiagonal;
+	double							mFluidCellCount;
+
+	// Sparse brick tracking - whether each brick is active and the bricks within each halo width of an active one
+	std::vector<unsigned char>		mBrickActivity;
+	std::array<BrickList, BRICK_MAX_HALO + 1>	mBrickLists;
+
+	// CPU side copies of the constant buffers the shaders would receive
+	InputBufferGeneral		mInputBufferGeneral;
+	InputBufferAdvection	mInputBufferAdvection;
+	InputBufferInjection	mInputBufferInjection;
+	std::vector<ImpulseSourceData>	mImpulseSources; // contents of the impulse sources structured buffer, the constant input's first
+	InputBufferScalarAdvection	mInputBufferScalarAdvection;
+	InputBufferObstacles	mInputBufferObstacles;
+	std::vector<ObstacleBoxData>	mObstacleBoxData; // contents of the obstacle box structured buffer
+};
+
+}
+
+#endif
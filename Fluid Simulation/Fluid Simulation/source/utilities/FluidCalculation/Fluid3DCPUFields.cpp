@@ -0,0 +1,173 @@
+/********************************************************************
+Fluid3DCPUFields.cpp: Implementation of the CPU fluid volumes
+
+Author:	Valentin Hinov
+Date: 2/5/2014
+*********************************************************************/
+
+#include "Fluid3DCPUFields.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace Fluid3D;
+
+///////SCALAR FIELD BEGIN////////
+ScalarField3D::ScalarField3D() : width(0), height(0), depth(0) {
+}
+
+ScalarField3D::ScalarField3D(int width, int height, int depth) {
+	Resize(width, height, depth);
+}
+
+void ScalarField3D::Resize(int width, int height, int depth) {
+	this->width = width;
+	this->height = height;
+	this->depth = depth;
+	values.assign(width * height * depth, 0.0f);
+}
+
+void ScalarField3D::Fill(float value) {
+	std::fill(values.begin(), values.end(), value);
+}
+///////SCALAR FIELD END////////
+
+///////VECTOR FIELD BEGIN////////
+void VectorField3D::Resize(int width, int height, int depth) {
+	x.Resize(width, height, depth);
+	y.Resize(width, height, depth);
+	z.Resize(width, height, depth);
+}
+
+void VectorField3D::Fill(float value) {
+	x.Fill(value);
+	y.Fill(value);
+	z.Fill(value);
+}
+///////VECTOR FIELD END////////
+
+///////MORTON FIELD BEGIN////////
+MortonScalarField3D::MortonScalarField3D() : width(0), height(0), depth(0) {
+}
+
+MortonScalarField3D::MortonScalarField3D(int width, int height, int depth) {
+	Resize(width, height, depth);
+}
+
+void MortonScalarField3D::Resize(int width, int height, int depth) {
+	this->width = width;
+	this->height = height;
+	this->depth = depth;
+
+	const int brickCells = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+	const int bricksX = GetBrickCount(width);
+	const int bricksY = GetBrickCount(height);
+	const int bricksZ = GetBrickCount(depth);
+
+	// x takes the lowest bit of every group of three, y the middle one and z the highest
+	offsetX.resize(width);
+	offsetY.resize(height);
+	offsetZ.resize(depth);
+	for (int x = 0; x < width; ++x) {
+		offsetX[x] = (x / BRICK_SIZE) * brickCells + SpreadBits3(x % BRICK_SIZE);
+	}
+	for (int y = 0; y < height; ++y) {
+		offsetY[y] = (y / BRICK_SIZE) * bricksX * brickCells + (SpreadBits3(y % BRICK_SIZE) << 1);
+	}
+	for (int z = 0; z < depth; ++z) {
+		offsetZ[z] = (z / BRICK_SIZE) * bricksX * bricksY * brickCells + (SpreadBits3(z % BRICK_SIZE) << 2);
+	}
+
+	values.assign(bricksX * bricksY * bricksZ * brickCells, 0.0f);
+}
+
+void MortonScalarField3D::Fill(float value) {
+	std::fill(values.begin(), values.end(), value);
+}
+
+void MortonVectorField3D::Resize(int width, int height, int depth) {
+	x.Resize(width, height, depth);
+	y.Resize(width, height, depth);
+	z.Resize(width, height, depth);
+}
+
+void MortonVectorField3D::Fill(float value) {
+	x.Fill(value);
+	y.Fill(value);
+	z.Fill(value);
+}
+
+void Fluid3D::ToMorton(const ScalarField3D &source, MortonScalarField3D &result) {
+	result.Resize(source.width, source.height, source.depth);
+	ParallelForSlices(source.depth, [&](int z) {
+		for (int y = 0; y < source.height; ++y) {
+			for (int x = 0; x < source.width; ++x) {
+				result(x, y, z) = source(x, y, z);
+			}
+		}
+	});
+}
+
+void Fluid3D::ToMorton(const VectorField3D &source, MortonVectorField3D &result) {
+	ToMorton(source.x, result.x);
+	ToMorton(source.y, result.y);
+	ToMorton(source.z, result.z);
+}
+
+void Fluid3D::FromMorton(const MortonScalarField3D &source, ScalarField3D &result) {
+	result.Resize(source.width, source.height, source.depth);
+	ParallelForSlices(source.depth, [&](int z) {
+		for (int y = 0; y < source.height; ++y) {
+			for (int x = 0; x < source.width; ++x) {
+				result(x, y, z) = source(x, y, z);
+			}
+		}
+	});
+}
+
+void Fluid3D::FromMorton(const MortonVectorField3D &source, VectorField3D &result) {
+	FromMorton(source.x, result.x);
+	FromMorton(source.y, result.y);
+	FromMorton(source.z, result.z);
+}
+///////MORTON FIELD END////////
+
+///////OBSTACLE FIELD BEGIN////////
+ObstacleField3D::ObstacleField3D() : width(0), height(0), depth(0) {
+}
+
+void ObstacleField3D::Resize(int width, int height, int depth) {
+	this->width = width;
+	this->height = height;
+	this->depth = depth;
+	flags.assign(width * height * depth, 0);
+	velocity.Resize(width, height, depth);
+}
+
+void ObstacleField3D::SetObstacleCell(int x, int y, int z, bool solid) {
+	const int offsets[6][3] = {{0, 1, 0}, {0, -1, 0}, {1, 0, 0}, {-1, 0, 0}, {0, 0, 1}, {0, 0, -1}};
+	// the flag a neighbour keeps for this cell is the opposite one of the pair
+	const unsigned char opposites[6] = {OBSTACLE_B, OBSTACLE_T, OBSTACLE_L, OBSTACLE_R, OBSTACLE_D, OBSTACLE_U};
+
+	int index = Index(x, y, z);
+	flags[index] = solid ? (flags[index] | OBSTACLE_SOLID) : (flags[index] & ~OBSTACLE_SOLID);
+	for (int n = 0; n < 6; ++n) {
+		int nX = x + offsets[n][0];
+		int nY = y + offsets[n][1];
+		int nZ = z + offsets[n][2];
+		if (nX < 0 || nY < 0 || nZ < 0 || nX >= width || nY >= height || nZ >= depth) {
+			continue;
+		}
+		unsigned char &neighbourFlags = flags[Index(nX, nY, nZ)];
+		neighbourFlags = solid ? (neighbourFlags | opposites[n]) : (neighbourFlags & ~opposites[n]);
+	}
+}
+///////OBSTACLE FIELD END////////
+
+float Fluid3D::MaxAbsDifference(const ScalarField3D &first, const ScalarField3D &second) {
+	float maxDifference = 0.0f;
+	size_t numCells = Min(first.values.size(), second.values.size());
+	for (size_t i = 0; i < numCells; ++i) {
+		maxDifference = Max(maxDifference, std::abs(first.values[i] - second.values[i]));
+	}
+	return maxDifference;
+}
@@ -0,0 +1,279 @@
+/********************************************************************
+Fluid3DCPUFields.h: Structure-of-arrays volumes used by the CPU
+implementation of the 3D fluid simulation. Mirrors the layout and
+sampling rules of the 3D textures used by cFluid3D.hlsl
+
+Author:	Valentin Hinov
+Date: 2/5/2014
+*********************************************************************/
+
+#ifndef _FLUID3DCPUFIELDS_H
+#define _FLUID3DCPUFIELDS_H
+
+#include <vector>
+#include <utility>
+#include <cmath>
+#include <ppl.h>
+#include "../math/MathUtils.h"
+#include "Fluid3DBricks.h"
+
+namespace Fluid3D {
+
+// Splits a volume into z slices and processes them on all available cores
+template<typename SliceFunction>
+inline void ParallelForSlices(int depth, const SliceFunction &sliceFunction) {
+	concurrency::parallel_for(0, depth, sliceFunction);
+}
+
+// Calls rowFunction(y, z, xBegin, xEnd) for every row of a volume, split into z slices. If a brick list is given,
+// only the rows of those bricks are visited, one brick at a time
+template<typename RowFunction>
+inline void ParallelForRows(int width, int height, int depth, const BrickList *bricks, const RowFunction &rowFunction) {
+	if (bricks == nullptr) {
+		ParallelForSlices(depth, [&](int z) {
+			for (int y = 0; y < height; ++y) {
+				rowFunction(y, z, 0, width);
+			}
+		});
+		return;
+	}
+
+	const int bricksX = GetBrickCount(width);
+	const int bricksY = GetBrickCount(height);
+	concurrency::parallel_for(0, (int)bricks->size(), [&](int i) {
+		int brick = (*bricks)[i];
+		int xBegin = (brick % bricksX) * BRICK_SIZE;
+		int yBegin = (brick / bricksX % bricksY) * BRICK_SIZE;
+		int zBegin = (brick / (bricksX * bricksY)) * BRICK_SIZE;
+		int xEnd = Min(xBegin + BRICK_SIZE, width);
+		int yEnd = Min(yBegin + BRICK_SIZE, height);
+		int zEnd = Min(zBegin + BRICK_SIZE, depth);
+		for (int z = zBegin; z < zEnd; ++z) {
+			for (int y = yBegin; y < yEnd; ++y) {
+				rowFunction(y, z, xBegin, xEnd);
+			}
+		}
+	});
+}
+
+// Trilinear sample of a volume at a position given in cell units, matching linearSampler with a zero border colour.
+// Reads the corners through field.Load
+template<typename Field>
+inline float SampleTrilinear(const Field &field, float x, float y, float z) {
+	float floorX = std::floor(x);
+	float floorY = std::floor(y);
+	float floorZ = std::floor(z);
+
+	int x0 = (int)floorX;
+	int y0 = (int)floorY;
+	int z0 = (int)floorZ;
+
+	float tx = x - floorX;
+	float ty = y - floorY;
+	float tz = z - floorZ;
+
+	float c000 = field.Load(x0, y0, z0);
+	float c100 = field.Load(x0+1, y0, z0);
+	float c010 = field.Load(x0, y0+1, z0);
+	float c110 = field.Load(x0+1, y0+1, z0);
+	float c001 = field.Load(x0, y0, z0+1);
+	float c101 = field.Load(x0+1, y0, z0+1);
+	float c011 = field.Load(x0, y0+1, z0+1);
+	float c111 = field.Load(x0+1, y0+1, z0+1);
+
+	float c00 = Lerp(c000, c100, tx);
+	float c10 = Lerp(c010, c110, tx);
+	float c01 = Lerp(c001, c101, tx);
+	float c11 = Lerp(c011, c111, tx);
+
+	float c0 = Lerp(c00, c10, ty);
+	float c1 = Lerp(c01, c11, ty);
+
+	return Lerp(c0, c1, tz);
+}
+
+// A single channel volume stored in x-major, then y, then z order
+struct ScalarField3D {
+	int width;
+	int height;
+	int depth;
+	std::vector<float> values;
+
+	ScalarField3D();
+	ScalarField3D(int width, int height, int depth);
+
+	void Resize(int width, int height, int depth);
+	void Fill(float value);
+
+	inline int GetNumCells() const { return width * height * depth; }
+	inline int Index(int x, int y, int z) const { return x + width * (y + height * z); }
+
+	inline float &operator()(int x, int y, int z) { return values[Index(x, y, z)]; }
+	inline float operator()(int x, int y, int z) const { return values[Index(x, y, z)]; }
+
+	// Behaves like a texture Load - reads outside of the volume return 0
+	inline float Load(int x, int y, int z) const {
+		if (x < 0 || y < 0 || z < 0 || x >= width || y >= height || z >= depth) {
+			return 0.0f;
+		}
+		return values[Index(x, y, z)];
+	}
+
+	// Trilinear sample at a position given in cell units, matching linearSampler
+	// with a zero border colour
+	inline float Sample(float x, float y, float z) const { return SampleTrilinear(*this, x, y, z); }
+};
+
+// Three component volume stored as three separate scalar volumes
+struct VectorField3D {
+	ScalarField3D x;
+	ScalarField3D y;
+	ScalarField3D z;
+
+	void Resize(int width, int height, int depth);
+	void Fill(float value);
+
+	inline Vector3 Get(int index) const { return Vector3(x.values[index], y.values[index], z.values[index]); }
+	inline void Set(int index, const Vector3 &value) {
+		x.values[index] = value.x;
+		y.values[index] = value.y;
+		z.values[index] = value.z;
+	}
+};
+
+// Spreads the bits of value two bits apart, the Z-order curve index of a single axis
+inline int SpreadBits3(int value) {
+	int result = 0;
+	for (int bit = 0; (value >> bit) != 0; ++bit) {
+		result |= ((value >> bit) & 1) << (3 * bit);
+	}
+	return result;
+}
+
+// A single channel volume stored brick by brick, numbered x first, then y, then z like the sparse passes, with the
+// BRICK_SIZE^3 cells of every brick along a Z-order curve. The y and z neighbours of a cell are mostly in its own
+// brick instead of a row or a slice away, and so are the corners a trilinear sample reads. The bricks on the far
+// edges are padded out to full bricks. The index of a cell is the sum of a per axis table entry for each coordinate
+struct MortonScalarField3D {
+	int width;
+	int height;
+	int depth;
+	std::vector<float> values;
+	std::vector<int> offsetX;
+	std::vector<int> offsetY;
+	std::vector<int> offsetZ;
+
+	MortonScalarField3D();
+	MortonScalarField3D(int width, int height, int depth);
+
+	void Resize(int width, int height, int depth);
+	void Fill(float value);
+
+	inline int GetNumCells() const { return width * height * depth; }
+	inline int Index(int x, int y, int z) const { return offsetX[x] + offsetY[y] + offsetZ[z]; }
+
+	inline float &operator()(int x, int y, int z) { return values[Index(x, y, z)]; }
+	inline float operator()(int x, int y, int z) const { return values[Index(x, y, z)]; }
+
+	// Behaves like a texture Load - reads outside of the volume return 0
+	inline float Load(int x, int y, int z) const {
+		if (x < 0 || y < 0 || z < 0 || x >= width || y >= height || z >= depth) {
+			return 0.0f;
+		}
+		return values[Index(x, y, z)];
+	}
+
+	// Same as ScalarField3D::Sample
+	inline float Sample(float x, float y, float z) const { return SampleTrilinear(*this, x, y, z); }
+};
+
+// Three component volume stored as three separate Morton ordered volumes
+struct MortonVectorField3D {
+	MortonScalarField3D x;
+	MortonScalarField3D y;
+	MortonScalarField3D z;
+
+	void Resize(int width, int height, int depth);
+	void Fill(float value);
+
+	inline Vector3 Get(int index) const { return Vector3(x.values[index], y.values[index], z.values[index]); }
+	inline void Set(int index, const Vector3 &value) {
+		x.values[index] = value.x;
+		y.values[index] = value.y;
+		z.values[index] = value.z;
+	}
+};
+
+// Conversions between the row-major and Morton layouts. The result is resized to the source
+void ToMorton(const ScalarField3D &source, MortonScalarField3D &result);
+void ToMorton(const VectorField3D &source, MortonVectorField3D &result);
+void FromMorton(const MortonScalarField3D &source, ScalarField3D &result);
+void FromMorton(const MortonVectorField3D &source, VectorField3D &result);
+
+// Flags of a cell of the obstacle field, the same as the OBSTACLE_* defines of cFluid3D.hlsl. Besides its own state
+// every cell flags which of its six neighbours are solid, neighbours outside of the volume count as solid
+enum ObstacleFlag_t {
+	OBSTACLE_SOLID = 1,
+	OBSTACLE_T = 2,		// y + 1
+	OBSTACLE_B = 4,		// y - 1
+	OBSTACLE_R = 8,		// x + 1
+	OBSTACLE_L = 16,	// x - 1
+	OBSTACLE_U = 32,	// z + 1
+	OBSTACLE_D = 64		// z - 1
+};
+
+// Flags of a cell given isSolid(x, y, z), which tells whether a cell inside of the volume is solid
+template<typename SolidFunction>
+inline unsigned char GetObstacleFlags(int x, int y, int z, int width, int height, int depth, const SolidFunction &isSolid) {
+	const int offsets[6][3] = {{0, 1, 0}, {0, -1, 0}, {1, 0, 0}, {-1, 0, 0}, {0, 0, 1}, {0, 0, -1}};
+	unsigned char flags = isSolid(x, y, z) ? OBSTACLE_SOLID : 0;
+	for (int n = 0; n < 6; ++n) {
+		int nX = x + offsets[n][0];
+		int nY = y + offsets[n][1];
+		int nZ = z + offsets[n][2];
+		if (nX < 0 || nY < 0 || nZ < 0 || nX >= width || nY >= height || nZ >= depth || isSolid(nX, nY, nZ)) {
+			flags |= OBSTACLE_T << n;
+		}
+	}
+	return flags;
+}
+
+// Equivalent of the Texture3D<uint> obstacle field, one byte of ObstacleFlag_t per cell, along with the obstacle
+// velocity field. Solid cells hold the velocity of the obstacle covering them, every other cell holds zero
+struct ObstacleField3D {
+	int width;
+	int height;
+	int depth;
+	std::vector<unsigned char> flags;
+	VectorField3D velocity;
+
+	ObstacleField3D();
+
+	void Resize(int width, int height, int depth);
+	// Makes a cell solid or fluid and updates the flags of its neighbours to match
+	void SetObstacleCell(int x, int y, int z, bool solid);
+
+	inline int Index(int x, int y, int z) const { return x + width * (y + height * z); }
+	inline bool IsObstacleCell(int x, int y, int z) const { return (flags[Index(x, y, z)] & OBSTACLE_SOLID) != 0; }
+};
+
+// Cheap swaps for ping-ponging fields, only the storage pointers are exchanged
+inline void swap(ScalarField3D &first, ScalarField3D &second) {
+	std::swap(first.width, second.width);
+	std::swap(first.height, second.height);
+	std::swap(first.depth, second.depth);
+	first.values.swap(second.values);
+}
+
+inline void swap(VectorField3D &first, VectorField3D &second) {
+	swap(first.x, second.x);
+	swap(first.y, second.y);
+	swap(first.z, second.z);
+}
+
+// Largest absolute per-cell difference between two volumes of the same size
+float MaxAbsDifference(const ScalarField3D &first, const ScalarField3D &second);
+
+}
+
+#endif
@@ -0,0 +1,1292 @@
+/********************************************************************
+Fluid3DCPUKernels.cpp: CPU versions of the compute shaders found in
+cFluid3D.hlsl
+
+Author:	Valentin Hinov
+Date: 2/5/2014
+*********************************************************************/
+
+#include "Fluid3DCPUKernels.h"
+#include "FluidSettings.h"
+#include "Fluid3DCPUStencils.h"
+#include <cmath>
+#include <vector>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include <string.h>
+
+using namespace Fluid3D;
+
+namespace {
+	inline Vector3 GetObstacleVelocity(const ObstacleField3D &obstacles, int index) {
+		return obstacles.velocity.Get(index);
+	}
+
+	// Whether a cell lies inside of an obstacle box, local receives its position in the frame of the box
+	inline bool IsInsideObstacleBox(int x, int y, int z, const ObstacleBoxData &box, Vector3 &local) {
+		if (x < (int)box.vRegionMin[0] || y < (int)box.vRegionMin[1] || z < (int)box.vRegionMin[2] ||
+			x > (int)box.vRegionMax[0] || y > (int)box.vRegionMax[1] || z > (int)box.vRegionMax[2]) {
+			return false;
+		}
+		Vector3 offset = Vector3((float)x, (float)y, (float)z) - box.vCentre;
+		local = Vector3(box.vInverseX.Dot(offset), box.vInverseY.Dot(offset), box.vInverseZ.Dot(offset));
+		return fabs(local.x) <= 1.0f && fabs(local.y) <= 1.0f && fabs(local.z) <= 1.0f;
+	}
+
+	// Velocity of the first box covering a cell, worked out from where the same point of the box was a step ago.
+	// Zero in the walls and the fluid
+	inline Vector3 ObstacleBoxVelocity(int x, int y, int z, const ObstacleBoxData *boxes, unsigned int boxCount, float timeStep) {
+		Vector3 local;
+		for (unsigned int b = 0; b < boxCount; ++b) {
+			const ObstacleBoxData &box = boxes[b];
+			if (IsInsideObstacleBox(x, y, z, box, local)) {
+				Vector3 previous = box.vPreviousCentre + local.x * box.vPreviousAxisX + local.y * box.vPreviousAxisY + local.z * box.vPreviousAxisZ;
+				return (Vector3((float)x, (float)y, (float)z) - previous) / timeStep;
+			}
+		}
+		return Vector3(0.0f, 0.0f, 0.0f);
+	}
+
+	// Sums the pressure of the fluid neighbours of a cell, cells outside of the volume count as solid
+	inline void SumFluidNeighbours(const ScalarField3D &pressure, const ObstacleField3D &obstacles, int index, float &sum, float &count) {
+		const int stride[3] = {1, pressure.width, pressure.width * pressure.height};
+		const unsigned char positiveFlags[3] = {OBSTACLE_R, OBSTACLE_T, OBSTACLE_U};
+		const unsigned char negativeFlags[3] = {OBSTACLE_L, OBSTACLE_B, OBSTACLE_D};
+		const unsigned char flags = obstacles.flags[index];
+
+		sum = 0.0f;
+		count = 0.0f;
+		for (int axis = 0; axis < 3; ++axis) {
+			if ((flags & positiveFlags[axis]) == 0) {
+				sum += pressure.values[index + stride[axis]];
+				count += 1.0f;
+			}
+			if ((flags & negativeFlags[axis]) == 0) {
+				sum += pressure.values[index - stride[axis]];
+				count += 1.0f;
+			}
+		}
+	}
+
+	// Number of fluid neighbours of a cell, cells outside of the volume count as solid
+	inline float CountFluidNeighbours(const ObstacleField3D &obstacles, int index) {
+		const unsigned char neighbourFlags[6] = {OBSTACLE_T, OBSTACLE_B, OBSTACLE_R, OBSTACLE_L, OBSTACLE_U, OBSTACLE_D};
+		const unsigned char flags = obstacles.flags[index];
+
+		float count = 0.0f;
+		for (int n = 0; n < 6; ++n) {
+			if ((flags & neighbourFlags[n]) == 0) {
+				count += 1.0f;
+			}
+		}
+		return count;
+	}
+
+	// Horizontal sum of the four lanes in double precision
+	inline double SumLanes(__m128 value) {
+		float lanes[4];
+		_mm_storeu_ps(lanes, value);
+		return (double)lanes[0] + (double)lanes[1] + (double)lanes[2] + (double)lanes[3];
+	}
+
+	// Falloff of an impulse at a cell, the same as the shaders' ImpulseFalloff
+	inline float ImpulseFalloff(int x, int y, int z, const Vector3 &position, float radius, float timeStep) {
+		float posX = x - position.x;
+		float posY = y - position.y;
+		float posZ = z - position.z;
+		float mag = posX*posX + posY*posY + posZ*posZ;
+		mag *= mag;
+		return std::exp(-mag/(radius*radius)) * timeStep;
+	}
+
+	// Adds up what every impulse source adds to a cell, the same as SumImpulseSources. scalarAmounts holds the
+	// temperature, density and reaction
+	inline void SumImpulseSources(int x, int y, int z, const InputBufferInjection &injection, const ImpulseSourceData *sources, float timeStep,
+		Vector3 &velocityAmount, float scalarAmounts[3])
+	{
+		velocityAmount = Vector3(0.0f, 0.0f, 0.0f);
+		scalarAmounts[0] = scalarAmounts[1] = scalarAmounts[2] = 0.0f;
+		for (unsigned int s = 0; s < injection.uImpulseSourceCount; ++s) {
+			const ImpulseSourceData &source = sources[s];
+			if (x < (int)source.vRegionMin[0] || y < (int)source.vRegionMin[1] || z < (int)source.vRegionMin[2] ||
+				x > (int)source.vRegionMax[0] || y > (int)source.vRegionMax[1] || z > (int)source.vRegionMax[2])
+			{
+				continue;
+			}
+
+			float falloff = ImpulseFalloff(x, y, z, source.vPoint, source.fRadius, timeStep);
+			if (source.uTarget == IMPULSE_TARGET_VELOCITY) {
+				velocityAmount += falloff * source.vAmount;
+			}
+			else {
+				scalarAmounts[source.uTarget - IMPULSE_TARGET_TEMPERATURE] += falloff * source.vAmount.x;
+			}
+		}
+	}
+
+	// Vorticity confinement force of a fluid cell
+	inline Vector3 ConfinementForce(const VectorField3D &vorticity, const ScalarField3D &vorticityLength, int index, const StencilNeighbours &n, float strength) {
+		float omegaT = vorticityLength.values[n.iT];
+		float omegaB = vorticityLength.values[n.iB];
+		float omegaR = vorticityLength.values[n.iR];
+		float omegaL = vorticityLength.values[n.iL];
+		float omegaU = vorticityLength.values[n.iU];
+		float omegaD = vorticityLength.values[n.iD];
+
+		Vector3 omega = vorticity.Get(index);
+
+		Vector3 eta = 0.5f * Vector3( omegaR - omegaL, omegaT - omegaB, omegaU - omegaD );
+		eta += Vector3(0.001f, 0.001f, 0.001f);
+		eta *= 1.0f / eta.Length();
+
+		return strength * Vector3( (eta.y * omega.z - eta.z * omega.y), (eta.z * omega.x - eta.x * omega.z), (eta.x * omega.y - eta.y * omega.x) );
+	}
+
+	// Divergence of a cell given the y velocity of its top and bottom neighbours, the x velocity of its right and left
+	// ones and the z velocity of the ones above and below it
+	inline float VelocityDivergence(const ObstacleField3D &obstacles, int index, const StencilNeighbours &n, float vT, float vB, float vR, float vL, float vU, float vD) {
+		unsigned char flags = obstacles.flags[index];
+
+		// Enforce boundaries
+		if (flags & OBSTACLE_T) vT = GetObstacleVelocity(obstacles, n.iT).y;
+		if (flags & OBSTACLE_B) vB = GetObstacleVelocity(obstacles, n.iB).y;
+		if (flags & OBSTACLE_R) vR = GetObstacleVelocity(obstacles, n.iR).x;
+		if (flags & OBSTACLE_L) vL = GetObstacleVelocity(obstacles, n.iL).x;
+		if (flags & OBSTACLE_U) vU = GetObstacleVelocity(obstacles, n.iU).z;
+		if (flags & OBSTACLE_D) vD = GetObstacleVelocity(obstacles, n.iD).z;
+
+		return 0.5f * (vR - vL + vT - vB + vU - vD);
+	}
+
+	// One Jacobi iteration of the pressure at a cell
+	inline float JacobiPressure(const ScalarField3D &pressure, const ScalarField3D &divergence, const ObstacleField3D &obstacles, int index, const StencilNeighbours &n) {
+		float xC = pressure.values[index];
+		unsigned char flags = obstacles.flags[index];
+
+		float xT = (flags & OBSTACLE_T) ? xC : pressure.values[n.iT];
+		float xB = (flags & OBSTACLE_B) ? xC : pressure.values[n.iB];
+		float xR = (flags & OBSTACLE_R) ? xC : pressure.values[n.iR];
+		float xL = (flags & OBSTACLE_L) ? xC : pressure.values[n.iL];
+		float xU = (flags & OBSTACLE_U) ? xC : pressure.values[n.iU];
+		float xD = (flags & OBSTACLE_D) ? xC : pressure.values[n.iD];
+
+		float bC = divergence.values[index];
+
+		return (xL + xR + xB + xT + xU + xD - bC) / 6.0f;
+	}
+
+	// Divergence free velocity of a fluid cell given the pressure of it and its neighbours
+	inline Vector3 ProjectVelocity(const Vector3 &velocity, const ObstacleField3D &obstacles, int index, const StencilNeighbours &n,
+		float pC, float pT, float pB, float pR, float pL, float pU, float pD)
+	{
+		unsigned char flags = obstacles.flags[index];
+		Vector3 vMask(1.0f, 1.0f, 1.0f);
+		Vector3 obstV(0.0f, 0.0f, 0.0f);
+
+		// If an adjacent cell is solid or boundary, ignore its pressure and use its velocity.
+		if (flags & OBSTACLE_T) { pT = pC; obstV.y = GetObstacleVelocity(obstacles, n.iT).y; vMask.y = 0.0f; }
+		if (flags & OBSTACLE_B) { pB = pC; obstV.y = GetObstacleVelocity(obstacles, n.iB).y; vMask.y = 0.0f; }
+		if (flags & OBSTACLE_R) { pR = pC; obstV.x = GetObstacleVelocity(obstacles, n.iR).x; vMask.x = 0.0f; }
+		if (flags & OBSTACLE_L) { pL = pC; obstV.x = GetObstacleVelocity(obstacles, n.iL).x; vMask.x = 0.0f; }
+		if (flags & OBSTACLE_U) { pU = pC; obstV.z = GetObstacleVelocity(obstacles, n.iU).z; vMask.z = 0.0f; }
+		if (flags & OBSTACLE_D) { pD = pC; obstV.z = GetObstacleVelocity(obstacles, n.iD).z; vMask.z = 0.0f; }
+
+		// Project the velocity onto its divergence-free component by subtracting the gradient of pressure.
+		Vector3 grad = Vector3(pR - pL, pT - pB, pU - pD) * 0.5f;
+		Vector3 newV = velocity - grad;
+
+		// Explicitly enforce the free-slip boundary condition
+		return newV * vMask + obstV;
+	}
+
+	// Slices each task of the fused kernels takes. Every task runs the first stage again on the slice below and above
+	// its chunk, so smaller chunks repeat more work
+	const int FUSED_CHUNK_SLICES = 8;
+
+	// Runs a two stage kernel whose second stage on slice z reads the first stage results of slices z-1 to z+1, the
+	// CPU equivalent of the tiles the fused shaders keep in shared memory. Each task runs the second stage on a slice as
+	// soon as the slice above it is done, while the first stage results are still in cache. The slices just outside of
+	// a task's chunk belong to the neighbouring tasks, so the task works them out again into its own halo slices.
+	// firstStage(z, channels) writes the NumChannels first stage results of slice z into channels, indexed x + width * y.
+	// secondStage(z, below, centre, above) gets the first stage results of slice z and its clamped neighbours
+	template<int NumChannels, typename FirstStage, typename SecondStage>
+	void ParallelForFusedSlices(int width, int height, int depth, float *const *firstStageResults, const FirstStage &firstStage, const SecondStage &secondStage) {
+		const int sliceSize = width * height;
+		const int numChunks = (depth + FUSED_CHUNK_SLICES - 1) / FUSED_CHUNK_SLICES;
+
+		ParallelForSlices(numChunks, [&](int chunk) {
+			int zBegin = chunk * FUSED_CHUNK_SLICES;
+			int zEnd = Min(zBegin + FUSED_CHUNK_SLICES, depth);
+
+			// the slice below the chunk followed by the one above it
+			std::vector<float> halo(2 * NumChannels * sliceSize);
+
+			auto getChannels = [&](int z, float **channels) {
+				for (int c = 0; c < NumChannels; ++c) {
+					if (z < zBegin) {
+						channels[c] = &halo[c * sliceSize];
+					}
+					else if (z >= zEnd) {
+						channels[c] = &halo[(NumChannels + c) * sliceSize];
+					}
+					else {
+						channels[c] = firstStageResults[c] + z * sliceSize;
+					}
+				}
+			};
+
+			auto runFirstStage = [&](int z) {
+				float *channels[NumChannels];
+				getChannels(z, channels);
+				firstStage(z, channels);
+			};
+
+			auto runSecondStage = [&](int z) {
+				float *below[NumChannels], *centre[NumChannels], *above[NumChannels];
+				getChannels(Max(z-1, 0), below);
+				getChannels(z, centre);
+				getChannels(Min(z+1, depth-1), above);
+				secondStage(z, below, centre, above);
+			};
+
+			if (zBegin > 0) {
+				runFirstStage(zBegin - 1);
+			}
+			for (int z = zBegin; z < zEnd; ++z) {
+				runFirstStage(z);
+				if (z > zBegin) {
+					runSecondStage(z - 1);
+				}
+			}
+			if (zEnd < depth) {
+				runFirstStage(zEnd);
+			}
+			runSecondStage(zEnd - 1);
+		});
+	}
+
+	// Slices each task of JacobiBlocked produces. Every task also runs the intermediate iterations on up to
+	// iterations - 1 slices on either side of its chunk, so smaller chunks repeat more work
+	const int JACOBI_BLOCK_SLICES = 16;
+
+	// Picks centre in the lanes whose flags have flag set and neighbour in the rest
+	inline __m128 SelectSolid(__m128i flags, int flag, __m128 centre, __m128 neighbour) {
+		__m128i flag4 = _mm_set1_epi32(flag);
+		__m128 solid = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(flags, flag4), flag4));
+		return _mm_or_ps(_mm_and_ps(solid, centre), _mm_andnot_ps(solid, neighbour));
+	}
+
+	// JacobiPressure over a slice given the previous iteration of it and of the slices below and above it, which the
+	// caller clamps to the volume. The interior of every row runs 4 cells at a time with SSE
+	void JacobiSlice(int width, int height, const float *below, const float *centre, const float *above,
+		const float *divergenceSlice, const unsigned char *flagsSlice, float *result)
+	{
+		auto jacobiCell = [&](int x, int y) {
+			int i = x + width * y;
+			float xC = centre[i];
+			unsigned char flags = flagsSlice[i];
+
+			float xT = (flags & OBSTACLE_T) ? xC : centre[x + width * Min(y+1, height-1)];
+			float xB = (flags & OBSTACLE_B) ? xC : centre[x + width * Max(y-1, 0)];
+			float xR = (flags & OBSTACLE_R) ? xC : centre[Min(x+1, width-1) + width * y];
+			float xL = (flags & OBSTACLE_L) ? xC : centre[Max(x-1, 0) + width * y];
+			float xU = (flags & OBSTACLE_U) ? xC : above[i];
+			float xD = (flags & OBSTACLE_D) ? xC : below[i];
+
+			result[i] = (xL + xR + xB + xT + xU + xD - divergenceSlice[i]) / 6.0f;
+		};
+
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 six = _mm_set1_ps(6.0f);
+
+		for (int y = 0; y < height; ++y) {
+			// rows on the ghost border clamp their neighbours
+			if (y == 0 || y == height-1 || width < 3) {
+				for (int x = 0; x < width; ++x) {
+					jacobiCell(x, y);
+				}
+				continue;
+			}
+
+			jacobiCell(0, y);
+			int x = 1;
+			for (; x + 4 <= width-1; x += 4) {
+				int i = x + width * y;
+				int packedFlags;
+				memcpy(&packedFlags, flagsSlice + i, sizeof(packedFlags));
+				__m128i flags = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packedFlags), zero), zero);
+
+				__m128 xC = _mm_loadu_ps(centre + i);
+				__m128 xT = SelectSolid(flags, OBSTACLE_T, xC, _mm_loadu_ps(centre + i + width));
+				__m128 xB = SelectSolid(flags, OBSTACLE_B, xC, _mm_loadu_ps(centre + i - width));
+				__m128 xR = SelectSolid(flags, OBSTACLE_R, xC, _mm_loadu_ps(centre + i + 1));
+				__m128 xL = SelectSolid(flags, OBSTACLE_L, xC, _mm_loadu_ps(centre + i - 1));
+				__m128 xU = SelectSolid(flags, OBSTACLE_U, xC, _mm_loadu_ps(above + i));
+				__m128 xD = SelectSolid(flags, OBSTACLE_D, xC, _mm_loadu_ps(below + i));
+
+				// summed in the same order as JacobiPressure so both give the same result
+				__m128 sum = _mm_add_ps(xL, xR);
+				sum = _mm_add_ps(sum, xB);
+				sum = _mm_add_ps(sum, xT);
+				sum = _mm_add_ps(sum, xU);
+				sum = _mm_add_ps(sum, xD);
+				sum = _mm_sub_ps(sum, _mm_loadu_ps(divergenceSlice + i));
+				_mm_storeu_ps(result + i, _mm_div_ps(sum, six));
+			}
+			for (; x < width; ++x) {
+				jacobiCell(x, y);
+			}
+		}
+	}
+
+	// Dissipation and decay of each advected component. AdvectComputeShader only decays the first component,
+	// the AdvectScalars shaders only the reaction
+	struct ComponentAdvection {
+		float dissipation[3];
+		float decay[3];
+		bool macCormack[3];	// components that take the MacCormack result, the rest take the semi-Lagrangian one
+
+		ComponentAdvection(const InputBufferAdvection &advection) {
+			for (int c = 0; c < 3; ++c) {
+				dissipation[c] = advection.fDissipation;
+				decay[c] = c == 0 ? advection.fDecay : 0.0f;
+				macCormack[c] = true;
+			}
+		}
+
+		ComponentAdvection(const InputBufferScalarAdvection &scalarAdvection) {
+			const float dissipations[3] = {scalarAdvection.vScalarDissipation.x, scalarAdvection.vScalarDissipation.y, scalarAdvection.vScalarDissipation.z};
+			const float macCormacks[3] = {scalarAdvection.vScalarMacCormack.x, scalarAdvection.vScalarMacCormack.y, scalarAdvection.vScalarMacCormack.z};
+			for (int c = 0; c < 3; ++c) {
+				dissipation[c] = dissipations[c];
+				decay[c] = c == 2 ? scalarAdvection.fReactionDecay : 0.0f;
+				macCormack[c] = macCormacks[c] > 0.0f;
+			}
+		}
+
+		float Finish(int c, float value) const {
+			float finalResult = value * dissipation[c];
+			if (decay[c] > 0.0f) {
+				finalResult = Max(0.0f, finalResult - decay[c]);
+			}
+			return finalResult;
+		}
+	};
+
+	// Components with a nullptr target are skipped
+	void AdvectComponents(const VectorField3D &velocity, const ScalarField3D *const *targets, ScalarField3D *const *results, int numComponents,
+		const ObstacleField3D &obstacles, float timeStep, const ComponentAdvection &advection, const BrickList *bricks)
+	{
+		const int width = velocity.x.width;
+		const int height = velocity.x.height;
+
+		ParallelForRows(width, height, velocity.x.depth, bricks, [&](int y, int z, int xBegin, int xEnd) {
+			for (int x = xBegin; x < xEnd; ++x) {
+				int index = x + width * (y + height * z);
+				if ((obstacles.flags[index] & OBSTACLE_SOLID) != 0) {
+					for (int c = 0; c < numComponents; ++c) {
+						if (targets[c]) {
+							results[c]->values[index] = 0.0f;
+						}
+					}
+					continue;
+				}
+
+				// advect by trace back
+				float prevX = x - timeStep * velocity.x.values[index];
+				float prevY = y - timeStep * velocity.y.values[index];
+				float prevZ = z - timeStep * velocity.z.values[index];
+
+				for (int c = 0; c < numComponents; ++c) {
+					if (targets[c]) {
+						results[c]->values[index] = advection.Finish(c, targets[c]->Sample(prevX, prevY, prevZ));
+					}
+				}
+			}
+		});
+	}
+
+	void AdvectMacCormackComponents(const VectorField3D &velocity, const ScalarField3D *const *targetsA, const ScalarField3D *const *targetsB,
+		const ScalarField3D *const *targetsC, ScalarField3D *const *results, int numComponents,
+		const ObstacleField3D &obstacles, const InputBufferGeneral &general, const ComponentAdvection &advection, const BrickList *bricks)
+	{
+		const int width = velocity.x.width;
+		const int height = velocity.x.height;
+
+		ParallelForRows(width, height, velocity.x.depth, bricks, [&](int y, int z, int xBegin, int xEnd) {
+			for (int x = xBegin; x < xEnd; ++x) {
+				int index = x + width * (y + height * z);
+				if ((obstacles.flags[index] & OBSTACLE_SOLID) != 0) {
+					for (int c = 0; c < numComponents; ++c) {
+						results[c]->values[index] = 0.0f;
+					}
+					continue;
+				}
+
+				// advect by trace back
+				float prevX = x - general.fTimeStep * velocity.x.values[index];
+				float prevY = y - general.fTimeStep * velocity.y.values[index];
+				float prevZ = z - general.fTimeStep * velocity.z.values[index];
+
+				// float to uint conversion in the shader clamps negative values to 0
+				int jx = prevX > 0.0f ? (int)prevX : 0;
+				int jy = prevY > 0.0f ? (int)prevY : 0;
+				int jz = prevZ > 0.0f ? (int)prevZ : 0;
+
+				for (int c = 0; c < numComponents; ++c) {
+					float phi_n = targetsC[c]->Sample(prevX, prevY, prevZ);
+					if (!advection.macCormack[c]) {
+						results[c]->values[index] = advection.Finish(c, phi_n);
+						continue;
+					}
+
+					const ScalarField3D &targetA = *targetsA[c];
+
+					// Determine a valid range for the result from the nodes that contribute to the interpolated value.
+					float lmin = targetA.Load(jx, jy, jz);
+					float lmax = lmin;
+					for (int corner = 1; corner < 8; ++corner) {
+						float value = targetA.Load(jx + (corner & 1), jy + ((corner >> 1) & 1), jz + ((corner >> 2) & 1));
+						lmin = Min(lmin, value);
+						lmax = Max(lmax, value);
+					}
+
+					// Perform final advection, combining values from intermediate advection steps.
+					float phi_n_1_hat = targetA.Sample(prevX, prevY, prevZ);
+					float phi_n_hat = targetsB[c]->Sample(prevX, prevY, prevZ);
+
+					float s = phi_n_1_hat + 0.5f*(phi_n - phi_n_hat);
+
+					// clamp results to desired range
+					s = Clamp(s, lmin, lmax);
+
+					results[c]->values[index] = advection.Finish(c, s);
+				}
+			}
+		});
+	}
+}
+
+void CPUKernels::Advect(const VectorField3D &velocity, const ScalarField3D &target, const ObstacleField3D &obstacles,
+	const InputBufferGeneral &general, const InputBufferAdvection &advection, ScalarField3D &result, const BrickList *bricks)
+{
+	const ScalarField3D *targets[1] = {&target};
+	ScalarField3D *results[1] = {&result};
+	AdvectComponents(velocity, targets, results, 1, obstacles, advection.fTimeStepModifier * general.fTimeStep, ComponentAdvection(advection), bricks);
+}
+
+void CPUKernels::Advect(const VectorField3D &velocity, const VectorField3D &target, const ObstacleField3D &obstacles,
+	const InputBufferGeneral &general, const InputBufferAdvection &advection, VectorField3D &result, const BrickList *bricks)
+{
+	const ScalarField3D *targets[3] = {&target.x, &target.y, &target.z};
+	ScalarField3D *results[3] = {&result.x, &result.y, &result.z};
+	AdvectComponents(velocity, targets, results, 3, obstacles, advection.fTimeStepModifier * general.fTimeStep, ComponentAdvection(advection), bricks);
+}
+
+void CPUKernels::AdvectMacCormack(const VectorField3D &velocity, const ScalarField3D &targetA, const ScalarField3D &targetB, const ScalarField3D &targetC,
+	const ObstacleField3D &obstacles, const InputBufferGeneral &general, const InputBufferAdvection &advection, ScalarField3D &result, const BrickList *bricks)
+{
+	const ScalarField3D *targetsA[1] = {&targetA};
+	const ScalarField3D *targetsB[1] = {&targetB};
+	const ScalarField3D *targetsC[1] = {&targetC};
+	ScalarField3D *results[1] = {&result};
+	AdvectMacCormackComponents(velocity, targetsA, targetsB, targetsC, results, 1, obstacles, general, ComponentAdvection(advection), bricks);
+}
+
+void CPUKernels::AdvectMacCormack(const VectorField3D &velocity, const VectorField3D &targetA, const VectorField3D &targetB, const VectorField3D &targetC,
+	const ObstacleField3D &obstacles, const InputBufferGeneral &general, const InputBufferAdvection &advection, VectorField3D &result, const BrickList *bricks)
+{
+	const ScalarField3D *targetsA[3] = {&targetA.x, &targetA.y, &targetA.z};
+	const ScalarField3D *targetsB[3] = {&targetB.x, &targetB.y, &targetB.z};
+	const ScalarField3D *targetsC[3] = {&targetC.x, &targetC.y, &targetC.z};
+	ScalarField3D *results[3] = {&result.x, &result.y, &result.z};
+	AdvectMacCormackComponents(velocity, targetsA, targetsB, targetsC, results, 3, obstacles, general, ComponentAdvection(advection), bricks);
+}
+
+void CPUKernels::AdvectScalars(const VectorField3D &velocity, const ScalarField3D *const *targets, const ObstacleField3D &obstacles,
+	const InputBufferGeneral &general, const InputBufferScalarAdvection &scalarAdvection, ScalarField3D *const *results, const BrickList *bricks)
+{
+	int numComponents = targets[2] ? 3 : 2;
+	AdvectComponents(velocity, targets, results, numComponents, obstacles, general.fTimeStep, ComponentAdvection(scalarAdvection), bricks);
+}
+
+void CPUKernels::AdvectScalarsForward(const VectorField3D &velocity, const ScalarField3D *const *targets, const ObstacleField3D &obstacles,
+	const InputBufferGeneral &general, const InputBufferScalarAdvection &scalarAdvection, VectorField3D &packedResult, const BrickList *bricks)
+{
+	InputBufferAdvection forward;
+	forward.fDissipation = 1.0f;
+	forward.fTimeStepModifier = 1.0f;
+	forward.fDecay = 0.0f;
+
+	// only the fields advected with MacCormack need the intermediate steps
+	ComponentAdvection scalars(scalarAdvection);
+	const ScalarField3D *forwardTargets[3];
+	for (int c = 0; c < 3; ++c) {
+		forwardTargets[c] = scalars.macCormack[c] ? targets[c] : nullptr;
+	}
+
+	ScalarField3D *results[3] = {&packedResult.x, &packedResult.y, &packedResult.z};
+	AdvectComponents(velocity, forwardTargets, results, 3, obstacles, general.fTimeStep, ComponentAdvection(forward), bricks);
+}
+
+void CPUKernels::AdvectScalarsBackward(const VectorField3D &velocity, const VectorField3D &packedForward, bool hasReaction, const ObstacleField3D &obstacles,
+	const InputBufferGeneral &general, const InputBufferScalarAdvection &scalarAdvection, VectorField3D &packedResult, const BrickList *bricks)
+{
+	InputBufferAdvection backward;
+	backward.fDissipation = 1.0f;
+	backward.fTimeStepModifier = -1.0f;
+	backward.fDecay = 0.0f;
+
+	ComponentAdvection scalars(scalarAdvection);
+	const ScalarField3D *packedTargets[3] = {&packedForward.x, &packedForward.y, hasReaction ? &packedForward.z : nullptr};
+	for (int c = 0; c < 3; ++c) {
+		if (!scalars.macCormack[c]) {
+			packedTargets[c] = nullptr;
+		}
+	}
+
+	ScalarField3D *results[3] = {&packedResult.x, &packedResult.y, &packedResult.z};
+	AdvectComponents(velocity, packedTargets, results, 3, obstacles, backward.fTimeStepModifier * general.fTimeStep, ComponentAdvection(backward), bricks);
+}
+
+void CPUKernels::AdvectScalarsMacCormack(const VectorField3D &velocity, const VectorField3D &packedForward, const VectorField3D &packedBackward,
+	const ScalarField3D *const *targets, const ObstacleField3D &obstacles, const InputBufferGeneral &general,
+	const InputBufferScalarAdvection &scalarAdvection, ScalarField3D *const *results, const BrickList *bricks)
+{
+	const ScalarField3D *targetsA[3] = {&packedForward.x, &packedForward.y, &packedForward.z};
+	const ScalarField3D *targetsB[3] = {&packedBackward.x, &packedBackward.y, &packedBackward.z};
+	int numComponents = targets[2] ? 3 : 2;
+	AdvectMacCormackComponents(velocity, targetsA, targetsB, targets, results, numComponents, obstacles, general, ComponentAdvection(scalarAdvection), bricks);
+}
+
+void CPUKernels::Buoyancy(const VectorField3D &velocity, const ScalarField3D &temperature, const ScalarField3D &density,
+	const InputBufferGeneral &general, VectorField3D &result, const BrickList *bricks)
+{
+	const int width = velocity.x.width;
+	const int height = velocity.x.height;
+
+	ParallelForRows(width, height, velocity.x.depth, bricks, [&](int y, int z, int xBegin, int xEnd) {
+		int rowStart = width * (y + height * z);
+		for (int index = rowStart + xBegin; index < rowStart + xEnd; ++index) {
+			float buoyancy = general.fTimeStep * temperature.values[index] * general.fDensityBuoyancy - density.values[index] * general.fDensityWeight;
+			result.x.values[index] = velocity.x.values[index];
+			result.y.values[index] = velocity.y.values[index] + buoyancy;
+			result.z.values[index] = velocity.z.values[index];
+		}
+	});
+}
+
+void CPUKernels::ImpulseSources(VectorField3D &velocity, ScalarField3D &temperature, ScalarField3D &density, ScalarField3D *reaction,
+	const InputBufferGeneral &general, const InputBufferInjection &injection, const ImpulseSourceData *sources)
+{
+	const int width = velocity.x.width;
+	const int height = velocity.x.height;
+	const int regionMin[3] = {(int)injection.vInjectionRegionMin[0], (int)injection.vInjectionRegionMin[1], (int)injection.vInjectionRegionMin[2]};
+	const int regionMax[3] = {(int)injection.vInjectionRegionMax[0], (int)injection.vInjectionRegionMax[1], (int)injection.vInjectionRegionMax[2]};
+	if (regionMin[2] > regionMax[2]) {
+		return;
+	}
+
+	ParallelForSlices(regionMax[2] - regionMin[2] + 1, [&](int slice) {
+		int z = regionMin[2] + slice;
+		for (int y = regionMin[1]; y <= regionMax[1]; ++y) {
+			for (int x = regionMin[0]; x <= regionMax[0]; ++x) {
+				int index = x + width * (y + height * z);
+
+				Vector3 velocityAmount;
+				float scalarAmounts[3];
+				SumImpulseSources(x, y, z, injection, sources, general.fTimeStep, velocityAmount, scalarAmounts);
+
+				velocity.Set(index, velocity.Get(index) + velocityAmount);
+				temperature.values[index] += scalarAmounts[0];
+				density.values[index] += scalarAmounts[1];
+				if (reaction != nullptr) {
+					reaction->values[index] += scalarAmounts[2];
+				}
+			}
+		}
+	});
+}
+
+void CPUKernels::ExtinguishmentImpulse(const ScalarField3D &reaction, const ScalarField3D &impulseInitial, const InputBufferInjection &injection, ScalarField3D &result, const BrickList *bricks) {
+	const int width = reaction.width;
+	const int height = reaction.height;
+
+	ParallelForRows(width, height, reaction.depth, bricks, [&](int y, int z, int xBegin, int xEnd) {
+		int rowStart = width * (y + height * z);
+		for (int index = rowStart + xBegin; index < rowStart + xEnd; ++index) {
+			float amount = 0.0f;
+			float reactionAmount = reaction.values[index];
+			if (reactionAmount > 0.0f && reactionAmount < injection.fInputExtinguishment) {
+				amount = injection.fSmokeAmount * reactionAmount;
+			}
+			result.values[index] = impulseInitial.values[index] + amount;
+		}
+	});
+}
+
+void CPUKernels::Vorticity(const VectorField3D &velocity, VectorField3D &vorticityResult, ScalarField3D &vorticityLengthResult) {
+	const int width = velocity.x.width;
+	const int height = velocity.x.height;
+	const int depth = velocity.x.depth;
+
+	ParallelForSlices(depth, [&](int z) {
+		ForEachStencilCell(z, width, height, depth, [&](int x, int y, int index, const StencilNeighbours &n) {
+			Vector3 vT = velocity.Get(n.iT);
+			Vector3 vB = velocity.Get(n.iB);
+			Vector3 vR = velocity.Get(n.iR);
+			Vector3 vL = velocity.Get(n.iL);
+			Vector3 vU = velocity.Get(n.iU);
+			Vector3 vD = velocity.Get(n.iD);
+
+			// using central differences: D0_x = (D+_x - D-_x) / 2
+			Vector3 result = 0.5f * Vector3( (( vT.z - vB.z ) - ( vU.y - vD.y )) ,
+											 (( vU.x - vD.x ) - ( vR.z - vL.z )) ,
+											 (( vR.y - vL.y ) - ( vT.x - vB.x )) );
+
+			vorticityResult.Set(index, result);
+			vorticityLengthResult.values[index] = result.Length();
+		});
+	});
+}
+
+void CPUKernels::Confinement(const VectorField3D &velocity, const VectorField3D &vorticity, const ScalarField3D &vorticityLength,
+	const ObstacleField3D &obstacles, const InputBufferGeneral &general, VectorField3D &result)
+{
+	const int width = velocity.x.width;
+	const int height = velocity.x.height;
+	const int depth = velocity.x.depth;
+	const float strength = general.fTimeStep * general.fVorticityStrength;
+
+	ParallelForSlices(depth, [&](int z) {
+		ForEachStencilCell(z, width, height, depth, [&](int x, int y, int index, const StencilNeighbours &n) {
+			// obstacle cells are left untouched by the shader, carry their velocity over
+			if ((obstacles.flags[index] & OBSTACLE_SOLID) != 0) {
+				result.Set(index, velocity.Get(index));
+				return;
+			}
+
+			result.Set(index, velocity.Get(index) + ConfinementForce(vorticity, vorticityLength, index, n, strength));
+		});
+	});
+}
+
+void CPUKernels::Divergence(const VectorField3D &velocity, const ObstacleField3D &obstacles, ScalarField3D &result) {
+	const int width = velocity.x.width;
+	const int height = velocity.x.height;
+	const int depth = velocity.x.depth;
+
+	ParallelForSlices(depth, [&](int z) {
+		ForEachStencilCell(z, width, height, depth, [&](int x, int y, int index, const StencilNeighbours &n) {
+			// Find neighbouring velocities
+			result.values[index] = VelocityDivergence(obstacles, index, n,
+				velocity.y.values[n.iT], velocity.y.values[n.iB], velocity.x.values[n.iR], velocity.x.values[n.iL], velocity.z.values[n.iU], velocity.z.values[n.iD]);
+		});
+	});
+}
+
+void CPUKernels::Jacobi(const ScalarField3D &pressure, const ScalarField3D &divergence, const ObstacleField3D &obstacles, ScalarField3D &result) {
+	const int width = pressure.width;
+	const int height = pressure.height;
+	const int depth = pressure.depth;
+
+	ParallelForSlices(depth, [&](int z) {
+		ForEachStencilCell(z, width, height, depth, [&](int x, int y, int index, const StencilNeighbours &n) {
+			result.values[index] = JacobiPressure(pressure, divergence, obstacles, index, n);
+		});
+	});
+}
+
+void CPUKernels::JacobiBlocked(const ScalarField3D &pressure, const ScalarField3D &divergence, const ObstacleField3D &obstacles, int iterations, ScalarField3D &result) {
+	const int width = pressure.width;
+	const int height = pressure.height;
+	const int depth = pressure.depth;
+	const int sliceSize = width * height;
+	const int numChunks = (depth + JACOBI_BLOCK_SLICES - 1) / JACOBI_BLOCK_SLICES;
+
+	ParallelForSlices(numChunks, [&](int chunk) {
+		int zBegin = chunk * JACOBI_BLOCK_SLICES;
+		int zEnd = Min(zBegin + JACOBI_BLOCK_SLICES, depth);
+
+		// the last three slices of every intermediate iteration, slice z of iteration n goes into ring n-1 at z % 3
+		std::vector<float> rings(3 * (iterations - 1) * sliceSize);
+
+		auto getSlice = [&](int iteration, int z) -> float * {
+			if (iteration == 0) {
+				return const_cast<float *>(&pressure.values[z * sliceSize]);
+			}
+			if (iteration == iterations) {
+				return &result.values[z * sliceSize];
+			}
+			return &rings[(3 * (iteration - 1) + z % 3) * sliceSize];
+		};
+
+		// Iteration n runs one slice behind iteration n-1, over the chunk and the iterations - n slices on either side
+		// of it that the later iterations read. By the time it reaches slice z, iteration n-1 has just finished slice
+		// z+1 and still holds z-1 in its ring
+		int stepBegin = Max(zBegin - (iterations - 1), 0) + 1;
+		int stepEnd = zEnd + iterations;
+		for (int step = stepBegin; step < stepEnd; ++step) {
+			for (int iteration = 1; iteration <= iterations; ++iteration) {
+				int z = step - iteration;
+				int halo = iterations - iteration;
+				if (z < Max(zBegin - halo, 0) || z >= Min(zEnd + halo, depth)) {
+					continue;
+				}
+
+				JacobiSlice(width, height, getSlice(iteration - 1, Max(z-1, 0)), getSlice(iteration - 1, z), getSlice(iteration - 1, Min(z+1, depth-1)),
+					&divergence.values[z * sliceSize], &obstacles.flags[z * sliceSize], getSlice(iteration, z));
+			}
+		}
+	});
+}
+
+void CPUKernels::SubtractGradient(const VectorField3D &velocity, const ScalarField3D &pressure, const ObstacleField3D &obstacles, VectorField3D &result) {
+	const int width = velocity.x.width;
+	const int height = velocity.x.height;
+	const int depth = velocity.x.depth;
+
+	ParallelForSlices(depth, [&](int z) {
+		ForEachStencilCell(z, width, height, depth, [&](int x, int y, int index, const StencilNeighbours &n) {
+			if ((obstacles.flags[index] & OBSTACLE_SOLID) != 0) {
+				result.Set(index, GetObstacleVelocity(obstacles, index));
+				return;
+			}
+
+			result.Set(index, ProjectVelocity(velocity.Get(index), obstacles, index, n, pressure.values[index],
+				pressure.values[n.iT], pressure.values[n.iB], pressure.values[n.iR], pressure.values[n.iL], pressure.values[n.iU], pressure.values[n.iD]));
+		});
+	});
+}
+
+void CPUKernels::Obstacles(const InputBufferGeneral &general, const InputBufferObstacles &obstacleInput, const ObstacleBoxData *boxes, ObstacleField3D &result) {
+	const int width = result.width;
+	const int height = result.height;
+	const int depth = result.depth;
+	const unsigned int boxCount = obstacleInput.uObstacleBoxCount;
+
+	auto isWall = [&](int x, int y, int z) {
+		return x == 0 || x == width-1 || y == 0 || y == height-1 || z == 0 || z == depth-1;
+	};
+	auto isSolid = [&](int x, int y, int z) {
+		if (isWall(x, y, z)) {
+			return true;
+		}
+		Vector3 local;
+		for (unsigned int b = 0; b < boxCount; ++b) {
+			if (IsInsideObstacleBox(x, y, z, boxes[b], local)) {
+				return true;
+			}
+		}
+		return false;
+	};
+
+	const int xBegin = obstacleInput.vObstacleRegionMin[0];
+	const int yBegin = obstacleInput.vObstacleRegionMin[1];
+	const int zBegin = obstacleInput.vObstacleRegionMin[2];
+	const int xEnd = obstacleInput.vObstacleRegionMax[0] + 1;
+	const int yEnd = obstacleInput.vObstacleRegionMax[1] + 1;
+	const int zEnd = obstacleInput.vObstacleRegionMax[2] + 1;
+
+	ParallelForSlices(zEnd - zBegin, [&](int slice) {
+		int z = zBegin + slice;
+		for (int y = yBegin; y < yEnd; ++y) {
+			for (int x = xBegin; x < xEnd; ++x) {
+				int index = result.Index(x, y, z);
+				result.flags[index] = GetObstacleFlags(x, y, z, width, height, depth, isSolid);
+				// the walls never move
+				Vector3 velocity = isWall(x, y, z) ? Vector3(0.0f, 0.0f, 0.0f) : ObstacleBoxVelocity(x, y, z, boxes, boxCount, general.fTimeStep);
+				result.velocity.Set(index, velocity);
+			}
+		}
+	});
+}
+
+void CPUKernels::Obstacles(ObstacleField3D &result) {
+	InputBufferGeneral general;
+	general.fTimeStep = 1.0f;
+
+	InputBufferObstacles obstacleInput;
+	obstacleInput.uObstacleBoxCount = 0;
+	obstacleInput.vObstacleRegionMin[0] = obstacleInput.vObstacleRegionMin[1] = obstacleInput.vObstacleRegionMin[2] = 0;
+	obstacleInput.vObstacleRegionMax[0] = result.width - 1;
+	obstacleInput.vObstacleRegionMax[1] = result.height - 1;
+	obstacleInput.vObstacleRegionMax[2] = result.depth - 1;
+
+	Obstacles(general, obstacleInput, nullptr, result);
+}
+
+void CPUKernels::RedBlackSOR(ScalarField3D &pressure, const ScalarField3D &rightHandSide, const ObstacleField3D &levelObstacles, float overRelaxation, int parity) {
+	const int width = pressure.width;
+	const int height = pressure.height;
+
+	// cells of one colour only read neighbours of the other colour, so the slices can be updated in place concurrently
+	ParallelForSlices(pressure.depth, [&](int z) {
+		for (int y = 0; y < height; ++y) {
+			for (int x = (y + z + parity) & 1; x < width; x += 2) {
+				int index = x + width * (y + height * z);
+				if ((levelObstacles.flags[index] & OBSTACLE_SOLID) != 0) {
+					pressure.values[index] = 0.0f;
+					continue;
+				}
+
+				float sum, count;
+				SumFluidNeighbours(pressure, levelObstacles, index, sum, count);
+
+				if (count > 0.0f) {
+					float xC = pressure.values[index];
+					pressure.values[index] = Lerp(xC, (sum - rightHandSide.values[index]) / count, overRelaxation);
+				}
+			}
+		}
+	});
+}
+
+void CPUKernels::MultigridResidual(const ScalarField3D &pressure, const ScalarField3D &rightHandSide, const ObstacleField3D &levelObstacles, ScalarField3D &result) {
+	const int width = pressure.width;
+	const int height = pressure.height;
+
+	ParallelForSlices(pressure.depth, [&](int z) {
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				int index = x + width * (y + height * z);
+				if ((levelObstacles.flags[index] & OBSTACLE_SOLID) != 0) {
+					result.values[index] = 0.0f;
+					continue;
+				}
+
+				float sum, count;
+				SumFluidNeighbours(pressure, levelObstacles, index, sum, count);
+
+				result.values[index] = rightHandSide.values[index] - (sum - count * pressure.values[index]);
+			}
+		}
+	});
+}
+
+void CPUKernels::MultigridRestrict(const ScalarField3D &fineResidual, const ObstacleField3D &coarseObstacles, ScalarField3D &coarseResult) {
+	const int width = coarseResult.width;
+	const int height = coarseResult.height;
+
+	ParallelForSlices(coarseResult.depth, [&](int z) {
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				int index = x + width * (y + height * z);
+				if ((coarseObstacles.flags[index] & OBSTACLE_SOLID) != 0) {
+					coarseResult.values[index] = 0.0f;
+					continue;
+				}
+
+				float sum = 0.0f;
+				for (int n = 0; n < 8; ++n) {
+					sum += fineResidual.Load(2*x + (n & 1), 2*y + ((n >> 1) & 1), 2*z + ((n >> 2) & 1));
+				}
+
+				// average of the children scaled by the coarse grid spacing squared (4/8)
+				coarseResult.values[index] = 0.5f * sum;
+			}
+		}
+	});
+}
+
+void CPUKernels::MultigridProlong(const ScalarField3D &coarseCorrection, const ObstacleField3D &fineObstacles, ScalarField3D &finePressure) {
+	const int width = finePressure.width;
+	const int height = finePressure.height;
+
+	ParallelForSlices(finePressure.depth, [&](int z) {
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				int index = x + width * (y + height * z);
+				if ((fineObstacles.flags[index] & OBSTACLE_SOLID) != 0) {
+					finePressure.values[index] = 0.0f;
+					continue;
+				}
+
+				// fine cell centres expressed in coarse cell units, kept inside the outermost coarse cell centres
+				// so the interpolation never fades towards the zero border
+				float coarseX = Clamp((x + 0.5f) * 0.5f - 0.5f, 0.0f, (float)(coarseCorrection.width - 1));
+				float coarseY = Clamp((y + 0.5f) * 0.5f - 0.5f, 0.0f, (float)(coarseCorrection.height - 1));
+				float coarseZ = Clamp((z + 0.5f) * 0.5f - 0.5f, 0.0f, (float)(coarseCorrection.depth - 1));
+				float correction = coarseCorrection.Sample(coarseX, coarseY, coarseZ);
+				finePressure.values[index] += correction;
+			}
+		}
+	});
+}
+
+void CPUKernels::MultigridRestrictObstacles(const ObstacleField3D &fineObstacles, ObstacleField3D &coarseResult) {
+	const int width = coarseResult.width;
+	const int height = coarseResult.height;
+	const int depth = coarseResult.depth;
+
+	// a coarse cell is solid only if all of its children are solid
+	auto isCoarseObstacle = [&](int x, int y, int z) {
+		for (int n = 0; n < 8; ++n) {
+			int fineX = 2*x + (n & 1);
+			int fineY = 2*y + ((n >> 1) & 1);
+			int fineZ = 2*z + ((n >> 2) & 1);
+			if (fineX < fineObstacles.width && fineY < fineObstacles.height && fineZ < fineObstacles.depth
+				&& !fineObstacles.IsObstacleCell(fineX, fineY, fineZ))
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+
+	ParallelForSlices(depth, [&](int z) {
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				coarseResult.flags[coarseResult.Index(x, y, z)] = GetObstacleFlags(x, y, z, width, height, depth, isCoarseObstacle);
+			}
+		}
+	});
+}
+
+float CPUKernels::ResidualReduction(const ScalarField3D &residual) {
+	const int width = residual.width;
+	const int height = residual.height;
+	const int depth = residual.depth;
+
+	// each slice sums into its own entry so no synchronisation is needed
+	std::vector<double> sliceSums(depth, 0.0);
+	ParallelForSlices(depth, [&](int z) {
+		const float *slice = &residual.values[width * height * z];
+		double sum = 0.0;
+		for (int i = 0; i < width * height; ++i) {
+			sum += slice[i] * slice[i];
+		}
+		sliceSums[z] = sum;
+	});
+
+	double totalSum = 0.0;
+	for (int z = 0; z < depth; ++z) {
+		totalSum += sliceSums[z];
+	}
+
+	return (float)std::sqrt(totalSum / residual.GetNumCells());
+}
+
+void CPUKernels::ActivityReduction(const VectorField3D &velocity, const ScalarField3D &temperature, const ScalarField3D &density, const ScalarField3D *reaction,
+	FluidActivityStats &stats)
+{
+	const int sliceSize = density.width * density.height;
+	const int depth = density.depth;
+
+	// each slice keeps its own maxima and energy, the squared speeds are compared so only the largest needs a square root
+	struct SliceActivity {
+		float maxDensity;
+		float maxTemperature;
+		float maxSpeedSquared;
+		double kineticEnergy;
+	};
+	std::vector<SliceActivity> sliceActivity(depth);
+	ParallelForSlices(depth, [&](int z) {
+		const int first = sliceSize * z;
+		SliceActivity activity = {0.0f, 0.0f, 0.0f, 0.0};
+		for (int i = first; i < first + sliceSize; ++i) {
+			float vx = velocity.x.values[i];
+			float vy = velocity.y.values[i];
+			float vz = velocity.z.values[i];
+			float speedSquared = vx * vx + vy * vy + vz * vz;
+			activity.maxDensity = Max(activity.maxDensity, std::fabs(density.values[i]));
+			activity.maxTemperature = Max(activity.maxTemperature, std::fabs(temperature.values[i]));
+			activity.maxSpeedSquared = Max(activity.maxSpeedSquared, speedSquared);
+			activity.kineticEnergy += 0.5 * speedSquared;
+		}
+		if (reaction) {
+			for (int i = first; i < first + sliceSize; ++i) {
+				activity.maxDensity = Max(activity.maxDensity, std::fabs(reaction->values[i]));
+			}
+		}
+		sliceActivity[z] = activity;
+	});
+
+	float maxSpeedSquared = 0.0f;
+	double kineticEnergy = 0.0;
+	stats.maxDensity = 0.0f;
+	stats.maxTemperature = 0.0f;
+	for (int z = 0; z < depth; ++z) {
+		stats.maxDensity = Max(stats.maxDensity, sliceActivity[z].maxDensity);
+		stats.maxTemperature = Max(stats.maxTemperature, sliceActivity[z].maxTemperature);
+		maxSpeedSquared = Max(maxSpeedSquared, sliceActivity[z].maxSpeedSquared);
+		kineticEnergy += sliceActivity[z].kineticEnergy;
+	}
+	stats.maxSpeed = std::sqrt(maxSpeedSquared);
+	stats.kineticEnergy = (float)kineticEnergy;
+}
+
+void CPUKernels::PCGLaplacianCoefficients(const ObstacleField3D &obstacles, ScalarField3D &fluidMask, ScalarField3D &diagonal) {
+	const int width = obstacles.width;
+	const int height = obstacles.height;
+
+	ParallelForSlices(obstacles.depth, [&](int z) {
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				int index = x + width * (y + height * z);
+				if ((obstacles.flags[index] & OBSTACLE_SOLID) != 0) {
+					fluidMask.values[index] = 0.0f;
+					diagonal.values[index] = 0.0f;
+					continue;
+				}
+
+				fluidMask.values[index] = 1.0f;
+				diagonal.values[index] = CountFluidNeighbours(obstacles, index);
+			}
+		}
+	});
+}
+
+void CPUKernels::PCGLaplacian(const ScalarField3D &direction, const ScalarField3D &fluidMask, const ScalarField3D &diagonal, ScalarField3D &result) {
+	const int width = direction.width;
+	const int height = direction.height;
+	const int depth = direction.depth;
+	const int slice = width * height;
+
+	const float *directionValues = &direction.values[0];
+	const float *maskValues = &fluidMask.values[0];
+	const float *diagonalValues = &diagonal.values[0];
+	float *resultValues = &result.values[0];
+
+	// solid neighbours hold a zero direction, so summing all six only picks up the fluid ones
+	auto laplacianCell = [&](int x, int y, int z) -> float {
+		int index = x + width * (y + height * z);
+		float sum = direction.Load(x+1, y, z) + direction.Load(x-1, y, z)
+			+ direction.Load(x, y+1, z) + direction.Load(x, y-1, z)
+			+ direction.Load(x, y, z+1) + direction.Load(x, y, z-1);
+		return maskValues[index] * sum - diagonalValues[index] * directionValues[index];
+	};
+
+	ParallelForSlices(depth, [&](int z) {
+		for (int y = 0; y < height; ++y) {
+			int rowStart = width * (y + height * z);
+
+			// rows on the faces of the volume have neighbours outside of it and take the bounds checked path
+			if (z == 0 || z == depth - 1 || y == 0 || y == height - 1) {
+				for (int x = 0; x < width; ++x) {
+					resultValues[rowStart + x] = laplacianCell(x, y, z);
+				}
+				continue;
+			}
+
+			resultValues[rowStart] = laplacianCell(0, y, z);
+			int x = 1;
+			for (; x + 4 <= width - 1; x += 4) {
+				const float *centre = directionValues + rowStart + x;
+				__m128 sum = _mm_add_ps(_mm_loadu_ps(centre - 1), _mm_loadu_ps(centre + 1));
+				sum = _mm_add_ps(sum, _mm_add_ps(_mm_loadu_ps(centre - width), _mm_loadu_ps(centre + width)));
+				sum = _mm_add_ps(sum, _mm_add_ps(_mm_loadu_ps(centre - slice), _mm_loadu_ps(centre + slice)));
+
+				__m128 neighbours = _mm_mul_ps(_mm_loadu_ps(maskValues + rowStart + x), sum);
+				__m128 self = _mm_mul_ps(_mm_loadu_ps(diagonalValues + rowStart + x), _mm_loadu_ps(centre));
+				_mm_storeu_ps(resultValues + rowStart + x, _mm_sub_ps(neighbours, self));
+			}
+			for (; x < width; ++x) {
+				resultValues[rowStart + x] = laplacianCell(x, y, z);
+			}
+		}
+	});
+}
+
+double CPUKernels::PCGDotProduct(const ScalarField3D &first, const ScalarField3D &second) {
+	const int width = first.width;
+	const int height = first.height;
+	const int depth = first.depth;
+
+	// rows are summed in single precision and accumulated in double, each slice into its own entry
+	std::vector<double> sliceSums(depth, 0.0);
+	ParallelForSlices(depth, [&](int z) {
+		double sum = 0.0;
+		for (int y = 0; y < height; ++y) {
+			const float *firstRow = &first.values[width * (y + height * z)];
+			const float *secondRow = &second.values[width * (y + height * z)];
+
+			__m128 rowSum = _mm_setzero_ps();
+			int x = 0;
+			for (; x + 4 <= width; x += 4) {
+				rowSum = _mm_add_ps(rowSum, _mm_mul_ps(_mm_loadu_ps(firstRow + x), _mm_loadu_ps(secondRow + x)));
+			}
+			sum += SumLanes(rowSum);
+			for (; x < width; ++x) {
+				sum += firstRow[x] * secondRow[x];
+			}
+		}
+		sliceSums[z] = sum;
+	});
+
+	double totalSum = 0.0;
+	for (int z = 0; z < depth; ++z) {
+		totalSum += sliceSums[z];
+	}
+	return totalSum;
+}
+
+void CPUKernels::PCGUpdateSolution(const ScalarField3D &direction, const ScalarField3D &laplacian, float alpha, ScalarField3D &pressure, ScalarField3D &residual) {
+	const int slice = direction.width * direction.height;
+	const __m128 alpha4 = _mm_set1_ps(alpha);
+
+	ParallelForSlices(direction.depth, [&](int z) {
+		const float *directionValues = &direction.values[slice * z];
+		const float *laplacianValues = &laplacian.values[slice * z];
+		float *pressureValues = &pressure.values[slice * z];
+		float *residualValues = &residual.values[slice * z];
+
+		int i = 0;
+		for (; i + 4 <= slice; i += 4) {
+			__m128 pressure4 = _mm_add_ps(_mm_loadu_ps(pressureValues + i), _mm_mul_ps(alpha4, _mm_loadu_ps(directionValues + i)));
+			__m128 residual4 = _mm_sub_ps(_mm_loadu_ps(residualValues + i), _mm_mul_ps(alpha4, _mm_loadu_ps(laplacianValues + i)));
+			_mm_storeu_ps(pressureValues + i, pressure4);
+			_mm_storeu_ps(residualValues + i, residual4);
+		}
+		for (; i < slice; ++i) {
+			pressureValues[i] += alpha * directionValues[i];
+			residualValues[i] -= alpha * laplacianValues[i];
+		}
+	});
+}
+
+void CPUKernels::PCGUpdateDirection(const ScalarField3D &preconditioned, float beta, ScalarField3D &direction) {
+	const int slice = direction.width * direction.height;
+	const __m128 beta4 = _mm_set1_ps(beta);
+
+	ParallelForSlices(direction.depth, [&](int z) {
+		const float *preconditionedValues = &preconditioned.values[slice * z];
+		float *directionValues = &direction.values[slice * z];
+
+		int i = 0;
+		for (; i + 4 <= slice; i += 4) {
+			__m128 direction4 = _mm_add_ps(_mm_loadu_ps(preconditionedValues + i), _mm_mul_ps(beta4, _mm_loadu_ps(directionValues + i)));
+			_mm_storeu_ps(directionValues + i, direction4);
+		}
+		for (; i < slice; ++i) {
+			directionValues[i] = preconditionedValues[i] + beta * directionValues[i];
+		}
+	});
+}
+
+void CPUKernels::PCGRemoveMean(const ScalarField3D &fluidMask, float mean, ScalarField3D &residual) {
+	const int slice = residual.width * residual.height;
+	const __m128 mean4 = _mm_set1_ps(mean);
+
+	ParallelForSlices(residual.depth, [&](int z) {
+		const float *maskValues = &fluidMask.values[slice * z];
+		float *residualValues = &residual.values[slice * z];
+
+		int i = 0;
+		for (; i + 4 <= slice; i += 4) {
+			__m128 residual4 = _mm_sub_ps(_mm_loadu_ps(residualValues + i), _mm_mul_ps(mean4, _mm_loadu_ps(maskValues + i)));
+			_mm_storeu_ps(residualValues + i, residual4);
+		}
+		for (; i < slice; ++i) {
+			residualValues[i] -= mean * maskValues[i];
+		}
+	});
+}
+
+void CPUKernels::BuoyancyImpulse(const VectorField3D &velocity, const ScalarField3D &temperature, const ScalarField3D &density, const ScalarField3D *reaction,
+	const InputBufferGeneral &general, const InputBufferInjection &injection, const ImpulseSourceData *sources,
+	VectorField3D &velocityResult, ScalarField3D &temperatureResult, ScalarField3D &densityResult, ScalarField3D *reactionResult, const BrickList *bricks)
+{
+	const int width = velocity.x.width;
+	const int height = velocity.x.height;
+
+	ParallelForRows(width, height, velocity.x.depth, bricks, [&](int y, int z, int xBegin, int xEnd) {
+		for (int x = xBegin; x < xEnd; ++x) {
+			int index = x + width * (y + height * z);
+			float temperatureVal = temperature.values[index];
+			float densityVal = density.values[index];
+
+			Vector3 velocityAmount;
+			float scalarAmounts[3];
+			SumImpulseSources(x, y, z, injection, sources, general.fTimeStep, velocityAmount, scalarAmounts);
+
+			Vector3 velocityVal = velocity.Get(index);
+			velocityVal.y += general.fTimeStep * temperatureVal * general.fDensityBuoyancy - densityVal * general.fDensityWeight;
+			velocityResult.Set(index, velocityVal + velocityAmount);
+
+			float smokeAmount = 0.0f;
+			if (reaction != nullptr) {
+				// smoke forms from the reaction after its impulse, the same as ExtinguishmentImpulse
+				float reactionVal = reaction->values[index] + scalarAmounts[2];
+				if (reactionVal > 0.0f && reactionVal < injection.fInputExtinguishment) {
+					smokeAmount = injection.fSmokeAmount * reactionVal;
+				}
+				reactionResult->values[index] = reactionVal;
+			}
+			densityResult.values[index] = densityVal + scalarAmounts[1] + smokeAmount;
+			temperatureResult.values[index] = temperatureVal + scalarAmounts[0];
+		}
+	});
+}
+
+void CPUKernels::ConfinementDivergence(const VectorField3D &velocity, const VectorField3D &vorticity, const ScalarField3D &vorticityLength,
+	const ObstacleField3D &obstacles, const InputBufferGeneral &general, VectorField3D &velocityResult, ScalarField3D &divergenceResult)
+{
+	const int width = velocity.x.width;
+	const int height = velocity.x.height;
+	const int depth = velocity.x.depth;
+	const int sliceSize = width * height;
+	const float strength = general.fTimeStep * general.fVorticityStrength;
+
+	float *const confinedVelocity[3] = {&velocityResult.x.values[0], &velocityResult.y.values[0], &velocityResult.z.values[0]};
+
+	ParallelForFusedSlices<3>(width, height, depth, confinedVelocity,
+		[&](int z, float *const *channels) {
+			const int sliceOffset = z * sliceSize;
+			ForEachStencilCell(z, width, height, depth, [&](int x, int y, int index, const StencilNeighbours &n) {
+				Vector3 result = velocity.Get(index);
+				// obstacle cells keep their velocity
+				if ((obstacles.flags[index] & OBSTACLE_SOLID) == 0) {
+					result += ConfinementForce(vorticity, vorticityLength, index, n, strength);
+				}
+
+				int sliceIndex = index - sliceOffset;
+				channels[0][sliceIndex] = result.x;
+				channels[1][sliceIndex] = result.y;
+				channels[2][sliceIndex] = result.z;
+			});
+		},
+		[&](int z, float *const *below, float *const *centre, float *const *above) {
+			const int sliceOffset = z * sliceSize;
+			ForEachStencilCell(z, width, height, depth, [&](int x, int y, int index, const StencilNeighbours &n) {
+				int sliceIndex = index - sliceOffset;
+				divergenceResult.values[index] = VelocityDivergence(obstacles, index, n,
+					centre[1][n.iT - sliceOffset], centre[1][n.iB - sliceOffset], centre[0][n.iR - sliceOffset], centre[0][n.iL - sliceOffset],
+					above[2][sliceIndex], below[2][sliceIndex]);
+			});
+		});
+}
+
+void CPUKernels::JacobiSubtractGradient(const VectorField3D &velocity, const ScalarField3D &pressure, const ScalarField3D &divergence, const ObstacleField3D &obstacles,
+	VectorField3D &velocityResult, ScalarField3D &pressureResult)
+{
+	const int width = pressure.width;
+	const int height = pressure.height;
+	const int depth = pressure.depth;
+	const int sliceSize = width * height;
+
+	float *const newPressure[1] = {&pressureResult.values[0]};
+
+	ParallelForFusedSlices<1>(width, height, depth, newPressure,
+		[&](int z, float *const *channels) {
+			const int sliceOffset = z * sliceSize;
+			ForEachStencilCell(z, width, height, depth, [&](int x, int y, int index, const StencilNeighbours &n) {
+				channels[0][index - sliceOffset] = JacobiPressure(pressure, divergence, obstacles, index, n);
+			});
+		},
+		[&](int z, float *const *below, float *const *centre, float *const *above) {
+			const int sliceOffset = z * sliceSize;
+			const float *pressureSlice = centre[0];
+			ForEachStencilCell(z, width, height, depth, [&](int x, int y, int index, const StencilNeighbours &n) {
+				int sliceIndex = index - sliceOffset;
+				if ((obstacles.flags[index] & OBSTACLE_SOLID) != 0) {
+					velocityResult.Set(index, GetObstacleVelocity(obstacles, index));
+					return;
+				}
+
+				velocityResult.Set(index, ProjectVelocity(velocity.Get(index), obstacles, index, n, pressureSlice[sliceIndex],
+					pressureSlice[n.iT - sliceOffset], pressureSlice[n.iB - sliceOffset], pressureSlice[n.iR - sliceOffset], pressureSlice[n.iL - sliceOffset],
+					above[0][sliceIndex], below[0][sliceIndex]));
+			});
+		});
+}
\ No newline at end of file
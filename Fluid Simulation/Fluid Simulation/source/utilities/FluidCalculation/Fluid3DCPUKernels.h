@@ -0,0 +1,160 @@
+/********************************************************************
+Fluid3DCPUKernels.h: CPU versions of the compute shaders found in
+cFluid3D.hlsl. Each kernel takes the same constant buffer structs as
+its shader counterpart and processes the volume in parallel z slices.
+The kernels taking a brick list only process the cells of those
+bricks when one is given, like the sparse entry points of the
+shaders. The neighbour stencils only clamp on the ghost border of
+Fluid3DCPUStencils.h.
+
+Author:	Valentin Hinov
+Date: 2/5/2014
+*********************************************************************/
+
+#ifndef _FLUID3DCPUKERNELS_H
+#define _FLUID3DCPUKERNELS_H
+
+#include "FluidSettings.h"
+#include "Fluid3DCPUFields.h"
+#include "Fluid3DBuffers.h"
+
+// Jacobi iterations the CPU calculator runs per pass over the volume
+#define JACOBI_BLOCK_ITERATIONS 4
+
+namespace Fluid3D {
+namespace CPUKernels {
+
+	// AdvectComputeShader
+	void Advect(const VectorField3D &velocity, const ScalarField3D &target, const ObstacleField3D &obstacles,
+		const InputBufferGeneral &general, const InputBufferAdvection &advection, ScalarField3D &result, const BrickList *bricks = nullptr);
+	void Advect(const VectorField3D &velocity, const VectorField3D &target, const ObstacleField3D &obstacles,
+		const InputBufferGeneral &general, const InputBufferAdvection &advection, VectorField3D &result, const BrickList *bricks = nullptr);
+
+	// AdvectMacCormackComputeShader - targetA is the forward advected field, targetB the backward advected one
+	// and targetC the original field
+	void AdvectMacCormack(const VectorField3D &velocity, const ScalarField3D &targetA, const ScalarField3D &targetB, const ScalarField3D &targetC,
+		const ObstacleField3D &obstacles, const InputBufferGeneral &general, const InputBufferAdvection &advection, ScalarField3D &result, const BrickList *bricks = nullptr);
+	void AdvectMacCormack(const VectorField3D &velocity, const VectorField3D &targetA, const VectorField3D &targetB, const VectorField3D &targetC,
+		const ObstacleField3D &obstacles, const InputBufferGeneral &general, const InputBufferAdvection &advection, VectorField3D &result, const BrickList *bricks = nullptr);
+
+	// AdvectScalarsComputeShader - targets and results hold the temperature, density and reaction, the reaction entries are nullptr for smoke
+	void AdvectScalars(const VectorField3D &velocity, const ScalarField3D *const *targets, const ObstacleField3D &obstacles,
+		const InputBufferGeneral &general, const InputBufferScalarAdvection &scalarAdvection, ScalarField3D *const *results, const BrickList *bricks = nullptr);
+
+	// AdvectScalarsForwardComputeShader - the forward advected fields are packed into the x, y and z components of packedResult.
+	// Unlike the shader, fields that are not advected with MacCormack are skipped
+	void AdvectScalarsForward(const VectorField3D &velocity, const ScalarField3D *const *targets, const ObstacleField3D &obstacles,
+		const InputBufferGeneral &general, const InputBufferScalarAdvection &scalarAdvection, VectorField3D &packedResult, const BrickList *bricks = nullptr);
+
+	// AdvectComputeShader run backwards on the packed fields written by AdvectScalarsForward, skipping the same fields
+	void AdvectScalarsBackward(const VectorField3D &velocity, const VectorField3D &packedForward, bool hasReaction, const ObstacleField3D &obstacles,
+		const InputBufferGeneral &general, const InputBufferScalarAdvection &scalarAdvection, VectorField3D &packedResult, const BrickList *bricks = nullptr);
+
+	// AdvectScalarsMacCormackComputeShader
+	void AdvectScalarsMacCormack(const VectorField3D &velocity, const VectorField3D &packedForward, const VectorField3D &packedBackward,
+		const ScalarField3D *const *targets, const ObstacleField3D &obstacles, const InputBufferGeneral &general,
+		const InputBufferScalarAdvection &scalarAdvection, ScalarField3D *const *results, const BrickList *bricks = nullptr);
+
+	// BuoyancyComputeShader
+	void Buoyancy(const VectorField3D &velocity, const ScalarField3D &temperature, const ScalarField3D &density,
+		const InputBufferGeneral &general, VectorField3D &result, const BrickList *bricks = nullptr);
+
+	// ImpulseSourcesComputeShader - adds the injection.uImpulseSourceCount entries of sources to the fields in place over the
+	// injection region. reaction is nullptr for smoke
+	void ImpulseSources(VectorField3D &velocity, ScalarField3D &temperature, ScalarField3D &density, ScalarField3D *reaction,
+		const InputBufferGeneral &general, const InputBufferInjection &injection, const ImpulseSourceData *sources);
+
+	// ExtinguishmentImpulseComputeShader
+	void ExtinguishmentImpulse(const ScalarField3D &reaction, const ScalarField3D &impulseInitial, const InputBufferInjection &injection, ScalarField3D &result, const BrickList *bricks = nullptr);
+
+	// VorticityComputeShader - the float4 result is split into the curl and its length
+	void Vorticity(const VectorField3D &velocity, VectorField3D &vorticityResult, ScalarField3D &vorticityLengthResult);
+
+	// ConfinementComputeShader
+	void Confinement(const VectorField3D &velocity, const VectorField3D &vorticity, const ScalarField3D &vorticityLength,
+		const ObstacleField3D &obstacles, const InputBufferGeneral &general, VectorField3D &result);
+
+	// DivergenceComputeShader
+	void Divergence(const VectorField3D &velocity, const ObstacleField3D &obstacles, ScalarField3D &result);
+
+	// JacobiComputeShader
+	void Jacobi(const ScalarField3D &pressure, const ScalarField3D &divergence, const ObstacleField3D &obstacles, ScalarField3D &result);
+
+	// JacobiComputeShader run iterations times, at least once, in a single pass over the volume. Each task works
+	// through a chunk of slices with every iteration a slice behind the one before it, so the intermediate
+	// iterations only live in a few slices that stay in cache. Gives the same result as calling Jacobi iterations
+	// times. result must not be pressure
+	void JacobiBlocked(const ScalarField3D &pressure, const ScalarField3D &divergence, const ObstacleField3D &obstacles, int iterations, ScalarField3D &result);
+
+	// SubtractGradientComputeShader
+	void SubtractGradient(const VectorField3D &velocity, const ScalarField3D &pressure, const ObstacleField3D &obstacles, VectorField3D &result);
+
+	// ObstaclesComputeShader - voxelizes the walls and the obstacleInput.uObstacleBoxCount entries of boxes over the
+	// obstacle region, writing the flags and velocity of its cells
+	void Obstacles(const InputBufferGeneral &general, const InputBufferObstacles &obstacleInput, const ObstacleBoxData *boxes, ObstacleField3D &result);
+	// ObstaclesComputeShader over the whole volume without any boxes, which leaves only the walls
+	void Obstacles(ObstacleField3D &result);
+
+	// RedBlackSORComputeShader - updates the cells whose (x + y + z) parity matches in place
+	void RedBlackSOR(ScalarField3D &pressure, const ScalarField3D &rightHandSide, const ObstacleField3D &levelObstacles, float overRelaxation, int parity);
+
+	// MultigridResidualComputeShader
+	void MultigridResidual(const ScalarField3D &pressure, const ScalarField3D &rightHandSide, const ObstacleField3D &levelObstacles, ScalarField3D &result);
+
+	// MultigridRestrictComputeShader
+	void MultigridRestrict(const ScalarField3D &fineResidual, const ObstacleField3D &coarseObstacles, ScalarField3D &coarseResult);
+
+	// MultigridProlongComputeShader
+	void MultigridProlong(const ScalarField3D &coarseCorrection, const ObstacleField3D &fineObstacles, ScalarField3D &finePressure);
+
+	// MultigridRestrictObstaclesComputeShader
+	void MultigridRestrictObstacles(const ObstacleField3D &fineObstacles, ObstacleField3D &coarseResult);
+
+	// ResidualReductionComputeShader followed by the CPU side sum - returns the RMS of the residual
+	float ResidualReduction(const ScalarField3D &residual);
+
+	// ActivityReductionComputeShader followed by the CPU side combination of the groups - fills in the maxima and the
+	// kinetic energy of stats. reaction is nullptr for smoke
+	void ActivityReduction(const VectorField3D &velocity, const ScalarField3D &temperature, const ScalarField3D &density, const ScalarField3D *reaction,
+		FluidActivityStats &stats);
+
+	// Conjugate gradient kernels. The CPU versions run 4 cells at a time with SSE
+
+	// CPU only - per cell coefficients of the pressure operator used by PCGLaplacian. fluidMask is 1 for fluid
+	// cells and 0 for solid ones, diagonal is the number of fluid neighbours of a fluid cell
+	void PCGLaplacianCoefficients(const ObstacleField3D &obstacles, ScalarField3D &fluidMask, ScalarField3D &diagonal);
+
+	// PCGLaplacianComputeShader - direction must be zero in solid cells, which lets every neighbour be summed without
+	// checking the obstacles
+	void PCGLaplacian(const ScalarField3D &direction, const ScalarField3D &fluidMask, const ScalarField3D &diagonal, ScalarField3D &result);
+
+	// PCGDotProductComputeShader followed by the sums of PCGComputeAlpha/BetaComputeShader
+	double PCGDotProduct(const ScalarField3D &first, const ScalarField3D &second);
+
+	// PCGUpdateSolutionComputeShader - pressure += alpha * direction, residual -= alpha * laplacian
+	void PCGUpdateSolution(const ScalarField3D &direction, const ScalarField3D &laplacian, float alpha, ScalarField3D &pressure, ScalarField3D &residual);
+
+	// PCGUpdateDirectionComputeShader - direction = preconditioned + beta * direction
+	void PCGUpdateDirection(const ScalarField3D &preconditioned, float beta, ScalarField3D &direction);
+
+	// PCGRemoveMeanComputeShader - subtracts mean from every fluid cell of the residual
+	void PCGRemoveMean(const ScalarField3D &fluidMask, float mean, ScalarField3D &residual);
+
+	// Fused kernels. The ones with neighbour stencils process the volume in chunks of slices instead of single slices
+
+	// BuoyancyImpulseSmokeComputeShader, or BuoyancyImpulseFireComputeShader if reaction is given
+	void BuoyancyImpulse(const VectorField3D &velocity, const ScalarField3D &temperature, const ScalarField3D &density, const ScalarField3D *reaction,
+		const InputBufferGeneral &general, const InputBufferInjection &injection, const ImpulseSourceData *sources,
+		VectorField3D &velocityResult, ScalarField3D &temperatureResult, ScalarField3D &densityResult, ScalarField3D *reactionResult, const BrickList *bricks = nullptr);
+
+	// ConfinementDivergenceComputeShader
+	void ConfinementDivergence(const VectorField3D &velocity, const VectorField3D &vorticity, const ScalarField3D &vorticityLength,
+		const ObstacleField3D &obstacles, const InputBufferGeneral &general, VectorField3D &velocityResult, ScalarField3D &divergenceResult);
+
+	// JacobiSubtractGradientComputeShader
+	void JacobiSubtractGradient(const VectorField3D &velocity, const ScalarField3D &pressure, const ScalarField3D &divergence, const ObstacleField3D &obstacles,
+		VectorField3D &velocityResult, ScalarField3D &pressureResult);
+}
+}
+
+#endif
@@ -0,0 +1,98 @@
+/********************************************************************
+Fluid3DCPUStencils.h: Neighbour lookups of the six point stencils of
+the CPU kernels.
+
+The outermost layer of every volume is the ghost border of the
+stencils - it holds the walls, so its cells are solid and flag every
+neighbour they have past the edge of the volume. Only the cells of
+that layer have neighbours outside of the volume, which are clamped
+back onto it the same way as coordT/B/R/L/U/D in the shaders. Every
+interior cell reads its neighbours a fixed stride away, so the
+interior rows run without any clamping or bounds checks.
+
+Author:	Valentin Hinov
+Date: 11/5/2014
+*********************************************************************/
+
+#ifndef _FLUID3DCPUSTENCILS_H
+#define _FLUID3DCPUSTENCILS_H
+
+#include "../math/MathUtils.h"
+
+namespace Fluid3D {
+
+// Indices of the six neighbours of a cell
+struct StencilNeighbours {
+	int iT, iB, iR, iL, iU, iD;
+
+	// Neighbours past the edge of the volume are clamped to it
+	static inline StencilNeighbours Clamped(int x, int y, int z, int width, int height, int depth) {
+		int xR = Min(x+1, width-1);
+		int xL = Max(x-1, 0);
+		int yT = Min(y+1, height-1);
+		int yB = Max(y-1, 0);
+		int zU = Min(z+1, depth-1);
+		int zD = Max(z-1, 0);
+
+		StencilNeighbours n;
+		n.iT = x + width * (yT + height * z);
+		n.iB = x + width * (yB + height * z);
+		n.iR = xR + width * (y + height * z);
+		n.iL = xL + width * (y + height * z);
+		n.iU = x + width * (y + height * zU);
+		n.iD = x + width * (y + height * zD);
+		return n;
+	}
+
+	// Only valid for cells off the ghost border
+	static inline StencilNeighbours Interior(int index, int width, int sliceSize) {
+		StencilNeighbours n;
+		n.iT = index + width;
+		n.iB = index - width;
+		n.iR = index + 1;
+		n.iL = index - 1;
+		n.iU = index + sliceSize;
+		n.iD = index - sliceSize;
+		return n;
+	}
+};
+
+// Calls cellFunction(x, y, index, n) for every cell of slice z with clamped neighbours. What the stencils cost
+// without a ghost border
+template<typename CellFunction>
+inline void ForEachClampedStencilCell(int z, int width, int height, int depth, const CellFunction &cellFunction) {
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			cellFunction(x, y, x + width * (y + height * z), StencilNeighbours::Clamped(x, y, z, width, height, depth));
+		}
+	}
+}
+
+// Calls cellFunction(x, y, index, n) for every cell of slice z. The cells of the ghost border get clamped neighbours,
+// the rest fixed strides
+template<typename CellFunction>
+inline void ForEachStencilCell(int z, int width, int height, int depth, const CellFunction &cellFunction) {
+	const bool borderSlice = z == 0 || z == depth-1 || width < 3 || height < 3;
+	const int sliceSize = width * height;
+	for (int y = 0; y < height; ++y) {
+		int rowIndex = width * (y + height * z);
+		bool borderRow = borderSlice || y == 0 || y == height-1;
+
+		// the whole row on the border, otherwise its first and last cell
+		int borderStep = borderRow ? 1 : width-1;
+		for (int x = 0; x < width; x += borderStep) {
+			cellFunction(x, y, rowIndex + x, StencilNeighbours::Clamped(x, y, z, width, height, depth));
+		}
+		if (borderRow) {
+			continue;
+		}
+
+		for (int x = 1; x < width-1; ++x) {
+			cellFunction(x, y, rowIndex + x, StencilNeighbours::Interior(rowIndex + x, width, sliceSize));
+		}
+	}
+}
+
+}
+
+#endif
\ No newline at end of file
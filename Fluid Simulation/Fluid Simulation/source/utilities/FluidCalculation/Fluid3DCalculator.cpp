@@ -10,6 +10,10 @@ Date: 18/2/2014
 #include "Fluid3DCalculator.h"
 #include "Fluid3DShaders.h"
 #include "Fluid3DBuffers.h"
+#include "Fluid3DMultigrid.h"
+#include "Fluid3DStateCache.h"
+#include <string.h>
+#include <float.h>
 
 #define READ 0
 #define WRITE 1
@@ -34,8 +38,10 @@ void Fluid3DCalculator::AttachCommonResources(ID3D11DeviceContext* context) {
 	context->CSSetSamplers(0,1,&(sampleState.p));
 }
 
-Fluid3DCalculator::Fluid3DCalculator(const FluidSettings &fluidSettings) : pD3dGraphicsObj(nullptr), 
-	mFluidSettings(fluidSettings), mExtraVelocityAdded(false)
+Fluid3DCalculator::Fluid3DCalculator(const FluidSettings &fluidSettings) : pD3dGraphicsObj(nullptr), mHwnd(nullptr),
+	mFluidSettings(fluidSettings), mBrickListsHoldAllBricks(false), mBrickListUpdates(0), mRedBlackOverRelaxation(-1.0f),
+	mActivityReductions(0), mResidualReadbacks(0), mStageTimer(mStageProfiler), mResolutionTier(0), mDimensions(fluidSettings.dimensions),
+	mHistoryLength(0), mHistoryHead(0), mHistoryFrames(0)
 {
 
 }
@@ -46,27 +52,16 @@ Fluid3DCalculator::~Fluid3DCalculator() {
 
 bool Fluid3DCalculator::Initialize(_In_ D3DGraphicsObject * d3dGraphicsObj, HWND hwnd) {
 	pD3dGraphicsObj = d3dGraphicsObj;
+	mHwnd = hwnd;
 	ID3D11Device *pDevice = pD3dGraphicsObj->GetDevice();
 	bool result = InitShaders(hwnd);
 	if (!result) {
 		return false;
 	}
 
-	switch (mFluidSettings.GetFluidType()) {
-	case SMOKE:
-		mFluidResources = FluidResourcesPerObject::CreateResourcesSmoke(pDevice, mFluidSettings.dimensions, hwnd);
-		break;
-	case FIRE:
-		mFluidResources = FluidResourcesPerObject::CreateResourcesFire(pDevice, mFluidSettings.dimensions, hwnd);
-		break;
-	}
-
-	if (commonResourcesMap.count(mFluidSettings.dimensions) == 0) {
-		mCommonResources = CommonFluidResources::CreateResources(pDevice, mFluidSettings.dimensions, hwnd);
-		commonResourcesMap[mFluidSettings.dimensions] = mCommonResources;
-	} else {
-		mCommonResources = commonResourcesMap[mFluidSettings.dimensions];
-	}
+	mFluidResources = CreateResourcesPerObject(mDimensions);
+	mFluidResources.ResizeHistory(pDevice, mDimensions, mHistoryLength, mFluidSettings.GetFluidType() == FIRE, hwnd);
+	UseCommonResources(mDimensions);
 
 	result = InitBuffersAndSamplers();
 	if (!result) {
@@ -74,37 +69,79 @@ bool Fluid3DCalculator::Initialize(_In_ D3DGraphicsObject * d3dGraphicsObj, HWND
 		return false;
 	}
 
-	// Update buffers with values
-	UpdateGeneralBuffer();
-
-	// create obstacle shader for generating the static obstacle field
-	ObstacleShader obstacleShader(mFluidSettings.dimensions);
-	result = obstacleShader.Initialize(pD3dGraphicsObj->GetDevice(), hwnd);
+	result = mStageTimer.Initialize(pDevice, hwnd);
 	if (!result) {
 		return false;
 	}
-	obstacleShader.Compute(pD3dGraphicsObj->GetDeviceContext(), &mFluidResources.obstacleSP);
+
+	// Update buffers with values
+	UpdateGeneralBuffer();
+
+	// the first voxelization covers the whole volume
+	UpdateObstacles();
+
+	// the pressure is used as the initial guess of the next solve, so it must start out cleared
+	float clearCol[4] = {0.0f,0.0f,0.0f,0.0f};
+	pD3dGraphicsObj->GetDeviceContext()->ClearUnorderedAccessViewFloat(mFluidResources.pressureSP.mUAV, clearCol);
 
 	return true;
 }
 
+FluidResourcesPerObject Fluid3DCalculator::CreateResourcesPerObject(const Vector3 &dimensions) const {
+	ID3D11Device *pDevice = pD3dGraphicsObj->GetDevice();
+	switch (mFluidSettings.GetFluidType()) {
+	case FIRE:
+		return FluidResourcesPerObject::CreateResourcesFire(pDevice, dimensions, mHwnd);
+	default:
+		return FluidResourcesPerObject::CreateResourcesSmoke(pDevice, dimensions, mHwnd);
+	}
+}
+
+void Fluid3DCalculator::UseCommonResources(const Vector3 &dimensions) {
+	if (commonResourcesMap.count(dimensions) == 0) {
+		mCommonResources = CommonFluidResources::CreateResources(pD3dGraphicsObj->GetDevice(), dimensions, mHwnd);
+		commonResourcesMap[dimensions] = mCommonResources;
+	} else {
+		mCommonResources = commonResourcesMap[dimensions];
+	}
+}
+
 bool Fluid3DCalculator::InitShaders(HWND hwnd) {
 	ID3D11Device *device = pD3dGraphicsObj->GetDevice();
 
-	mAdvectionShader = unique_ptr<AdvectionShader>(new AdvectionShader(AdvectionShader::ADVECTION_TYPE_NORMAL, mFluidSettings.dimensions));
+	// The advection, buoyancy and impulse shaders only run on the bricks of a list. With sparseBricks off the lists hold every brick
+	mAdvectionShader = unique_ptr<AdvectionShader>(new AdvectionShader(AdvectionShader::ADVECTION_TYPE_NORMAL, mFluidSettings.dimensions, true));
 	bool result = mAdvectionShader->Initialize(device,hwnd);
 	if (!result) {
 		return false;
 	}
 
-	mMacCormarckAdvectionShader = unique_ptr<AdvectionShader>(new AdvectionShader(AdvectionShader::ADVECTION_TYPE_MACCORMARCK, mFluidSettings.dimensions));
+	mMacCormarckAdvectionShader = unique_ptr<AdvectionShader>(new AdvectionShader(AdvectionShader::ADVECTION_TYPE_MACCORMARCK, mFluidSettings.dimensions, true));
 	result = mMacCormarckAdvectionShader->Initialize(device,hwnd);
 	if (!result) {
 		return false;
 	}
 
-	mImpulseShader = unique_ptr<ImpulseShader>(new ImpulseShader(mFluidSettings.dimensions));
-	result = mImpulseShader->Initialize(device,hwnd);
+	mScalarAdvectionShader = unique_ptr<ScalarAdvectionShader>(new ScalarAdvectionShader(ScalarAdvectionShader::SCALAR_ADVECTION_TYPE_NORMAL, mFluidSettings.dimensions, true));
+	result = mScalarAdvectionShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mScalarAdvectionForwardShader = unique_ptr<ScalarAdvectionShader>(new ScalarAdvectionShader(ScalarAdvectionShader::SCALAR_ADVECTION_TYPE_FORWARD, mFluidSettings.dimensions, true));
+	result = mScalarAdvectionForwardShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mScalarMacCormarckAdvectionShader = unique_ptr<ScalarAdvectionShader>(new ScalarAdvectionShader(ScalarAdvectionShader::SCALAR_ADVECTION_TYPE_MACCORMARCK, mFluidSettings.dimensions, true));
+	result = mScalarMacCormarckAdvectionShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mImpulseSourcesShader = unique_ptr<ImpulseSourcesShader>(new ImpulseSourcesShader(mFluidSettings.dimensions));
+	result = mImpulseSourcesShader->Initialize(device,hwnd);
 	if (!result) {
 		return false;
 	}
@@ -139,15 +176,172 @@ bool Fluid3DCalculator::InitShaders(HWND hwnd) {
 		return false;
 	}
 
-	mBuoyancyShader = unique_ptr<BuoyancyShader>(new BuoyancyShader(mFluidSettings.dimensions));
+	mBuoyancyShader = unique_ptr<BuoyancyShader>(new BuoyancyShader(mFluidSettings.dimensions, true));
 	result = mBuoyancyShader->Initialize(device,hwnd);
 	if (!result) {
 		return false;
 	}
 
+	mRedBlackSORShader = unique_ptr<RedBlackSORShader>(new RedBlackSORShader(mFluidSettings.dimensions));
+	result = mRedBlackSORShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mMultigridResidualShader = unique_ptr<MultigridResidualShader>(new MultigridResidualShader(mFluidSettings.dimensions));
+	result = mMultigridResidualShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mMultigridRestrictShader = unique_ptr<MultigridRestrictShader>(new MultigridRestrictShader(mFluidSettings.dimensions));
+	result = mMultigridRestrictShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mMultigridProlongShader = unique_ptr<MultigridProlongShader>(new MultigridProlongShader(mFluidSettings.dimensions));
+	result = mMultigridProlongShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mMultigridRestrictObstaclesShader = unique_ptr<MultigridRestrictObstaclesShader>(new MultigridRestrictObstaclesShader(mFluidSettings.dimensions));
+	result = mMultigridRestrictObstaclesShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mResidualReductionShader = unique_ptr<ResidualReductionShader>(new ResidualReductionShader(mFluidSettings.dimensions));
+	result = mResidualReductionShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mActivityReductionShader = unique_ptr<ActivityReductionShader>(new ActivityReductionShader(mFluidSettings.dimensions));
+	result = mActivityReductionShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mPCGLaplacianShader = unique_ptr<PCGLaplacianShader>(new PCGLaplacianShader(mFluidSettings.dimensions));
+	result = mPCGLaplacianShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mPCGDotProductShader = unique_ptr<PCGReductionShader>(new PCGReductionShader(PCGReductionShader::PCG_REDUCTION_DOT_PRODUCT, mFluidSettings.dimensions));
+	result = mPCGDotProductShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mPCGResidualSumShader = unique_ptr<PCGReductionShader>(new PCGReductionShader(PCGReductionShader::PCG_REDUCTION_RESIDUAL_SUM, mFluidSettings.dimensions));
+	result = mPCGResidualSumShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mPCGAlphaShader = unique_ptr<PCGScalarsShader>(new PCGScalarsShader(PCGScalarsShader::PCG_SCALARS_ALPHA, mFluidSettings.dimensions));
+	result = mPCGAlphaShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mPCGBetaShader = unique_ptr<PCGScalarsShader>(new PCGScalarsShader(PCGScalarsShader::PCG_SCALARS_BETA, mFluidSettings.dimensions));
+	result = mPCGBetaShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mPCGMeanShader = unique_ptr<PCGScalarsShader>(new PCGScalarsShader(PCGScalarsShader::PCG_SCALARS_MEAN, mFluidSettings.dimensions));
+	result = mPCGMeanShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mPCGRemoveMeanShader = unique_ptr<PCGRemoveMeanShader>(new PCGRemoveMeanShader(mFluidSettings.dimensions));
+	result = mPCGRemoveMeanShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mPCGUpdateSolutionShader = unique_ptr<PCGUpdateSolutionShader>(new PCGUpdateSolutionShader(mFluidSettings.dimensions));
+	result = mPCGUpdateSolutionShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mPCGUpdateDirectionShader = unique_ptr<PCGUpdateDirectionShader>(new PCGUpdateDirectionShader(mFluidSettings.dimensions));
+	result = mPCGUpdateDirectionShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	BuoyancyImpulseShader::BuoyancyImpulseType_t buoyancyImpulseType = mFluidSettings.GetFluidType() == FIRE ? BuoyancyImpulseShader::BUOYANCY_IMPULSE_FIRE : BuoyancyImpulseShader::BUOYANCY_IMPULSE_SMOKE;
+	mBuoyancyImpulseShader = unique_ptr<BuoyancyImpulseShader>(new BuoyancyImpulseShader(buoyancyImpulseType, mFluidSettings.dimensions, true));
+	result = mBuoyancyImpulseShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mConfinementDivergenceShader = unique_ptr<ConfinementDivergenceShader>(new ConfinementDivergenceShader(mFluidSettings.dimensions));
+	result = mConfinementDivergenceShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mJacobiSubtractGradientShader = unique_ptr<JacobiSubtractGradientShader>(new JacobiSubtractGradientShader(mFluidSettings.dimensions));
+	result = mJacobiSubtractGradientShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mBrickActivityShader = unique_ptr<BrickActivityShader>(new BrickActivityShader(mFluidSettings.dimensions));
+	result = mBrickActivityShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mBrickListShader = unique_ptr<BrickListShader>(new BrickListShader(mFluidSettings.dimensions));
+	result = mBrickListShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mObstacleShader = unique_ptr<ObstacleShader>(new ObstacleShader(mFluidSettings.dimensions));
+	result = mObstacleShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mRestrictVectorShader = unique_ptr<ResampleShader>(new ResampleShader(ResampleShader::RESAMPLE_RESTRICT_VECTOR, mFluidSettings.dimensions));
+	result = mRestrictVectorShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mRestrictScalarShader = unique_ptr<ResampleShader>(new ResampleShader(ResampleShader::RESAMPLE_RESTRICT_SCALAR, mFluidSettings.dimensions));
+	result = mRestrictScalarShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mProlongVectorShader = unique_ptr<ResampleShader>(new ResampleShader(ResampleShader::RESAMPLE_PROLONG_VECTOR, mFluidSettings.dimensions));
+	result = mProlongVectorShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
+	mProlongScalarShader = unique_ptr<ResampleShader>(new ResampleShader(ResampleShader::RESAMPLE_PROLONG_SCALAR, mFluidSettings.dimensions));
+	result = mProlongScalarShader->Initialize(device,hwnd);
+	if (!result) {
+		return false;
+	}
+
 	// only initialize ExtinguishmentImpulseShader if fluid type is fire
 	if (mFluidSettings.GetFluidType() == FIRE) {
-		mExtinguishmentImpulseShader = unique_ptr<ExtinguishmentImpulseShader>(new ExtinguishmentImpulseShader(mFluidSettings.dimensions));
+		mExtinguishmentImpulseShader = unique_ptr<ExtinguishmentImpulseShader>(new ExtinguishmentImpulseShader(mFluidSettings.dimensions, true));
 		result = mExtinguishmentImpulseShader->Initialize(device,hwnd);
 		if (!result) {
 			return false;
@@ -167,10 +361,32 @@ bool Fluid3DCalculator::InitBuffersAndSamplers() {
 	if (!result) {
 		return false;
 	}
-	result = BuildDynamicBuffer<InputBufferImpulse>(pD3dGraphicsObj->GetDevice(), &mInputBufferImpulse);
+	result = BuildDynamicBuffer<InputBufferInjection>(pD3dGraphicsObj->GetDevice(), &mInputBufferInjection);
+	if (!result) {
+		return false;
+	}
+	result = BuildDynamicBuffer<InputBufferScalarAdvection>(pD3dGraphicsObj->GetDevice(), &mInputBufferScalarAdvection);
+	if (!result) {
+		return false;
+	}
+	result = BuildDynamicBuffer<InputBufferBricks>(pD3dGraphicsObj->GetDevice(), &mInputBufferBricks);
+	if (!result) {
+		return false;
+	}
+	result = BuildDynamicBuffer<InputBufferObstacles>(pD3dGraphicsObj->GetDevice(), &mInputBufferObstacles);
 	if (!result) {
 		return false;
 	}
+	result = BuildDynamicBuffer<InputBufferResample>(pD3dGraphicsObj->GetDevice(), &mInputBufferResample);
+	if (!result) {
+		return false;
+	}
+	for (int parity = 0; parity < 2; ++parity) {
+		result = BuildDynamicBuffer<InputBufferRedBlack>(pD3dGraphicsObj->GetDevice(), &mInputBufferRedBlack[parity]);
+		if (!result) {
+			return false;
+		}
+	}
 
 	// Create the sampler if not already created
 	if (sampleState == nullptr) {
@@ -199,59 +415,323 @@ bool Fluid3DCalculator::InitBuffersAndSamplers() {
 }
 
 void Fluid3D::Fluid3DCalculator::AddForce(const ExtraForce& force) {
-	mExtraVelocityForce = force;
-	mExtraVelocityAdded = true;
+	ImpulseSource impulse;
+	impulse.target = IMPULSE_TARGET_VELOCITY;
+	impulse.position = force.position;
+	impulse.radius = force.radius;
+	impulse.amount = force.amount;
+	AddImpulse(impulse);
+}
+
+bool Fluid3DCalculator::AddImpulse(const ImpulseSource& impulse) {
+	if (mImpulses.size() >= MAX_IMPULSE_SOURCES) {
+		return false;
+	}
+	mImpulses.push_back(impulse);
+	Wake();
+	return true;
+}
+
+int Fluid3DCalculator::Process(int frames) {
+	if (mActivityStats.sleeping) {
+		mTimeStepPlan = TimeStepPlan();
+		return 0;
+	}
+
+	if (!mFluidSettings.adaptiveTimeStep) {
+		mTimeStepper.Reset();
+		if (frames <= 1) {
+			mTimeStepPlan.steps = 1;
+			mTimeStepPlan.timeStep = mFluidSettings.timeStep;
+			RecordHistory();
+			Step();
+			if (mFluidSettings.sleepWhenQuiet) {
+				MeasureActivity();
+			}
+			return 1;
+		}
+		mTimeStepPlan = AdaptiveTimeStepper::PlanSkippedFrames(mFluidSettings, mActivityStats.maxSpeed, frames);
+	}
+	else {
+		mTimeStepPlan = mTimeStepper.Plan(mFluidSettings, mActivityStats.maxSpeed, frames);
+	}
+	if (mTimeStepPlan.steps == 0) {
+		return 0;
+	}
+	RecordHistory();
+
+	// the steps run on the settings scaled to their length, the frame's own are put back once they are done
+	FluidSettings frameSettings = mFluidSettings;
+	mFluidSettings = AdaptiveTimeStepper::GetStepSettings(frameSettings, mTimeStepPlan.timeStep);
+	UpdateGeneralBuffer();
+	for (int i = 0; i < mTimeStepPlan.steps; ++i) {
+		Step();
+	}
+	mFluidSettings = frameSettings;
+	UpdateGeneralBuffer();
+	MeasureActivity();
+
+	return mTimeStepPlan.steps;
 }
 
-void Fluid3DCalculator::Process() {
+void Fluid3DCalculator::Step() {
 	auto context = pD3dGraphicsObj->GetDeviceContext();
 
+	mStageTimer.BeginStep(context, mFluidSettings.profileStages);
+	mStageTimer.Begin(context, STAGE_STEP);
+
 	context->CSSetSamplers(0,1,&(sampleState.p));
 
-	// Set the obstacle texture - it is constant throughout the execution step
+	mStageTimer.Begin(context, STAGE_OBSTACLES);
+	UpdateObstacles();
+	mStageTimer.End(context, STAGE_OBSTACLES);
+
+	// Set the obstacle textures - they are constant throughout the execution step
 	context->CSSetShaderResources(4, 1, &(mFluidResources.obstacleSP.mSRV.p));
+	context->CSSetShaderResources(11, 1, &(mFluidResources.obstacleVelocitySP.mSRV.p));
 
 	// Set all the buffers to the context
-	ID3D11Buffer *const pProcessConstantBuffers[3] = {mInputBufferGeneral, mInputBufferAdvection, mInputBufferImpulse};
-	context->CSSetConstantBuffers(0, 3, pProcessConstantBuffers);
+	UpdateInjectionBuffer();
+	ID3D11Buffer *const pProcessConstantBuffers[2] = {mInputBufferGeneral, mInputBufferAdvection};
+	context->CSSetConstantBuffers(0, 2, pProcessConstantBuffers);
+	context->CSSetConstantBuffers(4, 1, &(mInputBufferInjection.p));
+
+	// Set the impulse sources of the step - they are constant throughout the execution step as well
+	context->CSSetShaderResources(10, 1, &(mFluidResources.impulseSourcesSP.mSRV.p));
+
+	mStageTimer.Begin(context, STAGE_BRICKS);
+	UpdateActiveBricks();
+	mStageTimer.End(context, STAGE_BRICKS);
+
+	if (mFluidSettings.packedScalarAdvection) {
+		mStageTimer.Begin(context, STAGE_ADVECT_SCALARS);
+		AdvectScalars();
+		mStageTimer.End(context, STAGE_ADVECT_SCALARS);
+	}
+	else {
+		//Advect temperature against velocity
+		mStageTimer.Begin(context, STAGE_ADVECT_TEMPERATURE);
+		Advect(mFluidResources.temperatureSP, NORMAL, mFluidSettings.temperatureDissipation);
+		mStageTimer.End(context, STAGE_ADVECT_TEMPERATURE);
+
+		// Advect density against velocity
+		mStageTimer.Begin(context, STAGE_ADVECT_DENSITY);
+		Advect(mFluidResources.densitySP, GetAdvectionType(), mFluidSettings.densityDissipation);
+		mStageTimer.End(context, STAGE_ADVECT_DENSITY);
+
+		// Advect the reaction field against velocity
+		if (mFluidSettings.GetFluidType() == FIRE) {
+			mStageTimer.Begin(context, STAGE_ADVECT_REACTION);
+			Advect(mFluidResources.reactionSP, GetAdvectionType(), 1.0f, mFluidSettings.reactionDecay);
+			mStageTimer.End(context, STAGE_ADVECT_REACTION);
+		}
+	}
+
+	// Advect velocity against itself
+	mStageTimer.Begin(context, STAGE_ADVECT_VELOCITY);
+	Advect(mFluidResources.velocitySP, GetAdvectionType(), mFluidSettings.velocityDissipation);
+	mStageTimer.End(context, STAGE_ADVECT_VELOCITY);
+
+	if (mFluidSettings.fusedKernels) {
+		mStageTimer.Begin(context, STAGE_BUOYANCY_AND_IMPULSES);
+		ApplyBuoyancyAndImpulses();
+		mStageTimer.End(context, STAGE_BUOYANCY_AND_IMPULSES);
+	}
+	else {
+		//Determine how the temperature of the fluid changes the velocity
+		mStageTimer.Begin(context, STAGE_BUOYANCY);
+		UseBrickList(*mBuoyancyShader, BRICK_HALO_PASSES);
+		mBuoyancyShader->Compute(context,&mFluidResources.velocitySP[READ], &mFluidResources.temperatureSP[READ], &mFluidResources.densitySP[READ], &mFluidResources.velocitySP[WRITE]);
+		swap(mFluidResources.velocitySP[READ], mFluidResources.velocitySP[WRITE]);
+		mStageTimer.End(context, STAGE_BUOYANCY);
 
-	//Advect temperature against velocity
-	Advect(mFluidResources.temperatureSP, NORMAL, mFluidSettings.temperatureDissipation);
+		// Add a constant amount of density and temperature back into the system, along with any extra forces and impulses
+		mStageTimer.Begin(context, STAGE_IMPULSES);
+		ApplyImpulses();
+		mStageTimer.End(context, STAGE_IMPULSES);
+	}
 
-	// Advect density against velocity
-	Advect(mFluidResources.densitySP, mFluidSettings.advectionType, mFluidSettings.densityDissipation);
+	if (mFluidSettings.fusedKernels && mSolverProfile.vorticityConfinement) {
+		mStageTimer.Begin(context, STAGE_VORTICITY_AND_DIVERGENCE);
+		ComputeVorticityConfinementAndDivergence();
+		mStageTimer.End(context, STAGE_VORTICITY_AND_DIVERGENCE);
+	}
+	else {
+		// Try to preserve swirling movement of the fluid by injecting vorticity back into the system
+		if (mSolverProfile.vorticityConfinement) {
+			mStageTimer.Begin(context, STAGE_VORTICITY);
+			ComputeVorticityConfinement();
+			mStageTimer.End(context, STAGE_VORTICITY);
+		}
 
-	// Advect the reaction field against velocity
-	if (mFluidSettings.GetFluidType() == FIRE) {
-		Advect(mFluidResources.reactionSP, mFluidSettings.advectionType, 1.0f, mFluidSettings.reactionDecay);
+		// Calculate the divergence of the velocity
+		mStageTimer.Begin(context, STAGE_DIVERGENCE);
+		mDivergenceShader->Compute(context, &mFluidResources.velocitySP[READ], &mCommonResources.divergenceSP);
+		mStageTimer.End(context, STAGE_DIVERGENCE);
 	}
 
-	// Advect velocity against itself
-	Advect(mFluidResources.velocitySP, mFluidSettings.advectionType, mFluidSettings.velocityDissipation);
+	// the fused Jacobi solver runs its last iteration together with the gradient subtraction
+	bool fuseLastIteration = mFluidSettings.fusedKernels && mFluidSettings.pressureSolverType == JACOBI;
+	bool solverConverged = CalculatePressureGradient(fuseLastIteration ? 1 : 0);
 
-	//Determine how the temperature of the fluid changes the velocity
-	mBuoyancyShader->Compute(context,&mFluidResources.velocitySP[READ], &mFluidResources.temperatureSP[READ], &mFluidResources.densitySP[READ], &mFluidResources.velocitySP[WRITE]);
-	swap(mFluidResources.velocitySP[READ], mFluidResources.velocitySP[WRITE]);
+	mStageTimer.Begin(context, STAGE_SUBTRACT_GRADIENT);
+	if (fuseLastIteration && !solverConverged) {
+		mJacobiSubtractGradientShader->Compute(context, &mFluidResources.velocitySP[READ], &mFluidResources.pressureSP, &mCommonResources.divergenceSP,
+			&mFluidResources.velocitySP[WRITE], &mCommonResources.residualSP);
+		++mPressureSolverStats.iterationsUsed;
 
-	// Add a constant amount of density and temperature back into the system
-	RefreshConstantImpulse();
+		// the new pressure is only needed as the next step's initial guess
+		if (mFluidSettings.warmStartPressure) {
+			CopyVolume(&mCommonResources.residualSP, &mFluidResources.pressureSP);
+		}
+	}
+	else {
+		//Use the pressure texture that was last computed. This computes divergence free velocity
+		mSubtractGradientShader->Compute(context, &mFluidResources.velocitySP[READ], &mFluidResources.pressureSP, &mFluidResources.velocitySP[WRITE]);
+	}
+	std::swap(mFluidResources.velocitySP[READ], mFluidResources.velocitySP[WRITE]);
+	mStageTimer.End(context, STAGE_SUBTRACT_GRADIENT);
 
-	// If there are any extra forces - add them here
-	ApplyExtraForces();
+	mImpulses.clear();
 
-	// Try to preserve swirling movement of the fluid by injecting vorticity back into the system
-	ComputeVorticityConfinement();
+	mStageTimer.End(context, STAGE_STEP);
+	mStageTimer.EndStep(context);
+}
 
-	// Calculate the divergence of the velocity
-	mDivergenceShader->Compute(context, &mFluidResources.velocitySP[READ], &mCommonResources.divergenceSP);
+void Fluid3DCalculator::UpdateActiveBricks() {
+	ID3D11DeviceContext *context = pD3dGraphicsObj->GetDeviceContext();
+	bool sparse = mFluidSettings.sparseBricks;
+
+	// the lists only need filling with every brick once
+	if (!sparse && mBrickListsHoldAllBricks) {
+		mBrickOccupancyStats.activeBricks = mBrickOccupancyStats.totalBricks;
+		mBrickOccupancyStats.processedBricks = mBrickOccupancyStats.totalBricks;
+		mBrickOccupancyStats.processedPercentage = 100.0f;
+		return;
+	}
 
-	CalculatePressureGradient();
+	// the lists are about to be written, so the last one used must come off slot 7
+	ID3D11ShaderResourceView *const pSRVNULL[1] = {nullptr};
+	context->CSSetShaderResources(7, 1, pSRVNULL);
 
-	//Use the pressure texture that was last computed. This computes divergence free velocity
-	mSubtractGradientShader->Compute(context, &mFluidResources.velocitySP[READ], &mCommonResources.pressureSP[READ], &mFluidResources.velocitySP[WRITE]);
-	std::swap(mFluidResources.velocitySP[READ], mFluidResources.velocitySP[WRITE]);
+	UpdateBricksBuffer(!sparse);
+	context->CSSetConstantBuffers(6, 1, &(mInputBufferBricks.p));
+
+	if (sparse) {
+		bool isFire = mFluidSettings.GetFluidType() == FIRE;
+		mBrickActivityShader->Compute(context, mFluidResources.velocitySP.data(), mFluidResources.temperatureSP.data(), mFluidResources.densitySP.data(),
+			isFire ? mFluidResources.reactionSP.data() : nullptr, &mFluidResources.brickActivitySP);
+	}
+	mBrickListShader->Compute(context, &mFluidResources.brickActivitySP, mFluidResources.brickListSP.data());
+
+	// the group count of every list's dispatch arguments is its size
+	for (int halo = 0; halo <= BRICK_MAX_HALO; ++halo) {
+		context->CopyStructureCount(mFluidResources.brickDispatchArgs, halo * 3 * sizeof(UINT), mFluidResources.brickListSP[halo].mUAV);
+	}
+	mBrickListsHoldAllBricks = !sparse;
+
+	ReadBrickOccupancy();
+}
+
+void Fluid3DCalculator::UseBrickList(BaseFluid3DShader &shader, int haloBricks) {
+	ID3D11DeviceContext *context = pD3dGraphicsObj->GetDeviceContext();
+	shader.SetBrickDispatch(mFluidResources.brickDispatchArgs, haloBricks * 3 * sizeof(UINT));
+	context->CSSetShaderResources(7, 1, &(mFluidResources.brickListSP[haloBricks].mSRV.p));
+}
+
+void Fluid3DCalculator::ReadBrickOccupancy() {
+	ID3D11DeviceContext *context = pD3dGraphicsObj->GetDeviceContext();
+	std::array<CComPtr<ID3D11Buffer>, 2> &staging = mFluidResources.brickDispatchArgsStaging;
+
+	// Copy this update's list sizes and read the previous update's, which has most likely reached the staging buffer by
+	// now. If it has not, the stats are left as they were rather than stalling the pipeline
+	context->CopyResource(staging[mBrickListUpdates % 2], mFluidResources.brickDispatchArgs);
+	++mBrickListUpdates;
+	if (mBrickListUpdates < 2) {
+		return;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	HRESULT result = context->Map(staging[mBrickListUpdates % 2], 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mappedResource);
+	if (result == DXGI_ERROR_WAS_STILL_DRAWING) {
+		return;
+	}
+	if(FAILED(result)) {
+		throw std::runtime_error(std::string("Fluid3DEffect: failed to map buffer in ReadBrickOccupancy function"));
+	}
+
+	const UINT *dispatchArgs = (const UINT*)mappedResource.pData;
+	mBrickOccupancyStats.activeBricks = dispatchArgs[0];
+	mBrickOccupancyStats.processedBricks = dispatchArgs[3 * BRICK_HALO_PASSES];
+
+	context->Unmap(staging[mBrickListUpdates % 2], 0);
+
+	mBrickOccupancyStats.processedPercentage = 100.0f * mBrickOccupancyStats.processedBricks / mBrickOccupancyStats.totalBricks;
+}
+
+void Fluid3DCalculator::MeasureActivity() {
+	// the fluid only counts as quiet on stats read back since the last step
+	if (!ReadActivity()) {
+		return;
+	}
+
+	bool quiet = mFluidSettings.sleepWhenQuiet && mActivityStats.IsBelow(mFluidSettings.sleepThreshold);
+	mActivityStats.quietSteps = quiet ? mActivityStats.quietSteps + 1 : 0;
+	mActivityStats.sleeping = mActivityStats.quietSteps >= SLEEP_QUIET_STEPS;
+}
+
+bool Fluid3DCalculator::ReadActivity() {
+	ID3D11DeviceContext *context = pD3dGraphicsObj->GetDeviceContext();
+	std::array<CComPtr<ID3D11Buffer>, 2> &staging = mFluidResources.activityStaging;
+
+	bool isFire = mFluidSettings.GetFluidType() == FIRE;
+	mActivityReductionShader->Compute(context, &mFluidResources.velocitySP[READ], &mFluidResources.temperatureSP[READ], &mFluidResources.densitySP[READ],
+		isFire ? &mFluidResources.reactionSP[READ] : nullptr, &mFluidResources.activitySP);
+
+	// Copy this frame's reduction and read the previous frame's, the same way as ReadBrickOccupancy
+	context->CopyResource(staging[mActivityReductions % 2], mFluidResources.activityBuffer);
+	++mActivityReductions;
+	if (mActivityReductions < 2) {
+		return false;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	HRESULT result = context->Map(staging[mActivityReductions % 2], 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mappedResource);
+	if (result == DXGI_ERROR_WAS_STILL_DRAWING) {
+		return false;
+	}
+	if(FAILED(result)) {
+		throw std::runtime_error(std::string("Fluid3DEffect: failed to map buffer in ReadActivity function"));
+	}
+
+	D3D11_BUFFER_DESC bufferDesc;
+	mFluidResources.activityBuffer->GetDesc(&bufferDesc);
+	UINT numGroups = bufferDesc.ByteWidth / (4 * sizeof(float));
+
+	// every group holds its max density, max temperature, max squared speed and kinetic energy
+	const float *groups = (const float*)mappedResource.pData;
+	float maxSpeedSquared = 0.0f;
+	double kineticEnergy = 0.0;
+	mActivityStats.maxDensity = 0.0f;
+	mActivityStats.maxTemperature = 0.0f;
+	for (UINT i = 0; i < numGroups; ++i) {
+		const float *group = &groups[4 * i];
+		mActivityStats.maxDensity = Max(mActivityStats.maxDensity, group[0]);
+		mActivityStats.maxTemperature = Max(mActivityStats.maxTemperature, group[1]);
+		maxSpeedSquared = Max(maxSpeedSquared, group[2]);
+		kineticEnergy += group[3];
+	}
+
+	context->Unmap(staging[mActivityReductions % 2], 0);
 
-	mExtraVelocityAdded = false;
+	mActivityStats.maxSpeed = sqrt(maxSpeedSquared);
+	mActivityStats.kineticEnergy = (float)kineticEnergy;
+	return true;
+}
+
+void Fluid3DCalculator::Wake() {
+	mActivityStats.quietSteps = 0;
+	mActivityStats.sleeping = false;
 }
 
 void Fluid3DCalculator::Advect(std::array<ShaderParams, 2> &target, SystemAdvectionType_t advectionType, float dissipation, float decay) {
@@ -259,10 +739,12 @@ void Fluid3DCalculator::Advect(std::array<ShaderParams, 2> &target, SystemAdvect
 	switch (advectionType) {
 	case NORMAL:
 		UpdateAdvectionBuffer(dissipation, 1.0f, decay);
+		UseBrickList(*mAdvectionShader, BRICK_HALO_PASSES);
 		mAdvectionShader->Compute(context, &mFluidResources.velocitySP[READ], &target[READ], &target[WRITE]);
 		break;
 	case MACCORMARCK:
 		UpdateAdvectionBuffer(1.0f, 1.0f, 0.0f);
+		UseBrickList(*mAdvectionShader, BRICK_HALO_FORWARD);
 		mAdvectionShader->Compute(context, &mFluidResources.velocitySP[READ], &target[READ], &mCommonResources.tempSP[0]);
 		break;
 	}
@@ -270,55 +752,112 @@ void Fluid3DCalculator::Advect(std::array<ShaderParams, 2> &target, SystemAdvect
 	if (advectionType == MACCORMARCK) {
 		// advect backwards a step
 		UpdateAdvectionBuffer(1.0f, -1.0f, 0.0f);
+		UseBrickList(*mAdvectionShader, BRICK_HALO_BACKWARD);
 		mAdvectionShader->Compute(context, &mFluidResources.velocitySP[READ], &mCommonResources.tempSP[0], &mCommonResources.tempSP[1]);
 		ShaderParams advectArrayDens[3] = {mCommonResources.tempSP[0], mCommonResources.tempSP[1], target[READ]};
 		// proceed with MacCormack advection
 		UpdateAdvectionBuffer(dissipation, 1.0f, decay);
+		UseBrickList(*mMacCormarckAdvectionShader, BRICK_HALO_PASSES);
 		mMacCormarckAdvectionShader->Compute(context, &mFluidResources.velocitySP[READ], advectArrayDens, &target[WRITE]);
 	}
 	swap(target[READ], target[WRITE]);
 }
 
-void Fluid3DCalculator::RefreshConstantImpulse() {
-	auto context = pD3dGraphicsObj->GetDeviceContext();
-
-	Vector3 impulsePos = mFluidSettings.dimensions * mFluidSettings.constantInputPosition;
-	float size = mFluidSettings.dimensions.x + mFluidSettings.dimensions.y + mFluidSettings.dimensions.z;
-	float inputRadius = mFluidSettings.constantInputRadius * size;
+void Fluid3DCalculator::AdvectScalars() {
+	ID3D11DeviceContext *context = pD3dGraphicsObj->GetDeviceContext();
+	bool isFire = mFluidSettings.GetFluidType() == FIRE;
 
-	//refresh the impulse of the density and temperature
-	switch (mFluidSettings.GetFluidType()) {
-	case SMOKE:
-		ApplyImpulse(mFluidResources.densitySP, impulsePos, mFluidSettings.constantDensityAmount, inputRadius);
-		break;
-	case FIRE:
-		ApplyImpulse(mFluidResources.reactionSP, impulsePos, mFluidSettings.constantReactionAmount, inputRadius);
+	UpdateScalarAdvectionBuffer();
+	context->CSSetConstantBuffers(5, 1, &(mInputBufferScalarAdvection.p));
 
-		// Smoke forms as fire is extinguished
-		UpdateImpulseBuffer1D(impulsePos, mFluidSettings.constantDensityAmount, inputRadius, mFluidSettings.reactionExtinguishment);
-		mExtinguishmentImpulseShader->Compute(context, &mFluidResources.reactionSP[READ], &mFluidResources.densitySP[READ], &mFluidResources.densitySP[WRITE]);
-		swap(mFluidResources.densitySP[READ], mFluidResources.densitySP[WRITE]);
-		break;
+	// the reaction entries stay empty for smoke
+	ShaderParams scalarFields[3] = {mFluidResources.temperatureSP[READ], mFluidResources.densitySP[READ]};
+	ShaderParams scalarResults[3] = {mFluidResources.temperatureSP[WRITE], mFluidResources.densitySP[WRITE]};
+	if (isFire) {
+		scalarFields[2] = mFluidResources.reactionSP[READ];
+		scalarResults[2] = mFluidResources.reactionSP[WRITE];
 	}
-	
-	ApplyImpulse(mFluidResources.temperatureSP, impulsePos, mFluidSettings.constantTemperature, inputRadius);
-}
 
-void Fluid3DCalculator::ApplyExtraForces() {
-	if (mExtraVelocityAdded) {
-		Vector3 impulsePos = mFluidSettings.dimensions * mExtraVelocityForce.position;
-		auto context = pD3dGraphicsObj->GetDeviceContext();
-		UpdateImpulseBuffer3D(impulsePos, mExtraVelocityForce.amount, mExtraVelocityForce.radius);
-		mImpulseShader->Compute(context, &mFluidResources.velocitySP[READ], &mFluidResources.velocitySP[WRITE]);
-		swap(mFluidResources.velocitySP[READ], mFluidResources.velocitySP[WRITE]);
+	switch (GetAdvectionType()) {
+	case NORMAL:
+		UseBrickList(*mScalarAdvectionShader, BRICK_HALO_PASSES);
+		mScalarAdvectionShader->Compute(context, &mFluidResources.velocitySP[READ], scalarFields, nullptr, scalarResults);
+		break;
+	case MACCORMARCK:
+		// the forward and backward steps keep the three fields packed in the temporary volumes
+		UseBrickList(*mScalarAdvectionForwardShader, BRICK_HALO_FORWARD);
+		mScalarAdvectionForwardShader->Compute(context, &mFluidResources.velocitySP[READ], scalarFields, &mCommonResources.tempSP[0], nullptr);
+		UpdateAdvectionBuffer(1.0f, -1.0f, 0.0f);
+		UseBrickList(*mAdvectionShader, BRICK_HALO_BACKWARD);
+		mAdvectionShader->Compute(context, &mFluidResources.velocitySP[READ], &mCommonResources.tempSP[0], &mCommonResources.tempSP[1]);
+		UseBrickList(*mScalarMacCormarckAdvectionShader, BRICK_HALO_PASSES);
+		mScalarMacCormarckAdvectionShader->Compute(context, &mFluidResources.velocitySP[READ], scalarFields, &mCommonResources.tempSP[0], scalarResults);
+		break;
+	}
+
+	swap(mFluidResources.temperatureSP[READ], mFluidResources.temperatureSP[WRITE]);
+	swap(mFluidResources.densitySP[READ], mFluidResources.densitySP[WRITE]);
+	if (isFire) {
+		swap(mFluidResources.reactionSP[READ], mFluidResources.reactionSP[WRITE]);
 	}
 }
 
-void Fluid3DCalculator::ApplyImpulse(std::array<ShaderParams, 2> &target, Vector3 &position, float amount, float radius) {
+void Fluid3DCalculator::ApplyImpulses() {
 	auto context = pD3dGraphicsObj->GetDeviceContext();
-	UpdateImpulseBuffer1D(position, amount, radius);
-	mImpulseShader->Compute(context, &target[READ], &target[WRITE]);
-	swap(target[READ], target[WRITE]);
+	bool isFire = mFluidSettings.GetFluidType() == FIRE;
+
+	if (!mImpulseSources.empty()) {
+		Vector3 regionSize((float)(mInjectionRegionMax[0] - mInjectionRegionMin[0] + 1), (float)(mInjectionRegionMax[1] - mInjectionRegionMin[1] + 1),
+			(float)(mInjectionRegionMax[2] - mInjectionRegionMin[2] + 1));
+		mImpulseSourcesShader->Compute(context, regionSize, &mFluidResources.velocitySP[READ], &mFluidResources.temperatureSP[READ], &mFluidResources.densitySP[READ],
+			isFire ? &mFluidResources.reactionSP[READ] : nullptr, &mFluidResources.velocitySP[WRITE], &mFluidResources.temperatureSP[WRITE],
+			&mFluidResources.densitySP[WRITE], isFire ? &mFluidResources.reactionSP[WRITE] : nullptr);
+
+		// the rest of the WRITE buffers is out of date, so the region of every field a source added to is copied back
+		// instead of swapping. The fields are in ImpulseTarget_t order
+		std::array<ShaderParams, 2> *fields[4] = {&mFluidResources.velocitySP, &mFluidResources.temperatureSP, &mFluidResources.densitySP, &mFluidResources.reactionSP};
+		bool targeted[4] = {false, false, false, false};
+		for (const ImpulseSourceData &source : mImpulseSources) {
+			targeted[source.uTarget] = true;
+		}
+		for (int field = 0; field < 4; ++field) {
+			if (targeted[field]) {
+				CopyRegion(&(*fields[field])[WRITE], &(*fields[field])[READ], mInjectionRegionMin, mInjectionRegionMax);
+			}
+		}
+	}
+
+	if (isFire) {
+		// Smoke forms as fire is extinguished
+		UseBrickList(*mExtinguishmentImpulseShader, BRICK_HALO_PASSES);
+		mExtinguishmentImpulseShader->Compute(context, &mFluidResources.reactionSP[READ], &mFluidResources.densitySP[READ], &mFluidResources.densitySP[WRITE]);
+		swap(mFluidResources.densitySP[READ], mFluidResources.densitySP[WRITE]);
+	}
+}
+
+void Fluid3DCalculator::ApplyBuoyancyAndImpulses() {
+	auto context = pD3dGraphicsObj->GetDeviceContext();
+
+	UseBrickList(*mBuoyancyImpulseShader, BRICK_HALO_PASSES);
+
+	if (mFluidSettings.GetFluidType() == FIRE) {
+		mBuoyancyImpulseShader->Compute(context, &mFluidResources.velocitySP[READ], &mFluidResources.temperatureSP[READ], &mFluidResources.densitySP[READ], &mFluidResources.reactionSP[READ],
+			&mFluidResources.velocitySP[WRITE], &mFluidResources.temperatureSP[WRITE], &mFluidResources.densitySP[WRITE], &mFluidResources.reactionSP[WRITE]);
+		swap(mFluidResources.reactionSP[READ], mFluidResources.reactionSP[WRITE]);
+	}
+	else {
+		mBuoyancyImpulseShader->Compute(context, &mFluidResources.velocitySP[READ], &mFluidResources.temperatureSP[READ], &mFluidResources.densitySP[READ], nullptr,
+			&mFluidResources.velocitySP[WRITE], &mFluidResources.temperatureSP[WRITE], &mFluidResources.densitySP[WRITE], nullptr);
+	}
+	swap(mFluidResources.velocitySP[READ], mFluidResources.velocitySP[WRITE]);
+	swap(mFluidResources.temperatureSP[READ], mFluidResources.temperatureSP[WRITE]);
+	swap(mFluidResources.densitySP[READ], mFluidResources.densitySP[WRITE]);
+}
+
+void Fluid3DCalculator::GetConstantInput(Vector3 &position, float &radius) const {
+	position = mDimensions * mFluidSettings.constantInputPosition;
+	float size = mDimensions.x + mDimensions.y + mDimensions.z;
+	radius = mFluidSettings.constantInputRadius * size;
 }
 
 void Fluid3DCalculator::ComputeVorticityConfinement() {
@@ -329,22 +868,456 @@ void Fluid3DCalculator::ComputeVorticityConfinement() {
 	swap(mFluidResources.velocitySP[READ], mFluidResources.velocitySP[WRITE]);
 }
 
-void Fluid3DCalculator::CalculatePressureGradient() {
+void Fluid3DCalculator::ComputeVorticityConfinementAndDivergence() {
+	ID3D11DeviceContext* context = pD3dGraphicsObj->GetDeviceContext();
+
+	mVorticityShader->Compute(context, &mFluidResources.velocitySP[READ], &mFluidResources.vorticitySP);
+	mConfinementDivergenceShader->Compute(context, &mFluidResources.velocitySP[READ], &mFluidResources.vorticitySP, &mFluidResources.velocitySP[WRITE], &mCommonResources.divergenceSP);
+	swap(mFluidResources.velocitySP[READ], mFluidResources.velocitySP[WRITE]);
+}
+
+bool Fluid3DCalculator::CalculatePressureGradient(int reservedIterations) {
+	ID3D11DeviceContext* context = pD3dGraphicsObj->GetDeviceContext();
+
+	// clear pressure texture to prepare for the solver, unless last step's pressure is used as the initial guess
+	if (!mFluidSettings.warmStartPressure) {
+		float clearCol[4] = {0.0f,0.0f,0.0f,0.0f};
+		context->ClearUnorderedAccessViewFloat(mFluidResources.pressureSP.mUAV, clearCol);
+	}
+
+	int maxIterations = GetMaxPressureIterations() - reservedIterations;
+	// Reading the residual back waits on the GPU, so the solve only stops to measure it every few iterations and never after
+	// the last one, where the measurement could not stop anything. Fluid3DCPUCalculator checks on the same iterations
+	int checkInterval = mFluidSettings.residualCheckInterval;
+	bool measureResidual = mFluidSettings.pressureTolerance > 0.0f;
+	bool checkResidual = measureResidual && checkInterval > 0 && maxIterations > checkInterval;
+	bool converged = false;
+	bool residualReduced = false;	// the residual sums hold the residual of the current pressure
+
+	if (mFluidSettings.pressureSolverType == PRECONDITIONED_CG) {
+		BeginConjugateGradient();
+	}
+
+	// Jacobi cannot update in place, so it goes back and forth between the pressure and the fine residual texture
+	ShaderParams *pressure = &mFluidResources.pressureSP;
+	ShaderParams *pressureScratch = &mCommonResources.residualSP;
+
+	int i = 0;
+	while (i < maxIterations) {
+		// a batch runs up to the next residual measurement
+		mStageTimer.Begin(context, STAGE_PRESSURE_BATCH);
+		switch (mFluidSettings.pressureSolverType) {
+		case JACOBI:
+			mJacobiShader->Compute(context,
+				pressure,
+				&mCommonResources.divergenceSP,
+				pressureScratch);
+			swap(pressure, pressureScratch);
+			break;
+		case MULTIGRID:
+			MultigridVCycle(&mFluidResources.pressureSP, &mCommonResources.divergenceSP);
+			break;
+		case RED_BLACK_SOR:
+			SmoothPressure(&mFluidResources.pressureSP, &mCommonResources.divergenceSP, &mFluidResources.obstacleSP, mDimensions, 1, mFluidSettings.sorOverRelaxation);
+			break;
+		case PRECONDITIONED_CG:
+			ConjugateGradientIteration();
+			break;
+		}
+		++i;
+		residualReduced = false;
+
+		if (checkResidual && i % checkInterval == 0 && i < maxIterations) {
+			mStageTimer.End(context, STAGE_PRESSURE_BATCH);
+			mStageTimer.Begin(context, STAGE_PRESSURE_RESIDUAL);
+			// the measurement writes the fine residual texture, so a Jacobi iterate held there has to move back first
+			if (pressure != &mFluidResources.pressureSP) {
+				CopyVolume(pressure, &mFluidResources.pressureSP);
+				swap(pressure, pressureScratch);
+			}
+			float residual = MeasurePressureResidual();
+			residualReduced = true;
+			mStageTimer.End(context, STAGE_PRESSURE_RESIDUAL);
+			if (residual < mFluidSettings.pressureTolerance) {
+				converged = true;
+				break;
+			}
+		}
+	}
+	mStageTimer.End(context, STAGE_PRESSURE_BATCH);
+
+	if (pressure != &mFluidResources.pressureSP) {
+		CopyVolume(pressure, &mFluidResources.pressureSP);
+	}
+	mPressureSolverStats.iterationsUsed = i;
+
+	if (measureResidual) {
+		ReadPressureResidual(!residualReduced);
+	}
+	else {
+		mPressureSolverStats.residual = -1.0f;
+		mResidualReadbacks = 0;
+	}
+	return converged;
+}
+
+void Fluid3DCalculator::ReducePressureResidual() {
+	ID3D11DeviceContext* context = pD3dGraphicsObj->GetDeviceContext();
+
+	mMultigridResidualShader->Compute(context, mDimensions, &mFluidResources.pressureSP, &mCommonResources.divergenceSP, &mFluidResources.obstacleSP, &mCommonResources.residualSP);
+	mResidualReductionShader->Compute(context, &mCommonResources.residualSP, &mCommonResources.residualSumsSP);
+}
+
+float Fluid3DCalculator::SumPressureResidual(const D3D11_MAPPED_SUBRESOURCE &mappedResource, ID3D11Buffer *stagingBuffer) const {
+	D3D11_BUFFER_DESC bufferDesc;
+	stagingBuffer->GetDesc(&bufferDesc);
+	UINT numSums = bufferDesc.ByteWidth / sizeof(float);
+
+	const float *sums = (const float*)mappedResource.pData;
+	double totalSum = 0.0;
+	for (UINT i = 0; i < numSums; ++i) {
+		totalSum += sums[i];
+	}
+
+	float numCells = mDimensions.x * mDimensions.y * mDimensions.z;
+	return (float)sqrt(totalSum / numCells);
+}
+
+float Fluid3DCalculator::MeasurePressureResidual() {
+	ID3D11DeviceContext* context = pD3dGraphicsObj->GetDeviceContext();
+
+	ReducePressureResidual();
+	context->CopyResource(mCommonResources.residualSumsStagingBuffer, mCommonResources.residualSumsBuffer);
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	HRESULT result = context->Map(mCommonResources.residualSumsStagingBuffer, 0, D3D11_MAP_READ, 0, &mappedResource);
+	if(FAILED(result)) {
+		throw std::runtime_error(std::string("Fluid3DEffect: failed to map buffer in MeasurePressureResidual function"));
+	}
+
+	float residual = SumPressureResidual(mappedResource, mCommonResources.residualSumsStagingBuffer);
+
+	context->Unmap(mCommonResources.residualSumsStagingBuffer, 0);
+	return residual;
+}
+
+void Fluid3DCalculator::ReadPressureResidual(bool reduce) {
+	ID3D11DeviceContext *context = pD3dGraphicsObj->GetDeviceContext();
+	std::array<CComPtr<ID3D11Buffer>, 2> &staging = mFluidResources.residualSumsStaging;
+
+	if (reduce) {
+		ReducePressureResidual();
+	}
+
+	// Copy this solve's sums and read the previous solve's, the same way as ReadBrickOccupancy
+	context->CopyResource(staging[mResidualReadbacks % 2], mCommonResources.residualSumsBuffer);
+	++mResidualReadbacks;
+	if (mResidualReadbacks < 2) {
+		return;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	HRESULT result = context->Map(staging[mResidualReadbacks % 2], 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mappedResource);
+	if (result == DXGI_ERROR_WAS_STILL_DRAWING) {
+		return;
+	}
+	if(FAILED(result)) {
+		throw std::runtime_error(std::string("Fluid3DEffect: failed to map buffer in ReadPressureResidual function"));
+	}
+
+	mPressureSolverStats.residual = SumPressureResidual(mappedResource, staging[mResidualReadbacks % 2]);
+
+	context->Unmap(staging[mResidualReadbacks % 2], 0);
+}
+
+void Fluid3DCalculator::MultigridVCycle(ShaderParams *target, ShaderParams *rightHandSide) {
+	ID3D11DeviceContext* context = pD3dGraphicsObj->GetDeviceContext();
+	std::vector<MultigridLevelResources> &levels = mCommonResources.multigridLevels;
+	std::vector<ShaderParams> &obstacleLevels = mFluidResources.obstacleLevelsSP;
+	int numLevels = (int)levels.size();
+
+	// Post-smoothing sweeps the colours in the opposite order to pre-smoothing and the coarse solves do half of
+	// their sweeps each way, which keeps the cycle symmetric so it can precondition the conjugate gradient solver
+
+	// grid too small to coarsen - relax on the fine grid only
+	if (numLevels == 0) {
+		SmoothPressure(target, rightHandSide, &mFluidResources.obstacleSP, mDimensions, MULTIGRID_COARSE_ITERATIONS / 2);
+		SmoothPressure(target, rightHandSide, &mFluidResources.obstacleSP, mDimensions, MULTIGRID_COARSE_ITERATIONS / 2, 1.0f, true);
+		return;
+	}
+
+	// smooth the fine grid and pass its residual down as the right hand side of the first coarse level
+	SmoothPressure(target, rightHandSide, &mFluidResources.obstacleSP, mDimensions, MULTIGRID_PRE_SMOOTHING_STEPS);
+	mMultigridResidualShader->Compute(context, mDimensions, target, rightHandSide, &mFluidResources.obstacleSP, &mCommonResources.residualSP);
+	mMultigridRestrictShader->Compute(context, levels[0].dimensions, &mCommonResources.residualSP, &obstacleLevels[0], &levels[0].rightHandSideSP);
+
+	// go down the hierarchy, every level solves for a correction starting from zero
+	float clearCol[4] = {0.0f,0.0f,0.0f,0.0f};
+	for (int level = 0; level < numLevels; ++level) {
+		MultigridLevelResources &current = levels[level];
+		context->ClearUnorderedAccessViewFloat(current.correctionSP.mUAV, clearCol);
+
+		if (level == numLevels - 1) {
+			SmoothPressure(&current.correctionSP, &current.rightHandSideSP, &obstacleLevels[level], current.dimensions, MULTIGRID_COARSE_ITERATIONS / 2);
+			SmoothPressure(&current.correctionSP, &current.rightHandSideSP, &obstacleLevels[level], current.dimensions, MULTIGRID_COARSE_ITERATIONS / 2, 1.0f, true);
+			break;
+		}
+
+		SmoothPressure(&current.correctionSP, &current.rightHandSideSP, &obstacleLevels[level], current.dimensions, MULTIGRID_PRE_SMOOTHING_STEPS);
+		mMultigridResidualShader->Compute(context, current.dimensions, &current.correctionSP, &current.rightHandSideSP, &obstacleLevels[level], &current.residualSP);
+		mMultigridRestrictShader->Compute(context, levels[level+1].dimensions, &current.residualSP, &obstacleLevels[level+1], &levels[level+1].rightHandSideSP);
+	}
+
+	// come back up, interpolating each coarse correction onto the level above it
+	for (int level = numLevels - 2; level >= 0; --level) {
+		MultigridLevelResources &current = levels[level];
+		mMultigridProlongShader->Compute(context, current.dimensions, &levels[level+1].correctionSP, &obstacleLevels[level], &current.correctionSP);
+
+		SmoothPressure(&current.correctionSP, &current.rightHandSideSP, &obstacleLevels[level], current.dimensions, MULTIGRID_POST_SMOOTHING_STEPS, 1.0f, true);
+	}
+
+	mMultigridProlongShader->Compute(context, mDimensions, &levels[0].correctionSP, &mFluidResources.obstacleSP, target);
+
+	SmoothPressure(target, rightHandSide, &mFluidResources.obstacleSP, mDimensions, MULTIGRID_POST_SMOOTHING_STEPS, 1.0f, true);
+}
+
+void Fluid3DCalculator::SmoothPressure(ShaderParams *target, ShaderParams *rightHandSide, ShaderParams *obstacles, const Vector3 &dimensions, int iterations, float overRelaxation, bool reverseOrder) {
+	ID3D11DeviceContext* context = pD3dGraphicsObj->GetDeviceContext();
+
+	UpdateRedBlackBuffers(overRelaxation);
+
+	// every iteration is a full sweep - the red cells followed by the black cells, or the other way around
+	int firstParity = reverseOrder ? 1 : 0;
+	for (int i = 0; i < iterations; ++i) {
+		for (int pass = 0; pass < 2; ++pass) {
+			int parity = pass == 0 ? firstParity : 1 - firstParity;
+			context->CSSetConstantBuffers(3, 1, &(mInputBufferRedBlack[parity].p));
+			mRedBlackSORShader->Compute(context, dimensions, rightHandSide, obstacles, target);
+		}
+	}
+}
+
+void Fluid3DCalculator::BeginConjugateGradient() {
+	ID3D11DeviceContext* context = pD3dGraphicsObj->GetDeviceContext();
+
+	// the residual of the current pressure starts the search
+	mMultigridResidualShader->Compute(context, mDimensions, &mFluidResources.pressureSP, &mCommonResources.divergenceSP, &mFluidResources.obstacleSP, &mCommonResources.pcgResidualSP);
+
+	// An enclosed fluid only defines its pressure up to a constant, so a solution exists only if the divergence sums
+	// to zero. The central differenced divergence does not quite, and conjugate gradient would amplify that part
+	// instead of ignoring it like the relaxation solvers do. Computing the mean also clears the previous solve's scalars
+	mPCGResidualSumShader->Compute(context, &mCommonResources.pcgResidualSP, nullptr, &mCommonResources.pcgSumsSP);
+	mPCGMeanShader->Compute(context, &mCommonResources.pcgSumsSP, &mCommonResources.pcgScalarsSP);
+	mPCGRemoveMeanShader->Compute(context, &mCommonResources.pcgScalarsSP, &mCommonResources.pcgResidualSP);
+
+	// with a zero direction the first update takes the preconditioned residual as it is
+	float clearCol[4] = {0.0f,0.0f,0.0f,0.0f};
+	context->ClearUnorderedAccessViewFloat(mCommonResources.pcgDirectionSP.mUAV, clearCol);
+
+	PreconditionConjugateGradient();
+}
+
+void Fluid3DCalculator::ConjugateGradientIteration() {
+	ID3D11DeviceContext* context = pD3dGraphicsObj->GetDeviceContext();
+
+	// the laplacian of the direction goes into the fine residual texture, which is free until the next V-cycle
+	mPCGLaplacianShader->Compute(context, &mCommonResources.pcgDirectionSP, &mFluidResources.obstacleSP, &mCommonResources.residualSP);
+	mPCGDotProductShader->Compute(context, &mCommonResources.pcgDirectionSP, &mCommonResources.residualSP, &mCommonResources.pcgSumsSP);
+	mPCGAlphaShader->Compute(context, &mCommonResources.pcgSumsSP, &mCommonResources.pcgScalarsSP);
+	mPCGUpdateSolutionShader->Compute(context, &mCommonResources.pcgDirectionSP, &mCommonResources.residualSP, &mCommonResources.pcgScalarsSP,
+		&mFluidResources.pressureSP, &mCommonResources.pcgResidualSP);
+
+	PreconditionConjugateGradient();
+}
+
+void Fluid3DCalculator::PreconditionConjugateGradient() {
+	ID3D11DeviceContext* context = pD3dGraphicsObj->GetDeviceContext();
+
+	// one V-cycle from zero approximates the inverse of the pressure operator
+	float clearCol[4] = {0.0f,0.0f,0.0f,0.0f};
+	context->ClearUnorderedAccessViewFloat(mCommonResources.pcgPreconditionedSP.mUAV, clearCol);
+	MultigridVCycle(&mCommonResources.pcgPreconditionedSP, &mCommonResources.pcgResidualSP);
+
+	mPCGDotProductShader->Compute(context, &mCommonResources.pcgResidualSP, &mCommonResources.pcgPreconditionedSP, &mCommonResources.pcgSumsSP);
+	mPCGBetaShader->Compute(context, &mCommonResources.pcgSumsSP, &mCommonResources.pcgScalarsSP);
+	mPCGUpdateDirectionShader->Compute(context, &mCommonResources.pcgPreconditionedSP, &mCommonResources.pcgScalarsSP, &mCommonResources.pcgDirectionSP);
+}
+
+void Fluid3DCalculator::CopyVolume(ShaderParams *source, ShaderParams *destination) {
+	CComPtr<ID3D11Resource> sourceResource;
+	CComPtr<ID3D11Resource> destinationResource;
+	source->mUAV->GetResource(&sourceResource);
+	destination->mUAV->GetResource(&destinationResource);
+
+	pD3dGraphicsObj->GetDeviceContext()->CopyResource(destinationResource, sourceResource);
+}
+
+void Fluid3DCalculator::CopyRegion(ShaderParams *source, ShaderParams *destination, const int regionMin[3], const int regionMax[3]) {
+	CComPtr<ID3D11Resource> sourceResource;
+	CComPtr<ID3D11Resource> destinationResource;
+	source->mUAV->GetResource(&sourceResource);
+	destination->mUAV->GetResource(&destinationResource);
+
+	D3D11_BOX region;
+	region.left = regionMin[0];
+	region.top = regionMin[1];
+	region.front = regionMin[2];
+	region.right = regionMax[0] + 1;
+	region.bottom = regionMax[1] + 1;
+	region.back = regionMax[2] + 1;
+
+	pD3dGraphicsObj->GetDeviceContext()->CopySubresourceRegion(destinationResource, 0, regionMin[0], regionMin[1], regionMin[2], sourceResource, 0, &region);
+}
+
+void Fluid3DCalculator::SetObstacles(const vector<ObstacleBox> &boxes) {
+	if (!HaveSameObstacleBoxes(boxes, mObstacleBoxes)) {
+		Wake();
+	}
+	mObstacleBoxes = boxes;
+}
+
+void Fluid3DCalculator::UpdateObstacles() {
+	int regionMin[3];
+	int regionMax[3];
+	if (!mObstacleTracker.Update(mDimensions, mObstacleBoxes, regionMin, regionMax, mObstacleBoxData)) {
+		return;
+	}
+
+	ID3D11DeviceContext *context = pD3dGraphicsObj->GetDeviceContext();
+	UpdateObstaclesBuffer(regionMin, regionMax);
+	context->CSSetConstantBuffers(0, 1, &(mInputBufferGeneral.p));
+	context->CSSetConstantBuffers(7, 1, &(mInputBufferObstacles.p));
+
+	// the textures are about to be written, so last step's bindings must come off
+	ID3D11ShaderResourceView *const pSRVNULL[1] = {nullptr};
+	context->CSSetShaderResources(4, 1, pSRVNULL);
+	context->CSSetShaderResources(11, 1, pSRVNULL);
+
+	Vector3 regionSize((float)(regionMax[0] - regionMin[0] + 1), (float)(regionMax[1] - regionMin[1] + 1), (float)(regionMax[2] - regionMin[2] + 1));
+	mObstacleShader->Compute(context, regionSize, &mFluidResources.obstacleBoxesSP, &mFluidResources.obstacleSP, &mFluidResources.obstacleVelocitySP);
+
+	// coarsen the obstacle field for the multigrid levels
+	RestrictObstacles();
+}
+
+void Fluid3DCalculator::RestrictObstacles() {
 	ID3D11DeviceContext* context = pD3dGraphicsObj->GetDeviceContext();
+	std::vector<MultigridLevelResources> &levels = mCommonResources.multigridLevels;
+
+	ShaderParams *fineObstacles = &mFluidResources.obstacleSP;
+	for (size_t level = 0; level < levels.size(); ++level) {
+		mMultigridRestrictObstaclesShader->Compute(context, levels[level].dimensions, fineObstacles, &mFluidResources.obstacleLevelsSP[level]);
+		fineObstacles = &mFluidResources.obstacleLevelsSP[level];
+	}
+}
 
-	// clear pressure texture to prepare for Jacobi
+bool Fluid3DCalculator::SetResolutionTier(int tier) {
+	if (tier == mResolutionTier) {
+		return true;
+	}
+	if (pD3dGraphicsObj == nullptr || !IsResolutionTierAvailable(tier)) {
+		return false;
+	}
+
+	// a tier's resources are only created the first time it is used
+	FluidResourcesPerObject &tierResources = mTierResources[tier];
+	if (tierResources.velocitySP[READ].mSRV == nullptr) {
+		tierResources = CreateResourcesPerObject(GetTierDimensions(tier));
+	}
+	tierResources.ResizeHistory(pD3dGraphicsObj->GetDevice(), GetTierDimensions(tier), mHistoryLength, mFluidSettings.GetFluidType() == FIRE, mHwnd);
+
+	ResampleFields(tier, tierResources);
+	float previousCellSize = GetCellSize();
+	mTierResources[mResolutionTier] = mFluidResources;
+	mFluidResources = tierResources;
+	mResolutionTier = tier;
+	mDimensions = GetTierDimensions(tier);
+	UseCommonResources(mDimensions);
+	SetShaderDimensions(mDimensions);
+
+	// nothing the tier's resources held from the last time it was used carries over, the pressure starts over and the
+	// obstacles, brick lists and activity read backs are rebuilt on the next step
 	float clearCol[4] = {0.0f,0.0f,0.0f,0.0f};
-	context->ClearUnorderedAccessViewFloat(mCommonResources.pressureSP[READ].mUAV, clearCol);
-	ShaderParams *pDivergence = &mCommonResources.divergenceSP;
-	// perform Jacobi on pressure field
-	int i;
-	for (i = 0; i < mFluidSettings.jacobiIterations; ++i) {		
-		mJacobiShader->Compute(context,
-			&mCommonResources.pressureSP[READ],
-			pDivergence,
-			&mCommonResources.pressureSP[WRITE]);
+	pD3dGraphicsObj->GetDeviceContext()->ClearUnorderedAccessViewFloat(mFluidResources.pressureSP.mUAV, clearCol);
+	mObstacleTracker.Invalidate();
+	mBrickListsHoldAllBricks = false;
+	mBrickListUpdates = 0;
+	mActivityReductions = 0;
+	mResidualReadbacks = 0;
+	mHistoryFrames = 0;
+	// the speed is in cells, which the adaptive time step relies on until the next measurement
+	mActivityStats.maxSpeed *= previousCellSize / GetCellSize();
+
+	UpdateGeneralBuffer();
+	return true;
+}
 
-		swap(mCommonResources.pressureSP[READ], mCommonResources.pressureSP[WRITE]);
+bool Fluid3DCalculator::IsResolutionTierAvailable(int tier) const {
+	if (tier < 0 || tier >= NUM_RESOLUTION_TIERS) {
+		return false;
+	}
+
+	int cellSize = 1 << tier;
+	int cells[3] = {(int)mFluidSettings.dimensions.x, (int)mFluidSettings.dimensions.y, (int)mFluidSettings.dimensions.z};
+	for (int axis = 0; axis < 3; ++axis) {
+		if (cells[axis] % cellSize != 0 || cells[axis] / cellSize < MIN_TIER_DIMENSION) {
+			return false;
+		}
+	}
+	return true;
+}
+
+Vector3 Fluid3DCalculator::GetTierDimensions(int tier) const {
+	return mFluidSettings.dimensions / (float)(1 << tier);
+}
+
+float Fluid3DCalculator::GetCellSize() const {
+	return (float)(1 << mResolutionTier);
+}
+
+void Fluid3DCalculator::ResampleFields(int targetTier, FluidResourcesPerObject &target) {
+	ID3D11DeviceContext *context = pD3dGraphicsObj->GetDeviceContext();
+	Vector3 targetDimensions = GetTierDimensions(targetTier);
+	bool coarser = targetTier > mResolutionTier;
+	unsigned int ratio = 1 << (coarser ? targetTier - mResolutionTier : mResolutionTier - targetTier);
+	// the velocity is in cells, so it shrinks along with the dimensions
+	float velocityScale = coarser ? 1.0f / ratio : (float)ratio;
+
+	ResampleShader &vectorShader = coarser ? *mRestrictVectorShader : *mProlongVectorShader;
+	ResampleShader &scalarShader = coarser ? *mRestrictScalarShader : *mProlongScalarShader;
+	context->CSSetSamplers(0,1,&(sampleState.p));
+
+	UpdateResampleBuffer(ratio, velocityScale, -FLT_MAX);
+	context->CSSetConstantBuffers(8, 1, &(mInputBufferResample.p));
+	vectorShader.Compute(context, targetDimensions, &mFluidResources.velocitySP[READ], &target.velocitySP[READ]);
+
+	// prolonging a sharp edge can undershoot, which the scalars must not do below 0
+	UpdateResampleBuffer(ratio, 1.0f, 0.0f);
+	scalarShader.Compute(context, targetDimensions, &mFluidResources.temperatureSP[READ], &target.temperatureSP[READ]);
+	scalarShader.Compute(context, targetDimensions, &mFluidResources.densitySP[READ], &target.densitySP[READ]);
+	if (mFluidSettings.GetFluidType() == FIRE) {
+		scalarShader.Compute(context, targetDimensions, &mFluidResources.reactionSP[READ], &target.reactionSP[READ]);
+	}
+}
+
+void Fluid3DCalculator::SetShaderDimensions(const Vector3 &dimensions) {
+	BaseFluid3DShader *const shaders[] = {
+		mAdvectionShader.get(), mMacCormarckAdvectionShader.get(), mScalarAdvectionShader.get(), mScalarAdvectionForwardShader.get(),
+		mScalarMacCormarckAdvectionShader.get(), mImpulseSourcesShader.get(), mExtinguishmentImpulseShader.get(), mVorticityShader.get(),
+		mConfinementShader.get(), mJacobiShader.get(), mDivergenceShader.get(), mSubtractGradientShader.get(), mBuoyancyShader.get(),
+		mRedBlackSORShader.get(), mMultigridResidualShader.get(), mMultigridRestrictShader.get(), mMultigridProlongShader.get(),
+		mMultigridRestrictObstaclesShader.get(), mResidualReductionShader.get(), mActivityReductionShader.get(), mPCGLaplacianShader.get(),
+		mPCGDotProductShader.get(), mPCGResidualSumShader.get(), mPCGAlphaShader.get(), mPCGBetaShader.get(), mPCGMeanShader.get(),
+		mPCGRemoveMeanShader.get(), mPCGUpdateSolutionShader.get(), mPCGUpdateDirectionShader.get(), mBuoyancyImpulseShader.get(),
+		mConfinementDivergenceShader.get(), mJacobiSubtractGradientShader.get(), mBrickActivityShader.get(), mBrickListShader.get(),
+		mObstacleShader.get(), mRestrictVectorShader.get(), mRestrictScalarShader.get(), mProlongVectorShader.get(), mProlongScalarShader.get()
+	};
+
+	// the extinguishment shader is only there for fire
+	for (BaseFluid3DShader *shader : shaders) {
+		if (shader != nullptr) {
+			shader->SetDimensions(dimensions);
+		}
 	}
 }
 
@@ -362,8 +1335,9 @@ void Fluid3DCalculator::UpdateGeneralBuffer() {
 
 	dataPtr = (InputBufferGeneral*)mappedResource.pData;
 	dataPtr->fTimeStep = mFluidSettings.timeStep;
-	dataPtr->fDensityBuoyancy = mFluidSettings.densityBuoyancy;
-	dataPtr->fDensityWeight	= mFluidSettings.densityWeight;
+	// the velocity is in cells, so the buoyancy shrinks with the cells of the tier
+	dataPtr->fDensityBuoyancy = mFluidSettings.densityBuoyancy / GetCellSize();
+	dataPtr->fDensityWeight	= mFluidSettings.densityWeight / GetCellSize();
 	dataPtr->fVorticityStrength = mFluidSettings.vorticityStrength;
 
 	context->Unmap(mInputBufferGeneral,0);
@@ -389,29 +1363,255 @@ void Fluid3DCalculator::UpdateAdvectionBuffer(float dissipation, float timeModif
 	context->Unmap(mInputBufferAdvection,0);
 }
 
-void Fluid3DCalculator::UpdateImpulseBuffer1D(const Vector3& point, float amount, float radius, float extinguishment) {
-	UpdateImpulseBuffer3D(point, Vector3(amount, 0, 0), radius, extinguishment);
+void Fluid3DCalculator::UpdateRedBlackBuffers(float overRelaxation) {
+	// the buffers only hold constants, so they are rewritten only when the over-relaxation factor changes
+	if (overRelaxation == mRedBlackOverRelaxation) {
+		return;
+	}
+
+	ID3D11DeviceContext *context = pD3dGraphicsObj->GetDeviceContext();
+
+	for (int parity = 0; parity < 2; ++parity) {
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		HRESULT result = context->Map(mInputBufferRedBlack[parity], 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		if(FAILED(result)) {
+			throw std::runtime_error(std::string("Fluid3DEffect: failed to map buffer in UpdateRedBlackBuffers function"));
+		}
+
+		InputBufferRedBlack* dataPtr = (InputBufferRedBlack*)mappedResource.pData;
+		dataPtr->fOverRelaxation	= overRelaxation;
+		dataPtr->uParity			= parity;
+
+		context->Unmap(mInputBufferRedBlack[parity], 0);
+	}
+
+	mRedBlackOverRelaxation = overRelaxation;
 }
 
-void Fluid3DCalculator::UpdateImpulseBuffer3D(const Vector3& point, const Vector3& amount, float radius, float extinguishment) {
+void Fluid3DCalculator::UpdateInjectionBuffer() {
 	D3D11_MAPPED_SUBRESOURCE mappedResource;
-	InputBufferImpulse* dataPtr;
+	InputBufferInjection* dataPtr;
 
 	ID3D11DeviceContext *context = pD3dGraphicsObj->GetDeviceContext();
+	bool isFire = mFluidSettings.GetFluidType() == FIRE;
+
+	// the constant input comes first, followed by the impulses added to the step
+	mImpulseSources.clear();
+	Vector3 inputPosition;
+	float inputRadius;
+	GetConstantInput(inputPosition, inputRadius);
+	float inputAmount = isFire ? mFluidSettings.constantReactionAmount : mFluidSettings.constantDensityAmount;
+	AddImpulseSource(isFire ? IMPULSE_TARGET_REACTION : IMPULSE_TARGET_DENSITY, inputPosition, inputRadius, Vector3(inputAmount, 0.0f, 0.0f));
+	AddImpulseSource(IMPULSE_TARGET_TEMPERATURE, inputPosition, inputRadius, Vector3(mFluidSettings.constantTemperature, 0.0f, 0.0f));
+	// the radius and velocity of the impulses are in cells of the full resolution
+	float cellSize = GetCellSize();
+	for (const ImpulseSource &impulse : mImpulses) {
+		if (impulse.target != IMPULSE_TARGET_REACTION || isFire) {
+			Vector3 amount = impulse.target == IMPULSE_TARGET_VELOCITY ? impulse.amount / cellSize : impulse.amount;
+			AddImpulseSource(impulse.target, mDimensions * impulse.position, impulse.radius / cellSize, amount);
+		}
+	}
 
-	// Lock the screen size constant buffer so it can be written to.
-	HRESULT result = context->Map(mInputBufferImpulse, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	HRESULT result;
+	if (!mImpulseSources.empty()) {
+		result = context->Map(mFluidResources.impulseSourcesBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		if(FAILED(result)) {
+			throw std::runtime_error(std::string("Fluid3DEffect: failed to map buffer in UpdateInjectionBuffer function"));
+		}
+		memcpy(mappedResource.pData, &mImpulseSources[0], mImpulseSources.size() * sizeof(ImpulseSourceData));
+		context->Unmap(mFluidResources.impulseSourcesBuffer, 0);
+	}
+
+	result = context->Map(mInputBufferInjection, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	if(FAILED(result)) {
+		throw std::runtime_error(std::string("Fluid3DEffect: failed to map buffer in UpdateInjectionBuffer function"));
+	}
+
+	dataPtr = (InputBufferInjection*)mappedResource.pData;
+	dataPtr->uImpulseSourceCount	= (unsigned int)mImpulseSources.size();
+	dataPtr->fSmokeAmount			= mFluidSettings.constantDensityAmount;
+	dataPtr->fInputExtinguishment	= mFluidSettings.reactionExtinguishment;
+	for (int axis = 0; axis < 3; ++axis) {
+		dataPtr->vInjectionRegionMin[axis] = mImpulseSources.empty() ? 1 : mInjectionRegionMin[axis];
+		dataPtr->vInjectionRegionMax[axis] = mImpulseSources.empty() ? 0 : mInjectionRegionMax[axis];
+	}
+
+	context->Unmap(mInputBufferInjection,0);
+}
+
+void Fluid3DCalculator::AddImpulseSource(ImpulseTarget_t target, const Vector3 &point, float radius, const Vector3 &amount) {
+	int regionMin[3], regionMax[3];
+	if ((amount.x == 0.0f && amount.y == 0.0f && amount.z == 0.0f) || !GetImpulseRegion(point, radius, mDimensions, regionMin, regionMax)) {
+		return;
+	}
+
+	ImpulseSourceData source;
+	source.vPoint = point;
+	source.fRadius = radius;
+	source.vAmount = amount;
+	source.uTarget = target;
+	for (int axis = 0; axis < 3; ++axis) {
+		source.vRegionMin[axis] = regionMin[axis];
+		source.vRegionMax[axis] = regionMax[axis];
+		mInjectionRegionMin[axis] = mImpulseSources.empty() ? regionMin[axis] : Min(mInjectionRegionMin[axis], regionMin[axis]);
+		mInjectionRegionMax[axis] = mImpulseSources.empty() ? regionMax[axis] : Max(mInjectionRegionMax[axis], regionMax[axis]);
+	}
+	mImpulseSources.push_back(source);
+}
+
+void Fluid3DCalculator::UpdateScalarAdvectionBuffer() {
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	InputBufferScalarAdvection* dataPtr;
+
+	ID3D11DeviceContext *context = pD3dGraphicsObj->GetDeviceContext();
+
+	HRESULT result = context->Map(mInputBufferScalarAdvection, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	if(FAILED(result)) {
+		throw std::runtime_error(std::string("Fluid3DEffect: failed to map buffer in UpdateScalarAdvectionBuffer function"));
+	}
+
+	// temperature is always advected normally
+	float macCormack = GetAdvectionType() == MACCORMARCK ? 1.0f : 0.0f;
+
+	dataPtr = (InputBufferScalarAdvection*)mappedResource.pData;
+	dataPtr->vScalarDissipation	= Vector3(mFluidSettings.temperatureDissipation, mFluidSettings.densityDissipation, 1.0f);
+	dataPtr->fReactionDecay		= mFluidSettings.GetFluidType() == FIRE ? mFluidSettings.reactionDecay : 0.0f;
+	dataPtr->vScalarMacCormack	= Vector3(0.0f, macCormack, macCormack);
+
+	context->Unmap(mInputBufferScalarAdvection,0);
+}
+
+void Fluid3DCalculator::UpdateBricksBuffer(bool allBricksActive) {
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	InputBufferBricks* dataPtr;
+
+	ID3D11DeviceContext *context = pD3dGraphicsObj->GetDeviceContext();
+
+	HRESULT result = context->Map(mInputBufferBricks, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	if(FAILED(result)) {
+		throw std::runtime_error(std::string("Fluid3DEffect: failed to map buffer in UpdateBricksBuffer function"));
+	}
+
+	int brickCount[3] = {GetBrickCount((int)mDimensions.x), GetBrickCount((int)mDimensions.y), GetBrickCount((int)mDimensions.z)};
+
+	dataPtr = (InputBufferBricks*)mappedResource.pData;
+	dataPtr->vBrickCount[0]		= brickCount[0];
+	dataPtr->vBrickCount[1]		= brickCount[1];
+	dataPtr->vBrickCount[2]		= brickCount[2];
+	dataPtr->fBrickThreshold	= mFluidSettings.brickActivityThreshold;
+	dataPtr->uAllBricksActive	= allBricksActive ? 1 : 0;
+
+	context->Unmap(mInputBufferBricks,0);
+
+	mBrickOccupancyStats.totalBricks = brickCount[0] * brickCount[1] * brickCount[2];
+}
+
+void Fluid3DCalculator::UpdateObstaclesBuffer(const int regionMin[3], const int regionMax[3]) {
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	InputBufferObstacles* dataPtr;
+
+	ID3D11DeviceContext *context = pD3dGraphicsObj->GetDeviceContext();
+
+	HRESULT result;
+	if (!mObstacleBoxData.empty()) {
+		result = context->Map(mFluidResources.obstacleBoxesBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		if(FAILED(result)) {
+			throw std::runtime_error(std::string("Fluid3DEffect: failed to map buffer in UpdateObstaclesBuffer function"));
+		}
+		memcpy(mappedResource.pData, &mObstacleBoxData[0], mObstacleBoxData.size() * sizeof(ObstacleBoxData));
+		context->Unmap(mFluidResources.obstacleBoxesBuffer, 0);
+	}
+
+	result = context->Map(mInputBufferObstacles, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
 	if(FAILED(result)) {
-		throw std::runtime_error(std::string("Fluid3DEffect: failed to map buffer in UpdateImpulseBuffer function"));
+		throw std::runtime_error(std::string("Fluid3DEffect: failed to map buffer in UpdateObstaclesBuffer function"));
+	}
+
+	dataPtr = (InputBufferObstacles*)mappedResource.pData;
+	dataPtr->uObstacleBoxCount = (unsigned int)mObstacleBoxData.size();
+	for (int axis = 0; axis < 3; ++axis) {
+		dataPtr->vObstacleRegionMin[axis] = regionMin[axis];
+		dataPtr->vObstacleRegionMax[axis] = regionMax[axis];
+	}
+
+	context->Unmap(mInputBufferObstacles,0);
+}
+
+void Fluid3DCalculator::UpdateResampleBuffer(unsigned int ratio, float scale, float minimum) {
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	InputBufferResample* dataPtr;
+
+	ID3D11DeviceContext *context = pD3dGraphicsObj->GetDeviceContext();
+
+	HRESULT result = context->Map(mInputBufferResample, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	if(FAILED(result)) {
+		throw std::runtime_error(std::string("Fluid3DEffect: failed to map buffer in UpdateResampleBuffer function"));
+	}
+
+	dataPtr = (InputBufferResample*)mappedResource.pData;
+	dataPtr->uResampleRatio = ratio;
+	dataPtr->fResampleScale = scale;
+	dataPtr->fResampleMinimum = minimum;
+
+	context->Unmap(mInputBufferResample,0);
+}
+
+void Fluid3DCalculator::SetHistoryLength(int frames) {
+	frames = Clamp(frames, 0, MAX_HISTORY_FRAMES);
+	if (frames == mHistoryLength) {
+		return;
 	}
 
-	dataPtr = (InputBufferImpulse*)mappedResource.pData;
-	dataPtr->vPoint				= point;
-	dataPtr->fRadius			= radius;	
-	dataPtr->vAmount			= amount;
-	dataPtr->fExtinguishment	= extinguishment;
+	mHistoryLength = frames;
+	mHistoryHead = 0;
+	mHistoryFrames = 0;
+	// before Initialize the history is created along with the rest of the resources
+	if (pD3dGraphicsObj != nullptr) {
+		mFluidResources.ResizeHistory(pD3dGraphicsObj->GetDevice(), mDimensions, mHistoryLength, mFluidSettings.GetFluidType() == FIRE, mHwnd);
+	}
+}
+
+int Fluid3DCalculator::GetHistoryLength() const {
+	return mHistoryLength;
+}
+
+void Fluid3DCalculator::RecordHistory() {
+	if (mHistoryLength == 0) {
+		return;
+	}
+
+	mHistoryHead = (mHistoryHead + 1) % mHistoryLength;
+	mHistoryFrames = Min(mHistoryFrames + 1, mHistoryLength);
+	CopyVolume(&mFluidResources.densitySP[READ], &mFluidResources.densityHistorySP[mHistoryHead]);
+	if (mFluidSettings.GetFluidType() == FIRE) {
+		CopyVolume(&mFluidResources.reactionSP[READ], &mFluidResources.reactionHistorySP[mHistoryHead]);
+	}
+}
+
+int Fluid3DCalculator::GetHistorySlot(int framesBack) const {
+	framesBack = Min(framesBack, mHistoryFrames);
+	if (framesBack <= 0) {
+		return -1;
+	}
+	// the head holds the fields as they were before the latest frame, one frame back
+	return (mHistoryHead - (framesBack - 1) + mHistoryLength) % mHistoryLength;
+}
+
+void Fluid3DCalculator::SetSolverProfile(const SolverProfile &profile) {
+	mSolverProfile = profile;
+}
+
+const SolverProfile &Fluid3DCalculator::GetSolverProfile() const {
+	return mSolverProfile;
+}
+
+int Fluid3DCalculator::GetMaxPressureIterations() const {
+	int iterations = (int)ceil(mFluidSettings.GetMaxPressureIterations() * mSolverProfile.pressureEffort);
+	return Clamp(iterations, 1, mFluidSettings.GetMaxPressureIterations());
+}
 
-	context->Unmap(mInputBufferImpulse,0);
+SystemAdvectionType_t Fluid3DCalculator::GetAdvectionType() const {
+	return mSolverProfile.macCormackAdvection ? mFluidSettings.advectionType : NORMAL;
 }
 
 void Fluid3DCalculator::SetFluidSettings(const FluidSettings &fluidSettings) {
@@ -423,6 +1623,61 @@ void Fluid3DCalculator::SetFluidSettings(const FluidSettings &fluidSettings) {
 	if (dirtyFlags & BufferDirtyFlags::General) {
 		UpdateGeneralBuffer();
 	}
+	Wake();
+}
+
+bool Fluid3DCalculator::SaveState(const std::wstring &path) {
+	if (pD3dGraphicsObj == nullptr || mResolutionTier != 0) {
+		return false;
+	}
+
+	bool result = SaveFluidState(path, mFluidSettings, GetStateFields(), pD3dGraphicsObj->GetDevice(), pD3dGraphicsObj->GetDeviceContext());
+	if (!result) {
+		MessageBox(mHwnd, L"Could not save the fluid state", L"Error", MB_OK);
+	}
+	return result;
+}
+
+bool Fluid3DCalculator::LoadState(const std::wstring &path) {
+	if (pD3dGraphicsObj == nullptr || mResolutionTier != 0) {
+		return false;
+	}
+
+	MappedFluidState state;
+	if (!state.Open(path)) {
+		return false;
+	}
+
+	const FluidSettings &stateSettings = state.GetSettings();
+	if (stateSettings.GetFluidType() != mFluidSettings.GetFluidType() || stateSettings.dimensions != mFluidSettings.dimensions) {
+		return false;
+	}
+	if (!state.Upload(GetStateFields(), pD3dGraphicsObj->GetDeviceContext())) {
+		return false;
+	}
+	SetFluidSettings(stateSettings);
+
+	// nothing worked out from the old fields holds for the loaded ones
+	mTimeStepper.Reset();
+	mActivityStats = FluidActivityStats();
+	mActivityReductions = 0;
+	mResidualReadbacks = 0;
+	mBrickListsHoldAllBricks = false;
+	mBrickListUpdates = 0;
+	mHistoryFrames = 0;
+	return true;
+}
+
+std::vector<ShaderParams*> Fluid3DCalculator::GetStateFields() {
+	std::vector<ShaderParams*> fields;
+	fields.push_back(&mFluidResources.velocitySP[READ]);
+	fields.push_back(&mFluidResources.temperatureSP[READ]);
+	fields.push_back(&mFluidResources.densitySP[READ]);
+	fields.push_back(&mFluidResources.pressureSP);
+	if (mFluidSettings.GetFluidType() == FIRE) {
+		fields.push_back(&mFluidResources.reactionSP[READ]);
+	}
+	return fields;
 }
 
 int Fluid3DCalculator::GetUpdateDirtyFlags(const FluidSettings &newSettings) const {
@@ -438,6 +1693,26 @@ int Fluid3DCalculator::GetUpdateDirtyFlags(const FluidSettings &newSettings) con
 	return dirtyFlags;
 }
 
+const PressureSolverStats &Fluid3DCalculator::GetPressureSolverStats() const {
+	return mPressureSolverStats;
+}
+
+const BrickOccupancyStats &Fluid3DCalculator::GetBrickOccupancyStats() const {
+	return mBrickOccupancyStats;
+}
+
+const TimeStepPlan &Fluid3DCalculator::GetTimeStepPlan() const {
+	return mTimeStepPlan;
+}
+
+const FluidActivityStats &Fluid3DCalculator::GetFluidActivityStats() const {
+	return mActivityStats;
+}
+
+StageProfiler &Fluid3DCalculator::GetStageProfiler() {
+	return mStageProfiler;
+}
+
 FluidSettings * const Fluid3D::Fluid3DCalculator::GetFluidSettingsPointer() const {
 	return const_cast<FluidSettings*>(&mFluidSettings);
 }
@@ -446,10 +1721,20 @@ const FluidSettings &Fluid3DCalculator::GetFluidSettings() const {
 	return mFluidSettings;
 }
 
-ID3D11ShaderResourceView * Fluid3DCalculator::GetVolumeTexture() const {
-	return mFluidResources.densitySP[READ].mSRV;
+int Fluid3DCalculator::GetResolutionTier() const {
+	return mResolutionTier;
+}
+
+const Vector3 &Fluid3DCalculator::GetDimensions() const {
+	return mDimensions;
+}
+
+ID3D11ShaderResourceView * Fluid3DCalculator::GetVolumeTexture(int framesBack) const {
+	int slot = GetHistorySlot(framesBack);
+	return slot < 0 ? mFluidResources.densitySP[READ].mSRV : mFluidResources.densityHistorySP[slot].mSRV;
 }
 
-ID3D11ShaderResourceView * Fluid3DCalculator::GetReactionTexture() const {
-	return mFluidResources.reactionSP[READ].mSRV;
+ID3D11ShaderResourceView * Fluid3DCalculator::GetReactionTexture(int framesBack) const {
+	int slot = GetHistorySlot(framesBack);
+	return slot < 0 ? mFluidResources.reactionSP[READ].mSRV : mFluidResources.reactionHistorySP[slot].mSRV;
 }
\ No newline at end of file
@@ -10,18 +10,34 @@ Date: 18/2/2014
 #define _FLUID3DCALCULATOR_H
 
 #include <map>
+#include <vector>
 #include <array>
 #include <memory>
+#include <string>
 #include "../AtlInclude.h"
 
 #include "../../display/D3DGraphicsObject.h"
 #include "FluidSettings.h"
 #include "FluidResources.h"
+#include "Fluid3DBuffers.h"
+#include "Fluid3DObstacles.h"
+#include "Fluid3DTimeStep.h"
+#include "Fluid3DProfiler.h"
+#include "Fluid3DGPUTimer.h"
+
+// Resolution tiers a calculator can switch between, every tier halves the dimensions of the one before
+#define NUM_RESOLUTION_TIERS 3
+// Cells along each axis a tier needs at least to be used
+#define MIN_TIER_DIMENSION 16
+// Frames of the density and reaction a calculator can keep a history of
+#define MAX_HISTORY_FRAMES 8
 
 namespace Fluid3D {
 
+class BaseFluid3DShader;
 class AdvectionShader;
-class ImpulseShader;
+class ScalarAdvectionShader;
+class ImpulseSourcesShader;
 class ExtinguishmentImpulseShader;
 class JacobiShader;
 class DivergenceShader;
@@ -29,12 +45,26 @@ class SubtractGradientShader;
 class BuoyancyShader;
 class VorticityShader;
 class ConfinementShader;
-
-struct ExtraForce {
-	Vector3 position;
-	float radius;
-	Vector3 amount;
-};
+class MultigridResidualShader;
+class RedBlackSORShader;
+class MultigridRestrictShader;
+class MultigridProlongShader;
+class MultigridRestrictObstaclesShader;
+class ResidualReductionShader;
+class ActivityReductionShader;
+class PCGLaplacianShader;
+class PCGReductionShader;
+class PCGScalarsShader;
+class PCGRemoveMeanShader;
+class PCGUpdateSolutionShader;
+class PCGUpdateDirectionShader;
+class BuoyancyImpulseShader;
+class ConfinementDivergenceShader;
+class JacobiSubtractGradientShader;
+class BrickActivityShader;
+class BrickListShader;
+class ObstacleShader;
+class ResampleShader;
 
 class Fluid3DCalculator {
 public:
@@ -42,50 +72,207 @@ public:
 	~Fluid3DCalculator();
 
 	bool Initialize(_In_ D3DGraphicsObject * d3dGraphicsObj, HWND hwnd);
-	void Process();
+	// Runs a frame of the simulation and returns the steps it took. That is always a single step unless adaptiveTimeStep
+	// is on, which can split the frame into several steps or carry it over to the next one and take none. A sleeping
+	// fluid takes no steps and dispatches nothing
+	// Frames above 1 are frames the caller skipped. Their time is made up in steps as long as the CFL number allows, up
+	// to maxSubsteps of them
+	int Process(int frames = 1);
 
+	// Adds a velocity impulse to the next step. Any number of forces can be added to a step, up to MAX_IMPULSE_SOURCES
+	// forces and impulses in total
 	void AddForce(const ExtraForce& force);
+	// Adds to a field during the next step. All the impulses of a step are applied together with the constant input in
+	// a single pass. Returns false if the step already holds MAX_IMPULSE_SOURCES impulses. Wakes the fluid
+	bool AddImpulse(const ImpulseSource& impulse);
+	// Replaces the obstacle boxes, starting with the next step. Only the cells around the boxes that changed since the
+	// last step are voxelized again. Wakes the fluid if any box changed
+	void SetObstacles(const std::vector<ObstacleBox> &boxes);
+
+	// Switches to the grid of a resolution tier, whose dimensions are those of the settings halved tier times, and
+	// resamples the fields onto it. The resources of a tier are kept once it has been used, so switching back and forth
+	// allocates nothing. Impulses, buoyancy and the radius of the forces keep the size they have at full resolution.
+	// Returns false if the tier is not available
+	bool SetResolutionTier(int tier);
+	// A tier is available if the dimensions halve evenly into it and leave at least MIN_TIER_DIMENSION cells per axis
+	bool IsResolutionTierAvailable(int tier) const;
+	int GetResolutionTier() const;
+	// Dimensions of the grid of the current tier
+	const Vector3 &GetDimensions() const;
+
+	// Keeps copies of the density, and of the reaction when simulating fire, as they were before each of the last frames
+	// the fluid was stepped in, up to MAX_HISTORY_FRAMES. Lets renderers show the fluid a few frames back so several of
+	// them can share a calculator without looking the same. The history starts over when it is resized and on a switch
+	// of resolution tier
+	void SetHistoryLength(int frames);
+	int GetHistoryLength() const;
+
+	// Scales back the work of the next steps from what the settings ask for. Does not wake the fluid
+	void SetSolverProfile(const SolverProfile &profile);
+	const SolverProfile &GetSolverProfile() const;
 
 	// before computing all fluids, attach the resources they all share to the pipeline
 	static void AttachCommonResources(ID3D11DeviceContext* context);
 
-	ID3D11ShaderResourceView * GetVolumeTexture() const;
+	// The textures as of framesBack stepped frames ago, or as far back as the history goes
+	ID3D11ShaderResourceView * GetVolumeTexture(int framesBack = 0) const;
 	// If simulating fire - get the reaction values texture
-	ID3D11ShaderResourceView * GetReactionTexture() const;
+	ID3D11ShaderResourceView * GetReactionTexture(int framesBack = 0) const;
+
+	// Iterations and residual of the last pressure solve
+	const PressureSolverStats &GetPressureSolverStats() const;
+	// Bricks the last step ran advection, buoyancy and the impulses on. Read back without waiting on the GPU, so it
+	// lags a step behind
+	const BrickOccupancyStats &GetBrickOccupancyStats() const;
+	// Steps the last frame was run as
+	const TimeStepPlan &GetTimeStepPlan() const;
+	// Maxima and kinetic energy of the fluid and whether it is sleeping. Read back without waiting on the GPU, so they
+	// lag a frame behind
+	const FluidActivityStats &GetFluidActivityStats() const;
+	// Timings of the stages of the steps taken while profileStages is on, measured on the GPU a few steps late. They are
+	// only updated by a Collect on it, which can be done from another thread than Process
+	StageProfiler &GetStageProfiler();
 
 	const FluidSettings &GetFluidSettings() const;
 	FluidSettings * const GetFluidSettingsPointer() const;
+	// Wakes the fluid
 	void SetFluidSettings(const FluidSettings &fluidSettings);
 
+	// Saves the fields and settings of the fluid to a state file, see Fluid3DStateCache.h. Only the full resolution tier
+	// can be saved. Waits on the GPU
+	bool SaveState(const std::wstring &path);
+	// Replaces the fields and settings of the fluid with those of a state file saved from a fluid of the same type and
+	// dimensions, on the full resolution tier. Returns false and leaves the fluid as it is if the file is missing or does
+	// not match. Wakes the fluid
+	bool LoadState(const std::wstring &path);
+
 private:
 	bool InitShaders(HWND hwnd);
 	bool InitBuffersAndSamplers();
+	FluidResourcesPerObject CreateResourcesPerObject(const Vector3 &dimensions) const;
+	// Takes the common resources of grids of these dimensions, creating them if no calculator has yet
+	void UseCommonResources(const Vector3 &dimensions);
+	void SetShaderDimensions(const Vector3 &dimensions);
+
+	Vector3 GetTierDimensions(int tier) const;
+	// Cells of the settings' dimensions along each axis of a cell of the current tier
+	float GetCellSize() const;
+	// Resamples the velocity, temperature, density and reaction of the current tier onto the resources of another
+	void ResampleFields(int targetTier, FluidResourcesPerObject &target);
+
+	// Copies the density and reaction into the next slot of the history before the frame's steps overwrite them
+	void RecordHistory();
+	// Slot of the history holding the frame framesBack frames ago, -1 for the current fields
+	int GetHistorySlot(int framesBack) const;
+
+	// The fields a state file holds, in the order it holds them. The obstacles are voxelized again from the boxes
+	std::vector<ShaderParams*> GetStateFields();
+
+	// The settings as scaled back by the solver profile
+	int GetMaxPressureIterations() const;
+	SystemAdvectionType_t GetAdvectionType() const;
+
+	// A single step of the simulation, of the time step the general buffer holds
+	void Step();
+	// Reduces the fields to their activity and reads the activity of the frame before back, so the GPU is never waited
+	// on. Puts the fluid to sleep once it has stayed below the threshold long enough
+	void MeasureActivity();
+	// Returns false if the reduction has not reached the staging buffer yet
+	bool ReadActivity();
+	void Wake();
 
+	// Flags the bricks holding fluid and rebuilds the lists of bricks the sparse passes run on
+	void UpdateActiveBricks();
+	// Makes the next Compute of a sparse shader run on the bricks within haloBricks of an active one
+	void UseBrickList(BaseFluid3DShader &shader, int haloBricks);
+	void ReadBrickOccupancy();
 	void Advect(std::array<ShaderParams, 2> &target, SystemAdvectionType_t advectionType, float dissipation, float decay = 0.0f);
-	void RefreshConstantImpulse();
-	void ApplyExtraForces();
-	void ApplyImpulse(std::array<ShaderParams, 2> &target, Vector3 &position, float amount, float radius);
+	// Advects the temperature, density and reaction together, the same as advecting them one by one
+	void AdvectScalars();
+	// Adds the constant input and every impulse of the step in one pass over the region they reach, which updates the
+	// fields in place. Fire then forms smoke from the reaction
+	void ApplyImpulses();
 	void ApplyBuoyancy();
+	// fused version of the buoyancy and ApplyImpulses
+	void ApplyBuoyancyAndImpulses();
+	void GetConstantInput(Vector3 &position, float &radius) const;
 	void ComputeVorticityConfinement();
-	void CalculatePressureGradient();
+	// fused version of ComputeVorticityConfinement and the divergence
+	void ComputeVorticityConfinementAndDivergence();
+	// Leaves reservedIterations of the solver's iterations to the caller. Returns true if the solve stopped early
+	// because the residual fell below the tolerance
+	bool CalculatePressureGradient(int reservedIterations = 0);
+	void MultigridVCycle(ShaderParams *target, ShaderParams *rightHandSide);
+	void SmoothPressure(ShaderParams *target, ShaderParams *rightHandSide, ShaderParams *obstacles, const Vector3 &dimensions, int iterations, float overRelaxation = 1.0f, bool reverseOrder = false);
+	void BeginConjugateGradient();
+	void ConjugateGradientIteration();
+	void PreconditionConjugateGradient();
+	void CopyVolume(ShaderParams *source, ShaderParams *destination);
+	// Copies the cells from regionMin to regionMax, inclusive
+	void CopyRegion(ShaderParams *source, ShaderParams *destination, const int regionMin[3], const int regionMax[3]);
+	// Voxelizes the cells around the obstacle boxes that changed and restricts the new obstacles to the multigrid levels
+	void UpdateObstacles();
+	void RestrictObstacles();
+	// Reduces the residual of the pressure into the residual sums buffer
+	void ReducePressureResidual();
+	float SumPressureResidual(const D3D11_MAPPED_SUBRESOURCE &mappedResource, ID3D11Buffer *stagingBuffer) const;
+	// Waits on the GPU for the residual, only for the checks that can stop the solve early
+	float MeasurePressureResidual();
+	// Copies the residual sums of the finished solve out and reads the previous solve's into the stats without waiting.
+	// The sums are reduced first unless the last check left them holding the final pressure's residual
+	void ReadPressureResidual(bool reduce);
 
 	void UpdateAdvectionBuffer(float dissipation, float timeModifier, float decay);
 	void UpdateGeneralBuffer();
-	void UpdateImpulseBuffer1D(const Vector3& point, float amount, float radius, float extinguishment = 0.0f);
-	void UpdateImpulseBuffer3D(const Vector3& point, const Vector3& amount, float radius, float extinguishment = 0.0f);
+	void UpdateRedBlackBuffers(float overRelaxation);
+	// Gathers the constant input and the impulses added to the step into the impulse sources buffer
+	void UpdateInjectionBuffer();
+	// Queues an impulse of the step unless it adds nothing or misses the volume. The point is in cells
+	void AddImpulseSource(ImpulseTarget_t target, const Vector3 &point, float radius, const Vector3 &amount);
+	void UpdateScalarAdvectionBuffer();
+	void UpdateBricksBuffer(bool allBricksActive);
+	void UpdateObstaclesBuffer(const int regionMin[3], const int regionMax[3]);
+	void UpdateResampleBuffer(unsigned int ratio, float scale, float minimum);
 
 	int  GetUpdateDirtyFlags(const FluidSettings &newSettings) const;
 
 private:
 	D3DGraphicsObject* pD3dGraphicsObj;
+	HWND mHwnd;
 
 	FluidSettings mFluidSettings;
-	ExtraForce mExtraVelocityForce;
-	bool mExtraVelocityAdded;
+	std::vector<ImpulseSource> mImpulses;	// added for the next step
+	// Impulse sources of the current step, the constant input's first, and the cells any of them adds to
+	std::vector<ImpulseSourceData> mImpulseSources;
+	int mInjectionRegionMin[3];
+	int mInjectionRegionMax[3];
+	std::vector<ObstacleBox> mObstacleBoxes;
+	ObstacleTracker mObstacleTracker;
+	std::vector<ObstacleBoxData> mObstacleBoxData;	// boxes overlapping the cells voxelized in the step
+	PressureSolverStats mPressureSolverStats;
+	BrickOccupancyStats mBrickOccupancyStats;
+	AdaptiveTimeStepper mTimeStepper;
+	TimeStepPlan mTimeStepPlan;
+	FluidActivityStats mActivityStats;
+	unsigned int mActivityReductions;
+	unsigned int mResidualReadbacks;
+	StageProfiler mStageProfiler;
+	GPUStageTimer mStageTimer;
+	bool mBrickListsHoldAllBricks;	// the lists were last filled with every brick, they stay that way until sparseBricks is turned on
+	unsigned int mBrickListUpdates;
+	int mResolutionTier;
+	Vector3 mDimensions;	// of the grid of the current tier
+	SolverProfile mSolverProfile;
+	int mHistoryLength;
+	int mHistoryHead;		// slot of the latest frame
+	int mHistoryFrames;		// recorded since the history started over
 
 	std::unique_ptr<AdvectionShader>				mAdvectionShader;
 	std::unique_ptr<AdvectionShader>				mMacCormarckAdvectionShader;
-	std::unique_ptr<ImpulseShader>					mImpulseShader;
+	std::unique_ptr<ScalarAdvectionShader>			mScalarAdvectionShader;
+	std::unique_ptr<ScalarAdvectionShader>			mScalarAdvectionForwardShader;
+	std::unique_ptr<ScalarAdvectionShader>			mScalarMacCormarckAdvectionShader;
+	std::unique_ptr<ImpulseSourcesShader>			mImpulseSourcesShader;
 	std::unique_ptr<ExtinguishmentImpulseShader>	mExtinguishmentImpulseShader;
 	std::unique_ptr<VorticityShader>				mVorticityShader;
 	std::unique_ptr<ConfinementShader>				mConfinementShader;
@@ -93,9 +280,37 @@ private:
 	std::unique_ptr<DivergenceShader>				mDivergenceShader;
 	std::unique_ptr<SubtractGradientShader>			mSubtractGradientShader;
 	std::unique_ptr<BuoyancyShader>					mBuoyancyShader;
+	std::unique_ptr<RedBlackSORShader>				mRedBlackSORShader;
+	std::unique_ptr<MultigridResidualShader>		mMultigridResidualShader;
+	std::unique_ptr<MultigridRestrictShader>		mMultigridRestrictShader;
+	std::unique_ptr<MultigridProlongShader>			mMultigridProlongShader;
+	std::unique_ptr<MultigridRestrictObstaclesShader>	mMultigridRestrictObstaclesShader;
+	std::unique_ptr<ResidualReductionShader>		mResidualReductionShader;
+	std::unique_ptr<ActivityReductionShader>		mActivityReductionShader;
+	std::unique_ptr<PCGLaplacianShader>				mPCGLaplacianShader;
+	std::unique_ptr<PCGReductionShader>				mPCGDotProductShader;
+	std::unique_ptr<PCGReductionShader>				mPCGResidualSumShader;
+	std::unique_ptr<PCGScalarsShader>				mPCGAlphaShader;
+	std::unique_ptr<PCGScalarsShader>				mPCGBetaShader;
+	std::unique_ptr<PCGScalarsShader>				mPCGMeanShader;
+	std::unique_ptr<PCGRemoveMeanShader>			mPCGRemoveMeanShader;
+	std::unique_ptr<PCGUpdateSolutionShader>		mPCGUpdateSolutionShader;
+	std::unique_ptr<PCGUpdateDirectionShader>		mPCGUpdateDirectionShader;
+	std::unique_ptr<BuoyancyImpulseShader>			mBuoyancyImpulseShader;
+	std::unique_ptr<ConfinementDivergenceShader>	mConfinementDivergenceShader;
+	std::unique_ptr<JacobiSubtractGradientShader>	mJacobiSubtractGradientShader;
+	std::unique_ptr<BrickActivityShader>			mBrickActivityShader;
+	std::unique_ptr<BrickListShader>				mBrickListShader;
+	std::unique_ptr<ObstacleShader>					mObstacleShader;
+	std::unique_ptr<ResampleShader>					mRestrictVectorShader;
+	std::unique_ptr<ResampleShader>					mRestrictScalarShader;
+	std::unique_ptr<ResampleShader>					mProlongVectorShader;
+	std::unique_ptr<ResampleShader>					mProlongScalarShader;
 
 	// Resources per object
 	FluidResourcesPerObject mFluidResources;
+	// Resources of every tier used so far. Those of the current tier are in mFluidResources and only put back on a switch
+	std::array<FluidResourcesPerObject, NUM_RESOLUTION_TIERS> mTierResources;
 
 	// Resources that can be shared
 	CommonFluidResources mCommonResources;
@@ -107,8 +322,15 @@ private:
 
 
 	CComPtr<ID3D11Buffer>					mInputBufferGeneral;
-	CComPtr<ID3D11Buffer>					mInputBufferImpulse;
 	CComPtr<ID3D11Buffer>					mInputBufferAdvection;
+	CComPtr<ID3D11Buffer>					mInputBufferInjection;
+	CComPtr<ID3D11Buffer>					mInputBufferScalarAdvection;
+	CComPtr<ID3D11Buffer>					mInputBufferBricks;
+	CComPtr<ID3D11Buffer>					mInputBufferObstacles;
+	// One buffer per colour so the red-black sweeps only rebind instead of remapping between passes
+	std::array<CComPtr<ID3D11Buffer>, 2>	mInputBufferRedBlack;
+	CComPtr<ID3D11Buffer>					mInputBufferResample;
+	float									mRedBlackOverRelaxation;
 };
 
 }
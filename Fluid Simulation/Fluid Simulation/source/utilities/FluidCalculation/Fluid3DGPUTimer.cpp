@@ -0,0 +1,119 @@
+/********************************************************************
+Fluid3DGPUTimer.cpp: Implementation of the GPU stage timer
+
+Author:	Valentin Hinov
+Date: 11/5/2014
+*********************************************************************/
+
+#include "Fluid3DGPUTimer.h"
+
+using namespace Fluid3D;
+
+GPUStageTimer::GPUStageTimer(StageProfiler &profiler) : mProfiler(profiler), mStepIndex(0), mEnabled(false) {
+	for (TimedStep &step : mSteps) {
+		step.numStages = 0;
+		step.pending = false;
+	}
+	mOpenStages.fill(-1);
+}
+
+bool GPUStageTimer::Initialize(ID3D11Device *device, HWND hwnd) {
+	D3D11_QUERY_DESC disjointDesc = {D3D11_QUERY_TIMESTAMP_DISJOINT, 0};
+	D3D11_QUERY_DESC timestampDesc = {D3D11_QUERY_TIMESTAMP, 0};
+
+	for (TimedStep &step : mSteps) {
+		HRESULT hr = device->CreateQuery(&disjointDesc, &step.disjointQuery);
+		if (FAILED(hr)) {
+			MessageBox(hwnd, L"Could not create the timestamp disjoint query", L"Error", MB_OK);
+			return false;
+		}
+		for (auto &query : step.timestampQueries) {
+			hr = device->CreateQuery(&timestampDesc, &query);
+			if (FAILED(hr)) {
+				MessageBox(hwnd, L"Could not create the timestamp query", L"Error", MB_OK);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+void GPUStageTimer::BeginStep(ID3D11DeviceContext *context, bool enabled) {
+	// read back every step that is done, oldest first
+	for (unsigned int i = 0; i < GPU_TIMER_STEPS; ++i) {
+		TimedStep &step = mSteps[(mStepIndex + i) % GPU_TIMER_STEPS];
+		if (step.pending && !ReadStep(context, step)) {
+			break;
+		}
+	}
+
+	mEnabled = enabled;
+	if (!mEnabled) {
+		return;
+	}
+
+	// a step still not done by the time its queries are needed again is not timed
+	TimedStep &step = mSteps[mStepIndex % GPU_TIMER_STEPS];
+	step.pending = false;
+	step.numStages = 0;
+	mOpenStages.fill(-1);
+	context->Begin(step.disjointQuery);
+}
+
+void GPUStageTimer::Begin(ID3D11DeviceContext *context, ProfilerStage_t stage) {
+	TimedStep &step = mSteps[mStepIndex % GPU_TIMER_STEPS];
+	if (!mEnabled || mOpenStages[stage] >= 0 || step.numStages == MAX_GPU_TIMED_STAGES) {
+		return;
+	}
+
+	mOpenStages[stage] = step.numStages;
+	step.stages[step.numStages] = stage;
+	context->End(step.timestampQueries[2 * step.numStages]);
+	++step.numStages;
+}
+
+void GPUStageTimer::End(ID3D11DeviceContext *context, ProfilerStage_t stage) {
+	if (!mEnabled || mOpenStages[stage] < 0) {
+		return;
+	}
+
+	TimedStep &step = mSteps[mStepIndex % GPU_TIMER_STEPS];
+	context->End(step.timestampQueries[2 * mOpenStages[stage] + 1]);
+	mOpenStages[stage] = -1;
+}
+
+void GPUStageTimer::EndStep(ID3D11DeviceContext *context) {
+	if (!mEnabled) {
+		return;
+	}
+
+	TimedStep &step = mSteps[mStepIndex % GPU_TIMER_STEPS];
+	context->End(step.disjointQuery);
+	step.pending = true;
+	++mStepIndex;
+	mEnabled = false;
+}
+
+bool GPUStageTimer::ReadStep(ID3D11DeviceContext *context, TimedStep &step) {
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjointData;
+	if (context->GetData(step.disjointQuery, &disjointData, sizeof(disjointData), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) {
+		return false;
+	}
+
+	// the timestamps are only comparable if the clock kept the same frequency
+	if (!disjointData.Disjoint) {
+		for (int i = 0; i < step.numStages; ++i) {
+			UINT64 start, end;
+			if (context->GetData(step.timestampQueries[2 * i], &start, sizeof(start), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+				context->GetData(step.timestampQueries[2 * i + 1], &end, sizeof(end), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) {
+				continue;
+			}
+			float milliseconds = (float)((end - start) * 1000.0 / disjointData.Frequency);
+			mProfiler.AddSample(step.stages[i], milliseconds);
+		}
+	}
+
+	step.pending = false;
+	return true;
+}
\ No newline at end of file
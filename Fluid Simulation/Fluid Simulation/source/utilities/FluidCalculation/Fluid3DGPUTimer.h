@@ -0,0 +1,64 @@
+/********************************************************************
+Fluid3DGPUTimer.h: Times the stages of the GPU calculator with
+timestamp queries and hands the times to a StageProfiler.
+
+The queries of a step are read back a few steps later without
+waiting on the GPU. Steps that are not done by the time their
+queries are needed again, or that the GPU clock was disjoint in,
+are not timed.
+
+Author:	Valentin Hinov
+Date: 11/5/2014
+*********************************************************************/
+
+#ifndef _FLUID3DGPUTIMER_H
+#define _FLUID3DGPUTIMER_H
+
+#include <array>
+#include "../AtlInclude.h"
+#include "../D3dIncludes.h"
+#include "Fluid3DProfiler.h"
+
+// Steps whose queries can be in flight at once, enough for the substeps of a few frames
+#define GPU_TIMER_STEPS 8
+// Stages that can be timed in a step, any past that are not
+#define MAX_GPU_TIMED_STAGES 64
+
+namespace Fluid3D {
+
+class GPUStageTimer {
+public:
+	GPUStageTimer(StageProfiler &profiler);
+
+	bool Initialize(ID3D11Device *device, HWND hwnd);
+
+	// Stages are only timed between BeginStep and EndStep of a step that is enabled. A stage that is already being
+	// timed keeps its start on Begin, and one that is not is left alone on End
+	void BeginStep(ID3D11DeviceContext *context, bool enabled);
+	void Begin(ID3D11DeviceContext *context, ProfilerStage_t stage);
+	void End(ID3D11DeviceContext *context, ProfilerStage_t stage);
+	void EndStep(ID3D11DeviceContext *context);
+
+private:
+	struct TimedStep {
+		CComPtr<ID3D11Query> disjointQuery;
+		std::array<CComPtr<ID3D11Query>, 2 * MAX_GPU_TIMED_STAGES> timestampQueries;	// start and end of every stage
+		std::array<ProfilerStage_t, MAX_GPU_TIMED_STAGES> stages;
+		int numStages;
+		bool pending;	// the queries have been issued and not read back yet
+	};
+
+	// Hands the times of a pending step to the profiler if its queries are done. Returns false if they are not
+	bool ReadStep(ID3D11DeviceContext *context, TimedStep &step);
+
+private:
+	StageProfiler &mProfiler;
+	std::array<TimedStep, GPU_TIMER_STEPS> mSteps;
+	unsigned int mStepIndex;
+	bool mEnabled;
+	std::array<int, NUM_PROFILER_STAGES> mOpenStages;	// index of the stage in the step, or -1 if it is not being timed
+};
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,180 @@
+/********************************************************************
+Fluid3DMemoryTraffic.cpp: Implementation of the memory traffic
+estimate
+
+Author:	Valentin Hinov
+Date: 7/5/2014
+*********************************************************************/
+
+#include "Fluid3DMemoryTraffic.h"
+#include <stdio.h>
+
+using namespace std;
+using namespace Fluid3D;
+
+#define MEGABYTE (1024.0 * 1024.0)
+
+MemoryTrafficModel MemoryTrafficModel::CreateGPUModel() {
+	MemoryTrafficModel model;
+	model.name = "GPU";
+	model.velocityBytes = 8;		// DXGI_FORMAT_R16G16B16A16_FLOAT
+	model.scalarBytes = 2;			// DXGI_FORMAT_R16_FLOAT
+	model.obstacleBytes = 1;		// DXGI_FORMAT_R8_UINT
+	model.vorticityBytes = 8;		// DXGI_FORMAT_R16G16B16A16_FLOAT
+	model.divergenceBytes = 2;		// DXGI_FORMAT_R16_FLOAT
+	model.pressureBytes = 4;		// DXGI_FORMAT_R32_FLOAT
+	model.scalarTempBytes = 8;		// the temporary volumes are shared with the velocity advection
+	model.vectorTempBytes = 8;
+	model.jacobiCopiesResult = true;
+	model.packedTempPerField = false;
+	return model;
+}
+
+MemoryTrafficModel MemoryTrafficModel::CreateCPUModel() {
+	MemoryTrafficModel model;
+	model.name = "CPU";
+	model.velocityBytes = 3 * sizeof(float);
+	model.scalarBytes = sizeof(float);
+	model.obstacleBytes = sizeof(unsigned char);
+	model.vorticityBytes = 4 * sizeof(float); // vorticity plus its length
+	model.divergenceBytes = sizeof(float);
+	model.pressureBytes = sizeof(float);
+	model.scalarTempBytes = sizeof(float);
+	model.vectorTempBytes = 3 * sizeof(float);
+	model.jacobiCopiesResult = false;
+	model.packedTempPerField = true;
+	return model;
+}
+
+namespace {
+	void AddPass(vector<PassTraffic> &passes, const string &name, double cells, int bytesRead, int bytesWritten) {
+		PassTraffic pass;
+		pass.name = name;
+		pass.bytesRead = cells * bytesRead;
+		pass.bytesWritten = cells * bytesWritten;
+		passes.push_back(pass);
+	}
+
+	void AddAdvection(vector<PassTraffic> &passes, const string &name, double cells, const MemoryTrafficModel &model, SystemAdvectionType_t advectionType,
+		int targetBytes, int tempBytes) {
+		int velocityAndObstacles = model.velocityBytes + model.obstacleBytes;
+		if (advectionType == NORMAL) {
+			AddPass(passes, name, cells, velocityAndObstacles + targetBytes, targetBytes);
+		}
+		else {
+			// forward, backward and the MacCormack correction
+			AddPass(passes, name + " forward", cells, velocityAndObstacles + targetBytes, tempBytes);
+			AddPass(passes, name + " backward", cells, velocityAndObstacles + tempBytes, tempBytes);
+			AddPass(passes, name + " correction", cells, velocityAndObstacles + 2 * tempBytes + targetBytes, targetBytes);
+		}
+	}
+}
+
+vector<PassTraffic> Fluid3D::EstimateStepTraffic(const FluidSettings &fluidSettings, const MemoryTrafficModel &model) {
+	double cells = (double)fluidSettings.dimensions.x * fluidSettings.dimensions.y * fluidSettings.dimensions.z;
+	bool isFire = fluidSettings.GetFluidType() == FIRE;
+	bool fused = fluidSettings.fusedKernels;
+	int velocity = model.velocityBytes;
+	int scalar = model.scalarBytes;
+	int obstacles = model.obstacleBytes;
+
+	vector<PassTraffic> passes;
+
+	if (fluidSettings.packedScalarAdvection) {
+		int fields = isFire ? 3 : 2;
+		int velocityAndObstacles = velocity + obstacles;
+		if (fluidSettings.advectionType == NORMAL) {
+			AddPass(passes, "Advect scalars", cells, velocityAndObstacles + fields * scalar, fields * scalar);
+		}
+		else {
+			// temperature is not advected with MacCormack
+			int forwardFields = model.packedTempPerField ? fields - 1 : fields;
+			int packedTemp = model.packedTempPerField ? forwardFields * model.scalarTempBytes : model.vectorTempBytes;
+			AddPass(passes, "Advect scalars forward", cells, velocityAndObstacles + forwardFields * scalar, packedTemp);
+			AddPass(passes, "Advect scalars backward", cells, velocityAndObstacles + packedTemp, packedTemp);
+			AddPass(passes, "Advect scalars correction", cells, velocityAndObstacles + 2 * packedTemp + fields * scalar, fields * scalar);
+		}
+	}
+	else {
+		AddAdvection(passes, "Advect temperature", cells, model, NORMAL, scalar, model.scalarTempBytes);
+		AddAdvection(passes, "Advect density", cells, model, fluidSettings.advectionType, scalar, model.scalarTempBytes);
+		if (isFire) {
+			AddAdvection(passes, "Advect reaction", cells, model, fluidSettings.advectionType, scalar, model.scalarTempBytes);
+		}
+	}
+	AddAdvection(passes, "Advect velocity", cells, model, fluidSettings.advectionType, velocity, model.vectorTempBytes);
+
+	if (fused) {
+		int fields = velocity + 2 * scalar + (isFire ? scalar : 0);
+		AddPass(passes, "Buoyancy and impulses", cells, fields, fields);
+	}
+	else {
+		int fields = velocity + 2 * scalar + (isFire ? scalar : 0);
+		AddPass(passes, "Buoyancy", cells, velocity + 2 * scalar, velocity);
+		// all impulses in one pass, the written region is then copied back into the read buffers
+		AddPass(passes, "Impulses", cells, fields, fields);
+		AddPass(passes, "Copy impulse results", cells, fields, fields);
+		if (isFire) {
+			AddPass(passes, "Extinguishment impulse", cells, 2 * scalar, scalar);
+		}
+	}
+
+	AddPass(passes, "Vorticity", cells, velocity, model.vorticityBytes);
+	if (fused) {
+		AddPass(passes, "Confinement and divergence", cells, velocity + model.vorticityBytes + obstacles, velocity + model.divergenceBytes);
+	}
+	else {
+		AddPass(passes, "Confinement", cells, velocity + model.vorticityBytes, velocity);
+		AddPass(passes, "Divergence", cells, velocity + obstacles, model.divergenceBytes);
+	}
+
+	int pressure = model.pressureBytes;
+	int jacobiRead = pressure + model.divergenceBytes + obstacles;
+	if (fluidSettings.pressureSolverType == JACOBI && fused) {
+		if (model.jacobiCopiesResult && (fluidSettings.jacobiIterations - 1) % 2 == 1) {
+			AddPass(passes, "Copy pressure", cells, pressure, pressure);
+		}
+		AddPass(passes, "Last Jacobi and subtract gradient", cells, velocity + jacobiRead, velocity + pressure);
+		if (model.jacobiCopiesResult && fluidSettings.warmStartPressure) {
+			AddPass(passes, "Copy pressure", cells, pressure, pressure);
+		}
+	}
+	else {
+		if (fluidSettings.pressureSolverType == JACOBI) {
+			AddPass(passes, "Last Jacobi iteration", cells, jacobiRead, pressure);
+			if (model.jacobiCopiesResult && fluidSettings.jacobiIterations % 2 == 1) {
+				AddPass(passes, "Copy pressure", cells, pressure, pressure);
+			}
+		}
+		AddPass(passes, "Subtract gradient", cells, velocity + pressure + obstacles, velocity);
+	}
+
+	return passes;
+}
+
+void Fluid3D::PrintTrafficReport(const FluidSettings &fluidSettings, const MemoryTrafficModel &model) {
+	FluidSettings modeSettings[2] = {fluidSettings, fluidSettings};
+	for (int mode = 0; mode < 2; ++mode) {
+		modeSettings[mode].fusedKernels = mode == 1;
+		modeSettings[mode].packedScalarAdvection = mode == 1;
+	}
+	vector<PassTraffic> modes[2] = {EstimateStepTraffic(modeSettings[0], model), EstimateStepTraffic(modeSettings[1], model)};
+
+	printf("%s memory traffic per step (%dx%dx%d, %s):\n", model.name, (int)fluidSettings.dimensions.x, (int)fluidSettings.dimensions.y,
+		(int)fluidSettings.dimensions.z, fluidSettings.GetFluidType() == FIRE ? "fire" : "smoke");
+
+	double totals[2] = {0.0, 0.0};
+	int passCounts[2];
+	for (int mode = 0; mode < 2; ++mode) {
+		printf("  %s\n", mode == 0 ? "Unfused" : "Fused, packed scalar advection");
+		for (const PassTraffic &pass : modes[mode]) {
+			printf("    %-36s read %8.2f MB  written %8.2f MB\n", pass.name.c_str(), pass.bytesRead / MEGABYTE, pass.bytesWritten / MEGABYTE);
+			totals[mode] += pass.bytesRead + pass.bytesWritten;
+		}
+		passCounts[mode] = (int)modes[mode].size();
+	}
+
+	double saving = totals[0] > 0.0 ? 100.0 * (totals[0] - totals[1]) / totals[0] : 0.0;
+	printf("  Unfused: %d passes, %.2f MB. Fused: %d passes, %.2f MB. Saving %.1f%%\n", passCounts[0], totals[0] / MEGABYTE,
+		passCounts[1], totals[1] / MEGABYTE, saving);
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+/********************************************************************
+Fluid3DMemoryTraffic.h: Estimates how many bytes of volume data a
+single 3D fluid step reads and writes, so the fused and unfused
+execution modes can be compared
+
+Author:	Valentin Hinov
+Date: 7/5/2014
+*********************************************************************/
+
+#ifndef _FLUID3DMEMORYTRAFFIC_H
+#define _FLUID3DMEMORYTRAFFIC_H
+
+#include <vector>
+#include <string>
+#include "FluidSettings.h"
+
+namespace Fluid3D {
+
+// Bytes per cell of every volume the step touches
+struct MemoryTrafficModel {
+	const char *name;
+	int velocityBytes;
+	int scalarBytes;		// density, temperature and reaction
+	int obstacleBytes;
+	int vorticityBytes;
+	int divergenceBytes;
+	int pressureBytes;
+	int scalarTempBytes;	// MacCormack intermediate results of a scalar advection
+	int vectorTempBytes;	// MacCormack intermediate results of the velocity advection
+	bool jacobiCopiesResult; // Jacobi alternates between the pressure and a scratch volume, an odd count of iterations is copied back once
+	bool packedTempPerField; // the packed MacCormack steps only touch the fields advected with MacCormack, otherwise they go through whole vector temporaries
+
+	// Texture formats used by Fluid3DCalculator
+	static MemoryTrafficModel CreateGPUModel();
+	// Field layouts used by Fluid3DCPUCalculator
+	static MemoryTrafficModel CreateCPUModel();
+};
+
+// Whole volume bytes moved by a single pass. Every volume a pass touches is counted once per cell,
+// neighbour and sampler reads that hit the cache are not modelled
+struct PassTraffic {
+	std::string name;
+	double bytesRead;
+	double bytesWritten;
+};
+
+// Lists the passes of one step in execution order, following the fusedKernels and packedScalarAdvection settings.
+// Solver iterations other than the last Jacobi iteration are the same in every mode and are left out. Assumes the
+// impulses of the step reach the whole volume
+std::vector<PassTraffic> EstimateStepTraffic(const FluidSettings &fluidSettings, const MemoryTrafficModel &model);
+
+// Prints the passes of a step with fused kernels and packed scalar advection turned off and on, along with the totals
+void PrintTrafficReport(const FluidSettings &fluidSettings, const MemoryTrafficModel &model);
+
+}
+
+#endif
\ No newline at end of file
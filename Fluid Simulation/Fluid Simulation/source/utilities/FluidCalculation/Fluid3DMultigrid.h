@@ -0,0 +1,52 @@
+/********************************************************************
+Fluid3DMultigrid.h: Constants and grid hierarchy helpers shared by
+the GPU and CPU multigrid pressure solvers.
+
+Every level solves sum(pNeighbour - pCentre) = b over its fluid
+neighbours. Coarse right hand sides are scaled by h^2 = 4 during
+restriction, so the same smoothing and residual kernels serve
+every level.
+
+Author:	Valentin Hinov
+Date: 5/5/2014
+*********************************************************************/
+
+#ifndef _FLUID3DMULTIGRID_H
+#define _FLUID3DMULTIGRID_H
+
+#include <vector>
+#include "../math/MathUtils.h"
+
+// Red-black Gauss-Seidel sweeps before and after each coarse grid correction
+#define MULTIGRID_PRE_SMOOTHING_STEPS 2
+#define MULTIGRID_POST_SMOOTHING_STEPS 2
+// Sweeps used to solve the coarsest level
+#define MULTIGRID_COARSE_ITERATIONS 32
+// Coarsening stops once a level would have a side shorter than this
+#define MULTIGRID_MIN_DIMENSION 4
+
+namespace Fluid3D {
+
+// Dimensions of every coarse level below the given fine grid, from finest to coarsest
+inline std::vector<Vector3> GetMultigridLevelDimensions(const Vector3 &fineDimensions) {
+	std::vector<Vector3> levels;
+	int width = (int)fineDimensions.x;
+	int height = (int)fineDimensions.y;
+	int depth = (int)fineDimensions.z;
+
+	while (true) {
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+		depth = (depth + 1) / 2;
+		if (width < MULTIGRID_MIN_DIMENSION || height < MULTIGRID_MIN_DIMENSION || depth < MULTIGRID_MIN_DIMENSION) {
+			break;
+		}
+		levels.push_back(Vector3((float)width, (float)height, (float)depth));
+	}
+
+	return levels;
+}
+
+}
+
+#endif
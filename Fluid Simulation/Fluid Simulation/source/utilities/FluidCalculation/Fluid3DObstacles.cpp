@@ -0,0 +1,193 @@
+/********************************************************************
+Fluid3DObstacles.cpp: Implementation of the obstacle box tracking
+
+Author:	Valentin Hinov
+Date: 10/5/2014
+*********************************************************************/
+
+#include "Fluid3DObstacles.h"
+#include <cmath>
+
+using namespace std;
+using namespace Fluid3D;
+
+// Boxes whose half axes span less than this volume in cells are skipped
+#define MIN_OBSTACLE_BOX_VOLUME 1e-6f
+
+namespace {
+	// Grows the region by the cells of a box and a cell on every side of them
+	void AddToRegion(const int boxMin[3], const int boxMax[3], int regionMin[3], int regionMax[3]) {
+		for (int axis = 0; axis < 3; ++axis) {
+			regionMin[axis] = Min(regionMin[axis], boxMin[axis] - 1);
+			regionMax[axis] = Max(regionMax[axis], boxMax[axis] + 1);
+		}
+	}
+}
+
+ObstacleTracker::ObstacleTracker() : mInvalidated(true) {
+
+}
+
+void ObstacleTracker::Invalidate() {
+	mInvalidated = true;
+}
+
+bool ObstacleTracker::Update(const Vector3 &dimensions, const vector<ObstacleBox> &boxes, int regionMin[3], int regionMax[3], vector<ObstacleBoxData> &boxData) {
+	const int sizes[3] = {(int)dimensions.x, (int)dimensions.y, (int)dimensions.z};
+	for (int axis = 0; axis < 3; ++axis) {
+		regionMin[axis] = sizes[axis];
+		regionMax[axis] = -1;
+	}
+
+	// where the boxes were a step ago, new boxes start out still
+	map<unsigned int, TrackedBox> previousBoxes;
+	previousBoxes.swap(mBoxes);
+	size_t boxCount = Min(boxes.size(), (size_t)MAX_OBSTACLE_BOXES);
+	for (size_t i = 0; i < boxCount; ++i) {
+		TrackedBox box = ToCells(boxes[i], dimensions);
+		auto previous = previousBoxes.find(boxes[i].id);
+		bool wasMoving = false;
+		if (previous == previousBoxes.end()) {
+			box.moving = false;
+		}
+		else {
+			box.moving = !HasSamePose(previous->second, box);
+			wasMoving = previous->second.moving;
+		}
+
+		if (previous == previousBoxes.end() || box.moving || wasMoving) {
+			if (box.covered) {
+				AddToRegion(box.regionMin, box.regionMax, regionMin, regionMax);
+			}
+			if (previous != previousBoxes.end() && previous->second.covered) {
+				AddToRegion(previous->second.regionMin, previous->second.regionMax, regionMin, regionMax);
+			}
+		}
+		mBoxes[boxes[i].id] = box;
+	}
+
+	// the cells of the boxes that are gone become fluid again
+	for (auto &previous : previousBoxes) {
+		if (mBoxes.count(previous.first) == 0 && previous.second.covered) {
+			AddToRegion(previous.second.regionMin, previous.second.regionMax, regionMin, regionMax);
+		}
+	}
+
+	for (int axis = 0; axis < 3; ++axis) {
+		if (mInvalidated) {
+			regionMin[axis] = 0;
+			regionMax[axis] = sizes[axis] - 1;
+		}
+		else {
+			regionMin[axis] = Max(regionMin[axis], 0);
+			regionMax[axis] = Min(regionMax[axis], sizes[axis] - 1);
+		}
+	}
+	mInvalidated = false;
+
+	boxData.clear();
+	if (regionMin[0] > regionMax[0] || regionMin[1] > regionMax[1] || regionMin[2] > regionMax[2]) {
+		return false;
+	}
+
+	// the flags of the cells on the edge of the region depend on the cells just past it
+	for (auto &tracked : mBoxes) {
+		const TrackedBox &box = tracked.second;
+		bool overlaps = box.covered;
+		for (int axis = 0; axis < 3 && overlaps; ++axis) {
+			overlaps = box.regionMin[axis] <= regionMax[axis] + 1 && box.regionMax[axis] >= regionMin[axis] - 1;
+		}
+		if (!overlaps) {
+			continue;
+		}
+
+		// the rows of the inverse of the axis matrix are the cross products of the other two axes over the determinant
+		const Vector3 *axes = box.axes;
+		float inverseDeterminant = 1.0f / axes[0].Dot(axes[1].Cross(axes[2]));
+
+		ObstacleBoxData data;
+		data.vCentre = box.centre;
+		data.vInverseX = axes[1].Cross(axes[2]) * inverseDeterminant;
+		data.vInverseY = axes[2].Cross(axes[0]) * inverseDeterminant;
+		data.vInverseZ = axes[0].Cross(axes[1]) * inverseDeterminant;
+
+		auto previous = previousBoxes.find(tracked.first);
+		const TrackedBox &previousBox = (previous != previousBoxes.end() && box.moving) ? previous->second : box;
+		data.vPreviousCentre = previousBox.centre;
+		data.vPreviousAxisX = previousBox.axes[0];
+		data.vPreviousAxisY = previousBox.axes[1];
+		data.vPreviousAxisZ = previousBox.axes[2];
+		for (int axis = 0; axis < 3; ++axis) {
+			data.vRegionMin[axis] = box.regionMin[axis];
+			data.vRegionMax[axis] = box.regionMax[axis];
+		}
+		boxData.push_back(data);
+	}
+
+	return true;
+}
+
+ObstacleTracker::TrackedBox ObstacleTracker::ToCells(const ObstacleBox &box, const Vector3 &dimensions) {
+	TrackedBox tracked;
+	tracked.centre = box.centre * dimensions;
+	Vector3 extents(0.0f, 0.0f, 0.0f);
+	for (int axis = 0; axis < 3; ++axis) {
+		tracked.axes[axis] = box.halfAxes[axis] * dimensions;
+		extents += Vector3(fabs(tracked.axes[axis].x), fabs(tracked.axes[axis].y), fabs(tracked.axes[axis].z));
+	}
+	tracked.moving = false;
+
+	float volume = fabs(tracked.axes[0].Dot(tracked.axes[1].Cross(tracked.axes[2])));
+	tracked.covered = volume > MIN_OBSTACLE_BOX_VOLUME;
+
+	const float centres[3] = {tracked.centre.x, tracked.centre.y, tracked.centre.z};
+	const float reach[3] = {extents.x, extents.y, extents.z};
+	const float sizes[3] = {dimensions.x, dimensions.y, dimensions.z};
+	for (int axis = 0; axis < 3; ++axis) {
+		int low = (int)ceil(centres[axis] - reach[axis]);
+		int high = (int)floor(centres[axis] + reach[axis]);
+		tracked.regionMin[axis] = Max(low, 0);
+		tracked.regionMax[axis] = Min(high, (int)sizes[axis] - 1);
+		if (tracked.regionMin[axis] > tracked.regionMax[axis]) {
+			tracked.covered = false;
+		}
+	}
+
+	return tracked;
+}
+
+bool ObstacleTracker::HasSamePose(const TrackedBox &first, const TrackedBox &second) {
+	return first.centre == second.centre && first.axes[0] == second.axes[0] && first.axes[1] == second.axes[1] && first.axes[2] == second.axes[2];
+}
+
+bool Fluid3D::CoversConstantInput(const ObstacleBox &box, const FluidSettings &settings, const Vector3 &dimensions) {
+	// in cells, the same as the calculators place the input
+	Vector3 inputPosition = dimensions * settings.constantInputPosition;
+	float inputRadius = settings.constantInputRadius * (dimensions.x + dimensions.y + dimensions.z);
+
+	Vector3 centre = box.centre * dimensions;
+	Vector3 reach(0.0f, 0.0f, 0.0f);
+	for (int axis = 0; axis < 3; ++axis) {
+		Vector3 halfAxis = box.halfAxes[axis] * dimensions;
+		reach += Vector3(fabs(halfAxis.x), fabs(halfAxis.y), fabs(halfAxis.z));
+	}
+
+	// a cell further out than the radius still shares its flags with the input cells next to it
+	Vector3 separation = centre - inputPosition;
+	float margin = inputRadius + 1.0f;
+	return fabs(separation.x) <= reach.x + margin && fabs(separation.y) <= reach.y + margin && fabs(separation.z) <= reach.z + margin;
+}
+
+bool Fluid3D::HaveSameObstacleBoxes(const vector<ObstacleBox> &first, const vector<ObstacleBox> &second) {
+	if (first.size() != second.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < first.size(); ++i) {
+		const ObstacleBox &a = first[i];
+		const ObstacleBox &b = second[i];
+		if (a.id != b.id || a.centre != b.centre || a.halfAxes[0] != b.halfAxes[0] || a.halfAxes[1] != b.halfAxes[1] || a.halfAxes[2] != b.halfAxes[2]) {
+			return false;
+		}
+	}
+	return true;
+}
\ No newline at end of file
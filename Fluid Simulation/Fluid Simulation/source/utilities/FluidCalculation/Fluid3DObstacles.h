@@ -0,0 +1,67 @@
+/********************************************************************
+Fluid3DObstacles.h: Keeps track of the obstacle boxes of a 3D fluid
+between steps for the GPU and CPU calculators, so only the cells
+around the boxes that changed get voxelized again.
+
+A box is voxelized again when it appears, disappears or moves, and
+once more the step after it stops so its cells lose their velocity.
+The cells to voxelize are the bounds of those boxes before and after
+the step, grown by a cell since the flags of a cell depend on its
+neighbours.
+
+Author:	Valentin Hinov
+Date: 10/5/2014
+*********************************************************************/
+
+#ifndef _FLUID3DOBSTACLES_H
+#define _FLUID3DOBSTACLES_H
+
+#include <vector>
+#include <map>
+#include "FluidSettings.h"
+#include "Fluid3DBuffers.h"
+
+// Boxes that can be voxelized in a single step
+#define MAX_OBSTACLE_BOXES 64
+
+namespace Fluid3D {
+
+class ObstacleTracker {
+public:
+	ObstacleTracker();
+
+	// Makes the next step voxelize the whole volume, the walls included
+	void Invalidate();
+
+	// Takes the boxes of the next step, only the first MAX_OBSTACLE_BOXES are kept. Returns false if no cell has to be
+	// voxelized again. Otherwise fills the cells to voxelize, inclusive, and the boxes overlapping them
+	bool Update(const Vector3 &dimensions, const std::vector<ObstacleBox> &boxes, int regionMin[3], int regionMax[3], std::vector<ObstacleBoxData> &boxData);
+
+private:
+	// A box in cells and the cells it covers
+	struct TrackedBox {
+		Vector3 centre;
+		Vector3 axes[3];
+		int regionMin[3];
+		int regionMax[3];
+		bool covered;		// covers at least a cell of the volume
+		bool moving;		// moved since the step before
+	};
+
+	static TrackedBox ToCells(const ObstacleBox &box, const Vector3 &dimensions);
+	static bool HasSamePose(const TrackedBox &first, const TrackedBox &second);
+
+	std::map<unsigned int, TrackedBox> mBoxes;
+	bool mInvalidated;
+};
+
+// True if both hold the same boxes in the same order and pose
+bool HaveSameObstacleBoxes(const std::vector<ObstacleBox> &first, const std::vector<ObstacleBox> &second);
+
+// True if the box reaches a cell of the constant input of the settings or a neighbour of one in a grid of the dimensions,
+// going by the bounds of the box. Solid cells there would swallow what the input adds, so such boxes are best left out
+bool CoversConstantInput(const ObstacleBox &box, const FluidSettings &settings, const Vector3 &dimensions);
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,170 @@
+/********************************************************************
+Fluid3DProfiler.cpp: Implementation of the stage profiler
+
+Author:	Valentin Hinov
+Date: 11/5/2014
+*********************************************************************/
+
+#include "Fluid3DProfiler.h"
+#include <stdio.h>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+using namespace Fluid3D;
+
+namespace {
+	const char *stageNames[NUM_PROFILER_STAGES] = {
+		"Step",
+		"Obstacles",
+		"Bricks",
+		"Advect Scalars",
+		"Advect Temperature",
+		"Advect Density",
+		"Advect Reaction",
+		"Advect Velocity",
+		"Buoyancy",
+		"Impulses",
+		"Buoyancy + Impulses",
+		"Vorticity",
+		"Divergence",
+		"Vorticity + Divergence",
+		"Pressure Batch",
+		"Pressure Residual",
+		"Subtract Gradient"
+	};
+}
+
+StageProfiler::StageProfiler() : mWriteIndex(0), mReadIndex(0), mDroppedSamples(0) {
+	ClearTimings();
+}
+
+bool StageProfiler::AddSample(ProfilerStage_t stage, float milliseconds) {
+	unsigned int writeIndex = mWriteIndex.load(memory_order_relaxed);
+	// the slot is only free once the collecting thread has moved past it
+	if (writeIndex - mReadIndex.load(memory_order_acquire) >= PROFILER_RING_SIZE) {
+		mDroppedSamples.fetch_add(1, memory_order_relaxed);
+		return false;
+	}
+
+	StageSample &sample = mRing[writeIndex & (PROFILER_RING_SIZE - 1)];
+	sample.stage = stage;
+	sample.milliseconds = milliseconds;
+	mWriteIndex.store(writeIndex + 1, memory_order_release);
+	return true;
+}
+
+void StageProfiler::Collect() {
+	unsigned int readIndex = mReadIndex.load(memory_order_relaxed);
+	unsigned int writeIndex = mWriteIndex.load(memory_order_acquire);
+	if (readIndex == writeIndex) {
+		return;
+	}
+
+	bool stageChanged[NUM_PROFILER_STAGES] = {false};
+	for (; readIndex != writeIndex; ++readIndex) {
+		const StageSample &sample = mRing[readIndex & (PROFILER_RING_SIZE - 1)];
+		StageWindow &window = mWindows[sample.stage];
+		window.samples[window.next] = sample.milliseconds;
+		window.next = (window.next + 1) % STAGE_TIMING_WINDOW;
+		window.count = min(window.count + 1, STAGE_TIMING_WINDOW);
+		stageChanged[sample.stage] = true;
+	}
+	mReadIndex.store(readIndex, memory_order_release);
+
+	for (int stage = 0; stage < NUM_PROFILER_STAGES; ++stage) {
+		if (stageChanged[stage]) {
+			UpdateTimings((ProfilerStage_t)stage);
+		}
+	}
+}
+
+void StageProfiler::ClearTimings() {
+	for (int stage = 0; stage < NUM_PROFILER_STAGES; ++stage) {
+		mWindows[stage].count = 0;
+		mWindows[stage].next = 0;
+		mTimings[stage] = StageTimings();
+	}
+}
+
+void StageProfiler::UpdateTimings(ProfilerStage_t stage) {
+	const StageWindow &window = mWindows[stage];
+	std::array<float, STAGE_TIMING_WINDOW> samples;
+	copy(window.samples.begin(), window.samples.begin() + window.count, samples.begin());
+
+	float total = 0.0f;
+	for (int i = 0; i < window.count; ++i) {
+		total += samples[i];
+	}
+
+	// the sample 99% of the window is no slower than
+	int p99Index = max((int)ceil(0.99f * window.count) - 1, 0);
+	nth_element(samples.begin(), samples.begin() + p99Index, samples.begin() + window.count);
+
+	StageTimings &timings = mTimings[stage];
+	timings.minMilliseconds = *min_element(samples.begin(), samples.begin() + window.count);
+	timings.averageMilliseconds = total / window.count;
+	timings.p99Milliseconds = samples[p99Index];
+	timings.samples = window.count;
+}
+
+const StageTimings &StageProfiler::GetStageTimings(ProfilerStage_t stage) const {
+	return mTimings[stage];
+}
+
+unsigned int StageProfiler::GetDroppedSamples() const {
+	return mDroppedSamples.load(memory_order_relaxed);
+}
+
+const char *StageProfiler::GetStageName(ProfilerStage_t stage) {
+	return stageNames[stage];
+}
+
+void StageProfiler::PrintStageTimings() const {
+	printf("  %-24s %9s %9s %9s %8s\n", "Stage", "min ms", "avg ms", "p99 ms", "samples");
+	for (int stage = 0; stage < NUM_PROFILER_STAGES; ++stage) {
+		const StageTimings &timings = mTimings[stage];
+		if (timings.samples == 0) {
+			continue;
+		}
+		printf("  %-24s %9.3f %9.3f %9.3f %8d\n", stageNames[stage], timings.minMilliseconds, timings.averageMilliseconds, timings.p99Milliseconds, timings.samples);
+	}
+	if (GetDroppedSamples() > 0) {
+		printf("  %u samples dropped\n", GetDroppedSamples());
+	}
+}
+
+CPUStageTimer::CPUStageTimer(StageProfiler &profiler) : mProfiler(profiler), mEnabled(false) {
+	QueryPerformanceFrequency(&mFrequency);
+	mOpenStages.fill(false);
+}
+
+void CPUStageTimer::BeginStep(bool enabled) {
+	mEnabled = enabled;
+	mOpenStages.fill(false);
+}
+
+void CPUStageTimer::Begin(ProfilerStage_t stage) {
+	if (!mEnabled || mOpenStages[stage]) {
+		return;
+	}
+
+	mOpenStages[stage] = true;
+	QueryPerformanceCounter(&mStarts[stage]);
+}
+
+void CPUStageTimer::End(ProfilerStage_t stage) {
+	if (!mEnabled || !mOpenStages[stage]) {
+		return;
+	}
+
+	LARGE_INTEGER end;
+	QueryPerformanceCounter(&end);
+	mOpenStages[stage] = false;
+	float milliseconds = (float)((end.QuadPart - mStarts[stage].QuadPart) * 1000.0 / mFrequency.QuadPart);
+	mProfiler.AddSample(stage, milliseconds);
+}
+
+void CPUStageTimer::EndStep() {
+	mEnabled = false;
+}
\ No newline at end of file
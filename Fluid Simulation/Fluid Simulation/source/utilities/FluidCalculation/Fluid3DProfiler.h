@@ -0,0 +1,126 @@
+/********************************************************************
+Fluid3DProfiler.h: Times the stages of a step of a 3D fluid for the
+GPU and CPU calculators.
+
+The timers of the calculators add a sample for every stage they time
+to a lock-free ring, which the thread that shows the timings drains
+into a rolling window per stage. The windows give the min, average
+and 99th percentile of the last STAGE_TIMING_WINDOW samples.
+
+Author:	Valentin Hinov
+Date: 11/5/2014
+*********************************************************************/
+
+#ifndef _FLUID3DPROFILER_H
+#define _FLUID3DPROFILER_H
+
+#include <array>
+#include <atomic>
+#include <windows.h>
+
+// Samples the ring holds before the stage timings are collected, must be a power of two
+#define PROFILER_RING_SIZE 1024
+// Samples of every stage the timings are taken over
+#define STAGE_TIMING_WINDOW 128
+
+namespace Fluid3D {
+
+enum ProfilerStage_t {
+	STAGE_STEP,						// the whole step
+	STAGE_OBSTACLES,
+	STAGE_BRICKS,
+	STAGE_ADVECT_SCALARS,			// the packed temperature, density and reaction
+	STAGE_ADVECT_TEMPERATURE,
+	STAGE_ADVECT_DENSITY,
+	STAGE_ADVECT_REACTION,
+	STAGE_ADVECT_VELOCITY,
+	STAGE_BUOYANCY,
+	STAGE_IMPULSES,
+	STAGE_BUOYANCY_AND_IMPULSES,	// fused
+	STAGE_VORTICITY,
+	STAGE_DIVERGENCE,
+	STAGE_VORTICITY_AND_DIVERGENCE,	// fused
+	STAGE_PRESSURE_BATCH,			// the pressure iterations between two residual measurements
+	STAGE_PRESSURE_RESIDUAL,
+	STAGE_SUBTRACT_GRADIENT,		// along with the last Jacobi iteration when fused
+	NUM_PROFILER_STAGES
+};
+
+struct StageTimings {
+	float minMilliseconds;
+	float averageMilliseconds;
+	float p99Milliseconds;
+	int samples;				// in the window
+
+	StageTimings() : minMilliseconds(0.0f), averageMilliseconds(0.0f), p99Milliseconds(0.0f), samples(0) {}
+};
+
+class StageProfiler {
+public:
+	StageProfiler();
+
+	// Adds the time a stage took. Called by the thread that runs the simulation only. Returns false and drops the sample
+	// if the ring is full
+	bool AddSample(ProfilerStage_t stage, float milliseconds);
+
+	// Drains the ring into the windows of the stages and updates their timings. Can be called from another thread than
+	// AddSample, but from only one thread
+	void Collect();
+	// Empties the windows of every stage. Called from the thread that calls Collect
+	void ClearTimings();
+
+	// The timings as of the last Collect
+	const StageTimings &GetStageTimings(ProfilerStage_t stage) const;
+	unsigned int GetDroppedSamples() const;
+	static const char *GetStageName(ProfilerStage_t stage);
+
+	// Prints the timings of every stage that has samples
+	void PrintStageTimings() const;
+
+private:
+	struct StageSample {
+		ProfilerStage_t stage;
+		float milliseconds;
+	};
+
+	struct StageWindow {
+		std::array<float, STAGE_TIMING_WINDOW> samples;
+		int count;
+		int next;
+	};
+
+	void UpdateTimings(ProfilerStage_t stage);
+
+private:
+	std::array<StageSample, PROFILER_RING_SIZE> mRing;
+	std::atomic<unsigned int> mWriteIndex;		// only written by the thread adding samples
+	std::atomic<unsigned int> mReadIndex;		// only written by the thread collecting them
+	std::atomic<unsigned int> mDroppedSamples;
+
+	std::array<StageWindow, NUM_PROFILER_STAGES> mWindows;
+	std::array<StageTimings, NUM_PROFILER_STAGES> mTimings;
+};
+
+// Times the stages of the CPU calculator with the performance counter
+class CPUStageTimer {
+public:
+	CPUStageTimer(StageProfiler &profiler);
+
+	// Stages are only timed between BeginStep and EndStep of a step that is enabled. A stage that is already being
+	// timed keeps its start on Begin, and one that is not is left alone on End
+	void BeginStep(bool enabled);
+	void Begin(ProfilerStage_t stage);
+	void End(ProfilerStage_t stage);
+	void EndStep();
+
+private:
+	StageProfiler &mProfiler;
+	LARGE_INTEGER mFrequency;
+	bool mEnabled;
+	std::array<LARGE_INTEGER, NUM_PROFILER_STAGES> mStarts;
+	std::array<bool, NUM_PROFILER_STAGES> mOpenStages;
+};
+
+}
+
+#endif
\ No newline at end of file
@@ -14,18 +14,37 @@ Date: 09/11/2013
 
 using namespace Fluid3D;
 
-BaseFluid3DShader::BaseFluid3DShader(Vector3 dimensions) {
+BaseFluid3DShader::BaseFluid3DShader(Vector3 dimensions, bool sparse) : mSparse(sparse), pBrickDispatchArgs(nullptr), mBrickDispatchArgsOffset(0) {
 	SetDimensions(dimensions);
 }
 
 BaseFluid3DShader::~BaseFluid3DShader() {
+	pBrickDispatchArgs = nullptr;
+}
+
+void BaseFluid3DShader::SetBrickDispatch(_In_ ID3D11Buffer* dispatchArgs, UINT argsOffset) {
+	pBrickDispatchArgs = dispatchArgs;
+	mBrickDispatchArgsOffset = argsOffset;
+}
 
+bool BaseFluid3DShader::IsSparse() const {
+	return mSparse;
 }
 
 void BaseFluid3DShader::Dispatch(_In_ ID3D11DeviceContext* context) const {
 	// Run compute shader
 	SetComputeShader(context);
-	context->Dispatch(mNumThreadGroupX,mNumThreadGroupY,mNumThreadGroupZ);
+	if (mSparse) {
+		context->DispatchIndirect(pBrickDispatchArgs, mBrickDispatchArgsOffset);
+	}
+	else {
+		context->Dispatch(mNumThreadGroupX,mNumThreadGroupY,mNumThreadGroupZ);
+	}
+}
+
+void BaseFluid3DShader::Dispatch(_In_ ID3D11DeviceContext* context, const Vector3 &dimensions) const {
+	SetComputeShader(context);
+	context->Dispatch((UINT)ceil(dimensions.x/NUM_THREADS_X), (UINT)ceil(dimensions.y/NUM_THREADS_Y), (UINT)ceil(dimensions.z/NUM_THREADS_Z));
 }
 
 void BaseFluid3DShader::SetDimensions(const Vector3 &dimensions) {
@@ -39,8 +58,8 @@ ShaderDescription BaseFluid3DShader::GetShaderDescription() {
 }
 
 ///////ADVECTION SHADER BEGIN////////
-AdvectionShader::AdvectionShader(AdvectionShaderType_t advectionType, Vector3 dimensions) 
-: BaseFluid3DShader(dimensions), mAdvectionType(advectionType) {
+AdvectionShader::AdvectionShader(AdvectionShaderType_t advectionType, Vector3 dimensions, bool sparse) 
+: BaseFluid3DShader(dimensions, sparse), mAdvectionType(advectionType) {
 }
 
 AdvectionShader::~AdvectionShader() {
@@ -76,10 +95,20 @@ ShaderDescription AdvectionShader::GetShaderDescription() {
 	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
 	switch (mAdvectionType) {
 		case ADVECTION_TYPE_NORMAL:
-			shaderDescription.computeShaderDesc.shaderFunctionName = "AdvectComputeShader";
+			if (IsSparse()) {
+				shaderDescription.computeShaderDesc.shaderFunctionName = "AdvectSparseComputeShader";
+			}
+			else {
+				shaderDescription.computeShaderDesc.shaderFunctionName = "AdvectComputeShader";
+			}
 			break;
 		case ADVECTION_TYPE_MACCORMARCK:
-			shaderDescription.computeShaderDesc.shaderFunctionName = "AdvectMacCormackComputeShader";
+			if (IsSparse()) {
+				shaderDescription.computeShaderDesc.shaderFunctionName = "AdvectMacCormackSparseComputeShader";
+			}
+			else {
+				shaderDescription.computeShaderDesc.shaderFunctionName = "AdvectMacCormackComputeShader";
+			}
 			break;
 	}
 
@@ -88,41 +117,118 @@ ShaderDescription AdvectionShader::GetShaderDescription() {
 ///////ADVECTION SHADER END////////
 
 
-///////IMPULSE SHADER BEGIN////////
-ImpulseShader::ImpulseShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+///////SCALAR ADVECTION SHADER BEGIN////////
+ScalarAdvectionShader::ScalarAdvectionShader(ScalarAdvectionShaderType_t advectionType, Vector3 dimensions, bool sparse) 
+: BaseFluid3DShader(dimensions, sparse), mAdvectionType(advectionType) {
 }
 
-ImpulseShader::~ImpulseShader() {
+ScalarAdvectionShader::~ScalarAdvectionShader() {
 }
 
-void ImpulseShader::Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* impulseInitial, _In_ ShaderParams* impulseResult) {
-	// Set the parameters inside the compute shader	
-	context->CSSetShaderResources(0, 1, &(impulseInitial->mSRV.p));
-	context->CSSetUnorderedAccessViews(0, 1, &(impulseResult->mUAV.p), nullptr);
+void ScalarAdvectionShader::Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* velocityField, _In_ ShaderParams* scalarFields, _In_ ShaderParams* packedFields, _In_ ShaderParams* scalarResults) {
+	// Set the parameters inside the compute shader. The obstacles stay bound to slot 4
+	ID3D11ShaderResourceView *const pSRV[4] = {velocityField->mSRV, scalarFields[0].mSRV, scalarFields[1].mSRV, scalarFields[2].mSRV};
+	context->CSSetShaderResources(0, 4, pSRV);
+
+	if (mAdvectionType == SCALAR_ADVECTION_TYPE_MACCORMARCK) {
+		ID3D11ShaderResourceView *const pPackedSRV[2] = {packedFields[0].mSRV, packedFields[1].mSRV};
+		context->CSSetShaderResources(5, 2, pPackedSRV);
+	}
+
+	if (mAdvectionType == SCALAR_ADVECTION_TYPE_FORWARD) {
+		context->CSSetUnorderedAccessViews(0, 1, &(packedFields[0].mUAV.p), nullptr);
+	}
+	else {
+		ID3D11UnorderedAccessView *const pUAV[3] = {scalarResults[0].mUAV, scalarResults[1].mUAV, scalarResults[2].mUAV};
+		context->CSSetUnorderedAccessViews(1, 3, pUAV, nullptr);
+	}
 
 	Dispatch(context);
 
 	// To use for flushing shader parameters out of the shaders
-	ID3D11ShaderResourceView *const pSRVNULL[1] = {nullptr};
-	ID3D11UnorderedAccessView *const pUAVNULL[1] = {nullptr};
+	ID3D11ShaderResourceView *const pSRVNULL[4] = {nullptr, nullptr, nullptr, nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[4] = {nullptr, nullptr, nullptr, nullptr};
 
-	context->CSSetShaderResources(0, 1, pSRVNULL);
-	context->CSSetUnorderedAccessViews(0, 1, pUAVNULL, nullptr);
+	context->CSSetShaderResources(0, 4, pSRVNULL);
+	context->CSSetShaderResources(5, 2, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 4, pUAVNULL, nullptr);
+}
+
+ShaderDescription ScalarAdvectionShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+	switch (mAdvectionType) {
+		case SCALAR_ADVECTION_TYPE_NORMAL:
+			if (IsSparse()) {
+				shaderDescription.computeShaderDesc.shaderFunctionName = "AdvectScalarsSparseComputeShader";
+			}
+			else {
+				shaderDescription.computeShaderDesc.shaderFunctionName = "AdvectScalarsComputeShader";
+			}
+			break;
+		case SCALAR_ADVECTION_TYPE_FORWARD:
+			if (IsSparse()) {
+				shaderDescription.computeShaderDesc.shaderFunctionName = "AdvectScalarsForwardSparseComputeShader";
+			}
+			else {
+				shaderDescription.computeShaderDesc.shaderFunctionName = "AdvectScalarsForwardComputeShader";
+			}
+			break;
+		case SCALAR_ADVECTION_TYPE_MACCORMARCK:
+			if (IsSparse()) {
+				shaderDescription.computeShaderDesc.shaderFunctionName = "AdvectScalarsMacCormackSparseComputeShader";
+			}
+			else {
+				shaderDescription.computeShaderDesc.shaderFunctionName = "AdvectScalarsMacCormackComputeShader";
+			}
+			break;
+	}
+
+	return shaderDescription;
+}
+///////SCALAR ADVECTION SHADER END////////
+
+
+///////IMPULSE SOURCES SHADER BEGIN////////
+ImpulseSourcesShader::ImpulseSourcesShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+}
+
+ImpulseSourcesShader::~ImpulseSourcesShader() {
+}
+
+void ImpulseSourcesShader::Compute(_In_ ID3D11DeviceContext* context, const Vector3 &regionSize, _In_ ShaderParams* velocityField, _In_ ShaderParams* temperatureField, _In_ ShaderParams* densityField,
+	_In_ ShaderParams* reactionField, _In_ ShaderParams* velocityResult, _In_ ShaderParams* temperatureResult, _In_ ShaderParams* densityResult, _In_ ShaderParams* reactionResult)
+{
+	// Set the parameters inside the compute shader
+	ID3D11ShaderResourceView *const pSRV[4] = {velocityField->mSRV, temperatureField->mSRV, densityField->mSRV, reactionField ? reactionField->mSRV : nullptr};
+	ID3D11UnorderedAccessView *const pUAV[4] = {velocityResult->mUAV, temperatureResult->mUAV, densityResult->mUAV, reactionResult ? reactionResult->mUAV : nullptr};
+	context->CSSetShaderResources(0, 4, pSRV);
+	context->CSSetUnorderedAccessViews(0, 4, pUAV, nullptr);
+
+	Dispatch(context, regionSize);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[4] = {nullptr, nullptr, nullptr, nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[4] = {nullptr, nullptr, nullptr, nullptr};
+
+	context->CSSetShaderResources(0, 4, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 4, pUAVNULL, nullptr);
 }
 
-ShaderDescription ImpulseShader::GetShaderDescription() {
+ShaderDescription ImpulseSourcesShader::GetShaderDescription() {
 	ShaderDescription shaderDescription;
 
 	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
-	shaderDescription.computeShaderDesc.shaderFunctionName = "ImpulseComputeShader";
+	shaderDescription.computeShaderDesc.shaderFunctionName = "ImpulseSourcesComputeShader";
 
 	return shaderDescription;
 }
-///////IMPULSE SHADER END////////
+///////IMPULSE SOURCES SHADER END////////
 
 
 ///////EXTINGUISHMENT IMPULSE SHADER BEGIN////////
-ExtinguishmentImpulseShader::ExtinguishmentImpulseShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+ExtinguishmentImpulseShader::ExtinguishmentImpulseShader(Vector3 dimensions, bool sparse) : BaseFluid3DShader(dimensions, sparse) {
 }
 
 ExtinguishmentImpulseShader::~ExtinguishmentImpulseShader() {
@@ -148,7 +254,12 @@ ShaderDescription ExtinguishmentImpulseShader::GetShaderDescription() {
 	ShaderDescription shaderDescription;
 
 	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
-	shaderDescription.computeShaderDesc.shaderFunctionName = "ExtinguishmentImpulseComputeShader";
+	if (IsSparse()) {
+		shaderDescription.computeShaderDesc.shaderFunctionName = "ExtinguishmentImpulseSparseComputeShader";
+	}
+	else {
+		shaderDescription.computeShaderDesc.shaderFunctionName = "ExtinguishmentImpulseComputeShader";
+	}
 
 	return shaderDescription;
 }
@@ -257,7 +368,7 @@ ShaderDescription SubtractGradientShader::GetShaderDescription() {
 
 
 ///////BUOYANCY SHADER BEGIN////////
-BuoyancyShader::BuoyancyShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+BuoyancyShader::BuoyancyShader(Vector3 dimensions, bool sparse) : BaseFluid3DShader(dimensions, sparse) {
 }
 
 BuoyancyShader::~BuoyancyShader() {
@@ -283,7 +394,12 @@ ShaderDescription BuoyancyShader::GetShaderDescription() {
 	ShaderDescription shaderDescription;
 
 	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
-	shaderDescription.computeShaderDesc.shaderFunctionName = "BuoyancyComputeShader";
+	if (IsSparse()) {
+		shaderDescription.computeShaderDesc.shaderFunctionName = "BuoyancySparseComputeShader";
+	}
+	else {
+		shaderDescription.computeShaderDesc.shaderFunctionName = "BuoyancyComputeShader";
+	}
 
 	return shaderDescription;
 }
@@ -367,23 +483,780 @@ ObstacleShader::~ObstacleShader() {
 
 }
 
-void ObstacleShader::Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* obstacleResult) {
-	// Set the parameters inside the pixel shader
-	context->CSSetUnorderedAccessViews(0, 1, &(obstacleResult->mUAV.p), nullptr);
+void ObstacleShader::Compute(_In_ ID3D11DeviceContext* context, const Vector3 &regionSize, _In_ ShaderParams* obstacleBoxes, _In_ ShaderParams* obstacleResult, _In_ ShaderParams* obstacleVelocityResult) {
+	// Set the parameters inside the compute shader
+	ID3D11UnorderedAccessView *const pUAV[2] = {obstacleResult->mUAV, obstacleVelocityResult->mUAV};
+	context->CSSetShaderResources(0, 1, &(obstacleBoxes->mSRV.p));
+	context->CSSetUnorderedAccessViews(0, 2, pUAV, nullptr);
+
+	Dispatch(context, regionSize);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[1] = {nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[2] = {nullptr, nullptr};
+	context->CSSetShaderResources(0, 1, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 2, pUAVNULL, nullptr);
+}
+
+ShaderDescription ObstacleShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+	shaderDescription.computeShaderDesc.shaderFunctionName = "ObstaclesComputeShader";
+
+	return shaderDescription;
+}
+///////OBSTACLE SHADER END////////
+
+///////MULTIGRID RESIDUAL SHADER BEGIN////////
+MultigridResidualShader::MultigridResidualShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+
+}
+
+MultigridResidualShader::~MultigridResidualShader() {
+
+}
+
+void MultigridResidualShader::Compute(_In_ ID3D11DeviceContext* context, const Vector3 &levelDimensions, _In_ ShaderParams* pressureField, _In_ ShaderParams* rightHandSide, _In_ ShaderParams* levelObstacles, _In_ ShaderParams* result) {
+	// Set the parameters inside the compute shader
+	ID3D11ShaderResourceView *const pSRV[3] = {rightHandSide->mSRV, pressureField->mSRV, levelObstacles->mSRV};
+	context->CSSetShaderResources(0, 3, pSRV);
+	context->CSSetUnorderedAccessViews(0, 1, &(result->mUAV.p), nullptr);
+
+	Dispatch(context, levelDimensions);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[3] = {nullptr, nullptr, nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[1] = {nullptr};
+
+	context->CSSetShaderResources(0, 3, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 1, pUAVNULL, nullptr);
+}
+
+ShaderDescription MultigridResidualShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+	shaderDescription.computeShaderDesc.shaderFunctionName = "MultigridResidualComputeShader";
+
+	return shaderDescription;
+}
+///////MULTIGRID RESIDUAL SHADER END////////
+
+///////RED BLACK SOR SHADER BEGIN////////
+RedBlackSORShader::RedBlackSORShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+
+}
+
+RedBlackSORShader::~RedBlackSORShader() {
+
+}
+
+void RedBlackSORShader::Compute(_In_ ID3D11DeviceContext* context, const Vector3 &levelDimensions, _In_ ShaderParams* rightHandSide, _In_ ShaderParams* levelObstacles, _In_ ShaderParams* pressureInPlace) {
+	// Set the parameters inside the compute shader
+	ID3D11ShaderResourceView *const pSRV[3] = {rightHandSide->mSRV, nullptr, levelObstacles->mSRV};
+	context->CSSetShaderResources(0, 3, pSRV);
+	context->CSSetUnorderedAccessViews(0, 1, &(pressureInPlace->mUAV.p), nullptr);
+
+	// only half of the cells in every row have the requested colour
+	Dispatch(context, Vector3(ceil(levelDimensions.x * 0.5f), levelDimensions.y, levelDimensions.z));
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[3] = {nullptr, nullptr, nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[1] = {nullptr};
+
+	context->CSSetShaderResources(0, 3, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 1, pUAVNULL, nullptr);
+}
+
+ShaderDescription RedBlackSORShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+	shaderDescription.computeShaderDesc.shaderFunctionName = "RedBlackSORComputeShader";
+
+	return shaderDescription;
+}
+///////RED BLACK SOR SHADER END////////
+
+///////MULTIGRID RESTRICT SHADER BEGIN////////
+MultigridRestrictShader::MultigridRestrictShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+
+}
+
+MultigridRestrictShader::~MultigridRestrictShader() {
+
+}
+
+void MultigridRestrictShader::Compute(_In_ ID3D11DeviceContext* context, const Vector3 &coarseDimensions, _In_ ShaderParams* fineResidual, _In_ ShaderParams* coarseObstacles, _In_ ShaderParams* coarseRightHandSide) {
+	// Set the parameters inside the compute shader
+	ID3D11ShaderResourceView *const pSRV[3] = {fineResidual->mSRV, nullptr, coarseObstacles->mSRV};
+	context->CSSetShaderResources(0, 3, pSRV);
+	context->CSSetUnorderedAccessViews(0, 1, &(coarseRightHandSide->mUAV.p), nullptr);
+
+	Dispatch(context, coarseDimensions);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[3] = {nullptr, nullptr, nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[1] = {nullptr};
+
+	context->CSSetShaderResources(0, 3, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 1, pUAVNULL, nullptr);
+}
+
+ShaderDescription MultigridRestrictShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+	shaderDescription.computeShaderDesc.shaderFunctionName = "MultigridRestrictComputeShader";
+
+	return shaderDescription;
+}
+///////MULTIGRID RESTRICT SHADER END////////
+
+///////MULTIGRID PROLONG SHADER BEGIN////////
+MultigridProlongShader::MultigridProlongShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+
+}
+
+MultigridProlongShader::~MultigridProlongShader() {
+
+}
+
+void MultigridProlongShader::Compute(_In_ ID3D11DeviceContext* context, const Vector3 &fineDimensions, _In_ ShaderParams* coarseCorrection, _In_ ShaderParams* fineObstacles, _In_ ShaderParams* finePressure) {
+	// Set the parameters inside the compute shader
+	ID3D11ShaderResourceView *const pSRV[3] = {coarseCorrection->mSRV, nullptr, fineObstacles->mSRV};
+	context->CSSetShaderResources(0, 3, pSRV);
+	context->CSSetUnorderedAccessViews(0, 1, &(finePressure->mUAV.p), nullptr);
+
+	Dispatch(context, fineDimensions);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[3] = {nullptr, nullptr, nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[1] = {nullptr};
+
+	context->CSSetShaderResources(0, 3, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 1, pUAVNULL, nullptr);
+}
+
+ShaderDescription MultigridProlongShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+	shaderDescription.computeShaderDesc.shaderFunctionName = "MultigridProlongComputeShader";
+
+	return shaderDescription;
+}
+///////MULTIGRID PROLONG SHADER END////////
+
+///////MULTIGRID RESTRICT OBSTACLES SHADER BEGIN////////
+MultigridRestrictObstaclesShader::MultigridRestrictObstaclesShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+
+}
+
+MultigridRestrictObstaclesShader::~MultigridRestrictObstaclesShader() {
+
+}
+
+void MultigridRestrictObstaclesShader::Compute(_In_ ID3D11DeviceContext* context, const Vector3 &coarseDimensions, _In_ ShaderParams* fineObstacles, _In_ ShaderParams* coarseObstaclesResult) {
+	// Set the parameters inside the compute shader
+	context->CSSetShaderResources(0, 1, &(fineObstacles->mSRV.p));
+	context->CSSetUnorderedAccessViews(0, 1, &(coarseObstaclesResult->mUAV.p), nullptr);
+
+	Dispatch(context, coarseDimensions);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[1] = {nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[1] = {nullptr};
+
+	context->CSSetShaderResources(0, 1, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 1, pUAVNULL, nullptr);
+}
+
+ShaderDescription MultigridRestrictObstaclesShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+	shaderDescription.computeShaderDesc.shaderFunctionName = "MultigridRestrictObstaclesComputeShader";
+
+	return shaderDescription;
+}
+///////MULTIGRID RESTRICT OBSTACLES SHADER END////////
+
+///////RESIDUAL REDUCTION SHADER BEGIN////////
+ResidualReductionShader::ResidualReductionShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+
+}
+
+ResidualReductionShader::~ResidualReductionShader() {
+
+}
+
+void ResidualReductionShader::Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* residual, _In_ ShaderParams* residualSums) {
+	// Set the parameters inside the compute shader
+	context->CSSetShaderResources(0, 1, &(residual->mSRV.p));
+	context->CSSetUnorderedAccessViews(0, 1, &(residualSums->mUAV.p), nullptr);
 
 	Dispatch(context);
 
 	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[1] = {nullptr};
 	ID3D11UnorderedAccessView *const pUAVNULL[1] = {nullptr};
+
+	context->CSSetShaderResources(0, 1, pSRVNULL);
 	context->CSSetUnorderedAccessViews(0, 1, pUAVNULL, nullptr);
 }
 
-ShaderDescription ObstacleShader::GetShaderDescription() {
+ShaderDescription ResidualReductionShader::GetShaderDescription() {
 	ShaderDescription shaderDescription;
 
 	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
-	shaderDescription.computeShaderDesc.shaderFunctionName = "ObstaclesComputeShader";
+	shaderDescription.computeShaderDesc.shaderFunctionName = "ResidualReductionComputeShader";
+
+	return shaderDescription;
+}
+///////RESIDUAL REDUCTION SHADER END////////
+
+///////ACTIVITY REDUCTION SHADER BEGIN////////
+ActivityReductionShader::ActivityReductionShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+
+}
+
+ActivityReductionShader::~ActivityReductionShader() {
+
+}
+
+void ActivityReductionShader::Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* velocity, _In_ ShaderParams* temperature, _In_ ShaderParams* density,
+	_In_ ShaderParams* reaction, _In_ ShaderParams* activitySums)
+{
+	// Set the parameters inside the compute shader
+	ID3D11ShaderResourceView *const pSRV[4] = {velocity->mSRV, temperature->mSRV, density->mSRV, reaction ? reaction->mSRV : nullptr};
+	context->CSSetShaderResources(0, 4, pSRV);
+	context->CSSetUnorderedAccessViews(0, 1, &(activitySums->mUAV.p), nullptr);
+
+	Dispatch(context);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[4] = {nullptr, nullptr, nullptr, nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[1] = {nullptr};
+
+	context->CSSetShaderResources(0, 4, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 1, pUAVNULL, nullptr);
+}
+
+ShaderDescription ActivityReductionShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+	shaderDescription.computeShaderDesc.shaderFunctionName = "ActivityReductionComputeShader";
+
+	return shaderDescription;
+}
+///////ACTIVITY REDUCTION SHADER END////////
+
+///////PCG LAPLACIAN SHADER BEGIN////////
+PCGLaplacianShader::PCGLaplacianShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+
+}
+
+PCGLaplacianShader::~PCGLaplacianShader() {
+
+}
+
+void PCGLaplacianShader::Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* direction, _In_ ShaderParams* obstacles, _In_ ShaderParams* result) {
+	// Set the parameters inside the compute shader
+	ID3D11ShaderResourceView *const pSRV[3] = {nullptr, direction->mSRV, obstacles->mSRV};
+	context->CSSetShaderResources(0, 3, pSRV);
+	context->CSSetUnorderedAccessViews(0, 1, &(result->mUAV.p), nullptr);
+
+	Dispatch(context);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[3] = {nullptr, nullptr, nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[1] = {nullptr};
+
+	context->CSSetShaderResources(0, 3, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 1, pUAVNULL, nullptr);
+}
+
+ShaderDescription PCGLaplacianShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+	shaderDescription.computeShaderDesc.shaderFunctionName = "PCGLaplacianComputeShader";
+
+	return shaderDescription;
+}
+///////PCG LAPLACIAN SHADER END////////
+
+///////PCG REDUCTION SHADER BEGIN////////
+PCGReductionShader::PCGReductionShader(PCGReductionType_t reductionType, Vector3 dimensions) 
+: BaseFluid3DShader(dimensions), mReductionType(reductionType) {
+
+}
+
+PCGReductionShader::~PCGReductionShader() {
+
+}
+
+void PCGReductionShader::Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* first, _In_ ShaderParams* second, _In_ ShaderParams* sums) {
+	// Set the parameters inside the compute shader
+	ID3D11ShaderResourceView *const pSRV[2] = {first->mSRV, second != nullptr ? second->mSRV : nullptr};
+	context->CSSetShaderResources(0, 2, pSRV);
+	context->CSSetUnorderedAccessViews(0, 1, &(sums->mUAV.p), nullptr);
+
+	Dispatch(context);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[2] = {nullptr, nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[1] = {nullptr};
+
+	context->CSSetShaderResources(0, 2, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 1, pUAVNULL, nullptr);
+}
+
+ShaderDescription PCGReductionShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+
+	switch (mReductionType) {
+	case PCG_REDUCTION_DOT_PRODUCT:
+		shaderDescription.computeShaderDesc.shaderFunctionName = "PCGDotProductComputeShader";
+		break;
+	case PCG_REDUCTION_RESIDUAL_SUM:
+		shaderDescription.computeShaderDesc.shaderFunctionName = "PCGResidualSumComputeShader";
+		break;
+	}
+
+	return shaderDescription;
+}
+///////PCG REDUCTION SHADER END////////
+
+///////PCG SCALARS SHADER BEGIN////////
+PCGScalarsShader::PCGScalarsShader(PCGScalarsType_t scalarsType, Vector3 dimensions) 
+: BaseFluid3DShader(dimensions), mScalarsType(scalarsType) {
+
+}
+
+PCGScalarsShader::~PCGScalarsShader() {
+
+}
+
+void PCGScalarsShader::Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* sums, _In_ ShaderParams* scalars) {
+	// Set the parameters inside the compute shader
+	context->CSSetShaderResources(0, 1, &(sums->mSRV.p));
+	context->CSSetUnorderedAccessViews(0, 1, &(scalars->mUAV.p), nullptr);
+
+	// a single thread group adds up all of the partial sums
+	SetComputeShader(context);
+	context->Dispatch(1, 1, 1);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[1] = {nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[1] = {nullptr};
+
+	context->CSSetShaderResources(0, 1, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 1, pUAVNULL, nullptr);
+}
+
+ShaderDescription PCGScalarsShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+
+	switch (mScalarsType) {
+	case PCG_SCALARS_ALPHA:
+		shaderDescription.computeShaderDesc.shaderFunctionName = "PCGComputeAlphaComputeShader";
+		break;
+	case PCG_SCALARS_BETA:
+		shaderDescription.computeShaderDesc.shaderFunctionName = "PCGComputeBetaComputeShader";
+		break;
+	case PCG_SCALARS_MEAN:
+		shaderDescription.computeShaderDesc.shaderFunctionName = "PCGComputeMeanComputeShader";
+		break;
+	}
+
+	return shaderDescription;
+}
+///////PCG SCALARS SHADER END////////
+
+///////PCG REMOVE MEAN SHADER BEGIN////////
+PCGRemoveMeanShader::PCGRemoveMeanShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+
+}
+
+PCGRemoveMeanShader::~PCGRemoveMeanShader() {
+
+}
+
+void PCGRemoveMeanShader::Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* scalars, _In_ ShaderParams* residualInPlace) {
+	// Set the parameters inside the compute shader
+	context->CSSetShaderResources(3, 1, &(scalars->mSRV.p));
+	context->CSSetUnorderedAccessViews(0, 1, &(residualInPlace->mUAV.p), nullptr);
+
+	Dispatch(context);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[1] = {nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[1] = {nullptr};
+
+	context->CSSetShaderResources(3, 1, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 1, pUAVNULL, nullptr);
+}
+
+ShaderDescription PCGRemoveMeanShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+	shaderDescription.computeShaderDesc.shaderFunctionName = "PCGRemoveMeanComputeShader";
+
+	return shaderDescription;
+}
+///////PCG REMOVE MEAN SHADER END////////
+
+///////PCG UPDATE SOLUTION SHADER BEGIN////////
+PCGUpdateSolutionShader::PCGUpdateSolutionShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+
+}
+
+PCGUpdateSolutionShader::~PCGUpdateSolutionShader() {
+
+}
+
+void PCGUpdateSolutionShader::Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* direction, _In_ ShaderParams* laplacian, _In_ ShaderParams* scalars,
+	_In_ ShaderParams* pressureInPlace, _In_ ShaderParams* residualInPlace) 
+{
+	// Set the parameters inside the compute shader
+	ID3D11ShaderResourceView *const pSRV[4] = {direction->mSRV, laplacian->mSRV, nullptr, scalars->mSRV};
+	ID3D11UnorderedAccessView *const pUAV[2] = {pressureInPlace->mUAV, residualInPlace->mUAV};
+	context->CSSetShaderResources(0, 4, pSRV);
+	context->CSSetUnorderedAccessViews(0, 2, pUAV, nullptr);
+
+	Dispatch(context);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[4] = {nullptr, nullptr, nullptr, nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[2] = {nullptr, nullptr};
+
+	context->CSSetShaderResources(0, 4, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 2, pUAVNULL, nullptr);
+}
+
+ShaderDescription PCGUpdateSolutionShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+	shaderDescription.computeShaderDesc.shaderFunctionName = "PCGUpdateSolutionComputeShader";
+
+	return shaderDescription;
+}
+///////PCG UPDATE SOLUTION SHADER END////////
+
+///////PCG UPDATE DIRECTION SHADER BEGIN////////
+PCGUpdateDirectionShader::PCGUpdateDirectionShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+
+}
+
+PCGUpdateDirectionShader::~PCGUpdateDirectionShader() {
+
+}
+
+void PCGUpdateDirectionShader::Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* preconditioned, _In_ ShaderParams* scalars, _In_ ShaderParams* directionInPlace) {
+	// Set the parameters inside the compute shader
+	ID3D11ShaderResourceView *const pSRV[4] = {nullptr, preconditioned->mSRV, nullptr, scalars->mSRV};
+	context->CSSetShaderResources(0, 4, pSRV);
+	context->CSSetUnorderedAccessViews(0, 1, &(directionInPlace->mUAV.p), nullptr);
+
+	Dispatch(context);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[4] = {nullptr, nullptr, nullptr, nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[1] = {nullptr};
+
+	context->CSSetShaderResources(0, 4, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 1, pUAVNULL, nullptr);
+}
+
+ShaderDescription PCGUpdateDirectionShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+	shaderDescription.computeShaderDesc.shaderFunctionName = "PCGUpdateDirectionComputeShader";
+
+	return shaderDescription;
+}
+///////PCG UPDATE DIRECTION SHADER END////////
+
+///////BUOYANCY IMPULSE SHADER BEGIN////////
+BuoyancyImpulseShader::BuoyancyImpulseShader(BuoyancyImpulseType_t buoyancyImpulseType, Vector3 dimensions, bool sparse) : BaseFluid3DShader(dimensions, sparse),
+	mBuoyancyImpulseType(buoyancyImpulseType)
+{
+
+}
+
+BuoyancyImpulseShader::~BuoyancyImpulseShader() {
+
+}
+
+void BuoyancyImpulseShader::Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* velocityField, _In_ ShaderParams* temperatureField, _In_ ShaderParams* densityField, _In_ ShaderParams* reactionField,
+	_In_ ShaderParams* velocityResult, _In_ ShaderParams* temperatureResult, _In_ ShaderParams* densityResult, _In_ ShaderParams* reactionResult)
+{
+	bool isFire = mBuoyancyImpulseType == BUOYANCY_IMPULSE_FIRE;
+
+	// Set the parameters inside the compute shader
+	ID3D11ShaderResourceView *const pSRV[4] = {velocityField->mSRV, temperatureField->mSRV, densityField->mSRV, isFire ? reactionField->mSRV : nullptr};
+	ID3D11UnorderedAccessView *const pUAV[4] = {velocityResult->mUAV, temperatureResult->mUAV, densityResult->mUAV, isFire ? reactionResult->mUAV : nullptr};
+	context->CSSetShaderResources(0, 4, pSRV);
+	context->CSSetUnorderedAccessViews(0, 4, pUAV, nullptr);
+
+	Dispatch(context);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[4] = {nullptr, nullptr, nullptr, nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[4] = {nullptr, nullptr, nullptr, nullptr};
+
+	context->CSSetShaderResources(0, 4, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 4, pUAVNULL, nullptr);
+}
+
+ShaderDescription BuoyancyImpulseShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+	switch (mBuoyancyImpulseType) {
+	case BUOYANCY_IMPULSE_SMOKE:
+		if (IsSparse()) {
+			shaderDescription.computeShaderDesc.shaderFunctionName = "BuoyancyImpulseSmokeSparseComputeShader";
+		}
+		else {
+			shaderDescription.computeShaderDesc.shaderFunctionName = "BuoyancyImpulseSmokeComputeShader";
+		}
+		break;
+	case BUOYANCY_IMPULSE_FIRE:
+		if (IsSparse()) {
+			shaderDescription.computeShaderDesc.shaderFunctionName = "BuoyancyImpulseFireSparseComputeShader";
+		}
+		else {
+			shaderDescription.computeShaderDesc.shaderFunctionName = "BuoyancyImpulseFireComputeShader";
+		}
+		break;
+	}
+
+	return shaderDescription;
+}
+///////BUOYANCY IMPULSE SHADER END////////
+
+///////CONFINEMENT DIVERGENCE SHADER BEGIN////////
+ConfinementDivergenceShader::ConfinementDivergenceShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+
+}
+
+ConfinementDivergenceShader::~ConfinementDivergenceShader() {
+
+}
+
+void ConfinementDivergenceShader::Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* velocityField, _In_ ShaderParams* vorticityField, _In_ ShaderParams* velocityResult, _In_ ShaderParams* divergenceResult) {
+	// Set the parameters inside the compute shader
+	ID3D11ShaderResourceView *const pSRV[2] = {velocityField->mSRV, vorticityField->mSRV};
+	ID3D11UnorderedAccessView *const pUAV[2] = {velocityResult->mUAV, divergenceResult->mUAV};
+	context->CSSetShaderResources(0, 2, pSRV);
+	context->CSSetUnorderedAccessViews(0, 2, pUAV, nullptr);
+
+	Dispatch(context);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[2] = {nullptr, nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[2] = {nullptr, nullptr};
+
+	context->CSSetShaderResources(0, 2, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 2, pUAVNULL, nullptr);
+}
+
+ShaderDescription ConfinementDivergenceShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+	shaderDescription.computeShaderDesc.shaderFunctionName = "ConfinementDivergenceComputeShader";
+
+	return shaderDescription;
+}
+///////CONFINEMENT DIVERGENCE SHADER END////////
+
+///////JACOBI SUBTRACT GRADIENT SHADER BEGIN////////
+JacobiSubtractGradientShader::JacobiSubtractGradientShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+
+}
+
+JacobiSubtractGradientShader::~JacobiSubtractGradientShader() {
+
+}
+
+void JacobiSubtractGradientShader::Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* velocityField, _In_ ShaderParams* pressureField, _In_ ShaderParams* divergence,
+	_In_ ShaderParams* velocityResult, _In_ ShaderParams* pressureResult)
+{
+	// Set the parameters inside the compute shader
+	ID3D11ShaderResourceView *const pSRV[3] = {velocityField->mSRV, pressureField->mSRV, divergence->mSRV};
+	ID3D11UnorderedAccessView *const pUAV[2] = {velocityResult->mUAV, pressureResult->mUAV};
+	context->CSSetShaderResources(0, 3, pSRV);
+	context->CSSetUnorderedAccessViews(0, 2, pUAV, nullptr);
+
+	Dispatch(context);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[3] = {nullptr, nullptr, nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[2] = {nullptr, nullptr};
+
+	context->CSSetShaderResources(0, 3, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 2, pUAVNULL, nullptr);
+}
+
+ShaderDescription JacobiSubtractGradientShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+	shaderDescription.computeShaderDesc.shaderFunctionName = "JacobiSubtractGradientComputeShader";
+
+	return shaderDescription;
+}
+///////JACOBI SUBTRACT GRADIENT SHADER END////////
+
+///////BRICK ACTIVITY SHADER BEGIN////////
+BrickActivityShader::BrickActivityShader(Vector3 dimensions) : BaseFluid3DShader(dimensions) {
+
+}
+
+BrickActivityShader::~BrickActivityShader() {
+
+}
+
+void BrickActivityShader::Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* velocityFields, _In_ ShaderParams* temperatureFields, _In_ ShaderParams* densityFields,
+	_In_ ShaderParams* reactionFields, _In_ ShaderParams* brickActivityResult)
+{
+	// Set the parameters inside the compute shader. The obstacles stay bound to slot 4, the brick list to slot 7 and the impulse sources to slot 10
+	ID3D11ShaderResourceView *const pSRV[4] = {velocityFields[0].mSRV, temperatureFields[0].mSRV, densityFields[0].mSRV, reactionFields ? reactionFields[0].mSRV : nullptr};
+	ID3D11ShaderResourceView *const pPreviousSRV[2] = {velocityFields[1].mSRV, temperatureFields[1].mSRV};
+	ID3D11ShaderResourceView *const pPreviousScalarSRV[2] = {densityFields[1].mSRV, reactionFields ? reactionFields[1].mSRV : nullptr};
+	context->CSSetShaderResources(0, 4, pSRV);
+	context->CSSetShaderResources(5, 2, pPreviousSRV);
+	context->CSSetShaderResources(8, 2, pPreviousScalarSRV);
+	context->CSSetUnorderedAccessViews(0, 1, &(brickActivityResult->mUAV.p), nullptr);
+
+	Dispatch(context);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[4] = {nullptr, nullptr, nullptr, nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[1] = {nullptr};
+
+	context->CSSetShaderResources(0, 4, pSRVNULL);
+	context->CSSetShaderResources(5, 2, pSRVNULL);
+	context->CSSetShaderResources(8, 2, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 1, pUAVNULL, nullptr);
+}
+
+ShaderDescription BrickActivityShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+	shaderDescription.computeShaderDesc.shaderFunctionName = "BrickActivityComputeShader";
+
+	return shaderDescription;
+}
+///////BRICK ACTIVITY SHADER END////////
+
+///////BRICK LIST SHADER BEGIN////////
+BrickListShader::BrickListShader(Vector3 dimensions) : BaseFluid3DShader(dimensions),
+	mBrickCount((float)GetBrickCount((int)dimensions.x), (float)GetBrickCount((int)dimensions.y), (float)GetBrickCount((int)dimensions.z))
+{
+
+}
+
+BrickListShader::~BrickListShader() {
+
+}
+
+void BrickListShader::Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* brickActivity, _In_ ShaderParams* brickLists) {
+	// Set the parameters inside the compute shader, the lists start out empty
+	ID3D11UnorderedAccessView *pUAV[BRICK_MAX_HALO + 1];
+	UINT initialCounts[BRICK_MAX_HALO + 1];
+	for (int i = 0; i <= BRICK_MAX_HALO; ++i) {
+		pUAV[i] = brickLists[i].mUAV;
+		initialCounts[i] = 0;
+	}
+	context->CSSetShaderResources(0, 1, &(brickActivity->mSRV.p));
+	context->CSSetUnorderedAccessViews(0, BRICK_MAX_HALO + 1, pUAV, initialCounts);
+
+	// one thread per brick
+	Dispatch(context, mBrickCount);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[1] = {nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[BRICK_MAX_HALO + 1] = {nullptr};
+
+	context->CSSetShaderResources(0, 1, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, BRICK_MAX_HALO + 1, pUAVNULL, nullptr);
+}
+
+void BrickListShader::SetDimensions(const Vector3 &dimensions) {
+	BaseFluid3DShader::SetDimensions(dimensions);
+	mBrickCount = Vector3((float)GetBrickCount((int)dimensions.x), (float)GetBrickCount((int)dimensions.y), (float)GetBrickCount((int)dimensions.z));
+}
+
+ShaderDescription BrickListShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+	shaderDescription.computeShaderDesc.shaderFunctionName = "BrickListComputeShader";
+
+	return shaderDescription;
+}
+///////BRICK LIST SHADER END////////
+
+///////RESAMPLE SHADER BEGIN////////
+ResampleShader::ResampleShader(ResampleType_t resampleType, Vector3 dimensions) 
+: BaseFluid3DShader(dimensions), mResampleType(resampleType) {
+
+}
+
+ResampleShader::~ResampleShader() {
+
+}
+
+void ResampleShader::Compute(_In_ ID3D11DeviceContext* context, const Vector3 &resultDimensions, _In_ ShaderParams* field, _In_ ShaderParams* result) {
+	// Set the parameters inside the compute shader
+	context->CSSetShaderResources(0, 1, &(field->mSRV.p));
+	context->CSSetUnorderedAccessViews(0, 1, &(result->mUAV.p), nullptr);
+
+	Dispatch(context, resultDimensions);
+
+	// To use for flushing shader parameters out of the shaders
+	ID3D11ShaderResourceView *const pSRVNULL[1] = {nullptr};
+	ID3D11UnorderedAccessView *const pUAVNULL[1] = {nullptr};
+
+	context->CSSetShaderResources(0, 1, pSRVNULL);
+	context->CSSetUnorderedAccessViews(0, 1, pUAVNULL, nullptr);
+}
+
+ShaderDescription ResampleShader::GetShaderDescription() {
+	ShaderDescription shaderDescription;
+
+	shaderDescription.computeShaderDesc.shaderFilename = L"hlsl/cFluid3D.hlsl";
+
+	switch (mResampleType) {
+	case RESAMPLE_RESTRICT_VECTOR:
+		shaderDescription.computeShaderDesc.shaderFunctionName = "RestrictVectorComputeShader";
+		break;
+	case RESAMPLE_RESTRICT_SCALAR:
+		shaderDescription.computeShaderDesc.shaderFunctionName = "RestrictScalarComputeShader";
+		break;
+	case RESAMPLE_PROLONG_VECTOR:
+		shaderDescription.computeShaderDesc.shaderFunctionName = "ProlongVectorComputeShader";
+		break;
+	case RESAMPLE_PROLONG_SCALAR:
+		shaderDescription.computeShaderDesc.shaderFunctionName = "ProlongScalarComputeShader";
+		break;
+	}
 
 	return shaderDescription;
 }
-///////OBSTACLE SHADER END////////
\ No newline at end of file
+///////RESAMPLE SHADER END////////
\ No newline at end of file
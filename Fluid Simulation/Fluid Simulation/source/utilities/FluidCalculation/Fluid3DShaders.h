@@ -10,6 +10,7 @@ Date: 09/11/2013
 
 #include "../../display/D3DShaders/BaseD3DShader.h"
 #include "../../display/D3DShaders/ShaderParams.h"
+#include "Fluid3DBricks.h"
 
 namespace Fluid3D {
 
@@ -17,13 +18,24 @@ class BaseFluid3DShader : public BaseD3DShader {
 public:
 	~BaseFluid3DShader();
 
+	// Sparse shaders run one thread group per brick of the list bound to slot 7. The group count is read from
+	// dispatchArgs at argsOffset, which must be set before every Compute that uses a different list
+	void SetBrickDispatch(_In_ ID3D11Buffer* dispatchArgs, UINT argsOffset);
+	bool IsSparse() const;
+	// Makes Dispatch cover a volume of these dimensions from now on
+	virtual void SetDimensions(const Vector3 &dimensions);
+
 protected:
-	BaseFluid3DShader(Vector3 dimensions);	// base class cannot be created
+	BaseFluid3DShader(Vector3 dimensions, bool sparse = false);	// base class cannot be created
 	void Dispatch(_In_ ID3D11DeviceContext* context) const;
+	// Dispatch enough thread groups to cover a volume other than the one given at construction
+	void Dispatch(_In_ ID3D11DeviceContext* context, const Vector3 &dimensions) const;
 
 private:
 	UINT mNumThreadGroupX, mNumThreadGroupY, mNumThreadGroupZ;
-	void SetDimensions(const Vector3 &dimensions);
+	bool mSparse;
+	ID3D11Buffer *pBrickDispatchArgs;
+	UINT mBrickDispatchArgsOffset;
 
 	ShaderDescription GetShaderDescription();
 };
@@ -36,7 +48,7 @@ public:
 	};
 
 public:
-	AdvectionShader(AdvectionShaderType_t advectionType, Vector3 dimensions);
+	AdvectionShader(AdvectionShaderType_t advectionType, Vector3 dimensions, bool sparse = false);
 	~AdvectionShader();
 
 	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* velocityField, _In_ ShaderParams* advectTarget, _In_ ShaderParams* advectResult);
@@ -49,12 +61,42 @@ private:
 };
 
 
-class ImpulseShader : public BaseFluid3DShader {
+// Advects the temperature, density and reaction fields in a single pass so the trace back through the velocity is
+// only done once. The three fields are passed as an array of three, the reaction one is left empty for smoke
+class ScalarAdvectionShader : public BaseFluid3DShader {
+public:
+	enum ScalarAdvectionShaderType_t {
+		SCALAR_ADVECTION_TYPE_NORMAL,
+		SCALAR_ADVECTION_TYPE_FORWARD,		// first step of MacCormack, writes the fields packed into packedFields[0]
+		SCALAR_ADVECTION_TYPE_MACCORMARCK	// reads the forward and backward packed fields from packedFields[0] and [1]
+	};
+
+public:
+	ScalarAdvectionShader(ScalarAdvectionShaderType_t advectionType, Vector3 dimensions, bool sparse = false);
+	~ScalarAdvectionShader();
+
+	// Reads the InputBufferScalarAdvection constant buffer, which must be bound to slot 5 by the caller
+	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* velocityField, _In_ ShaderParams* scalarFields, _In_ ShaderParams* packedFields, _In_ ShaderParams* scalarResults);
+
+private:
+	ShaderDescription GetShaderDescription();
+
+private:
+	ScalarAdvectionShaderType_t mAdvectionType;
+};
+
+
+// Adds every impulse source of the step at once. Reads the InputBufferInjection constant buffer from slot 4 and the sources
+// from slot 10, both bound by the caller. Only covers the injection region, which starts at its vInjectionRegionMin cell
+// and spans regionSize cells. Cells of the results outside of the region are left untouched. The reaction fields may be
+// nullptr when simulating smoke
+class ImpulseSourcesShader : public BaseFluid3DShader {
 public:
-	ImpulseShader(Vector3 dimensions);
-	~ImpulseShader();
+	ImpulseSourcesShader(Vector3 dimensions);
+	~ImpulseSourcesShader();
 
-	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* impulseInitial, _In_ ShaderParams* impulseResult);
+	void Compute(_In_ ID3D11DeviceContext* context, const Vector3 &regionSize, _In_ ShaderParams* velocityField, _In_ ShaderParams* temperatureField, _In_ ShaderParams* densityField,
+		_In_ ShaderParams* reactionField, _In_ ShaderParams* velocityResult, _In_ ShaderParams* temperatureResult, _In_ ShaderParams* densityResult, _In_ ShaderParams* reactionResult);
 
 private:
 	ShaderDescription GetShaderDescription();
@@ -63,7 +105,7 @@ private:
 
 class ExtinguishmentImpulseShader : public BaseFluid3DShader {
 public:
-	ExtinguishmentImpulseShader(Vector3 dimensions);
+	ExtinguishmentImpulseShader(Vector3 dimensions, bool sparse = false);
 	~ExtinguishmentImpulseShader();
 
 	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* reactionField, _In_ ShaderParams* impulseInitial, _In_ ShaderParams* impulseResult);
@@ -111,7 +153,7 @@ private:
 
 class BuoyancyShader : public BaseFluid3DShader {
 public:
-	BuoyancyShader(Vector3 dimensions);
+	BuoyancyShader(Vector3 dimensions, bool sparse = false);
 	~BuoyancyShader();
 
 	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* velocityField, _In_ ShaderParams* temperatureField, _In_ ShaderParams* density, _In_ ShaderParams* velocityResult);
@@ -147,12 +189,296 @@ public:
 	ObstacleShader(Vector3 dimensions);
 	~ObstacleShader();
 
-	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* obstacleResult);
+	// Voxelizes the cells from vObstacleRegionMin of the obstacles buffer onwards, regionSize holds how many along each axis
+	void Compute(_In_ ID3D11DeviceContext* context, const Vector3 &regionSize, _In_ ShaderParams* obstacleBoxes, _In_ ShaderParams* obstacleResult, _In_ ShaderParams* obstacleVelocityResult);
+
+private:
+	ShaderDescription GetShaderDescription();
+};
+
+// The multigrid shaders run on every level of the grid hierarchy, so the dimensions of
+// the level being processed are passed to Compute
+class MultigridResidualShader : public BaseFluid3DShader {
+public:
+	MultigridResidualShader(Vector3 dimensions);
+	~MultigridResidualShader();
+
+	void Compute(_In_ ID3D11DeviceContext* context, const Vector3 &levelDimensions, _In_ ShaderParams* pressureField, _In_ ShaderParams* rightHandSide, _In_ ShaderParams* levelObstacles, _In_ ShaderParams* result);
+
+private:
+	ShaderDescription GetShaderDescription();
+};
+
+// Updates the cells of one colour of the pressure field in place. The over-relaxation factor and the colour
+// are read from the InputBufferRedBlack constant buffer, which must be bound to slot 3 by the caller.
+// The pressure field must be R32_FLOAT as the shader loads from its UAV
+class RedBlackSORShader : public BaseFluid3DShader {
+public:
+	RedBlackSORShader(Vector3 dimensions);
+	~RedBlackSORShader();
+
+	void Compute(_In_ ID3D11DeviceContext* context, const Vector3 &levelDimensions, _In_ ShaderParams* rightHandSide, _In_ ShaderParams* levelObstacles, _In_ ShaderParams* pressureInPlace);
+
+private:
+	ShaderDescription GetShaderDescription();
+};
+
+class MultigridRestrictShader : public BaseFluid3DShader {
+public:
+	MultigridRestrictShader(Vector3 dimensions);
+	~MultigridRestrictShader();
+
+	void Compute(_In_ ID3D11DeviceContext* context, const Vector3 &coarseDimensions, _In_ ShaderParams* fineResidual, _In_ ShaderParams* coarseObstacles, _In_ ShaderParams* coarseRightHandSide);
+
+private:
+	ShaderDescription GetShaderDescription();
+};
+
+class MultigridProlongShader : public BaseFluid3DShader {
+public:
+	MultigridProlongShader(Vector3 dimensions);
+	~MultigridProlongShader();
+
+	// adds the interpolated coarse correction to finePressure in place, which must be R32_FLOAT
+	void Compute(_In_ ID3D11DeviceContext* context, const Vector3 &fineDimensions, _In_ ShaderParams* coarseCorrection, _In_ ShaderParams* fineObstacles, _In_ ShaderParams* finePressure);
 
 private:
 	ShaderDescription GetShaderDescription();
 };
 
+class MultigridRestrictObstaclesShader : public BaseFluid3DShader {
+public:
+	MultigridRestrictObstaclesShader(Vector3 dimensions);
+	~MultigridRestrictObstaclesShader();
+
+	void Compute(_In_ ID3D11DeviceContext* context, const Vector3 &coarseDimensions, _In_ ShaderParams* fineObstacles, _In_ ShaderParams* coarseObstaclesResult);
+
+private:
+	ShaderDescription GetShaderDescription();
+};
+
+class ResidualReductionShader : public BaseFluid3DShader {
+public:
+	ResidualReductionShader(Vector3 dimensions);
+	~ResidualReductionShader();
+
+	// Writes the sum of the squared residual of every thread group into residualSums
+	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* residual, _In_ ShaderParams* residualSums);
+
+private:
+	ShaderDescription GetShaderDescription();
+};
+
+class ActivityReductionShader : public BaseFluid3DShader {
+public:
+	ActivityReductionShader(Vector3 dimensions);
+	~ActivityReductionShader();
+
+	// Writes the largest density or reaction, temperature and squared speed of every thread group and its kinetic energy
+	// into activitySums. reaction is nullptr for smoke
+	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* velocity, _In_ ShaderParams* temperature, _In_ ShaderParams* density,
+		_In_ ShaderParams* reaction, _In_ ShaderParams* activitySums);
+
+private:
+	ShaderDescription GetShaderDescription();
+};
+
+// The conjugate gradient shaders work on the fine grid only. The scalars they share (step length, direction weight and
+// residual mean) stay in a structured buffer on the GPU, so a solve never waits on a read back
+class PCGLaplacianShader : public BaseFluid3DShader {
+public:
+	PCGLaplacianShader(Vector3 dimensions);
+	~PCGLaplacianShader();
+
+	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* direction, _In_ ShaderParams* obstacles, _In_ ShaderParams* result);
+
+private:
+	ShaderDescription GetShaderDescription();
+};
+
+class PCGReductionShader : public BaseFluid3DShader {
+public:
+	enum PCGReductionType_t {
+		PCG_REDUCTION_DOT_PRODUCT,	// first dot second
+		PCG_REDUCTION_RESIDUAL_SUM	// sum of first and the number of fluid cells, second is ignored
+	};
+
+public:
+	PCGReductionShader(PCGReductionType_t reductionType, Vector3 dimensions);
+	~PCGReductionShader();
+
+	// Writes the partial sums of every thread group into sums
+	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* first, _In_ ShaderParams* second, _In_ ShaderParams* sums);
+
+private:
+	ShaderDescription GetShaderDescription();
+
+private:
+	PCGReductionType_t mReductionType;
+};
+
+class PCGScalarsShader : public BaseFluid3DShader {
+public:
+	enum PCGScalarsType_t {
+		PCG_SCALARS_ALPHA,	// sums hold the direction dot its laplacian
+		PCG_SCALARS_BETA,	// sums hold the residual dot the preconditioned residual
+		PCG_SCALARS_MEAN	// sums hold the residual sum and fluid cell count
+	};
+
+public:
+	PCGScalarsShader(PCGScalarsType_t scalarsType, Vector3 dimensions);
+	~PCGScalarsShader();
+
+	// Adds up the partial sums with a single thread group and updates the matching entries of scalars
+	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* sums, _In_ ShaderParams* scalars);
+
+private:
+	ShaderDescription GetShaderDescription();
+
+private:
+	PCGScalarsType_t mScalarsType;
+};
+
+class PCGRemoveMeanShader : public BaseFluid3DShader {
+public:
+	PCGRemoveMeanShader(Vector3 dimensions);
+	~PCGRemoveMeanShader();
+
+	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* scalars, _In_ ShaderParams* residualInPlace);
+
+private:
+	ShaderDescription GetShaderDescription();
+};
+
+class PCGUpdateSolutionShader : public BaseFluid3DShader {
+public:
+	PCGUpdateSolutionShader(Vector3 dimensions);
+	~PCGUpdateSolutionShader();
+
+	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* direction, _In_ ShaderParams* laplacian, _In_ ShaderParams* scalars,
+		_In_ ShaderParams* pressureInPlace, _In_ ShaderParams* residualInPlace);
+
+private:
+	ShaderDescription GetShaderDescription();
+};
+
+class PCGUpdateDirectionShader : public BaseFluid3DShader {
+public:
+	PCGUpdateDirectionShader(Vector3 dimensions);
+	~PCGUpdateDirectionShader();
+
+	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* preconditioned, _In_ ShaderParams* scalars, _In_ ShaderParams* directionInPlace);
+
+private:
+	ShaderDescription GetShaderDescription();
+};
+
+// The fused shaders each do the work of two or more of the shaders above in a single pass, so the volumes in between
+// never go through memory. The tiled ones keep their group's cells plus a one cell border in shared memory
+class BuoyancyImpulseShader : public BaseFluid3DShader {
+public:
+	enum BuoyancyImpulseType_t {
+		BUOYANCY_IMPULSE_SMOKE,
+		BUOYANCY_IMPULSE_FIRE	// also updates the reaction field
+	};
+
+public:
+	BuoyancyImpulseShader(BuoyancyImpulseType_t buoyancyImpulseType, Vector3 dimensions, bool sparse = false);
+	~BuoyancyImpulseShader();
+
+	// Reads the InputBufferInjection constant buffer and the impulse sources, which must be bound to slot 4 and 10 by
+	// the caller. The reaction fields are ignored by the smoke version
+	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* velocityField, _In_ ShaderParams* temperatureField, _In_ ShaderParams* densityField, _In_ ShaderParams* reactionField,
+		_In_ ShaderParams* velocityResult, _In_ ShaderParams* temperatureResult, _In_ ShaderParams* densityResult, _In_ ShaderParams* reactionResult);
+
+private:
+	ShaderDescription GetShaderDescription();
+
+private:
+	BuoyancyImpulseType_t mBuoyancyImpulseType;
+};
+
+class ConfinementDivergenceShader : public BaseFluid3DShader {
+public:
+	ConfinementDivergenceShader(Vector3 dimensions);
+	~ConfinementDivergenceShader();
+
+	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* velocityField, _In_ ShaderParams* vorticityField, _In_ ShaderParams* velocityResult, _In_ ShaderParams* divergenceResult);
+
+private:
+	ShaderDescription GetShaderDescription();
+};
+
+class JacobiSubtractGradientShader : public BaseFluid3DShader {
+public:
+	JacobiSubtractGradientShader(Vector3 dimensions);
+	~JacobiSubtractGradientShader();
+
+	// pressureResult receives the pressure after the Jacobi iteration
+	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* velocityField, _In_ ShaderParams* pressureField, _In_ ShaderParams* divergence,
+		_In_ ShaderParams* velocityResult, _In_ ShaderParams* pressureResult);
+
+private:
+	ShaderDescription GetShaderDescription();
+};
+
+// Flags the bricks that hold fluid or that an impulse source adds to. Reads the InputBufferBricks and InputBufferInjection
+// constant buffers and the impulse sources, which must be bound to slot 6, 4 and 10 by the caller. The fields are passed
+// as arrays of their two buffers, reactionFields is ignored for smoke
+class BrickActivityShader : public BaseFluid3DShader {
+public:
+	BrickActivityShader(Vector3 dimensions);
+	~BrickActivityShader();
+
+	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* velocityFields, _In_ ShaderParams* temperatureFields, _In_ ShaderParams* densityFields,
+		_In_ ShaderParams* reactionFields, _In_ ShaderParams* brickActivityResult);
+
+private:
+	ShaderDescription GetShaderDescription();
+};
+
+// Fills the lists of bricks within 0 to BRICK_MAX_HALO bricks of an active one, brickLists holds BRICK_MAX_HALO + 1
+// append buffers. Reads the InputBufferBricks constant buffer, which must be bound to slot 6 by the caller
+class BrickListShader : public BaseFluid3DShader {
+public:
+	BrickListShader(Vector3 dimensions);
+	~BrickListShader();
+
+	void Compute(_In_ ID3D11DeviceContext* context, _In_ ShaderParams* brickActivity, _In_ ShaderParams* brickLists);
+	void SetDimensions(const Vector3 &dimensions);
+
+private:
+	ShaderDescription GetShaderDescription();
+
+private:
+	Vector3 mBrickCount;
+};
+
+// Moves a field onto the grid of another resolution tier, keeping the total of the field. Restricting averages the fine
+// cells under every coarse cell and prolonging interpolates the coarse cells, corrected so the fine cells under every
+// coarse cell average to it again. Reads the InputBufferResample constant buffer, which must be bound to slot 8 by the caller
+class ResampleShader : public BaseFluid3DShader {
+public:
+	enum ResampleType_t {
+		RESAMPLE_RESTRICT_VECTOR,
+		RESAMPLE_RESTRICT_SCALAR,
+		RESAMPLE_PROLONG_VECTOR,
+		RESAMPLE_PROLONG_SCALAR
+	};
+
+public:
+	ResampleShader(ResampleType_t resampleType, Vector3 dimensions);
+	~ResampleShader();
+
+	void Compute(_In_ ID3D11DeviceContext* context, const Vector3 &resultDimensions, _In_ ShaderParams* field, _In_ ShaderParams* result);
+
+private:
+	ShaderDescription GetShaderDescription();
+
+private:
+	ResampleType_t mResampleType;
+};
+
 }// End namespace Fluid3D
 
 #endif
\ No newline at end of file
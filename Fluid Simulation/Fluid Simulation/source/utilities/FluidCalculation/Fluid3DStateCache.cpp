@@ -0,0 +1,239 @@
+/********************************************************************
+Fluid3DStateCache.cpp: Implementation of the fluid state files
+
+Author:	Valentin Hinov
+Date: 11/5/2014
+*********************************************************************/
+
+#include "Fluid3DStateCache.h"
+#include <fstream>
+#include <string.h>
+#include "../AtlInclude.h"
+#include "../../display/D3DShaders/ShaderParams.h"
+
+using namespace std;
+using namespace Fluid3D;
+
+namespace {
+	const char stateMagic[4] = {'F', 'L', 'S', 'T'};
+
+	struct StateHeader {
+		char magic[4];
+		unsigned int version;
+		unsigned int settingsSize;	// sizeof(FluidSettings) when the file was saved
+		unsigned int dimensions[3];
+		unsigned int numFields;
+		unsigned int fieldFormats[MAX_FLUID_STATE_FIELDS];	// DXGI_FORMAT of every field
+	};
+
+	// 0 for the formats a state cannot hold
+	unsigned int GetBytesPerCell(unsigned int format) {
+		switch (format) {
+		case DXGI_FORMAT_R16G16B16A16_FLOAT:
+			return 8;
+		case DXGI_FORMAT_R32_FLOAT:
+			return 4;
+		case DXGI_FORMAT_R16_FLOAT:
+			return 2;
+		default:
+			return 0;
+		}
+	}
+
+	size_t GetFieldSize(const StateHeader &header, unsigned int format) {
+		return (size_t)header.dimensions[0] * header.dimensions[1] * header.dimensions[2] * GetBytesPerCell(format);
+	}
+
+	CComPtr<ID3D11Texture3D> GetFieldTexture(ShaderParams *field) {
+		CComPtr<ID3D11Resource> resource;
+		CComPtr<ID3D11Texture3D> texture;
+		field->mUAV->GetResource(&resource);
+		resource->QueryInterface(__uuidof(ID3D11Texture3D), reinterpret_cast<void**>(&texture));
+		return texture;
+	}
+
+	bool MatchesHeader(const D3D11_TEXTURE3D_DESC &textureDesc, const StateHeader &header, unsigned int format) {
+		return textureDesc.Width == header.dimensions[0] && textureDesc.Height == header.dimensions[1] && textureDesc.Depth == header.dimensions[2]
+			&& textureDesc.Format == format;
+	}
+}
+
+bool Fluid3D::SaveFluidState(const std::wstring &path, const FluidSettings &settings, const std::vector<ShaderParams*> &fields, ID3D11Device *device,
+	ID3D11DeviceContext *context)
+{
+	if (fields.size() > MAX_FLUID_STATE_FIELDS) {
+		return false;
+	}
+
+	StateHeader header;
+	ZeroMemory(&header, sizeof(StateHeader));
+	memcpy(header.magic, stateMagic, sizeof(stateMagic));
+	header.version = FLUID_STATE_VERSION;
+	header.settingsSize = sizeof(FluidSettings);
+	header.dimensions[0] = (unsigned int)settings.dimensions.x;
+	header.dimensions[1] = (unsigned int)settings.dimensions.y;
+	header.dimensions[2] = (unsigned int)settings.dimensions.z;
+	header.numFields = (unsigned int)fields.size();
+
+	// copy every field out to the CPU before anything is written, so a field that cannot be saved leaves no file behind
+	vector<CComPtr<ID3D11Texture3D>> stagingTextures(fields.size());
+	for (size_t i = 0; i < fields.size(); ++i) {
+		CComPtr<ID3D11Texture3D> texture = GetFieldTexture(fields[i]);
+		if (texture == nullptr) {
+			return false;
+		}
+
+		D3D11_TEXTURE3D_DESC textureDesc;
+		texture->GetDesc(&textureDesc);
+		header.fieldFormats[i] = textureDesc.Format;
+		if (GetBytesPerCell(textureDesc.Format) == 0 || !MatchesHeader(textureDesc, header, textureDesc.Format)) {
+			return false;
+		}
+
+		textureDesc.Usage = D3D11_USAGE_STAGING;
+		textureDesc.BindFlags = 0;
+		textureDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		textureDesc.MiscFlags = 0;
+		HRESULT hr = device->CreateTexture3D(&textureDesc, NULL, &stagingTextures[i]);
+		if (FAILED(hr)) {
+			return false;
+		}
+		context->CopyResource(stagingTextures[i], texture);
+	}
+
+	ofstream fout(path.c_str(), ios::out | ios::binary | ios::trunc);
+	if (!fout) {
+		return false;
+	}
+	fout.write((const char*)&header, sizeof(StateHeader));
+	fout.write((const char*)&settings, sizeof(FluidSettings));
+
+	// the rows of the mapped textures are padded, the file keeps them packed
+	for (size_t i = 0; i < stagingTextures.size(); ++i) {
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		HRESULT result = context->Map(stagingTextures[i], 0, D3D11_MAP_READ, 0, &mappedResource);
+		if(FAILED(result)) {
+			throw std::runtime_error(std::string("Fluid3DStateCache: failed to map texture in SaveFluidState function"));
+		}
+
+		const char *data = (const char*)mappedResource.pData;
+		size_t rowBytes = header.dimensions[0] * GetBytesPerCell(header.fieldFormats[i]);
+		for (unsigned int z = 0; z < header.dimensions[2]; ++z) {
+			for (unsigned int y = 0; y < header.dimensions[1]; ++y) {
+				fout.write(data + z * mappedResource.DepthPitch + y * mappedResource.RowPitch, rowBytes);
+			}
+		}
+
+		context->Unmap(stagingTextures[i], 0);
+	}
+
+	return fout.good();
+}
+
+MappedFluidState::MappedFluidState() : mFile(INVALID_HANDLE_VALUE), mMapping(nullptr), mView(nullptr) {
+
+}
+
+MappedFluidState::~MappedFluidState() {
+	Close();
+}
+
+bool MappedFluidState::Open(const std::wstring &path) {
+	Close();
+
+	mFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (mFile == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart < (LONGLONG)(sizeof(StateHeader) + sizeof(FluidSettings))) {
+		Close();
+		return false;
+	}
+
+	mMapping = CreateFileMappingW(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mMapping == nullptr) {
+		Close();
+		return false;
+	}
+	mView = (const char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+	if (mView == nullptr) {
+		Close();
+		return false;
+	}
+
+	const StateHeader &header = *(const StateHeader*)mView;
+	if (memcmp(header.magic, stateMagic, sizeof(stateMagic)) != 0 || header.version != FLUID_STATE_VERSION
+		|| header.settingsSize != sizeof(FluidSettings) || header.numFields > MAX_FLUID_STATE_FIELDS)
+	{
+		Close();
+		return false;
+	}
+
+	LONGLONG expectedSize = sizeof(StateHeader) + sizeof(FluidSettings);
+	for (unsigned int i = 0; i < header.numFields; ++i) {
+		if (GetBytesPerCell(header.fieldFormats[i]) == 0) {
+			Close();
+			return false;
+		}
+		expectedSize += GetFieldSize(header, header.fieldFormats[i]);
+	}
+	if (fileSize.QuadPart != expectedSize) {
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFluidState::Close() {
+	if (mView != nullptr) {
+		UnmapViewOfFile(mView);
+		mView = nullptr;
+	}
+	if (mMapping != nullptr) {
+		CloseHandle(mMapping);
+		mMapping = nullptr;
+	}
+	if (mFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(mFile);
+		mFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+const FluidSettings &MappedFluidState::GetSettings() const {
+	return *(const FluidSettings*)(mView + sizeof(StateHeader));
+}
+
+bool MappedFluidState::Upload(const std::vector<ShaderParams*> &fields, ID3D11DeviceContext *context) const {
+	const StateHeader &header = *(const StateHeader*)mView;
+	if (fields.size() != header.numFields) {
+		return false;
+	}
+
+	vector<CComPtr<ID3D11Texture3D>> textures(fields.size());
+	for (size_t i = 0; i < fields.size(); ++i) {
+		textures[i] = GetFieldTexture(fields[i]);
+		if (textures[i] == nullptr) {
+			return false;
+		}
+
+		D3D11_TEXTURE3D_DESC textureDesc;
+		textures[i]->GetDesc(&textureDesc);
+		if (!MatchesHeader(textureDesc, header, header.fieldFormats[i])) {
+			return false;
+		}
+	}
+
+	// every field goes up straight from the mapped file
+	const char *data = mView + sizeof(StateHeader) + sizeof(FluidSettings);
+	for (size_t i = 0; i < textures.size(); ++i) {
+		UINT rowPitch = header.dimensions[0] * GetBytesPerCell(header.fieldFormats[i]);
+		UINT depthPitch = rowPitch * header.dimensions[1];
+		context->UpdateSubresource(textures[i], 0, nullptr, data, rowPitch, depthPitch);
+		data += GetFieldSize(header, header.fieldFormats[i]);
+	}
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+/********************************************************************
+Fluid3DStateCache.h: Saves the state of a developed 3D fluid to a
+binary file and loads new fluids from it, so they start out mature
+instead of having to be stepped until they develop.
+
+A state file holds a header, the settings of the fluid and then its
+fields one after the other, every cell of a field packed tightly in
+the format of its texture. Loading maps the file into memory and
+uploads every field straight from the mapped view.
+
+Author:	Valentin Hinov
+Date: 11/5/2014
+*********************************************************************/
+
+#ifndef _FLUID3DSTATECACHE_H
+#define _FLUID3DSTATECACHE_H
+
+#include <string>
+#include <vector>
+#include "../D3dIncludes.h"
+#include "FluidSettings.h"
+
+struct ShaderParams;
+
+// Bumped whenever the layout of a state file or of FluidSettings changes
+#define FLUID_STATE_VERSION 1
+// Fields a state file can hold
+#define MAX_FLUID_STATE_FIELDS 8
+
+namespace Fluid3D {
+
+// Reads the fields back from the GPU and writes them to a state file along with the settings. The fields must all have
+// the dimensions of the settings. Waits on the GPU, so it is not meant to run every frame
+bool SaveFluidState(const std::wstring &path, const FluidSettings &settings, const std::vector<ShaderParams*> &fields, ID3D11Device *device,
+	ID3D11DeviceContext *context);
+
+// A state file mapped into memory
+class MappedFluidState {
+public:
+	MappedFluidState();
+	~MappedFluidState();
+
+	// Returns false if the file is missing, was saved by another version or does not hold as much as its header says
+	bool Open(const std::wstring &path);
+	void Close();
+
+	const FluidSettings &GetSettings() const;
+	// Uploads the fields to textures of the same dimensions and formats, in the order they were saved in. Returns false
+	// and uploads nothing if the textures do not match
+	bool Upload(const std::vector<ShaderParams*> &fields, ID3D11DeviceContext *context) const;
+
+private:
+	// not copyable, it owns the mapping
+	MappedFluidState(const MappedFluidState &);
+	MappedFluidState &operator=(const MappedFluidState &);
+
+private:
+	HANDLE mFile;
+	HANDLE mMapping;
+	const char *mView;	// the header, settings and fields, in that order
+};
+
+}
+
+#endif
\ No newline at end of file
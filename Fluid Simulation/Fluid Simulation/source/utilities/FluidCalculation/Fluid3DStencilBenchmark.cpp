@@ -0,0 +1,415 @@
+/********************************************************************
+Fluid3DStencilBenchmark.cpp: Implementation of the stencil benchmark
+
+Author:	Valentin Hinov
+Date: 11/5/2014
+*********************************************************************/
+
+#include "Fluid3DStencilBenchmark.h"
+#include <stdio.h>
+#include <cmath>
+#include <windows.h>
+#include "Fluid3DCPUFields.h"
+#include "Fluid3DCPUKernels.h"
+#include "Fluid3DCPUStencils.h"
+
+using namespace std;
+using namespace Fluid3D;
+
+// Floating point operations of a Jacobi cell update - five additions, a subtraction and a division
+#define JACOBI_FLOPS_PER_CELL 7
+// Bytes a pass over the volume moves per cell when the pressure, divergence and obstacle flags are read and the new
+// pressure written once
+#define JACOBI_BYTES_PER_CELL (3 * sizeof(float) + sizeof(unsigned char))
+
+namespace {
+	// Seconds a single run of function takes, averaged over repetitions runs
+	template<typename Function>
+	double TimeRuns(int repetitions, const Function &function) {
+		LARGE_INTEGER frequency, start, end;
+		QueryPerformanceFrequency(&frequency);
+
+		// the first run warms up the caches and the thread pool
+		function();
+
+		QueryPerformanceCounter(&start);
+		for (int i = 0; i < repetitions; ++i) {
+			function();
+		}
+		QueryPerformanceCounter(&end);
+
+		return (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart / repetitions;
+	}
+
+	// Runs every slice of a stencil through one of the traversals
+	template<bool GhostBorder, typename CellFunction>
+	void RunStencil(int width, int height, int depth, const CellFunction &cellFunction) {
+		ParallelForSlices(depth, [&](int z) {
+			if (GhostBorder) {
+				ForEachStencilCell(z, width, height, depth, cellFunction);
+			}
+			else {
+				ForEachClampedStencilCell(z, width, height, depth, cellFunction);
+			}
+		});
+	}
+
+	// Cells per second of repetitions runs of a stencil
+	template<bool GhostBorder, typename CellFunction>
+	double TimeStencil(int width, int height, int depth, int repetitions, const CellFunction &cellFunction) {
+		double seconds = TimeRuns(repetitions, [&]() {
+			RunStencil<GhostBorder>(width, height, depth, cellFunction);
+		});
+		return seconds > 0.0 ? (double)width * height * depth / seconds : 0.0;
+	}
+
+	// Times a stencil writing a scalar field in both traversals and compares their results
+	template<typename StencilFunction>
+	StencilBenchmarkResult BenchmarkStencil(const char *name, int width, int height, int depth, int repetitions, const StencilFunction &stencil) {
+		ScalarField3D clampedResult(width, height, depth);
+		ScalarField3D ghostBorderResult(width, height, depth);
+
+		StencilBenchmarkResult result;
+		result.name = name;
+		result.clampedCellsPerSecond = TimeStencil<false>(width, height, depth, repetitions, [&](int x, int y, int index, const StencilNeighbours &n) {
+			clampedResult.values[index] = stencil(index, n);
+		});
+		result.ghostBorderCellsPerSecond = TimeStencil<true>(width, height, depth, repetitions, [&](int x, int y, int index, const StencilNeighbours &n) {
+			ghostBorderResult.values[index] = stencil(index, n);
+		});
+		result.maxDifference = MaxAbsDifference(clampedResult, ghostBorderResult);
+		return result;
+	}
+
+	// A repeatable pseudo random field in the [-0.5, 0.5] range
+	void FillRandom(ScalarField3D &field, unsigned int seed) {
+		for (size_t i = 0; i < field.values.size(); ++i) {
+			seed = seed * 1664525u + 1013904223u;
+			field.values[i] = (float)(seed >> 8) / (float)(1 << 24) - 0.5f;
+		}
+	}
+
+	// Walls around the volume and a solid block in the middle of it
+	void CreateObstacles(int width, int height, int depth, ObstacleField3D &obstacles) {
+		obstacles.Resize(width, height, depth);
+		CPUKernels::Obstacles(obstacles);
+		for (int z = depth/3; z < depth/2; ++z) {
+			for (int y = height/3; y < height/2; ++y) {
+				for (int x = width/3; x < width/2; ++x) {
+					obstacles.SetObstacleCell(x, y, z, true);
+				}
+			}
+		}
+	}
+
+	// Passes over the volume the blocked solve takes for a number of iterations
+	int GetBlockedPasses(int iterations) {
+		return (iterations + JACOBI_BLOCK_ITERATIONS - 1) / JACOBI_BLOCK_ITERATIONS;
+	}
+
+	// Calls cellFunction(x, y, z) for every cell in the storage order of a layout - row by row for the row-major one
+	template<typename CellFunction>
+	void ForEachCellInOrder(const ScalarField3D &field, const CellFunction &cellFunction) {
+		ParallelForSlices(field.depth, [&](int z) {
+			for (int y = 0; y < field.height; ++y) {
+				for (int x = 0; x < field.width; ++x) {
+					cellFunction(x, y, z);
+				}
+			}
+		});
+	}
+
+	// Brick by brick for the Morton one
+	template<typename CellFunction>
+	void ForEachCellInOrder(const MortonScalarField3D &field, const CellFunction &cellFunction) {
+		const int bricksX = GetBrickCount(field.width);
+		const int bricksY = GetBrickCount(field.height);
+		const int bricksZ = GetBrickCount(field.depth);
+		concurrency::parallel_for(0, bricksX * bricksY * bricksZ, [&](int brick) {
+			int xBegin = (brick % bricksX) * BRICK_SIZE;
+			int yBegin = (brick / bricksX % bricksY) * BRICK_SIZE;
+			int zBegin = (brick / (bricksX * bricksY)) * BRICK_SIZE;
+			int xEnd = Min(xBegin + BRICK_SIZE, field.width);
+			int yEnd = Min(yBegin + BRICK_SIZE, field.height);
+			int zEnd = Min(zBegin + BRICK_SIZE, field.depth);
+			for (int z = zBegin; z < zEnd; ++z) {
+				for (int y = yBegin; y < yEnd; ++y) {
+					for (int x = xBegin; x < xEnd; ++x) {
+						cellFunction(x, y, z);
+					}
+				}
+			}
+		});
+	}
+
+	// The kernels below are written once for both layouts, every cell goes through Index so only the layout differs
+
+	// Semi-Lagrangian advection of target, the same as AdvectComputeShader without dissipation
+	template<typename Field, typename VectorField>
+	void AdvectLayout(const VectorField &velocity, const Field &target, float timeStep, Field &result) {
+		ForEachCellInOrder(target, [&](int x, int y, int z) {
+			int index = target.Index(x, y, z);
+			Vector3 v = velocity.Get(index);
+			result.values[index] = target.Sample(x - timeStep * v.x, y - timeStep * v.y, z - timeStep * v.z);
+		});
+	}
+
+	// The MacCormack correction of AdvectMacCormackComputeShader - the trace back followed by the 8 corner gather of the
+	// forward step and the samples of all three steps
+	template<typename Field, typename VectorField>
+	void MacCormackLayout(const VectorField &velocity, const Field &forward, const Field &backward, const Field &original, float timeStep, Field &result) {
+		ForEachCellInOrder(original, [&](int x, int y, int z) {
+			int index = original.Index(x, y, z);
+			Vector3 v = velocity.Get(index);
+			float prevX = x - timeStep * v.x;
+			float prevY = y - timeStep * v.y;
+			float prevZ = z - timeStep * v.z;
+
+			int jx = prevX > 0.0f ? (int)prevX : 0;
+			int jy = prevY > 0.0f ? (int)prevY : 0;
+			int jz = prevZ > 0.0f ? (int)prevZ : 0;
+			float lmin = forward.Load(jx, jy, jz);
+			float lmax = lmin;
+			for (int corner = 1; corner < 8; ++corner) {
+				float value = forward.Load(jx + (corner & 1), jy + ((corner >> 1) & 1), jz + ((corner >> 2) & 1));
+				lmin = Min(lmin, value);
+				lmax = Max(lmax, value);
+			}
+
+			float s = forward.Sample(prevX, prevY, prevZ) + 0.5f * (original.Sample(prevX, prevY, prevZ) - backward.Sample(prevX, prevY, prevZ));
+			result.values[index] = Clamp(s, lmin, lmax);
+		});
+	}
+
+	// A Jacobi iteration of the pressure equation with clamped neighbours and no obstacles
+	template<typename Field>
+	void JacobiLayout(const Field &pressure, const Field &divergence, Field &result) {
+		const int width = pressure.width;
+		const int height = pressure.height;
+		const int depth = pressure.depth;
+		ForEachCellInOrder(pressure, [&](int x, int y, int z) {
+			float xT = pressure(x, Min(y+1, height-1), z);
+			float xB = pressure(x, Max(y-1, 0), z);
+			float xR = pressure(Min(x+1, width-1), y, z);
+			float xL = pressure(Max(x-1, 0), y, z);
+			float xU = pressure(x, y, Min(z+1, depth-1));
+			float xD = pressure(x, y, Max(z-1, 0));
+			result(x, y, z) = (xL + xR + xB + xT + xU + xD - divergence(x, y, z)) / 6.0f;
+		});
+	}
+
+	// Times a kernel on the row-major fields and on their Morton copies and compares the results
+	template<typename RowMajorKernel, typename MortonKernel>
+	LayoutBenchmarkResult BenchmarkLayoutKernel(const char *name, int repetitions, const Vector3 &dimensions, const RowMajorKernel &rowMajorKernel,
+		const MortonKernel &mortonKernel)
+	{
+		const int width = (int)dimensions.x;
+		const int height = (int)dimensions.y;
+		const int depth = (int)dimensions.z;
+		ScalarField3D rowMajorResult(width, height, depth);
+		MortonScalarField3D mortonResult(width, height, depth);
+
+		LayoutBenchmarkResult result;
+		result.name = name;
+		double rowMajorSeconds = TimeRuns(repetitions, [&]() {
+			rowMajorKernel(rowMajorResult);
+		});
+		double mortonSeconds = TimeRuns(repetitions, [&]() {
+			mortonKernel(mortonResult);
+		});
+
+		double cells = (double)width * height * depth;
+		result.rowMajorCellsPerSecond = rowMajorSeconds > 0.0 ? cells / rowMajorSeconds : 0.0;
+		result.mortonCellsPerSecond = mortonSeconds > 0.0 ? cells / mortonSeconds : 0.0;
+
+		ScalarField3D convertedResult;
+		FromMorton(mortonResult, convertedResult);
+		result.maxDifference = MaxAbsDifference(rowMajorResult, convertedResult);
+		return result;
+	}
+}
+
+vector<StencilBenchmarkResult> Fluid3D::BenchmarkStencils(const Vector3 &dimensions, int repetitions) {
+	const int width = (int)dimensions.x;
+	const int height = (int)dimensions.y;
+	const int depth = (int)dimensions.z;
+
+	ObstacleField3D obstacles;
+	CreateObstacles(width, height, depth, obstacles);
+
+	ScalarField3D pressure(width, height, depth);
+	ScalarField3D divergence(width, height, depth);
+	VectorField3D velocity;
+	velocity.Resize(width, height, depth);
+	FillRandom(pressure, 1);
+	FillRandom(divergence, 2);
+	FillRandom(velocity.x, 3);
+	FillRandom(velocity.y, 4);
+	FillRandom(velocity.z, 5);
+
+	vector<StencilBenchmarkResult> results;
+
+	// the bodies follow JacobiPressure, VelocityDivergence and CPUKernels::Vorticity
+	results.push_back(BenchmarkStencil("Jacobi", width, height, depth, repetitions, [&](int index, const StencilNeighbours &n) -> float {
+		float xC = pressure.values[index];
+		unsigned char flags = obstacles.flags[index];
+		float xT = (flags & OBSTACLE_T) ? xC : pressure.values[n.iT];
+		float xB = (flags & OBSTACLE_B) ? xC : pressure.values[n.iB];
+		float xR = (flags & OBSTACLE_R) ? xC : pressure.values[n.iR];
+		float xL = (flags & OBSTACLE_L) ? xC : pressure.values[n.iL];
+		float xU = (flags & OBSTACLE_U) ? xC : pressure.values[n.iU];
+		float xD = (flags & OBSTACLE_D) ? xC : pressure.values[n.iD];
+		return (xL + xR + xB + xT + xU + xD - divergence.values[index]) / 6.0f;
+	}));
+
+	results.push_back(BenchmarkStencil("Divergence", width, height, depth, repetitions, [&](int index, const StencilNeighbours &n) -> float {
+		unsigned char flags = obstacles.flags[index];
+		float vT = (flags & OBSTACLE_T) ? obstacles.velocity.y.values[n.iT] : velocity.y.values[n.iT];
+		float vB = (flags & OBSTACLE_B) ? obstacles.velocity.y.values[n.iB] : velocity.y.values[n.iB];
+		float vR = (flags & OBSTACLE_R) ? obstacles.velocity.x.values[n.iR] : velocity.x.values[n.iR];
+		float vL = (flags & OBSTACLE_L) ? obstacles.velocity.x.values[n.iL] : velocity.x.values[n.iL];
+		float vU = (flags & OBSTACLE_U) ? obstacles.velocity.z.values[n.iU] : velocity.z.values[n.iU];
+		float vD = (flags & OBSTACLE_D) ? obstacles.velocity.z.values[n.iD] : velocity.z.values[n.iD];
+		return 0.5f * (vR - vL + vT - vB + vU - vD);
+	}));
+
+	results.push_back(BenchmarkStencil("Vorticity", width, height, depth, repetitions, [&](int index, const StencilNeighbours &n) -> float {
+		Vector3 vT = velocity.Get(n.iT);
+		Vector3 vB = velocity.Get(n.iB);
+		Vector3 vR = velocity.Get(n.iR);
+		Vector3 vL = velocity.Get(n.iL);
+		Vector3 vU = velocity.Get(n.iU);
+		Vector3 vD = velocity.Get(n.iD);
+		Vector3 curl = 0.5f * Vector3( (( vT.z - vB.z ) - ( vU.y - vD.y )) ,
+									   (( vU.x - vD.x ) - ( vR.z - vL.z )) ,
+									   (( vR.y - vL.y ) - ( vT.x - vB.x )) );
+		return curl.Length();
+	}));
+
+	return results;
+}
+
+void Fluid3D::PrintStencilBenchmark(const Vector3 &dimensions, int repetitions) {
+	vector<StencilBenchmarkResult> results = BenchmarkStencils(dimensions, repetitions);
+
+	printf("Stencil throughput (%dx%dx%d, %d runs):\n", (int)dimensions.x, (int)dimensions.y, (int)dimensions.z, repetitions);
+	for (const StencilBenchmarkResult &result : results) {
+		double speedup = result.clampedCellsPerSecond > 0.0 ? result.ghostBorderCellsPerSecond / result.clampedCellsPerSecond : 0.0;
+		printf("  %-12s clamped %8.1f Mcells/s  ghost border %8.1f Mcells/s  speedup %.2fx  max difference %g\n", result.name,
+			result.clampedCellsPerSecond / 1e6, result.ghostBorderCellsPerSecond / 1e6, speedup, result.maxDifference);
+	}
+}
+
+JacobiBlockingResult Fluid3D::BenchmarkJacobiBlocking(const Vector3 &dimensions, int iterations, int repetitions) {
+	const int width = (int)dimensions.x;
+	const int height = (int)dimensions.y;
+	const int depth = (int)dimensions.z;
+
+	ObstacleField3D obstacles;
+	CreateObstacles(width, height, depth, obstacles);
+
+	ScalarField3D initialPressure(width, height, depth);
+	ScalarField3D divergence(width, height, depth);
+	FillRandom(initialPressure, 1);
+	FillRandom(divergence, 2);
+
+	ScalarField3D streamedPressure, blockedPressure;
+	ScalarField3D temp(width, height, depth);
+
+	// the same loops as Fluid3DCPUCalculator before and after the blocking
+	double streamedSeconds = TimeRuns(repetitions, [&]() {
+		streamedPressure = initialPressure;
+		for (int i = 0; i < iterations; ++i) {
+			CPUKernels::Jacobi(streamedPressure, divergence, obstacles, temp);
+			swap(streamedPressure, temp);
+		}
+	});
+	double blockedSeconds = TimeRuns(repetitions, [&]() {
+		blockedPressure = initialPressure;
+		for (int i = 0; i < iterations; i += JACOBI_BLOCK_ITERATIONS) {
+			CPUKernels::JacobiBlocked(blockedPressure, divergence, obstacles, Min(JACOBI_BLOCK_ITERATIONS, iterations - i), temp);
+			swap(blockedPressure, temp);
+		}
+	});
+
+	double cellUpdates = (double)width * height * depth * iterations;
+
+	JacobiBlockingResult result;
+	result.streamedCellUpdatesPerSecond = streamedSeconds > 0.0 ? cellUpdates / streamedSeconds : 0.0;
+	result.blockedCellUpdatesPerSecond = blockedSeconds > 0.0 ? cellUpdates / blockedSeconds : 0.0;
+	result.streamedBytesPerCellUpdate = (double)JACOBI_BYTES_PER_CELL;
+	result.blockedBytesPerCellUpdate = (double)JACOBI_BYTES_PER_CELL * GetBlockedPasses(iterations) / iterations;
+	result.maxDifference = MaxAbsDifference(streamedPressure, blockedPressure);
+	return result;
+}
+
+void Fluid3D::PrintJacobiBlockingBenchmark(const Vector3 &dimensions, int iterations, int repetitions) {
+	JacobiBlockingResult result = BenchmarkJacobiBlocking(dimensions, iterations, repetitions);
+
+	printf("Jacobi solve (%dx%dx%d, %d iterations, %d runs):\n", (int)dimensions.x, (int)dimensions.y, (int)dimensions.z, iterations, repetitions);
+
+	const char *names[2] = {"One pass per iteration", "Blocked"};
+	double updatesPerSecond[2] = {result.streamedCellUpdatesPerSecond, result.blockedCellUpdatesPerSecond};
+	double bytesPerUpdate[2] = {result.streamedBytesPerCellUpdate, result.blockedBytesPerCellUpdate};
+	for (int i = 0; i < 2; ++i) {
+		printf("  %-24s %8.1f Mupdates/s  %6.2f GFLOP/s  %5.2f bytes/update  %6.2f GB/s\n", names[i], updatesPerSecond[i] / 1e6,
+			updatesPerSecond[i] * JACOBI_FLOPS_PER_CELL / 1e9, bytesPerUpdate[i], updatesPerSecond[i] * bytesPerUpdate[i] / 1e9);
+	}
+
+	double speedup = result.streamedCellUpdatesPerSecond > 0.0 ? result.blockedCellUpdatesPerSecond / result.streamedCellUpdatesPerSecond : 0.0;
+	printf("  Speedup %.2fx, max difference %g\n", speedup, result.maxDifference);
+}
+
+vector<LayoutBenchmarkResult> Fluid3D::BenchmarkLayouts(const Vector3 &dimensions, float timeStep, int repetitions) {
+	const int width = (int)dimensions.x;
+	const int height = (int)dimensions.y;
+	const int depth = (int)dimensions.z;
+
+	// a smooth swirl that moves up to 10 cells per unit of time, so the trace backs stay coherent like in a real step
+	VectorField3D velocity;
+	velocity.Resize(width, height, depth);
+	for (int z = 0; z < depth; ++z) {
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				velocity.Set(velocity.x.Index(x, y, z), 10.0f * Vector3(sin(0.1f * y), sin(0.1f * z), sin(0.1f * x)));
+			}
+		}
+	}
+
+	ScalarField3D fields[3];
+	for (int i = 0; i < 3; ++i) {
+		fields[i].Resize(width, height, depth);
+		FillRandom(fields[i], i + 1);
+	}
+
+	MortonVectorField3D mortonVelocity;
+	MortonScalarField3D mortonFields[3];
+	ToMorton(velocity, mortonVelocity);
+	for (int i = 0; i < 3; ++i) {
+		ToMorton(fields[i], mortonFields[i]);
+	}
+
+	vector<LayoutBenchmarkResult> results;
+	results.push_back(BenchmarkLayoutKernel("Advection", repetitions, dimensions,
+		[&](ScalarField3D &result) { AdvectLayout(velocity, fields[0], timeStep, result); },
+		[&](MortonScalarField3D &result) { AdvectLayout(mortonVelocity, mortonFields[0], timeStep, result); }));
+	results.push_back(BenchmarkLayoutKernel("MacCormack", repetitions, dimensions,
+		[&](ScalarField3D &result) { MacCormackLayout(velocity, fields[0], fields[1], fields[2], timeStep, result); },
+		[&](MortonScalarField3D &result) { MacCormackLayout(mortonVelocity, mortonFields[0], mortonFields[1], mortonFields[2], timeStep, result); }));
+	results.push_back(BenchmarkLayoutKernel("Jacobi", repetitions, dimensions,
+		[&](ScalarField3D &result) { JacobiLayout(fields[0], fields[1], result); },
+		[&](MortonScalarField3D &result) { JacobiLayout(mortonFields[0], mortonFields[1], result); }));
+
+	return results;
+}
+
+void Fluid3D::PrintLayoutBenchmark(const Vector3 &dimensions, float timeStep, int repetitions) {
+	vector<LayoutBenchmarkResult> results = BenchmarkLayouts(dimensions, timeStep, repetitions);
+
+	printf("Field layouts (%dx%dx%d, %d runs):\n", (int)dimensions.x, (int)dimensions.y, (int)dimensions.z, repetitions);
+	for (const LayoutBenchmarkResult &result : results) {
+		double speedup = result.rowMajorCellsPerSecond > 0.0 ? result.mortonCellsPerSecond / result.rowMajorCellsPerSecond : 0.0;
+		printf("  %-12s row-major %8.1f Mcells/s  Morton %8.1f Mcells/s  speedup %.2fx  max difference %g\n", result.name,
+			result.rowMajorCellsPerSecond / 1e6, result.mortonCellsPerSecond / 1e6, speedup, result.maxDifference);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+/********************************************************************
+Fluid3DStencilBenchmark.h: Times the neighbour stencils of the CPU
+kernels with every cell clamping its neighbours against the time
+they take with the ghost border of Fluid3DCPUStencils.h, the
+Jacobi solver with and without temporal blocking, and the row-major
+fields against the Morton ordered ones
+
+Author:	Valentin Hinov
+Date: 11/5/2014
+*********************************************************************/
+
+#ifndef _FLUID3DSTENCILBENCHMARK_H
+#define _FLUID3DSTENCILBENCHMARK_H
+
+#include <vector>
+#include "../math/MathUtils.h"
+
+namespace Fluid3D {
+
+// Throughput of one stencil in both traversals
+struct StencilBenchmarkResult {
+	const char *name;
+	double clampedCellsPerSecond;
+	double ghostBorderCellsPerSecond;
+	float maxDifference;	// between the results of both traversals, anything but 0 is a bug
+};
+
+// Runs the Jacobi, divergence and vorticity stencils repetitions times over a volume with walls and a solid block in
+// both traversals
+std::vector<StencilBenchmarkResult> BenchmarkStencils(const Vector3 &dimensions, int repetitions);
+
+// Prints the results of BenchmarkStencils along with the speedup of the ghost border
+void PrintStencilBenchmark(const Vector3 &dimensions, int repetitions);
+
+// Throughput of a Jacobi pressure solve run one pass per iteration and with CPUKernels::JacobiBlocked. The bytes are the
+// volume traffic of the passes, assuming the slices a blocked pass keeps around stay in cache
+struct JacobiBlockingResult {
+	double streamedCellUpdatesPerSecond;
+	double blockedCellUpdatesPerSecond;
+	double streamedBytesPerCellUpdate;
+	double blockedBytesPerCellUpdate;
+	float maxDifference;	// between the pressures of both solves, anything but 0 is a bug
+};
+
+// Runs a solve of the given number of iterations repetitions times both ways over a volume with walls and a solid block
+JacobiBlockingResult BenchmarkJacobiBlocking(const Vector3 &dimensions, int iterations, int repetitions);
+
+// Prints the results of BenchmarkJacobiBlocking as cell updates, GFLOP/s, bytes per cell update and the bandwidth they add up to
+void PrintJacobiBlockingBenchmark(const Vector3 &dimensions, int iterations, int repetitions);
+
+// Throughput of one kernel on row-major fields and on Morton ordered ones
+struct LayoutBenchmarkResult {
+	const char *name;
+	double rowMajorCellsPerSecond;
+	double mortonCellsPerSecond;
+	float maxDifference;	// between the results of both layouts, anything but 0 is a bug
+};
+
+// Runs the advection, the MacCormack correction and a Jacobi iteration repetitions times on both layouts. Each kernel
+// is written once for both and walks the cells in the storage order of its layout
+std::vector<LayoutBenchmarkResult> BenchmarkLayouts(const Vector3 &dimensions, float timeStep, int repetitions);
+
+// Prints the results of BenchmarkLayouts along with the speedup of the Morton layout
+void PrintLayoutBenchmark(const Vector3 &dimensions, float timeStep, int repetitions);
+
+}
+
+#endif
\ No newline at end of file
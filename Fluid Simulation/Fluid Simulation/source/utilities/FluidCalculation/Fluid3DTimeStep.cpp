@@ -0,0 +1,87 @@
+/********************************************************************
+Fluid3DTimeStep.cpp: Implementation of the adaptive time stepping
+
+Author:	Valentin Hinov
+Date: 11/5/2014
+*********************************************************************/
+
+#include "Fluid3DTimeStep.h"
+#include <cmath>
+
+using namespace Fluid3D;
+
+AdaptiveTimeStepper::AdaptiveTimeStepper() : mPendingTime(0.0f) {
+
+}
+
+TimeStepPlan AdaptiveTimeStepper::Plan(const FluidSettings &settings, float maxSpeed, int frames) {
+	float frameTime = settings.timeStep;
+	float stableTimeStep = GetStableTimeStep(settings, maxSpeed);
+	mPendingTime += frameTime * Max(frames, 1);
+
+	// a calm frame waits while the frame after it would still fit in the same stable step
+	if (mPendingTime + frameTime <= stableTimeStep) {
+		return TimeStepPlan();
+	}
+
+	TimeStepPlan plan = Split(settings, mPendingTime, stableTimeStep);
+	mPendingTime = 0.0f;
+
+	return plan;
+}
+
+void AdaptiveTimeStepper::Reset() {
+	mPendingTime = 0.0f;
+}
+
+TimeStepPlan AdaptiveTimeStepper::PlanSkippedFrames(const FluidSettings &settings, float maxSpeed, int frames) {
+	if (frames <= 1) {
+		TimeStepPlan plan;
+		plan.steps = 1;
+		plan.timeStep = settings.timeStep;
+		return plan;
+	}
+
+	// the fluid is already run at timeStep, so the steps are never made shorter than that
+	float stableTimeStep = Max(GetStableTimeStep(settings, maxSpeed), settings.timeStep);
+	return Split(settings, settings.timeStep * frames, stableTimeStep);
+}
+
+TimeStepPlan AdaptiveTimeStepper::Split(const FluidSettings &settings, float duration, float stableTimeStep) {
+	TimeStepPlan plan;
+	int steps = Max((int)ceil(duration / stableTimeStep), 1);
+	if (steps <= settings.maxSubsteps) {
+		plan.steps = steps;
+		plan.timeStep = duration / steps;
+	}
+	else {
+		// the simulation falls behind rather than take steps past the CFL number
+		plan.steps = Max(settings.maxSubsteps, 1);
+		plan.timeStep = stableTimeStep;
+	}
+
+	return plan;
+}
+
+float AdaptiveTimeStepper::GetStableTimeStep(const FluidSettings &settings, float maxSpeed) {
+	float stableTimeStep = maxSpeed > 0.0f ? settings.cflNumber / maxSpeed : settings.maxTimeStep;
+	return Max(settings.minTimeStep, Min(stableTimeStep, settings.maxTimeStep));
+}
+
+FluidSettings AdaptiveTimeStepper::GetStepSettings(const FluidSettings &settings, float timeStep) {
+	FluidSettings stepSettings = settings;
+	stepSettings.timeStep = timeStep;
+	if (timeStep == settings.timeStep || settings.timeStep <= 0.0f) {
+		return stepSettings;
+	}
+
+	// the factors multiply the fields once per step and the decay and weight are taken off once per step
+	float frameFraction = timeStep / settings.timeStep;
+	stepSettings.velocityDissipation = pow(settings.velocityDissipation, frameFraction);
+	stepSettings.temperatureDissipation = pow(settings.temperatureDissipation, frameFraction);
+	stepSettings.densityDissipation = pow(settings.densityDissipation, frameFraction);
+	stepSettings.reactionDecay = settings.reactionDecay * frameFraction;
+	stepSettings.densityWeight = settings.densityWeight * frameFraction;
+
+	return stepSettings;
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+/********************************************************************
+Fluid3DTimeStep.h: Splits the frames of a 3D fluid into time steps
+under a CFL number for the GPU and CPU calculators.
+
+Every frame stands for timeStep of simulated time. The longest
+stable step lets the fastest fluid cross cflNumber cells. A frame
+longer than that is split into substeps, while a frame of calm flow
+is carried over and run together with the next ones as a single
+longer step. Frames skipped by the caller are made up the same way,
+their time is run on the next processed frame.
+
+Author:	Valentin Hinov
+Date: 11/5/2014
+*********************************************************************/
+
+#ifndef _FLUID3DTIMESTEP_H
+#define _FLUID3DTIMESTEP_H
+
+#include "FluidSettings.h"
+
+namespace Fluid3D {
+
+// The steps a frame is run as
+struct TimeStepPlan {
+	int steps;			// 0 if the frame is carried over to the next one
+	float timeStep;		// of every step
+
+	TimeStepPlan() : steps(0), timeStep(0.0f) {}
+};
+
+class AdaptiveTimeStepper {
+public:
+	AdaptiveTimeStepper();
+
+	// Plans the steps of the next frames given the fastest speed in the fluid, in cells per unit of time. Frames above 1
+	// are frames skipped by the caller whose time is run along with this one
+	TimeStepPlan Plan(const FluidSettings &settings, float maxSpeed, int frames = 1);
+	// Drops any time carried over from the frames before
+	void Reset();
+
+	// Plans the steps that make up the time of frames skipped by the caller when the time step is not adaptive. A single
+	// frame is always a single step of timeStep, more frames are run in steps no shorter than timeStep, as few as the
+	// CFL number allows
+	static TimeStepPlan PlanSkippedFrames(const FluidSettings &settings, float maxSpeed, int frames);
+	// Longest time step at which the fastest fluid crosses no more than cflNumber cells, within the step bounds
+	static float GetStableTimeStep(const FluidSettings &settings, float maxSpeed);
+	// The settings of a step of the given length. The dissipation and decay are given per frame, so they are scaled to
+	// take as much out of the fluid over a frame whatever steps it is run as
+	static FluidSettings GetStepSettings(const FluidSettings &settings, float timeStep);
+
+private:
+	// Splits a duration into steps no longer than the stable time step. Past maxSubsteps the rest of the time is dropped
+	static TimeStepPlan Split(const FluidSettings &settings, float duration, float stableTimeStep);
+
+private:
+	float mPendingTime;		// simulated time of the frames carried over
+};
+
+}
+
+#endif
\ No newline at end of file
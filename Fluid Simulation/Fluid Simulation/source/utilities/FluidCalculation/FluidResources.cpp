@@ -6,10 +6,219 @@ Date: 19/3/2014
 *********************************************************************/
 
 #include "FluidResources.h"
+#include "Fluid3DMultigrid.h"
+#include "Fluid3DBuffers.h"
+#include "Fluid3DObstacles.h"
 
 using namespace std;
+using namespace Fluid3D;
 #define NUM_MIPS 1
 
+namespace {
+	// Creates a single channel volume used by the pressure solvers or the history along with its SRV and UAV
+	void CreateSingleChannelVolume(ID3D11Device * device, const Vector3 &textureSize, DXGI_FORMAT format, ShaderParams &shaderParams, HWND hwnd) {
+		D3D11_TEXTURE3D_DESC textureDesc;
+		ZeroMemory(&textureDesc, sizeof(D3D11_TEXTURE3D_DESC));
+		textureDesc.Width = (UINT) textureSize.x;
+		textureDesc.Height = (UINT) textureSize.y;
+		textureDesc.Depth = (UINT) textureSize.z;
+		textureDesc.MipLevels = NUM_MIPS;
+		textureDesc.Format = format;
+		textureDesc.Usage = D3D11_USAGE_DEFAULT;
+		textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+		textureDesc.CPUAccessFlags = 0;
+		textureDesc.MiscFlags = 0;
+
+		CComPtr<ID3D11Texture3D> texture;
+		HRESULT hr = device->CreateTexture3D(&textureDesc, NULL, &texture);
+		if (FAILED(hr)) {
+			MessageBox(hwnd, L"Could not create the single channel Texture Object", L"Error", MB_OK);
+			return;
+		}
+		hr = device->CreateShaderResourceView(texture, NULL, &shaderParams.mSRV);
+		if(FAILED(hr)) {
+			MessageBox(hwnd, L"Could not create the single channel SRV", L"Error", MB_OK);
+		}
+		hr = device->CreateUnorderedAccessView(texture, NULL, &shaderParams.mUAV);
+		if(FAILED(hr)) {
+			MessageBox(hwnd, L"Could not create the single channel UAV", L"Error", MB_OK);
+		}
+	}
+
+	// Creates a structured buffer that can be both written and read by the compute shaders
+	void CreateStructuredBuffer(ID3D11Device * device, UINT numElements, UINT elementSize, ShaderParams &shaderParams, HWND hwnd) {
+		D3D11_BUFFER_DESC bufferDesc;
+		ZeroMemory(&bufferDesc, sizeof(D3D11_BUFFER_DESC));
+		bufferDesc.ByteWidth = numElements * elementSize;
+		bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+		bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		bufferDesc.StructureByteStride = elementSize;
+
+		CComPtr<ID3D11Buffer> buffer;
+		HRESULT hr = device->CreateBuffer(&bufferDesc, NULL, &buffer);
+		if (FAILED(hr)) {
+			MessageBox(hwnd, L"Could not create the structured buffer", L"Error", MB_OK);
+			return;
+		}
+		hr = device->CreateShaderResourceView(buffer, NULL, &shaderParams.mSRV);
+		if(FAILED(hr)) {
+			MessageBox(hwnd, L"Could not create the structured buffer SRV", L"Error", MB_OK);
+		}
+		hr = device->CreateUnorderedAccessView(buffer, NULL, &shaderParams.mUAV);
+		if(FAILED(hr)) {
+			MessageBox(hwnd, L"Could not create the structured buffer UAV", L"Error", MB_OK);
+		}
+	}
+
+	// Creates a structured buffer the compute shaders append to and read from along with its SRV and append UAV
+	void CreateAppendBuffer(ID3D11Device * device, UINT numElements, UINT elementSize, ShaderParams &shaderParams, HWND hwnd) {
+		D3D11_BUFFER_DESC bufferDesc;
+		ZeroMemory(&bufferDesc, sizeof(D3D11_BUFFER_DESC));
+		bufferDesc.ByteWidth = numElements * elementSize;
+		bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+		bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		bufferDesc.StructureByteStride = elementSize;
+
+		CComPtr<ID3D11Buffer> buffer;
+		HRESULT hr = device->CreateBuffer(&bufferDesc, NULL, &buffer);
+		if (FAILED(hr)) {
+			MessageBox(hwnd, L"Could not create the append buffer", L"Error", MB_OK);
+			return;
+		}
+		hr = device->CreateShaderResourceView(buffer, NULL, &shaderParams.mSRV);
+		if(FAILED(hr)) {
+			MessageBox(hwnd, L"Could not create the append buffer SRV", L"Error", MB_OK);
+		}
+
+		D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+		ZeroMemory(&uavDesc, sizeof(D3D11_UNORDERED_ACCESS_VIEW_DESC));
+		uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+		uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+		uavDesc.Buffer.FirstElement = 0;
+		uavDesc.Buffer.NumElements = numElements;
+		uavDesc.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_APPEND;
+		hr = device->CreateUnorderedAccessView(buffer, &uavDesc, &shaderParams.mUAV);
+		if(FAILED(hr)) {
+			MessageBox(hwnd, L"Could not create the append buffer UAV", L"Error", MB_OK);
+		}
+	}
+
+	// Creates a structured buffer the CPU rewrites every step and the compute shaders only read
+	void CreateDynamicStructuredBuffer(ID3D11Device * device, UINT numElements, UINT elementSize, CComPtr<ID3D11Buffer> &buffer, ShaderParams &shaderParams, HWND hwnd) {
+		D3D11_BUFFER_DESC bufferDesc;
+		ZeroMemory(&bufferDesc, sizeof(D3D11_BUFFER_DESC));
+		bufferDesc.ByteWidth = numElements * elementSize;
+		bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+		bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		bufferDesc.StructureByteStride = elementSize;
+
+		HRESULT hr = device->CreateBuffer(&bufferDesc, NULL, &buffer);
+		if (FAILED(hr)) {
+			MessageBox(hwnd, L"Could not create the dynamic structured buffer", L"Error", MB_OK);
+			return;
+		}
+		hr = device->CreateShaderResourceView(buffer, NULL, &shaderParams.mSRV);
+		if(FAILED(hr)) {
+			MessageBox(hwnd, L"Could not create the dynamic structured buffer SRV", L"Error", MB_OK);
+		}
+	}
+
+	// Creates the brick tracking buffers of a simulation. Every DispatchIndirect argument starts out as {0, 1, 1} and
+	// only the group count is overwritten with the size of its list
+	void CreateBrickResources(ID3D11Device * device, const Vector3 &textureSize, FluidResourcesPerObject &resources, HWND hwnd) {
+		UINT numBricks = GetBrickCount((int)textureSize.x) * GetBrickCount((int)textureSize.y) * GetBrickCount((int)textureSize.z);
+		CreateStructuredBuffer(device, numBricks, sizeof(UINT), resources.brickActivitySP, hwnd);
+		for (size_t i = 0; i < resources.brickListSP.size(); ++i) {
+			CreateAppendBuffer(device, numBricks, sizeof(UINT), resources.brickListSP[i], hwnd);
+		}
+
+		UINT dispatchArgs[3 * (BRICK_MAX_HALO + 1)];
+		for (int i = 0; i <= BRICK_MAX_HALO; ++i) {
+			dispatchArgs[3*i] = 0;
+			dispatchArgs[3*i + 1] = 1;
+			dispatchArgs[3*i + 2] = 1;
+		}
+		D3D11_SUBRESOURCE_DATA initialData;
+		ZeroMemory(&initialData, sizeof(D3D11_SUBRESOURCE_DATA));
+		initialData.pSysMem = dispatchArgs;
+
+		D3D11_BUFFER_DESC bufferDesc;
+		ZeroMemory(&bufferDesc, sizeof(D3D11_BUFFER_DESC));
+		bufferDesc.ByteWidth = sizeof(dispatchArgs);
+		bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		bufferDesc.BindFlags = 0;
+		bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS;
+		HRESULT hr = device->CreateBuffer(&bufferDesc, &initialData, &resources.brickDispatchArgs);
+		if (FAILED(hr)) {
+			MessageBox(hwnd, L"Could not create the brick dispatch arguments buffer", L"Error", MB_OK);
+		}
+
+		bufferDesc.Usage = D3D11_USAGE_STAGING;
+		bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		bufferDesc.MiscFlags = 0;
+		for (size_t i = 0; i < resources.brickDispatchArgsStaging.size(); ++i) {
+			hr = device->CreateBuffer(&bufferDesc, NULL, &resources.brickDispatchArgsStaging[i]);
+			if (FAILED(hr)) {
+				MessageBox(hwnd, L"Could not create the brick dispatch arguments staging buffer", L"Error", MB_OK);
+			}
+		}
+	}
+
+	// Creates the activity reduction buffers of a simulation, four floats per 8x8x8 thread group
+	void CreateActivityResources(ID3D11Device * device, const Vector3 &textureSize, FluidResourcesPerObject &resources, HWND hwnd) {
+		UINT numGroups = ((UINT)textureSize.x + 7) / 8 * (((UINT)textureSize.y + 7) / 8) * (((UINT)textureSize.z + 7) / 8);
+		D3D11_BUFFER_DESC bufferDesc;
+		ZeroMemory(&bufferDesc, sizeof(D3D11_BUFFER_DESC));
+		bufferDesc.ByteWidth = numGroups * 4 * sizeof(float);
+		bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		bufferDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+		bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		bufferDesc.StructureByteStride = 4 * sizeof(float);
+		HRESULT hr = device->CreateBuffer(&bufferDesc, NULL, &resources.activityBuffer);
+		if (FAILED(hr)) {
+			MessageBox(hwnd, L"Could not create the activity buffer", L"Error", MB_OK);
+			return;
+		}
+		hr = device->CreateUnorderedAccessView(resources.activityBuffer, NULL, &resources.activitySP.mUAV);
+		if(FAILED(hr)) {
+			MessageBox(hwnd, L"Could not create the activity UAV", L"Error", MB_OK);
+		}
+
+		bufferDesc.Usage = D3D11_USAGE_STAGING;
+		bufferDesc.BindFlags = 0;
+		bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		for (size_t i = 0; i < resources.activityStaging.size(); ++i) {
+			hr = device->CreateBuffer(&bufferDesc, NULL, &resources.activityStaging[i]);
+			if (FAILED(hr)) {
+				MessageBox(hwnd, L"Could not create the activity staging buffer", L"Error", MB_OK);
+			}
+		}
+	}
+
+	// Creates the staging buffers the residual sums of a simulation's pressure solves are read back through, one float per
+	// 8x8x8 thread group like the residual sums buffer
+	void CreateResidualReadbackResources(ID3D11Device * device, const Vector3 &textureSize, FluidResourcesPerObject &resources, HWND hwnd) {
+		UINT numGroups = ((UINT)textureSize.x + 7) / 8 * (((UINT)textureSize.y + 7) / 8) * (((UINT)textureSize.z + 7) / 8);
+		D3D11_BUFFER_DESC bufferDesc;
+		ZeroMemory(&bufferDesc, sizeof(D3D11_BUFFER_DESC));
+		bufferDesc.ByteWidth = numGroups * sizeof(float);
+		bufferDesc.Usage = D3D11_USAGE_STAGING;
+		bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		bufferDesc.StructureByteStride = sizeof(float);
+		for (size_t i = 0; i < resources.residualSumsStaging.size(); ++i) {
+			HRESULT hr = device->CreateBuffer(&bufferDesc, NULL, &resources.residualSumsStaging[i]);
+			if (FAILED(hr)) {
+				MessageBox(hwnd, L"Could not create the residual sums staging buffer", L"Error", MB_OK);
+			}
+		}
+	}
+}
+
 CommonFluidResources CommonFluidResources::CreateResources(ID3D11Device * device, const Vector3 &textureSize, HWND hwnd) {
 	HRESULT hr;
 
@@ -28,25 +237,6 @@ CommonFluidResources CommonFluidResources::CreateResources(ID3D11Device * device
 	textureDesc.CPUAccessFlags = 0;
 	textureDesc.MiscFlags = 0;
 
-	// Create pressure shader params
-	CComPtr<ID3D11Texture3D> pressureText[2];	
-	for (int i = 0; i < 2; ++i) {
-		hr = device->CreateTexture3D(&textureDesc, NULL, &pressureText[i]);
-		if (FAILED(hr)) {
-			MessageBox(hwnd, L"Could not create the pressure Texture Object", L"Error", MB_OK);
-		}
-		// Create the SRV and UAV.
-		hr = device->CreateShaderResourceView(pressureText[i], NULL, &resources.pressureSP[i].mSRV);
-		if(FAILED(hr)) {
-			MessageBox(hwnd, L"Could not create the pressure SRV", L"Error", MB_OK);
-		}
-
-		hr = device->CreateUnorderedAccessView(pressureText[i], NULL, &resources.pressureSP[i].mUAV);
-		if(FAILED(hr)) {
-			MessageBox(hwnd, L"Could not create the pressure UAV", L"Error", MB_OK);
-		}
-	}
-
 	// Create divergence shader params
 	CComPtr<ID3D11Texture3D> divergenceText;
 	hr = device->CreateTexture3D(&textureDesc, NULL, &divergenceText);
@@ -79,6 +269,52 @@ CommonFluidResources CommonFluidResources::CreateResources(ID3D11Device * device
 		}
 	}
 
+	// Create the multigrid hierarchy. The coarse levels are kept in full precision as they only hold corrections
+	CreateSingleChannelVolume(device, textureSize, DXGI_FORMAT_R32_FLOAT, resources.residualSP, hwnd);
+	vector<Vector3> levelDimensions = GetMultigridLevelDimensions(textureSize);
+	resources.multigridLevels.resize(levelDimensions.size());
+	for (size_t level = 0; level < levelDimensions.size(); ++level) {
+		MultigridLevelResources &levelResources = resources.multigridLevels[level];
+		levelResources.dimensions = levelDimensions[level];
+		CreateSingleChannelVolume(device, levelResources.dimensions, DXGI_FORMAT_R32_FLOAT, levelResources.rightHandSideSP, hwnd);
+		CreateSingleChannelVolume(device, levelResources.dimensions, DXGI_FORMAT_R32_FLOAT, levelResources.correctionSP, hwnd);
+		CreateSingleChannelVolume(device, levelResources.dimensions, DXGI_FORMAT_R32_FLOAT, levelResources.residualSP, hwnd);
+	}
+
+	// Create the residual reduction buffers, one float per 8x8x8 thread group
+	UINT numResidualSums = ((UINT)textureSize.x + 7) / 8 * (((UINT)textureSize.y + 7) / 8) * (((UINT)textureSize.z + 7) / 8);
+	D3D11_BUFFER_DESC bufferDesc;
+	ZeroMemory(&bufferDesc, sizeof(D3D11_BUFFER_DESC));
+	bufferDesc.ByteWidth = numResidualSums * sizeof(float);
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	bufferDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bufferDesc.StructureByteStride = sizeof(float);
+	hr = device->CreateBuffer(&bufferDesc, NULL, &resources.residualSumsBuffer);
+	if (FAILED(hr)) {
+		MessageBox(hwnd, L"Could not create the residual sums buffer", L"Error", MB_OK);
+	}
+	hr = device->CreateUnorderedAccessView(resources.residualSumsBuffer, NULL, &resources.residualSumsSP.mUAV);
+	if(FAILED(hr)) {
+		MessageBox(hwnd, L"Could not create the residual sums UAV", L"Error", MB_OK);
+	}
+
+	bufferDesc.Usage = D3D11_USAGE_STAGING;
+	bufferDesc.BindFlags = 0;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	hr = device->CreateBuffer(&bufferDesc, NULL, &resources.residualSumsStagingBuffer);
+	if (FAILED(hr)) {
+		MessageBox(hwnd, L"Could not create the residual sums staging buffer", L"Error", MB_OK);
+	}
+
+	// Create the conjugate gradient volumes and buffers. The partial sums hold two floats per thread group as the
+	// residual mean needs the fluid cell count alongside the sum
+	CreateSingleChannelVolume(device, textureSize, DXGI_FORMAT_R32_FLOAT, resources.pcgResidualSP, hwnd);
+	CreateSingleChannelVolume(device, textureSize, DXGI_FORMAT_R32_FLOAT, resources.pcgPreconditionedSP, hwnd);
+	CreateSingleChannelVolume(device, textureSize, DXGI_FORMAT_R32_FLOAT, resources.pcgDirectionSP, hwnd);
+	CreateStructuredBuffer(device, numResidualSums, 2 * sizeof(float), resources.pcgSumsSP, hwnd);
+	CreateStructuredBuffer(device, 4, sizeof(float), resources.pcgScalarsSP, hwnd);
+
 	return resources;
 }
 
@@ -115,9 +351,9 @@ FluidResourcesPerObject FluidResourcesPerObject::CreateResourcesSmoke(ID3D11Devi
 		}
 	}
 
-	// Create the obstacle shader params
+	// Create the obstacle shader params, the cells hold the OBSTACLE_* flags of cFluid3D.hlsl
 	CComPtr<ID3D11Texture3D> obstacleText;
-	textureDesc.Format = DXGI_FORMAT_R8_SINT;
+	textureDesc.Format = DXGI_FORMAT_R8_UINT;
 	HRESULT hresult = device->CreateTexture3D(&textureDesc, NULL, &obstacleText);
 	if (FAILED(hresult)) {
 		MessageBox(hwnd, L"Could not create the obstacle Texture Object", L"Error", MB_OK);
@@ -132,6 +368,22 @@ FluidResourcesPerObject FluidResourcesPerObject::CreateResourcesSmoke(ID3D11Devi
 		MessageBox(hwnd, L"Could not create the obstacle UAV", L"Error", MB_OK);
 	}
 
+	// Create the obstacle velocity shader params
+	CComPtr<ID3D11Texture3D> obstacleVelocityText;
+	textureDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	hresult = device->CreateTexture3D(&textureDesc, NULL, &obstacleVelocityText);
+	if (FAILED(hresult)) {
+		MessageBox(hwnd, L"Could not create the obstacle velocity Texture Object", L"Error", MB_OK);
+	}
+	hresult = device->CreateShaderResourceView(obstacleVelocityText, NULL, &resources.obstacleVelocitySP.mSRV);
+	if(FAILED(hresult)) {
+		MessageBox(hwnd, L"Could not create the obstacle velocity SRV", L"Error", MB_OK);
+	}
+	hresult = device->CreateUnorderedAccessView(obstacleVelocityText, NULL, &resources.obstacleVelocitySP.mUAV);
+	if(FAILED(hresult)) {
+		MessageBox(hwnd, L"Could not create the obstacle velocity UAV", L"Error", MB_OK);
+	}
+
 	// Create the density shader params
 	CComPtr<ID3D11Texture3D> densityText[2];
 	textureDesc.Format = DXGI_FORMAT_R16_FLOAT;
@@ -170,6 +422,9 @@ FluidResourcesPerObject FluidResourcesPerObject::CreateResourcesSmoke(ID3D11Devi
 		}
 	}
 
+	// Create the pressure shader params. The solvers update it in place, which needs the typed UAV loads only R32_FLOAT supports
+	CreateSingleChannelVolume(device, textureSize, DXGI_FORMAT_R32_FLOAT, resources.pressureSP, hwnd);
+
 	// Create the vorticity shader params
 	CComPtr<ID3D11Texture3D> vorticityText;
 	textureDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
@@ -187,10 +442,35 @@ FluidResourcesPerObject FluidResourcesPerObject::CreateResourcesSmoke(ID3D11Devi
 		MessageBox(hwnd, L"Could not create the vorticity UAV", L"Error", MB_OK);
 	}
 
+	// Create the obstacles of the coarse multigrid levels
+	vector<Vector3> levelDimensions = GetMultigridLevelDimensions(textureSize);
+	resources.obstacleLevelsSP.resize(levelDimensions.size());
+	for (size_t level = 0; level < levelDimensions.size(); ++level) {
+		CreateSingleChannelVolume(device, levelDimensions[level], DXGI_FORMAT_R8_UINT, resources.obstacleLevelsSP[level], hwnd);
+	}
+
+	CreateBrickResources(device, textureSize, resources, hwnd);
+	CreateActivityResources(device, textureSize, resources, hwnd);
+	CreateResidualReadbackResources(device, textureSize, resources, hwnd);
+
+	CreateDynamicStructuredBuffer(device, MAX_IMPULSE_SOURCES + CONSTANT_INPUT_SOURCES, sizeof(ImpulseSourceData), resources.impulseSourcesBuffer, resources.impulseSourcesSP, hwnd);
+	CreateDynamicStructuredBuffer(device, MAX_OBSTACLE_BOXES, sizeof(ObstacleBoxData), resources.obstacleBoxesBuffer, resources.obstacleBoxesSP, hwnd);
 
 	return resources;
 }
 
+void FluidResourcesPerObject::ResizeHistory(ID3D11Device * device, const Vector3 &textureSize, int frames, bool withReaction, HWND hwnd) {
+	size_t oldFrames = densityHistorySP.size();
+	densityHistorySP.resize(frames);
+	reactionHistorySP.resize(withReaction ? frames : 0);
+	for (size_t i = oldFrames; i < (size_t)frames; ++i) {
+		CreateSingleChannelVolume(device, textureSize, DXGI_FORMAT_R16_FLOAT, densityHistorySP[i], hwnd);
+		if (withReaction) {
+			CreateSingleChannelVolume(device, textureSize, DXGI_FORMAT_R16_FLOAT, reactionHistorySP[i], hwnd);
+		}
+	}
+}
+
 FluidResourcesPerObject FluidResourcesPerObject::CreateResourcesFire(ID3D11Device * device, const Vector3 &textureSize, HWND hwnd) {
 	FluidResourcesPerObject resources = CreateResourcesSmoke(device, textureSize, hwnd);
 
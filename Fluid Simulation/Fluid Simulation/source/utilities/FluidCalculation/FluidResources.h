@@ -11,12 +11,34 @@ Date: 19/3/2014
 
 #include <memory>
 #include <array>
+#include <vector>
 #include "../../display/D3DShaders/ShaderParams.h"
+#include "Fluid3DBricks.h"
+
+// Scratch textures of one coarse level of the multigrid pressure solver
+struct MultigridLevelResources {
+	Vector3 dimensions;
+	ShaderParams rightHandSideSP;
+	ShaderParams correctionSP;	// smoothed and corrected in place
+	ShaderParams residualSP;
+};
 
 struct CommonFluidResources {
 	ShaderParams divergenceSP;
-	std::array<ShaderParams, 2>	pressureSP;
 	std::array<ShaderParams, 2>	tempSP;
+	ShaderParams residualSP;	// residual of the finest multigrid level, doubles as the second buffer of the Jacobi solver and the laplacian of the conjugate gradient direction
+	std::vector<MultigridLevelResources> multigridLevels; // coarse multigrid levels, finest first
+	// Per thread group sums of the squared residual and the staging copy they are read back through
+	ShaderParams residualSumsSP;
+	CComPtr<ID3D11Buffer> residualSumsBuffer;
+	CComPtr<ID3D11Buffer> residualSumsStagingBuffer;
+	// Conjugate gradient solver state - residual, preconditioned residual and search direction
+	ShaderParams pcgResidualSP;
+	ShaderParams pcgPreconditionedSP;
+	ShaderParams pcgDirectionSP;
+	// Per thread group partial sums of the conjugate gradient reductions and the scalars worked out from them
+	ShaderParams pcgSumsSP;
+	ShaderParams pcgScalarsSP;
 
 	static CommonFluidResources CreateResources(ID3D11Device * device, const Vector3 &textureSize, HWND hwnd);
 };
@@ -26,8 +48,36 @@ struct FluidResourcesPerObject {
 	std::array<ShaderParams, 2>	densitySP;
 	std::array<ShaderParams, 2>	temperatureSP;
 	std::array<ShaderParams, 2>	reactionSP; // only used when fluid type is fire
+	ShaderParams pressureSP; // updated in place and kept per object so the last solution can warm start the next solve
 	ShaderParams obstacleSP;
+	ShaderParams obstacleVelocitySP; // velocity of the obstacle covering each solid cell
+	std::vector<ShaderParams> obstacleLevelsSP; // obstacles of each coarse multigrid level
 	ShaderParams vorticitySP;
+	// Sparse brick tracking - a flag per brick, the lists of bricks within 0 to BRICK_MAX_HALO bricks of an active one and
+	// the DispatchIndirect arguments of every list. The arguments are copied into the staging buffers to read the list sizes back
+	ShaderParams brickActivitySP;
+	std::array<ShaderParams, BRICK_MAX_HALO + 1> brickListSP;
+	CComPtr<ID3D11Buffer> brickDispatchArgs;
+	std::array<CComPtr<ID3D11Buffer>, 2> brickDispatchArgsStaging;
+	// Per thread group maxima and kinetic energy of the fields, read back through the staging buffers a frame late to put
+	// the fluid to sleep and pick the adaptive time step
+	ShaderParams activitySP;
+	CComPtr<ID3D11Buffer> activityBuffer;
+	std::array<CComPtr<ID3D11Buffer>, 2> activityStaging;
+	// Staging copies of the residual sums of every finished pressure solve, read back a step late for the solver stats
+	std::array<CComPtr<ID3D11Buffer>, 2> residualSumsStaging;
+	// The impulse sources of the current step, rewritten by the CPU every step
+	ShaderParams impulseSourcesSP;
+	CComPtr<ID3D11Buffer> impulseSourcesBuffer;
+	// The obstacle boxes voxelized in the current step, rewritten by the CPU whenever a box changes
+	ShaderParams obstacleBoxesSP;
+	CComPtr<ID3D11Buffer> obstacleBoxesBuffer;
+	// Copies of the density and reaction of the last frames, filled in as a ring. Empty unless the calculator keeps a history
+	std::vector<ShaderParams> densityHistorySP;
+	std::vector<ShaderParams> reactionHistorySP;
+
+	// Creates or releases history volumes until there are frames of them
+	void ResizeHistory(ID3D11Device * device, const Vector3 &textureSize, int frames, bool withReaction, HWND hwnd);
 
 	static FluidResourcesPerObject CreateResourcesSmoke(ID3D11Device * device, const Vector3 &textureSize, HWND hwnd);
 	static FluidResourcesPerObject CreateResourcesFire(ID3D11Device * device, const Vector3 &textureSize, HWND hwnd);
@@ -10,10 +10,35 @@ void InitTypes() {
 									{SystemAdvectionType_t::MACCORMARCK, "MacCormack"} };
 	TwType advectionTwType = TwDefineEnum("AdvectionType", advectionTypeEV, 2);
 
+	TwEnumVal pressureSolverTypeEV[] = { {PressureSolverType_t::JACOBI, "Jacobi"}, 
+										{PressureSolverType_t::MULTIGRID, "Multigrid"},
+										{PressureSolverType_t::RED_BLACK_SOR, "Red-Black SOR"},
+										{PressureSolverType_t::PRECONDITIONED_CG, "Multigrid PCG"} };
+	TwType pressureSolverTwType = TwDefineEnum("PressureSolverType", pressureSolverTypeEV, 4);
+
 	TwStructMember fluidSettingsStructMembers[] = {
 		{ "Advection", advectionTwType, offsetof(FluidSettings, advectionType), "" },
+		{ "Pressure Solver", pressureSolverTwType, offsetof(FluidSettings, pressureSolverType), "" },
 		{ "Jacobi Iterations", TW_TYPE_INT32, offsetof(FluidSettings, jacobiIterations), "min=1 max=50 step=1" },
+		{ "Multigrid V-Cycles", TW_TYPE_INT32, offsetof(FluidSettings, multigridCycles), "min=1 max=10 step=1" },
+		{ "SOR Over-Relaxation", TW_TYPE_FLOAT, offsetof(FluidSettings, sorOverRelaxation), "min=1.0 max=1.95 step=0.01" },
+		{ "CG Iterations", TW_TYPE_INT32, offsetof(FluidSettings, conjugateGradientIterations), "min=1 max=50 step=1" },
+		{ "Pressure Tolerance", TW_TYPE_FLOAT, offsetof(FluidSettings, pressureTolerance), "min=0.0 max=0.1 step=0.00001" },
+		{ "Residual Check Interval", TW_TYPE_INT32, offsetof(FluidSettings, residualCheckInterval), "min=1 max=50 step=1" },
+		{ "Warm Start Pressure", TW_TYPE_BOOLCPP, offsetof(FluidSettings, warmStartPressure), "" },
+		{ "Fused Kernels", TW_TYPE_BOOLCPP, offsetof(FluidSettings, fusedKernels), "" },
+		{ "Packed Scalar Advection", TW_TYPE_BOOLCPP, offsetof(FluidSettings, packedScalarAdvection), "" },
+		{ "Sparse Bricks", TW_TYPE_BOOLCPP, offsetof(FluidSettings, sparseBricks), "" },
+		{ "Brick Activity Threshold", TW_TYPE_FLOAT, offsetof(FluidSettings, brickActivityThreshold), "min=0.0 max=0.1 step=0.0001" },
 		{ "Time Step", TW_TYPE_FLOAT, offsetof(FluidSettings, timeStep), "min=0.0 max=1.0 step=0.001" },
+		{ "Adaptive Time Step", TW_TYPE_BOOLCPP, offsetof(FluidSettings, adaptiveTimeStep), "" },
+		{ "CFL Number", TW_TYPE_FLOAT, offsetof(FluidSettings, cflNumber), "min=0.1 max=10.0 step=0.1" },
+		{ "Min Time Step", TW_TYPE_FLOAT, offsetof(FluidSettings, minTimeStep), "min=0.001 max=1.0 step=0.001" },
+		{ "Max Time Step", TW_TYPE_FLOAT, offsetof(FluidSettings, maxTimeStep), "min=0.001 max=2.0 step=0.001" },
+		{ "Max Substeps", TW_TYPE_INT32, offsetof(FluidSettings, maxSubsteps), "min=1 max=16 step=1" },
+		{ "Sleep When Quiet", TW_TYPE_BOOLCPP, offsetof(FluidSettings, sleepWhenQuiet), "" },
+		{ "Sleep Threshold", TW_TYPE_FLOAT, offsetof(FluidSettings, sleepThreshold), "min=0.0 max=0.1 step=0.0001" },
+		{ "Profile Stages", TW_TYPE_BOOLCPP, offsetof(FluidSettings, profileStages), "" },
 		{ "Vorticity Strength", TW_TYPE_FLOAT, offsetof(FluidSettings, vorticityStrength), "min=0.0 max=1.0 step=0.01" },
 		{ "Velocity Dissipation", TW_TYPE_FLOAT, offsetof(FluidSettings, velocityDissipation), "min=0.0 max=1.0 step=0.001" },
 		{ "Temperature Dissipation", TW_TYPE_FLOAT, offsetof(FluidSettings, temperatureDissipation), "min=0.0 max=1.0 step=0.001" },
@@ -51,7 +76,26 @@ TwType FluidSettings::GetFluidSettingsTwType() {
 
 FluidSettings::FluidSettings(FluidType_t fluidType) : mFluidType(fluidType) {
 	jacobiIterations = JACOBI_ITERATIONS;
+	pressureSolverType = JACOBI;
+	multigridCycles = MULTIGRID_CYCLES;
+	sorOverRelaxation = SOR_OVER_RELAXATION;
+	conjugateGradientIterations = CONJUGATE_GRADIENT_ITERATIONS;
+	pressureTolerance = PRESSURE_TOLERANCE;
+	residualCheckInterval = RESIDUAL_CHECK_INTERVAL;
+	warmStartPressure = WARM_START_PRESSURE;
+	fusedKernels = FUSED_KERNELS;
+	packedScalarAdvection = PACKED_SCALAR_ADVECTION;
+	sparseBricks = SPARSE_BRICKS;
+	brickActivityThreshold = BRICK_ACTIVITY_THRESHOLD;
 	timeStep = TIME_STEP;
+	adaptiveTimeStep = ADAPTIVE_TIME_STEP;
+	cflNumber = CFL_NUMBER;
+	minTimeStep = MIN_TIME_STEP;
+	maxTimeStep = MAX_TIME_STEP;
+	maxSubsteps = MAX_SUBSTEPS;
+	sleepWhenQuiet = SLEEP_WHEN_QUIET;
+	sleepThreshold = SLEEP_THRESHOLD;
+	profileStages = PROFILE_STAGES;
 	advectionType = MACCORMARCK;
 	velocityDissipation = VEL_DISSIPATION;
 	temperatureDissipation = TEMPERATURE_DISSIPATION;
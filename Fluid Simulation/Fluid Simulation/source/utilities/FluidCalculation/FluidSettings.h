@@ -15,10 +15,29 @@ Date: 3/3/2014
 // Default parameters
 #define DIMENSION 64.0f
 #define TIME_STEP 0.1f
+#define ADAPTIVE_TIME_STEP false
+#define CFL_NUMBER 2.0f // cells the fastest fluid may cross in a step
+#define MIN_TIME_STEP 0.01f
+#define MAX_TIME_STEP 0.4f
+#define MAX_SUBSTEPS 4
+#define SLEEP_WHEN_QUIET true
+#define SLEEP_THRESHOLD 0.001f
+#define SLEEP_QUIET_STEPS 10 // steps in a row a fluid has to stay below the sleep threshold before it sleeps
+#define PROFILE_STAGES false
 #define CONSTANT_INPUT_RADIUS 0.1f // as a percentage of total size
 #define INTERACTION_IMPULSE_RADIUS 7.0f
 #define OBSTACLES_IMPULSE_RADIUS 5.0f
 #define JACOBI_ITERATIONS 10
+#define MULTIGRID_CYCLES 1
+#define SOR_OVER_RELAXATION 1.5f
+#define CONJUGATE_GRADIENT_ITERATIONS 10
+#define PRESSURE_TOLERANCE 0.0001f // RMS of the pressure equation residual, 0 disables the early exit
+#define RESIDUAL_CHECK_INTERVAL 5
+#define WARM_START_PRESSURE true
+#define FUSED_KERNELS true
+#define PACKED_SCALAR_ADVECTION true
+#define SPARSE_BRICKS true
+#define BRICK_ACTIVITY_THRESHOLD 0.001f
 #define VEL_DISSIPATION 0.995f
 #define DENSITY_DISSIPATION 0.999f
 #define TEMPERATURE_DISSIPATION 0.995f
@@ -37,6 +56,13 @@ enum SystemAdvectionType_t {
 	MACCORMARCK
 };
 
+enum PressureSolverType_t {
+	JACOBI,
+	MULTIGRID,
+	RED_BLACK_SOR,
+	PRECONDITIONED_CG
+};
+
 enum FluidType_t {
 	SMOKE,
 	FIRE
@@ -47,8 +73,27 @@ enum ETwType;
 
 struct FluidSettings {	
 	Vector3 dimensions;	
-	int jacobiIterations;
-	float timeStep;
+	int jacobiIterations;			// also the number of red-black sweeps when using the SOR solver
+	PressureSolverType_t pressureSolverType;
+	int multigridCycles;			// number of V-cycles per step when using the multigrid solver
+	float sorOverRelaxation;		// over-relaxation factor of the red-black SOR solver, 1 gives plain Gauss-Seidel
+	int conjugateGradientIterations;	// max iterations of the multigrid preconditioned conjugate gradient solver
+	float pressureTolerance;		// stop the pressure solve early once the residual falls below this. The iteration count of the chosen solver becomes the hard max
+	int residualCheckInterval;		// iterations between residual measurements
+	bool warmStartPressure;			// start the pressure solve from the previous step's pressure instead of zero
+	bool fusedKernels;				// run buoyancy with the impulses, confinement with divergence and the last Jacobi iteration with the gradient subtraction as single passes
+	bool packedScalarAdvection;		// advect the temperature, density and reaction in a single pass that traces back through the velocity once
+	bool sparseBricks;				// only advect and apply buoyancy and impulses on the bricks of the volume that hold fluid, plus a halo
+	float brickActivityThreshold;	// a brick holds fluid while any field in it is above this
+	float timeStep;					// simulated time of a frame, and of every step unless adaptiveTimeStep is on
+	bool adaptiveTimeStep;			// split the frames into steps as long as the CFL number allows, carrying calm frames over into longer steps
+	float cflNumber;				// cells the fastest fluid may cross in an adaptive step
+	float minTimeStep;				// bounds of an adaptive step
+	float maxTimeStep;
+	int maxSubsteps;				// adaptive steps a frame may be split into, any time left over is dropped
+	bool sleepWhenQuiet;			// stop stepping the fluid once it has settled, until an impulse, obstacle or settings change wakes it
+	float sleepThreshold;			// the fluid has settled while its density, reaction, temperature and speed all stay below this
+	bool profileStages;				// time every stage of a step, see Fluid3DProfiler.h
 	SystemAdvectionType_t advectionType;
 	float velocityDissipation;
 	float temperatureDissipation;
@@ -68,11 +113,106 @@ struct FluidSettings {
 
 	FluidSettings(FluidType_t fluidType = SMOKE);
 	inline FluidType_t GetFluidType() const { return mFluidType; }
+	// Iterations, V-cycles or sweeps the chosen pressure solver may run per step
+	inline int GetMaxPressureIterations() const {
+		switch (pressureSolverType) {
+		case MULTIGRID:
+			return multigridCycles;
+		case PRECONDITIONED_CG:
+			return conjugateGradientIterations;
+		default:
+			return jacobiIterations;
+		}
+	}
 	ETwType GetFluidSettingsTwType(); // for use on an AntTweakBar
 
 private:
 	FluidType_t mFluidType; // should not be changed after initialization
 };
 
+namespace Fluid3D {
+
+// How much of the work the settings ask for a step does. Lowered for fluids whose LOD leaves little of them to see,
+// a profile only ever takes work away from the settings
+struct SolverProfile {
+	float pressureEffort;		// part of the pressure solver's iterations that are run, at least one always is
+	bool macCormackAdvection;	// advect with MacCormack where the settings ask for it, normally otherwise
+	bool vorticityConfinement;
+
+	SolverProfile() : pressureEffort(1.0f), macCormackAdvection(true), vorticityConfinement(true) {}
+};
+
+// How much work the pressure solver did in the last step. residual is -1 if it was not measured, the GPU calculator reads it
+// back a step late so it never waits on the solve
+struct PressureSolverStats {
+	int iterationsUsed;
+	float residual;
+
+	PressureSolverStats() : iterationsUsed(0), residual(-1.0f) {}
+};
+
+// How much of the volume the sparse passes covered in the last step
+struct BrickOccupancyStats {
+	int totalBricks;
+	int activeBricks;		// bricks holding a field above the activity threshold
+	int processedBricks;	// the active bricks and their halo, which advection, buoyancy and the impulses ran on
+	float processedPercentage;
+
+	BrickOccupancyStats() : totalBricks(0), activeBricks(0), processedBricks(0), processedPercentage(100.0f) {}
+};
+
+// How much is going on in a fluid as of its last step. Only measured while the fluid may sleep or adapts its time step
+struct FluidActivityStats {
+	float maxDensity;		// of the density, and of the reaction when simulating fire
+	float maxTemperature;
+	float maxSpeed;
+	float kineticEnergy;	// half the squared speed summed over every cell
+	int quietSteps;			// steps in a row the fluid has stayed below the sleep threshold
+	bool sleeping;
+
+	FluidActivityStats() : maxDensity(0.0f), maxTemperature(0.0f), maxSpeed(0.0f), kineticEnergy(0.0f), quietSteps(0), sleeping(false) {}
+
+	inline bool IsBelow(float threshold) const {
+		return maxDensity < threshold && maxTemperature < threshold && maxSpeed < threshold;
+	}
+};
+
+// A velocity impulse applied to a fluid for a single step. Position is in the (0,0,0) to (1,1,1) range
+struct ExtraForce {
+	Vector3 position;
+	float radius;
+	Vector3 amount;
+};
+
+// Fields an impulse can add to
+enum ImpulseTarget_t {
+	IMPULSE_TARGET_VELOCITY,
+	IMPULSE_TARGET_TEMPERATURE,
+	IMPULSE_TARGET_DENSITY,
+	IMPULSE_TARGET_REACTION	// ignored when simulating smoke
+};
+
+// An amount added to one field of a fluid for a single step, falling off around position the same way as the constant
+// input. Position is in the (0,0,0) to (1,1,1) range and the radius in cells like ExtraForce. The scalar fields only
+// receive the x component of amount
+struct ImpulseSource {
+	ImpulseTarget_t target;
+	Vector3 position;
+	float radius;
+	Vector3 amount;
+};
+
+// A solid box the fluid flows around, given in the (0,0,0) to (1,1,1) range of the volume. halfAxes go from the
+// centre to the middle of three faces of the box. They only need to be linearly independent, so a box seen through
+// a non-uniform scale can be given as is. A box keeps its id between steps, which is how moving boxes are told apart
+// from new ones and given a velocity
+struct ObstacleBox {
+	unsigned int id;
+	Vector3 centre;
+	Vector3 halfAxes[3];
+};
+
+}
+
 
 #endif
\ No newline at end of file